@@ -0,0 +1,199 @@
+#include <math.h>
+#include <limits>
+#include <Eigen/LU>
+
+#include "LCP.h"
+
+#define PIVOT_TOL 1e-12
+
+using namespace Eigen;
+using namespace std;
+
+LCPSolver::LCPSolver() : max_pivots(1000), tol(1e-8), warm_start_hit(false), num_pivots(0) {}
+
+bool LCPSolver::solve(const MatrixXd& M, const VectorXd& w, VectorXd& z)
+{
+  num_pivots = 0;
+  if (w.size() == 0) {
+    z.resize(0);
+    warm_start_hit = false;
+    return true;
+  }
+  warm_start_hit = (z.size() == w.size()) && tryBasis(M,w,z);
+  if (warm_start_hit)
+    return true;
+
+  // a singular M can leave Lemke on a secondary ray, or let round-off build up
+  // in the tableau over degenerate pivots, so its answer is checked (and
+  // re-solved on the basis it ended on if need be).  failing that we retry
+  // with more and more regularization, as the M + eps*I solution approaches
+  // an M solution
+  const double regularization[] = {0.0, 1e-10, 1e-8, 1e-6, 1e-4};
+  for (int k=0; k<5; k++) {
+    if (lemke(M,w,regularization[k],z) && (isSolution(M,w,regularization[k],z) || tryBasis(M,w,z)))
+      return true;
+  }
+  z = VectorXd::Zero(w.size());
+  return false;
+}
+
+bool LCPSolver::isSolution(const MatrixXd& M, const VectorXd& w, double regularization, const VectorXd& z)
+{
+  double feas_tol = tol*(1.0 + w.lpNorm<Infinity>());
+  s = w;
+  s.noalias() += M*z;
+  if (regularization > 0.0)  // lemke scales the rows before regularizing
+    s += regularization*z.cwiseQuotient(row_scale);
+  for (int i=0; i<w.size(); i++) {
+    if (z(i) < 0.0 || s(i) < -feas_tol || min(z(i),s(i)) > feas_tol)
+      return false;
+  }
+  return true;
+}
+
+bool LCPSolver::tryBasis(const MatrixXd& M, const VectorXd& w, VectorXd& z)
+{
+  int n = w.size();
+  double feas_tol = tol*(1.0 + w.lpNorm<Infinity>());
+
+  guess.clear();
+  for (int i=0; i<n; i++)
+    if (z(i) > 0.0) guess.push_back(i);
+  int m = guess.size();
+
+  z_guess.resize(m);
+  if (m > 0) {
+    M_guess.resize(m,m);
+    for (int i=0; i<m; i++) {
+      z_guess(i) = -w(guess[i]);
+      for (int j=0; j<m; j++)
+        M_guess(i,j) = M(guess[i],guess[j]);
+    }
+    z_guess = M_guess.fullPivLu().solve(z_guess);
+    if (!z_guess.allFinite() || z_guess.minCoeff() < -feas_tol)
+      return false;
+  }
+
+  s = w;
+  for (int j=0; j<m; j++)
+    s += M.col(guess[j])*z_guess(j);
+  if (s.minCoeff() < -feas_tol)
+    return false;
+  for (int i=0; i<m; i++)  // the basic rows have to hold with equality
+    if (fabs(s(guess[i])) > feas_tol) return false;
+
+  z.setZero();
+  for (int i=0; i<m; i++)
+    z(guess[i]) = max(0.0,z_guess(i));
+  return true;
+}
+
+bool LCPSolver::lexicographicallySmaller(int i, int k, int c) const
+{
+  int n = T.rows();
+  double ai = T(i,c), ak = T(k,c);
+  for (int j=0; j<n; j++) {
+    double diff = T(i,j)/ai - T(k,j)/ak;
+    if (diff < -PIVOT_TOL) return true;
+    if (diff > PIVOT_TOL) return false;
+  }
+  return false;
+}
+
+void LCPSolver::pivot(int r, int c)
+{
+  pivot_col = T.col(c);
+  pivot_col(r) = 0.0;
+  T.row(r) /= T(r,c);
+  T.noalias() -= pivot_col*T.row(r);
+}
+
+bool LCPSolver::lemke(const MatrixXd& M, const VectorXd& w, double regularization, VectorXd& z)
+{
+  int n = w.size();
+  int z0 = 2*n, rhs = 2*n+1;
+  z = VectorXd::Zero(n);
+
+  // scaling the rows of [M, w] does not change the solution set, and rows of
+  // very different size (e.g. position and velocity level constraints) make
+  // the pivot tolerances meaningless otherwise
+  row_scale.resize(n);
+  for (int i=0; i<n; i++) {
+    double row_max = max(M.row(i).lpNorm<Infinity>(),fabs(w(i)));
+    row_scale(i) = (row_max > 0.0) ? 1.0/row_max : 1.0;
+  }
+
+  int r;
+  if (n == 0 || w.cwiseProduct(row_scale).minCoeff(&r) >= 0.0)
+    return true;
+
+  T.resize(n,2*n+2);
+  T.leftCols(n).setIdentity();
+  T.middleCols(n,n).noalias() = -(row_scale.asDiagonal()*M);
+  T.middleCols(n,n).diagonal().array() -= regularization;
+  T.col(z0).setConstant(-1.0);
+  T.col(rhs) = w.cwiseProduct(row_scale);
+  basis.resize(n);
+  for (int i=0; i<n; i++) basis[i] = i;
+
+  // z0 enters at the row of the most negative w, which makes the tableau feasible
+  pivot(r,z0);
+  int leaving = basis[r];
+  basis[r] = z0;
+  num_pivots++;
+
+  for (int k=0; k<max_pivots; k++) {
+    // the complement of the variable that just left the basis enters it
+    int entering = (leaving < n) ? leaving+n : leaving-n;
+
+    // minimum ratio test.  ties go to z0 (which ends the method), and are
+    // otherwise broken lexicographically on the rows of inv(B) in the first n
+    // columns of the tableau, which keeps Lemke from cycling on the degenerate
+    // problems that redundant contacts produce
+    r = -1;
+    double min_ratio = numeric_limits<double>::infinity();
+    for (int i=0; i<n; i++) {
+      double a = T(i,entering);
+      if (a <= PIVOT_TOL) continue;
+      double ratio = T(i,rhs)/a;
+      double tie = PIVOT_TOL*(1.0 + fabs(min_ratio));
+      if (r < 0 || ratio < min_ratio - tie) {
+        r = i; min_ratio = ratio;
+      } else if (ratio < min_ratio + tie && basis[r] != z0) {
+        if (basis[i] == z0 || lexicographicallySmaller(i,r,entering)) {
+          r = i; min_ratio = min(min_ratio,ratio);
+        }
+      }
+    }
+    if (r < 0)
+      return false;  // ray termination
+
+    pivot(r,entering);
+    leaving = basis[r];
+    basis[r] = entering;
+    num_pivots++;
+
+    if (leaving == z0) {
+      // the rhs column has picked up round-off over the pivots, so solve for
+      // the basic variables again from the original columns
+      B.resize(n,n);
+      for (int j=0; j<n; j++) {
+        if (basis[j] < n) {
+          B.col(j).setZero();
+          B(basis[j],j) = 1.0;
+        } else {
+          B.col(j) = -M.col(basis[j]-n).cwiseProduct(row_scale);
+          B(basis[j]-n,j) -= regularization;
+        }
+      }
+      x = B.partialPivLu().solve(w.cwiseProduct(row_scale));
+      if (!x.allFinite())
+        x = T.col(rhs);
+      for (int j=0; j<n; j++)
+        if (basis[j] >= n)
+          z(basis[j]-n) = max(0.0,x(j));
+      return true;
+    }
+  }
+  return false;
+}
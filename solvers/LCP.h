@@ -0,0 +1,60 @@
+#ifndef __LCP_H__
+#define __LCP_H__
+#include <Eigen/Dense>
+#include <vector>
+
+/*
+ * Solves the linear complementarity problem
+ *   z >= 0,  M*z + w >= 0,  z'*(M*z + w) = 0
+ * with Lemke's complementary pivoting method on a dense tableau.  Unlike
+ * projected Gauss-Seidel, this does not need M to be symmetric or to have a
+ * positive diagonal, so it handles the contact LCP of the time-stepping
+ * simulation (whose friction rows have zero diagonal blocks) like pathlcp does.
+ *
+ * Meant to be kept alive across calls (e.g. one per simulator).  When z holds
+ * a guess on entry, solve first tries the basis that the guess implies (the
+ * positive components of z are basic, the others sit at zero) with a single
+ * linear solve, and only starts pivoting if that basis is wrong.  Workspaces
+ * grow only, so repeated solves of the same size do not allocate.
+ */
+class LCPSolver
+{
+public:
+  LCPSolver();
+
+  // returns true on success.  on entry, z is a warm start if it has the same
+  // size as w (pass an empty z to start cold); on exit it is the solution
+  bool solve(const Eigen::MatrixXd& M, const Eigen::VectorXd& w, Eigen::VectorXd& z);
+
+  // what the last solve did
+  bool warmStartHit() const { return warm_start_hit; }
+  int numPivots() const { return num_pivots; }
+
+  int max_pivots;  // per Lemke run
+  double tol;      // feasibility tolerance, relative to the size of w
+
+private:
+  bool isSolution(const Eigen::MatrixXd& M, const Eigen::VectorXd& w, double regularization, const Eigen::VectorXd& z);
+  bool tryBasis(const Eigen::MatrixXd& M, const Eigen::VectorXd& w, Eigen::VectorXd& z);
+  bool lemke(const Eigen::MatrixXd& M, const Eigen::VectorXd& w, double regularization, Eigen::VectorXd& z);
+  bool lexicographicallySmaller(int i, int k, int c) const;  // row i/T(i,c) < row k/T(k,c) over inv(B)
+  void pivot(int r, int c);
+
+  bool warm_start_hit;
+  int num_pivots;
+
+  // tableau [I, -S*M, -1, S*w] over the variables [S*s; z; z0] (s = M*z + w),
+  // with the rows scaled by S = diag(row_scale)
+  Eigen::MatrixXd T;
+  Eigen::VectorXd row_scale;
+  Eigen::VectorXd pivot_col;
+  std::vector<int> basis;
+  Eigen::MatrixXd B;  // the basic columns of the tableau, once Lemke is done
+  Eigen::VectorXd x;
+
+  std::vector<int> guess;
+  Eigen::MatrixXd M_guess;
+  Eigen::VectorXd z_guess, s;
+};
+
+#endif
@@ -320,9 +320,27 @@ int myGRBaddconstrs(GRBmodel *model, MatrixBase<DerivedA> const & A, MatrixBase<
   return error;
 }
 
+// the row-major compressed storage is exactly gurobi's constraint format
+static int myGRBaddconstrs(GRBmodel *model, const SparseMatrix<double,RowMajor>& A, const VectorXd& b, char sense)
+{
+  if (!A.isCompressed()) {
+    SparseMatrix<double,RowMajor> Acompressed(A);
+    Acompressed.makeCompressed();
+    return myGRBaddconstrs(model,Acompressed,b,sense);
+  }
+  vector<char> senses(A.rows(),sense);
+  return GRBaddconstrs(model,A.rows(),A.nonZeros(),const_cast<int*>(A.outerIndexPtr()),const_cast<int*>(A.innerIndexPtr()),const_cast<double*>(A.valuePtr()),senses.data(),const_cast<double*>(b.data()),NULL);
+}
+
+static int myGRBaddconstrs(GRBmodel *model, const MatrixXd& A, const VectorXd& b, char sense)
+{
+  return myGRBaddconstrs(model,A,b,sense,1e-18);
+}
+
 //template <typename tA, typename tB, typename tC, typename tD, typename tE>
 //GRBmodel* gurobiQP(GRBenv *env, vector< MatrixBase<tA>* > QblkDiag, VectorXd& f, const MatrixBase<tB>& Aeq, const MatrixBase<tC>& beq, const MatrixBase<tD>& Ain, const MatrixBase<tE>& bin, VectorXd& lb, VectorXd& ub, set<int>& active, VectorXd& x)
-GRBmodel* gurobiQP(GRBenv *env, vector< MatrixXd* > QblkDiag, VectorXd& f, const MatrixXd& Aeq, const VectorXd& beq, 
+template <typename AeqType>
+static GRBmodel* gurobiQPImpl(GRBenv *env, vector< MatrixXd* > QblkDiag, VectorXd& f, const AeqType& Aeq, const VectorXd& beq,
   const MatrixXd& Ain, const VectorXd& bin, VectorXd& lb, VectorXd& ub, set<int>& active, VectorXd& x, double active_set_slack_tolerance)
 {
 	// Note: f,lb, and ub are VectorXd instead of const MatrixBase templates because i want to be able to call f.data() on them
@@ -378,7 +396,7 @@ GRBmodel* gurobiQP(GRBenv *env, vector< MatrixXd* > QblkDiag, VectorXd& f, const
 
   CGE (GRBsetdblattrarray(model,"Obj",0,nparams,f.data()), env);
 
-  if (Aeq.rows()>0) CGE (myGRBaddconstrs(model,Aeq,beq,GRB_EQUAL, 1e-18), env);
+  if (Aeq.rows()>0) CGE (myGRBaddconstrs(model,Aeq,beq,GRB_EQUAL), env);
   if (Ain.rows()>0) CGE (myGRBaddconstrs(model,Ain,bin,GRB_LESS_EQUAL, 1e-18), env);
 
   CGE (GRBupdatemodel(model), env);
@@ -409,7 +427,8 @@ GRBmodel* gurobiQP(GRBenv *env, vector< MatrixXd* > QblkDiag, VectorXd& f, const
 }
 
 
-GRBmodel* gurobiActiveSetQP(GRBenv *env, vector< MatrixXd* > QblkDiag, VectorXd& f, const MatrixXd& Aeq, const VectorXd& beq, 
+template <typename AeqType>
+static GRBmodel* gurobiActiveSetQPImpl(GRBenv *env, vector< MatrixXd* > QblkDiag, VectorXd& f, const AeqType& Aeq, const VectorXd& beq,
   const MatrixXd& Ain, const VectorXd& bin, VectorXd& lb, VectorXd& ub, int* &vbasis, int vbasis_len, int* &cbasis, int cbasis_len, VectorXd& x)
 {
   // NOTE:  this allocates memory for a new GRBmodel and returns it. (you should delete this object when you're done with it)
@@ -463,7 +482,7 @@ GRBmodel* gurobiActiveSetQP(GRBenv *env, vector< MatrixXd* > QblkDiag, VectorXd&
 
   CGE (GRBsetdblattrarray(model,"Obj",0,nparams,f.data()), env);
 
-  if (Aeq.rows()>0) CGE (myGRBaddconstrs(model,Aeq,beq,GRB_EQUAL, 1e-18), env);
+  if (Aeq.rows()>0) CGE (myGRBaddconstrs(model,Aeq,beq,GRB_EQUAL), env);
   if (Ain.rows()>0) CGE (myGRBaddconstrs(model,Ain,bin,GRB_LESS_EQUAL, 1e-18), env);
 
   CGE (GRBupdatemodel(model), env);
@@ -495,6 +514,30 @@ GRBmodel* gurobiActiveSetQP(GRBenv *env, vector< MatrixXd* > QblkDiag, VectorXd&
   return model;
 }
 
+GRBmodel* gurobiQP(GRBenv *env, vector< MatrixXd* > QblkDiag, VectorXd& f, const MatrixXd& Aeq, const VectorXd& beq,
+  const MatrixXd& Ain, const VectorXd& bin, VectorXd& lb, VectorXd& ub, set<int>& active, VectorXd& x, double active_set_slack_tolerance)
+{
+  return gurobiQPImpl(env,QblkDiag,f,Aeq,beq,Ain,bin,lb,ub,active,x,active_set_slack_tolerance);
+}
+
+GRBmodel* gurobiQP(GRBenv *env, vector< MatrixXd* > QblkDiag, VectorXd& f, const SparseMatrix<double,RowMajor>& Aeq, const VectorXd& beq,
+  const MatrixXd& Ain, const VectorXd& bin, VectorXd& lb, VectorXd& ub, set<int>& active, VectorXd& x, double active_set_slack_tolerance)
+{
+  return gurobiQPImpl(env,QblkDiag,f,Aeq,beq,Ain,bin,lb,ub,active,x,active_set_slack_tolerance);
+}
+
+GRBmodel* gurobiActiveSetQP(GRBenv *env, vector< MatrixXd* > QblkDiag, VectorXd& f, const MatrixXd& Aeq, const VectorXd& beq,
+  const MatrixXd& Ain, const VectorXd& bin, VectorXd& lb, VectorXd& ub, int* &vbasis, int vbasis_len, int* &cbasis, int cbasis_len, VectorXd& x)
+{
+  return gurobiActiveSetQPImpl(env,QblkDiag,f,Aeq,beq,Ain,bin,lb,ub,vbasis,vbasis_len,cbasis,cbasis_len,x);
+}
+
+GRBmodel* gurobiActiveSetQP(GRBenv *env, vector< MatrixXd* > QblkDiag, VectorXd& f, const SparseMatrix<double,RowMajor>& Aeq, const VectorXd& beq,
+  const MatrixXd& Ain, const VectorXd& bin, VectorXd& lb, VectorXd& ub, int* &vbasis, int vbasis_len, int* &cbasis, int cbasis_len, VectorXd& x)
+{
+  return gurobiActiveSetQPImpl(env,QblkDiag,f,Aeq,beq,Ain,bin,lb,ub,vbasis,vbasis_len,cbasis,cbasis_len,x);
+}
+
 
 
 /*
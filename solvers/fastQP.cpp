@@ -0,0 +1,408 @@
+#include <math.h>
+#include <iostream>
+#include <algorithm>
+#include <Eigen/Cholesky>
+
+#include "fastQP.h"
+
+#define MAX_ITER    10
+#define REG 1e-13
+
+using namespace Eigen;
+using namespace std;
+
+// y = Qinv*v, with Qinv given by its diagonal blocks
+static void applyQinvBlkDiag(const vector< MatrixXd* >& QinvblkDiag, const VectorXd& v, double* y_data)
+{
+  Map<VectorXd> y(y_data,v.size());
+  int startrow=0;
+  for (vector< MatrixXd* >::const_iterator iterQinv=QinvblkDiag.begin(); iterQinv!=QinvblkDiag.end(); iterQinv++) {
+    const MatrixXd* thisQinv = *iterQinv;
+    if (thisQinv->rows() == 1 || thisQinv->cols() == 1) {  // it's a vector
+      int d = thisQinv->size();
+      y.segment(startrow,d) = Map<const VectorXd>(thisQinv->data(),d).cwiseProduct(v.segment(startrow,d));
+      startrow += d;
+    } else {
+      int d = thisQinv->rows();
+      y.segment(startrow,d).noalias() = (*thisQinv)*v.segment(startrow,d);
+      startrow += d;
+    }
+  }
+}
+
+FastQPSolver::FastQPSolver() : num_rows(0), factor_ok(true), Aeq_sparse(NULL) {}
+
+void FastQPSolver::applyQinv(const vector< MatrixXd* >& QinvblkDiag, const VectorXd& v, int col)
+{
+  applyQinvBlkDiag(QinvblkDiag,v,QinvAt.col(col).data());
+}
+
+void FastQPSolver::applyQinv(const vector< MatrixXd* >& QinvblkDiag, const SparseMatrix<double,RowMajor>& Aeq, int i, int col)
+{
+  // only the columns of Qinv that meet a nonzero of row i contribute.  the
+  // nonzeros come sorted by column, so walk them alongside the blocks
+  QinvAt.col(col).setZero();
+  SparseMatrix<double,RowMajor>::InnerIterator it(Aeq,i);
+  int startrow=0;
+  for (vector< MatrixXd* >::const_iterator iterQinv=QinvblkDiag.begin(); iterQinv!=QinvblkDiag.end(); iterQinv++) {
+    const MatrixXd* thisQinv = *iterQinv;
+    bool is_diag = (thisQinv->rows() == 1 || thisQinv->cols() == 1);
+    int d = is_diag ? thisQinv->size() : thisQinv->rows();
+    for (; it && it.col()<startrow+d; ++it) {
+      if (is_diag)
+        QinvAt(it.col(),col) = (*thisQinv)(it.col()-startrow)*it.value();
+      else  // Qinv is symmetric, so its column is the row we want
+        QinvAt.col(col).segment(startrow,d) += thisQinv->col(it.col()-startrow)*it.value();
+    }
+    startrow += d;
+  }
+}
+
+void FastQPSolver::addRow(const vector< MatrixXd* >& QinvblkDiag, const VectorXd& a, double b_row)
+{
+  int n = num_rows;
+  A.row(n) = a.transpose();
+  b(n) = b_row;
+  applyQinv(QinvblkDiag,a,n);
+  updateFactor();
+}
+
+void FastQPSolver::addRow(const vector< MatrixXd* >& QinvblkDiag, const MatrixXd& Aeq, int i, double b_row)
+{
+  row = Aeq.row(i).transpose();
+  addRow(QinvblkDiag,row,b_row);
+}
+
+void FastQPSolver::addRow(const vector< MatrixXd* >& QinvblkDiag, const SparseMatrix<double,RowMajor>& Aeq, int i, double b_row)
+{
+  int n = num_rows;
+  A.row(n) = Aeq.row(i);
+  b(n) = b_row;
+  applyQinv(QinvblkDiag,Aeq,i,n);
+  updateFactor();
+}
+
+void FastQPSolver::updateFactor()
+{
+  int n = num_rows;
+  if (factor_ok) {
+    // the new row l of L solves L*l = A*Qinv*a', and the new diagonal is
+    // sqrt(a*Qinv*a' - l'*l)
+    double sigma = A.row(n).dot(QinvAt.col(n));
+    int m = 0;
+    if (Aeq_sparse) {
+      m = min(n,(int)Aeq_sparse->rows());
+      work.head(m).noalias() = Aeq_sparse->topRows(m)*QinvAt.col(n);
+    }
+    work.segment(m,n-m).noalias() = A.middleRows(m,n-m)*QinvAt.col(n);
+    L.topLeftCorner(n,n).triangularView<Lower>().solveInPlace(work.head(n));
+    double d2 = sigma - work.head(n).squaredNorm();
+    if (d2 > 1e-12*sigma) {
+      L.row(n).head(n) = work.head(n).transpose();
+      L(n,n) = sqrt(d2);
+    } else {
+      // a is (nearly) a combination of the rows already in A
+      factor_ok = false;
+    }
+  }
+  num_rows++;
+}
+
+void FastQPSolver::removeRow(int k)
+{
+  int n = num_rows;
+  if (factor_ok) {
+    // without row and column k, the trailing block of A*QinvAt is
+    // L33*L33' + l32*l32', so L33 gets a rank-one update
+    int m = n-k-1;
+    work.head(m) = L.col(k).segment(k+1,m);
+    for (int j=0; j<m; j++) {
+      int jj = k+1+j;
+      double r = sqrt(L(jj,jj)*L(jj,jj) + work(j)*work(j));
+      double c = r/L(jj,jj), s = work(j)/L(jj,jj);
+      L(jj,jj) = r;
+      for (int i=j+1; i<m; i++) {
+        int ii = k+1+i;
+        L(ii,jj) = (L(ii,jj) + s*work(i))/c;
+        work(i) = c*work(i) - s*L(ii,jj);
+      }
+    }
+    // shift the rows below k up and the columns right of k left
+    for (int j=0; j<n-1; j++) {
+      int src_col = j<k ? j : j+1;
+      for (int i=max(j,k); i<n-1; i++)
+        L(i,j) = L(i+1,src_col);
+    }
+  }
+  for (int i=k; i<n-1; i++) {
+    A.row(i) = A.row(i+1);
+    b(i) = b(i+1);
+    QinvAt.col(i) = QinvAt.col(i+1);
+  }
+  num_rows--;
+}
+
+void FastQPSolver::solveKKT(const VectorXd& f, VectorXd& x)
+{
+  //Solve H * [x;lam] = [-f;b] using Schur complements, H = [Q,At';A,0];
+  int n = num_rows;
+  if (n == 0) {
+    x = minusQinvf;
+    return;
+  }
+  lam.head(n).noalias() = QinvAt.leftCols(n).transpose()*f;
+  lam.head(n) += b.head(n);
+  if (factor_ok) {
+    L.topLeftCorner(n,n).triangularView<Lower>().solveInPlace(lam.head(n));
+    L.topLeftCorner(n,n).triangularView<Lower>().adjoint().solveInPlace(lam.head(n));
+  } else {
+    S.noalias() = A.topRows(n)*QinvAt.leftCols(n);
+    lam.head(n) = S.ldlt().solve(lam.head(n));
+  }
+  lam.head(n) = -lam.head(n);
+  x = minusQinvf;
+  x.noalias() -= QinvAt.leftCols(n)*lam.head(n);
+}
+
+template <typename AeqType>
+int FastQPSolver::solveImpl(const vector< MatrixXd* >& QinvblkDiag, const VectorXd& f, const AeqType& Aeq, const VectorXd& beq, const MatrixXd& Ain, const VectorXd& bin, vector<int>& active, VectorXd& x)
+{
+  int i;
+  int iterCnt = 0;
+
+  int M_in = bin.size();
+  int M = Aeq.rows();
+  int N = Aeq.cols();
+
+  if (f.rows() != N) { cerr << "size of f (" << f.rows() << " by " << f.cols() << ") doesn't match cols of Aeq (" << Aeq.rows() << " by " << Aeq.cols() << ")" << endl; return 2; }
+  if (beq.rows() !=M) { cerr << "size of beq doesn't match rows of Aeq" << endl; return 2; }
+  if (Ain.cols() !=N) { cerr << "cols of Ain doesn't match cols of Aeq" << endl; return 2; };
+  if (bin.rows() != Ain.rows()) { cerr << "bin rows doesn't match Ain rows" << endl; return 2; };
+  if (x.rows() != N) { cerr << "x doesn't match Aeq" << endl; return 2; }
+
+  int startrow=0;
+  for (vector< MatrixXd* >::const_iterator iterQinv=QinvblkDiag.begin(); iterQinv!=QinvblkDiag.end(); iterQinv++) {
+    const MatrixXd* thisQinv = *iterQinv;
+    int numRow = thisQinv->rows();
+    int numCol = thisQinv->cols();
+    if (numRow == 1 || numCol == 1) {  // it's a vector
+      startrow += numRow*numCol;
+    } else {
+      if (numRow!=numCol) {
+        cerr << "Q is not square! " << numRow << "x" << numCol << "\n";
+        return -2;
+      }
+      startrow += numRow;
+    }
+    if (startrow>N) {
+      cerr << "Q is too big!" << endl;
+      return -2;
+    }
+  }
+  if (startrow!=N) { cerr << "Q is the wrong size.  Got " << startrow << "by" << startrow << " but needed " << N << "by" << N << endl; return -2; }
+
+  for (i=0; i<active.size(); i++) {
+    if (active[i]<0 || active[i]>=M_in) {
+      return -3;  // active set is invalid.  exit quietly, because this is expected behavior in normal operation (e.g. it means I should immediately kick out to gurobi)
+    }
+  }
+
+  // workspaces only grow
+  int max_rows = M+M_in;
+  if (A.rows()<max_rows || A.cols()!=N) {
+    A.resize(max_rows,N);
+    QinvAt.resize(N,max_rows);
+  }
+  if (L.rows()<max_rows) {
+    L.resize(max_rows,max_rows);
+    b.resize(max_rows);
+    lam.resize(max_rows);
+    work.resize(max_rows);
+  }
+  if (row.size()!=N) {
+    row.resize(N);
+    minusQinvf.resize(N);
+  }
+  if (violation.size()!=M_in) violation.resize(M_in);
+  is_active.assign(M_in,0);
+  active_rows.clear();
+
+  applyQinvBlkDiag(QinvblkDiag,f,minusQinvf.data());
+  minusQinvf = -minusQinvf;
+
+  num_rows = 0;
+  factor_ok = true;
+  for (i=0; i<M; i++) {
+    addRow(QinvblkDiag,Aeq,i,beq(i));
+  }
+  for (i=0; i<active.size(); i++) {
+    if (!is_active[active[i]]) {
+      row = Ain.row(active[i]).transpose();
+      addRow(QinvblkDiag,row,bin(active[i]));
+      active_rows.push_back(active[i]);
+      is_active[active[i]] = 1;
+    }
+  }
+
+  while(1) {
+    iterCnt++;
+
+    solveKKT(f,x);
+
+    if (M_in == 0) {
+      active.clear();
+      break;
+    }
+
+    int n_active = active_rows.size();
+    violation.noalias() = Ain*x;
+    violation -= bin;
+    bool any_violated = false;
+    for (i=0; i<M_in; i++) {
+      if (violation(i) >= 1e-6) {
+        any_violated = true;
+        break;
+      }
+    }
+
+    bool all_pos_mults = true;
+    for (i=0; i<n_active; i++) {
+      if (lam(M+i)<0) {
+        all_pos_mults = false;
+        break;
+      }
+    }
+    if (!any_violated && all_pos_mults) {
+      // existing active was AOK
+      break;
+    }
+
+    // back to front, so that the remaining indices stay valid
+    for (i=n_active-1; i>=0; i--) {
+      if (lam(M+i)<0) {
+        is_active[active_rows[i]] = 0;
+        active_rows.erase(active_rows.begin()+i);
+        removeRow(M+i);
+      }
+    }
+    for (i=0; i<M_in; i++) {
+      if (violation(i) >= 1e-6 && !is_active[i]) {
+        row = Ain.row(i).transpose();
+        addRow(QinvblkDiag,row,bin(i));
+        active_rows.push_back(i);
+        is_active[i] = 1;
+      }
+    }
+
+    if (iterCnt > MAX_ITER) {
+      active = active_rows;
+      return -1;
+    }
+  }
+  if (M_in > 0) active = active_rows;
+  return iterCnt;
+}
+
+int FastQPSolver::invertQ(const vector< MatrixXd* >& QblkDiag, int N)
+{
+  if (Qinv.size() != QblkDiag.size()) {
+    Qinv.resize(QblkDiag.size());
+    Qldlt.resize(QblkDiag.size());
+    Qinvptr.resize(QblkDiag.size());
+  }
+
+  int startrow=0;
+  for (int i=0; i<QblkDiag.size(); i++) {
+    const MatrixXd* thisQ = QblkDiag[i];
+    int numRow = thisQ->rows();
+    int numCol = thisQ->cols();
+
+    if (numCol == 1) {  // it's a vector
+      Qinv[i] = (thisQ->array() + REG).inverse().matrix(); // regularize
+    } else { // potentially dense matrix
+      if (numRow!=numCol) {
+        if (numRow==1)
+          cerr << "diagonal Q's must be set as column vectors" << endl;
+        else
+          cerr << "Q is not square! " << numRow << "x" << numCol << endl;
+        return -2;
+      }
+      Qldlt[i].compute(*thisQ + REG*MatrixXd::Identity(numRow,numRow));
+      Qinv[i].setIdentity(numRow,numRow);
+      Qldlt[i].solveInPlace(Qinv[i]);
+    }
+    Qinvptr[i] = &Qinv[i];
+    startrow += numRow;
+    if (startrow>N) {
+      cerr << "Q is too big!" << endl;
+      return -2;
+    }
+  }
+  if (startrow!=N) { cerr << "Q is the wrong size.  Got " << startrow << "by" << startrow << " but needed " << N << "by" << N << endl; return -2; }
+
+  return 0;
+}
+
+int FastQPSolver::solveThatTakesQinv(const vector< MatrixXd* >& QinvblkDiag, const VectorXd& f, const MatrixXd& Aeq, const VectorXd& beq, const MatrixXd& Ain, const VectorXd& bin, vector<int>& active, VectorXd& x)
+{
+  Aeq_sparse = NULL;
+  return solveImpl(QinvblkDiag,f,Aeq,beq,Ain,bin,active,x);
+}
+
+int FastQPSolver::solveThatTakesQinv(const vector< MatrixXd* >& QinvblkDiag, const VectorXd& f, const SparseMatrix<double,RowMajor>& Aeq, const VectorXd& beq, const MatrixXd& Ain, const VectorXd& bin, vector<int>& active, VectorXd& x)
+{
+  Aeq_sparse = &Aeq;
+  int info = solveImpl(QinvblkDiag,f,Aeq,beq,Ain,bin,active,x);
+  Aeq_sparse = NULL;
+  return info;
+}
+
+int FastQPSolver::solve(const vector< MatrixXd* >& QblkDiag, const VectorXd& f, const MatrixXd& Aeq, const VectorXd& beq, const MatrixXd& Ain, const VectorXd& bin, vector<int>& active, VectorXd& x)
+{
+  int info = invertQ(QblkDiag,f.rows());
+  if (info<0) return info;
+  return solveThatTakesQinv(Qinvptr,f,Aeq,beq,Ain,bin,active,x);
+}
+
+int FastQPSolver::solve(const vector< MatrixXd* >& QblkDiag, const VectorXd& f, const SparseMatrix<double,RowMajor>& Aeq, const VectorXd& beq, const MatrixXd& Ain, const VectorXd& bin, vector<int>& active, VectorXd& x)
+{
+  int info = invertQ(QblkDiag,f.rows());
+  if (info<0) return info;
+  return solveThatTakesQinv(Qinvptr,f,Aeq,beq,Ain,bin,active,x);
+}
+
+int FastQPSolver::solveThatTakesQinv(const vector< MatrixXd* >& QinvblkDiag, const VectorXd& f, const MatrixXd& Aeq, const VectorXd& beq, const MatrixXd& Ain, const VectorXd& bin, set<int>& active, VectorXd& x)
+{
+  active_vec.assign(active.begin(),active.end());
+  int info = solveThatTakesQinv(QinvblkDiag,f,Aeq,beq,Ain,bin,active_vec,x);
+  active.clear();
+  active.insert(active_vec.begin(),active_vec.end());
+  return info;
+}
+
+int FastQPSolver::solve(const vector< MatrixXd* >& QblkDiag, const VectorXd& f, const MatrixXd& Aeq, const VectorXd& beq, const MatrixXd& Ain, const VectorXd& bin, set<int>& active, VectorXd& x)
+{
+  active_vec.assign(active.begin(),active.end());
+  int info = solve(QblkDiag,f,Aeq,beq,Ain,bin,active_vec,x);
+  active.clear();
+  active.insert(active_vec.begin(),active_vec.end());
+  return info;
+}
+
+int FastQPSolver::solveThatTakesQinv(const vector< MatrixXd* >& QinvblkDiag, const VectorXd& f, const SparseMatrix<double,RowMajor>& Aeq, const VectorXd& beq, const MatrixXd& Ain, const VectorXd& bin, set<int>& active, VectorXd& x)
+{
+  active_vec.assign(active.begin(),active.end());
+  int info = solveThatTakesQinv(QinvblkDiag,f,Aeq,beq,Ain,bin,active_vec,x);
+  active.clear();
+  active.insert(active_vec.begin(),active_vec.end());
+  return info;
+}
+
+int FastQPSolver::solve(const vector< MatrixXd* >& QblkDiag, const VectorXd& f, const SparseMatrix<double,RowMajor>& Aeq, const VectorXd& beq, const MatrixXd& Ain, const VectorXd& bin, set<int>& active, VectorXd& x)
+{
+  active_vec.assign(active.begin(),active.end());
+  int info = solve(QblkDiag,f,Aeq,beq,Ain,bin,active_vec,x);
+  active.clear();
+  active.insert(active_vec.begin(),active_vec.end());
+  return info;
+}
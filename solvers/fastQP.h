@@ -2,6 +2,7 @@
 #ifndef __FAST_QP__
 #define __FAST_QP__
 #include <Eigen/Dense>
+#include <Eigen/Sparse>
 #include <vector>
 #include <set>
 
@@ -10,6 +11,71 @@ int fastQPThatTakesQinv(std::vector< Eigen::MatrixXd* > QinvblkDiag, const Eigen
 int fastQP(std::vector< Eigen::MatrixXd* > QblkDiag, const Eigen::VectorXd& f, const Eigen::MatrixXd& Aeq, const Eigen::VectorXd& beq, const Eigen::MatrixXd& Ain, const Eigen::VectorXd& bin, std::set<int>& active, Eigen::VectorXd& x);
 //int fastQP(std::vector< Eigen::MatrixXd* > QblkDiag, const Eigen::VectorXd& f, const Eigen::MatrixXd& Aeq, const Eigen::VectorXd& beq, const Eigen::MatrixXd& Ain, const Eigen::VectorXd& bin, std::set<int>& active, Eigen::VectorXd& x, const Eigen::VectorXd& lb, const Eigen::VectorXd& ub);
 
+/*
+ * Same active-set method, inputs and return values as fastQPThatTakesQinv and
+ * fastQP, but meant to be kept alive across calls (e.g. one per controller).
+ * Instead of refactoring A*Qinv*A' on every active-set iteration, it keeps a
+ * Cholesky factor of that matrix and updates it when a constraint enters (one
+ * new row) or leaves (a rank-one update of the trailing block).  The active
+ * set is kept as a vector of Ain row indices and all workspaces grow only, so
+ * repeated solves of the same size do not allocate.
+ */
+class FastQPSolver
+{
+public:
+  FastQPSolver();
+
+  int solveThatTakesQinv(const std::vector< Eigen::MatrixXd* >& QinvblkDiag, const Eigen::VectorXd& f, const Eigen::MatrixXd& Aeq, const Eigen::VectorXd& beq, const Eigen::MatrixXd& Ain, const Eigen::VectorXd& bin, std::vector<int>& active, Eigen::VectorXd& x);
+  int solve(const std::vector< Eigen::MatrixXd* >& QblkDiag, const Eigen::VectorXd& f, const Eigen::MatrixXd& Aeq, const Eigen::VectorXd& beq, const Eigen::MatrixXd& Ain, const Eigen::VectorXd& bin, std::vector<int>& active, Eigen::VectorXd& x);
+
+  // drop-in versions of fastQPThatTakesQinv and fastQP
+  int solveThatTakesQinv(const std::vector< Eigen::MatrixXd* >& QinvblkDiag, const Eigen::VectorXd& f, const Eigen::MatrixXd& Aeq, const Eigen::VectorXd& beq, const Eigen::MatrixXd& Ain, const Eigen::VectorXd& bin, std::set<int>& active, Eigen::VectorXd& x);
+  int solve(const std::vector< Eigen::MatrixXd* >& QblkDiag, const Eigen::VectorXd& f, const Eigen::MatrixXd& Aeq, const Eigen::VectorXd& beq, const Eigen::MatrixXd& Ain, const Eigen::VectorXd& bin, std::set<int>& active, Eigen::VectorXd& x);
+
+  // versions for a row-major sparse Aeq.  Qinv*Aeq' and the products with the
+  // equality rows only visit the nonzeros, so structurally empty blocks of
+  // Aeq cost nothing
+  int solveThatTakesQinv(const std::vector< Eigen::MatrixXd* >& QinvblkDiag, const Eigen::VectorXd& f, const Eigen::SparseMatrix<double,Eigen::RowMajor>& Aeq, const Eigen::VectorXd& beq, const Eigen::MatrixXd& Ain, const Eigen::VectorXd& bin, std::vector<int>& active, Eigen::VectorXd& x);
+  int solve(const std::vector< Eigen::MatrixXd* >& QblkDiag, const Eigen::VectorXd& f, const Eigen::SparseMatrix<double,Eigen::RowMajor>& Aeq, const Eigen::VectorXd& beq, const Eigen::MatrixXd& Ain, const Eigen::VectorXd& bin, std::vector<int>& active, Eigen::VectorXd& x);
+  int solveThatTakesQinv(const std::vector< Eigen::MatrixXd* >& QinvblkDiag, const Eigen::VectorXd& f, const Eigen::SparseMatrix<double,Eigen::RowMajor>& Aeq, const Eigen::VectorXd& beq, const Eigen::MatrixXd& Ain, const Eigen::VectorXd& bin, std::set<int>& active, Eigen::VectorXd& x);
+  int solve(const std::vector< Eigen::MatrixXd* >& QblkDiag, const Eigen::VectorXd& f, const Eigen::SparseMatrix<double,Eigen::RowMajor>& Aeq, const Eigen::VectorXd& beq, const Eigen::MatrixXd& Ain, const Eigen::VectorXd& bin, std::set<int>& active, Eigen::VectorXd& x);
+
+private:
+  template <typename AeqType>
+  int solveImpl(const std::vector< Eigen::MatrixXd* >& QinvblkDiag, const Eigen::VectorXd& f, const AeqType& Aeq, const Eigen::VectorXd& beq, const Eigen::MatrixXd& Ain, const Eigen::VectorXd& bin, std::vector<int>& active, Eigen::VectorXd& x);
+  int invertQ(const std::vector< Eigen::MatrixXd* >& QblkDiag, int N);
+  void applyQinv(const std::vector< Eigen::MatrixXd* >& QinvblkDiag, const Eigen::VectorXd& v, int col);
+  void applyQinv(const std::vector< Eigen::MatrixXd* >& QinvblkDiag, const Eigen::SparseMatrix<double,Eigen::RowMajor>& Aeq, int i, int col);
+  void addRow(const std::vector< Eigen::MatrixXd* >& QinvblkDiag, const Eigen::VectorXd& a, double b_row);
+  void addRow(const std::vector< Eigen::MatrixXd* >& QinvblkDiag, const Eigen::MatrixXd& Aeq, int i, double b_row);
+  void addRow(const std::vector< Eigen::MatrixXd* >& QinvblkDiag, const Eigen::SparseMatrix<double,Eigen::RowMajor>& Aeq, int i, double b_row);
+  void updateFactor();
+  void removeRow(int k);
+  void solveKKT(const Eigen::VectorXd& f, Eigen::VectorXd& x);
+
+  // the rows of [Aeq; Ain(active,:)], in the order they were added
+  int num_rows;
+  Eigen::MatrixXd A;
+  Eigen::VectorXd b;
+  Eigen::MatrixXd QinvAt;
+  // lower triangular L*L' = A*QinvAt; stale when factor_ok is false, in which
+  // case the rest of the solve refactors A*QinvAt from scratch
+  Eigen::MatrixXd L;
+  bool factor_ok;
+  // the equality rows (the first rows of A) during a solve with a sparse Aeq
+  const Eigen::SparseMatrix<double,Eigen::RowMajor>* Aeq_sparse;
+
+  std::vector<char> is_active;
+  std::vector<int> active_rows;
+  Eigen::VectorXd minusQinvf, lam, violation, row, work;
+  Eigen::MatrixXd S;
+
+  std::vector<Eigen::MatrixXd> Qinv;
+  std::vector< Eigen::LDLT<Eigen::MatrixXd> > Qldlt;
+  std::vector<Eigen::MatrixXd*> Qinvptr;
+  std::vector<int> active_vec;
+};
+
 /* TODO: restore templated versions
 template <typename tA, typename tB, typename tC, typename tD, typename tE, typename tF, typename tG>
 int fastQP(std::vector< Eigen::Map<tA> > QblkDiag, const Eigen::MatrixBase<tB>& f, const Eigen::MatrixBase<tC>& Aeq, const Eigen::MatrixBase<tD>& beq, const Eigen::MatrixBase<tE>& Ain, const Eigen::MatrixBase<tF>& bin, std::set<int>& active, Eigen::MatrixBase<tG>& x);
@@ -3,6 +3,7 @@
 #define __GUROBI_QP__
 
 #include <Eigen/Dense>
+#include <Eigen/Sparse>
 #include <vector>
 #include <set>
 #include <gurobi_c++.h>
@@ -19,6 +20,14 @@ GRBmodel* gurobiQP(GRBenv *env, std::vector< Eigen::MatrixXd* > QblkDiag, Eigen:
 GRBmodel* gurobiActiveSetQP(GRBenv *env, std::vector< Eigen::MatrixXd* > QblkDiag, Eigen::VectorXd& f, const Eigen::MatrixXd& Aeq, 
 	const Eigen::VectorXd& beq, const Eigen::MatrixXd& Ain, const Eigen::VectorXd& bin, Eigen::VectorXd& lb, Eigen::VectorXd& ub, 
 	int* &vbasis, int vbasis_len, int* &cbasis, int cbasis_len, Eigen::VectorXd& x);
+
+// versions for a row-major sparse Aeq, which is handed to gurobi as is
+GRBmodel* gurobiQP(GRBenv *env, std::vector< Eigen::MatrixXd* > QblkDiag, Eigen::VectorXd& f, const Eigen::SparseMatrix<double,Eigen::RowMajor>& Aeq,
+	const Eigen::VectorXd& beq, const Eigen::MatrixXd& Ain, const Eigen::VectorXd& bin, Eigen::VectorXd& lb, Eigen::VectorXd& ub,
+	std::set<int>& active, Eigen::VectorXd& x, double active_set_slack_tol=1e-4);
+GRBmodel* gurobiActiveSetQP(GRBenv *env, std::vector< Eigen::MatrixXd* > QblkDiag, Eigen::VectorXd& f, const Eigen::SparseMatrix<double,Eigen::RowMajor>& Aeq,
+	const Eigen::VectorXd& beq, const Eigen::MatrixXd& Ain, const Eigen::VectorXd& bin, Eigen::VectorXd& lb, Eigen::VectorXd& ub,
+	int* &vbasis, int vbasis_len, int* &cbasis, int cbasis_len, Eigen::VectorXd& x);
 #endif
 
 
@@ -0,0 +1,98 @@
+/*
+ * Times FastQPSolver against fastQP on a sequence of QPs shaped like the ones
+ * QPController solves every tick (a dense block for the joint accelerations,
+ * diagonal blocks for the contact forces and slacks, floating base dynamics
+ * and contact equality rows, and torque limits and bounds as inequalities),
+ * with the active set carried over from tick to tick, and checks that all of
+ * them return the same solutions.  FastQPSolver is timed with Aeq passed both
+ * densely and as a sparse matrix.
+ */
+#include <iostream>
+#include <cstdio>
+#include <chrono>
+#include "fastQP.h"
+
+using namespace std;
+using namespace Eigen;
+
+int main()
+{
+  const int num_ticks = 500;
+  const int nq = 34, nf = 32, neps = 12, nu = 28, neq = 6+neps;
+  const int nparams = nq+nf+neps;
+
+  srand(0);
+  MatrixXd R = MatrixXd::Random(nq,nq);
+  MatrixXd Hqp = R*R.transpose() + MatrixXd::Identity(nq,nq);
+  MatrixXd Qnfdiag = MatrixXd::Constant(nf,1,1.0);
+  MatrixXd Qneps = MatrixXd::Constant(neps,1,1e2);
+  vector<MatrixXd*> QblkDiag;
+  QblkDiag.push_back(&Hqp);
+  QblkDiag.push_back(&Qnfdiag);
+  QblkDiag.push_back(&Qneps);
+
+  // floating base dynamics rows touch every qdd and contact force, each
+  // contact row only the joints of one leg and its own slack
+  MatrixXd Aeq = MatrixXd::Zero(neq,nparams);
+  Aeq.topLeftCorner(6,nq+nf) = MatrixXd::Random(6,nq+nf);
+  for (int i=0; i<neps; i++) {
+    int leg = i<neps/2 ? 0 : 1;
+    Aeq.block(6+i,0,1,6) = MatrixXd::Random(1,6);
+    Aeq.block(6+i,6+6*leg,1,6) = MatrixXd::Random(1,6);
+    Aeq(6+i,nq+nf+i) = 1;
+  }
+  SparseMatrix<double,RowMajor> Aeq_sparse = Aeq.sparseView();
+  MatrixXd B = 0.2*MatrixXd::Random(nu,nparams);
+  MatrixXd Ain(2*nu+2*nparams,nparams);
+  Ain << B, -B, -MatrixXd::Identity(nparams,nparams), MatrixXd::Identity(nparams,nparams);
+  VectorXd bin = VectorXd::Constant(Ain.rows(),1.0);
+  VectorXd f0 = 3*VectorXd::Random(nparams);
+
+  VectorXd x_ref(nparams), x(nparams), x_sparse(nparams);
+  set<int> active_ref, active, active_sparse;
+  FastQPSolver solver, sparse_solver;
+  double ref_time = 0, solver_time = 0, sparse_time = 0;
+  int num_mismatched = 0, num_failed = 0, ref_iters = 0, solver_iters = 0;
+  for (int k=0; k<num_ticks; k++) {
+    VectorXd f = f0 + VectorXd::Random(nparams);
+    VectorXd beq = 0.1*VectorXd::Random(neq);
+
+    auto start = chrono::high_resolution_clock::now();
+    int info_ref = fastQP(QblkDiag,f,Aeq,beq,Ain,bin,active_ref,x_ref);
+    auto mid = chrono::high_resolution_clock::now();
+    int info = solver.solve(QblkDiag,f,Aeq,beq,Ain,bin,active,x);
+    auto mid2 = chrono::high_resolution_clock::now();
+    int info_sparse = sparse_solver.solve(QblkDiag,f,Aeq_sparse,beq,Ain,bin,active_sparse,x_sparse);
+    auto stop = chrono::high_resolution_clock::now();
+    ref_time += chrono::duration_cast<chrono::nanoseconds>(mid-start).count()/1e3;
+    solver_time += chrono::duration_cast<chrono::nanoseconds>(mid2-mid).count()/1e3;
+    sparse_time += chrono::duration_cast<chrono::nanoseconds>(stop-mid2).count()/1e3;
+
+    if (info_ref<0) {
+      // the controller falls back to gurobi here; start the next tick cold
+      active_ref.clear();
+      active.clear();
+      active_sparse.clear();
+      num_failed++;
+      continue;
+    }
+    ref_iters += info_ref;
+    solver_iters += info;
+    if (info != info_ref || (x-x_ref).lpNorm<Infinity>() > 1e-6*(1+x_ref.lpNorm<Infinity>()) || active != active_ref) {
+      num_mismatched++;
+    }
+    if (info_sparse != info_ref || (x_sparse-x_ref).lpNorm<Infinity>() > 1e-6*(1+x_ref.lpNorm<Infinity>()) || active_sparse != active_ref) {
+      num_mismatched++;
+    }
+  }
+
+  printf("%d params, %d equalities, %d inequalities, %d ticks (%d fell back to gurobi)\n",nparams,neq,(int)Ain.rows(),num_ticks,num_failed);
+  printf("fastQP:       %8.2f us/solve, %d active-set iterations\n",ref_time/num_ticks,ref_iters);
+  printf("FastQPSolver: %8.2f us/solve, %d active-set iterations\n",solver_time/num_ticks,solver_iters);
+  printf("  sparse Aeq: %8.2f us/solve (%d of %d entries of Aeq nonzero)\n",sparse_time/num_ticks,(int)Aeq_sparse.nonZeros(),(int)Aeq.size());
+  if (num_mismatched>0) {
+    cerr << num_mismatched << " solves did not match fastQP" << endl;
+    return 1;
+  }
+  return 0;
+}
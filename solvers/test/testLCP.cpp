@@ -0,0 +1,92 @@
+/*
+ * Solves random LCPs with positive definite, positive semidefinite and
+ * frictional-contact shaped M, checks the complementarity conditions, and
+ * checks that resolving from the solution takes no pivots.
+ */
+#include <iostream>
+#include <cstdio>
+#include <cmath>
+#include "LCP.h"
+
+using namespace std;
+using namespace Eigen;
+
+static bool isSolution(const MatrixXd& M, const VectorXd& w, const VectorXd& z, double tol)
+{
+  VectorXd s = M*z + w;
+  return z.minCoeff() >= -tol && s.minCoeff() >= -tol && fabs(z.dot(s)) <= tol*(1+z.norm()*s.norm());
+}
+
+// the contact LCP of a point mass on the ground (as in TimeSteppingRigidBodyManipulator):
+// z = [cn; beta (2*m directions); lambda], for a random velocity and timestep
+static void contactLCP(int m, double mu, MatrixXd& M, VectorXd& w)
+{
+  int nd = 2*m, n = nd+2;
+  double h = 1e-3, mass = 1.0;
+  Vector3d v = Vector3d::Random(), normal(0,0,1);
+  MatrixXd D(nd,3);
+  for (int j=0; j<m; j++) {
+    Vector3d d(cos(j*M_PI/m),sin(j*M_PI/m),0);
+    D.row(j) = d.transpose();
+    D.row(m+j) = -d.transpose();
+  }
+  Vector3d vfree = v + h*Vector3d(0,0,-9.81);
+  M = MatrixXd::Zero(n,n);
+  w = VectorXd::Zero(n);
+  w(0) = h*normal.dot(vfree);
+  M(0,0) = h*normal.dot(normal)/mass;
+  M.block(0,1,1,nd) = h*normal.transpose()*D.transpose()/mass;
+  w.segment(1,nd) = D*vfree;
+  M.block(1,0,nd,1) = D*normal/mass;
+  M.block(1,1,nd,nd) = D*D.transpose()/mass;
+  M.block(1,nd+1,nd,1).setOnes();
+  M(nd+1,0) = mu;
+  M.block(nd+1,1,1,nd).setConstant(-1.0);
+}
+
+int main()
+{
+  const double tol = 1e-8;
+  LCPSolver solver;
+  int num_failed = 0, num_problems = 0, total_pivots = 0, num_warm_hits = 0;
+
+  srand(0);
+  for (int k=0; k<300; k++) {
+    MatrixXd M;
+    VectorXd w;
+    int n = 1 + k%20;
+    if (k%3 == 0) {  // positive definite
+      MatrixXd A = MatrixXd::Random(n,n);
+      M = A*A.transpose() + 0.1*MatrixXd::Identity(n,n);
+      w = VectorXd::Random(n);
+    } else if (k%3 == 1) {  // positive semidefinite, with a solution
+      MatrixXd A = MatrixXd::Random(n,n/2+1);
+      M = A*A.transpose();
+      w = VectorXd::Random(n).cwiseAbs() - M*VectorXd::Random(n).cwiseAbs();
+    } else {
+      contactLCP(2+k%3,0.5+0.1*(k%5),M,w);
+    }
+
+    VectorXd z;
+    num_problems++;
+    if (!solver.solve(M,w,z) || !isSolution(M,w,z,tol)) {
+      cerr << "problem " << k << ": Lemke did not find a solution" << endl;
+      num_failed++;
+      continue;
+    }
+    total_pivots += solver.numPivots();
+
+    // warm started from its own solution, the solver should not pivot at all
+    // (unless the positive part of the solution is degenerate, e.g. a lambda
+    // alone, which only happens in the contact problems)
+    bool solved = solver.solve(M,w,z);
+    if (solver.warmStartHit()) num_warm_hits++;
+    if (!solved || !isSolution(M,w,z,tol) || (k%3 == 0 && (!solver.warmStartHit() || solver.numPivots() != 0))) {
+      cerr << "problem " << k << ": the warm start from the solution failed" << endl;
+      num_failed++;
+    }
+  }
+
+  printf("%d of %d LCPs solved, %.1f pivots per cold solve, %d warm starts from the solution taken\n",num_problems-num_failed,num_problems,(double)total_pivots/num_problems,num_warm_hits);
+  return num_failed>0 ? 1 : 0;
+}
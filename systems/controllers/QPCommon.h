@@ -1,41 +0,0 @@
-#include "controlUtil.h"
-#include "drake/fastQP.h"
-#include "drake/gurobiQP.h"
-
-const double REG = 1e-8;
-
-struct QPControllerData {
-  GRBenv *env;
-  RigidBodyManipulator* r;
-  double slack_limit; // maximum absolute magnitude of acceleration slack variable values
-  VectorXd umin,umax;
-  void* map_ptr;
-  std::set<int> active;
-
-  // preallocate memory
-  MatrixXd H, H_float, H_act;
-  VectorXd C, C_float, C_act;
-  MatrixXd B, B_act;
-  MatrixXd J, Jdot;
-  MatrixXd J_xy, Jdot_xy;
-  MatrixXd Hqp;
-  RowVectorXd fqp;
-  
-  // momentum controller-specific
-  MatrixXd Ag, Agdot; // centroidal momentum matrix
-  MatrixXd Ak, Akdot; // centroidal angular momentum matrix
-  MatrixXd W_kdot; // quadratic cost for angular momentum rate: (kdot_des - kdot)'*W*(kdot_des - kdot)
-  VectorXd w_qdd; 
-  double w_grf; 
-  double w_slack; 
-  double Kp_ang; // angular momentum (k) P gain 
-  int n_body_accel_inputs;
-  int n_body_accel_constraints;
-  VectorXd body_accel_input_weights;
-
-  // gurobi active set params
-  int *vbasis;
-  int *cbasis;
-  int vbasis_len;
-  int cbasis_len;
-};
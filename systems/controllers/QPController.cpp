@@ -0,0 +1,470 @@
+/*
+ * A c++ version of (significant pieces of) the QPController.m mimoOutput method.
+ *
+ * Todo:
+ *   switch to spatial accelerations in motion constraints
+ *   use fixed-size matrices (or at least pre-allocated)
+ *       for instance: #define nq
+ *       set MaxRowsAtCompileTime (http://eigen.tuxfamily.org/dox/TutorialMatrixClass.html)
+ *   some matrices might be better off using RowMajor
+ */
+
+#include "QPController.h"
+#include <iostream>
+#include <chrono>
+
+//#define TEST_FAST_QP
+//#define USE_MATRIX_INVERSION_LEMMA
+
+using namespace std;
+using namespace Eigen;
+
+const double REG = 1e-8;
+
+// appends the nonzeros of v, times scale, to the row of A that was started last
+template <typename Derived>
+static void appendNonzeros(SparseMatrix<double,RowMajor>& A, int row, int start_col, const MatrixBase<Derived>& v, double scale=1.0)
+{
+  for (int j=0; j<v.size(); j++) {
+    if (v(j)!=0.0) A.insertBack(row,start_col+j) = scale*v(j);
+  }
+}
+
+QPController::QPController(RigidBodyManipulator* r, const QPControllerParams& params, void* map_ptr)
+  : r(r), params(params), map_ptr(map_ptr), height_map(NULL), vbasis(NULL), cbasis(NULL), vbasis_len(0), cbasis_len(0)
+{
+  int nq = r->num_dof, nu = params.B.cols();
+
+  B_act = params.B.bottomRows(nu);
+
+  // create gurobi environment
+  int error = GRBloadenv(&env,NULL);
+  if (error) cerr << "QPController: could not create the gurobi environment" << endl;
+
+  // set solver params (http://www.gurobi.com/documentation/5.5/reference-manual/node798#sec:Parameters)
+  CGE ( GRBsetintparam(env,"outputflag",0), env );
+  CGE ( GRBsetintparam(env,"method",params.gurobi_method), env );
+  CGE ( GRBsetintparam(env,"presolve",0), env );
+  if (params.gurobi_method==2) {
+    CGE ( GRBsetintparam(env,"bariterlimit",20), env );
+    CGE ( GRBsetintparam(env,"barhomogeneous",0), env );
+    CGE ( GRBsetdblparam(env,"barconvtol",0.0005), env );
+  }
+
+  // preallocate some memory
+  H.resize(nq,nq);
+  H_float.resize(6,nq);
+  H_act.resize(nu,nq);
+
+  C.resize(nq);
+  C_float.resize(6);
+  C_act.resize(nu);
+
+  J.resize(3,nq);
+  Jdot.resize(3,nq);
+  J_xy.resize(2,nq);
+  Jdot_xy.resize(2,nq);
+  fqp.resize(nq);
+  Ag.resize(6,nq);
+  Agdot.resize(6,nq);
+  Ak.resize(3,nq);
+  Akdot.resize(3,nq);
+  Jb.resize(6,nq);
+  Jbdot.resize(6,nq);
+  tau.resize(nu);
+}
+
+QPController::~QPController()
+{
+  GRBfreeenv(env);
+  delete[] vbasis;
+  delete[] cbasis;
+}
+
+void QPController::update(const QPControllerInput& input, QPControllerOutput& output)
+{
+  auto tick_start = chrono::high_resolution_clock::now();
+
+  int nu = params.B.cols(), nq = r->num_dof;
+  const int dim = 3, // 3D
+  nd = 2*m_surface_tangents; // for friction cone approx, hard coded for now
+
+  assert(nu+6 == nq);
+
+  const VectorXd& qddot_des = input.qddot_des;
+  const VectorXd& qdvec = input.qd;
+  const vector<VectorXd,aligned_allocator<VectorXd>>& body_accel_inputs = input.body_accel_inputs;
+  const vector<SupportStateElement>& active_supports = input.supports;
+  int num_condof = input.condof.size();
+  int n_body_accel_inputs = params.body_accel_input_weights.size();
+
+  // RigidBodyManipulator takes non-const state pointers, but does not write through them
+  double *q = const_cast<double*>(input.q.data()), *qd = const_cast<double*>(input.qd.data());
+
+  Matrix2d R_DQyD_ls = input.R_ls + input.D_ls.transpose()*input.Qy*input.D_ls;
+
+  r->doKinematics(q,false,qd);
+
+  //---------------------------------------------------------------------
+  // Active supports -----------------------------------------------------
+
+  int num_active_contact_pts=0;
+  output.active_supports.resize(active_supports.size());
+  for (int i=0; i<active_supports.size(); i++) {
+    num_active_contact_pts += active_supports[i].contact_pt_inds.size();
+    output.active_supports[i] = active_supports[i].body_idx;
+  }
+
+  r->HandC(q,qd,(MatrixXd*)NULL,H,C,(MatrixXd*)NULL,(MatrixXd*)NULL,(MatrixXd*)NULL);
+
+  H_float = H.topRows(6);
+  H_act = H.bottomRows(nu);
+  C_float = C.head(6);
+  C_act = C.tail(nu);
+
+  bool include_angular_momentum = (params.W_kdot.array().maxCoeff() > 1e-10);
+
+  if (include_angular_momentum) {
+    r->getCMM(q,qd,Ag,Agdot);
+    Ak = Ag.topRows(3);
+    Akdot = Agdot.topRows(3);
+  }
+  Vector3d xcom;
+  // consider making all J's into row-major
+
+  r->getCOM(xcom);
+  r->getCOMJac(J);
+  r->getCOMJacDot(Jdot);
+  // copy to xy versions for computations below (avoid doing topRows a bunch of times)
+  J_xy = J.topRows(2);
+  Jdot_xy = Jdot.topRows(2);
+
+  int nc;
+  if (height_map)
+    nc = contactConstraintsBV(r,num_active_contact_pts,input.mu,active_supports,*height_map,Jz,D,Jp,Jpdot);
+  else
+    nc = contactConstraintsBV(r,num_active_contact_pts,input.mu,active_supports,map_ptr,Jz,D,Jp,Jpdot,input.terrain_height);
+  int neps = nc*dim;
+
+  Vector4d x_bar,xlimp;
+  D_float.resize(6,D.cols());
+  D_act.resize(nu,D.cols());
+  if (nc>0) {
+    xlimp << xcom.topRows(2),J_xy*qdvec;
+    x_bar = xlimp-input.x0;
+
+    D_float = D.topRows(6);
+    D_act = D.bottomRows(nu);
+  }
+
+  int nf = nc*nd; // number of contact force variables
+  int nparams = nq+nf+neps;
+
+  Vector3d kdot_des;
+  if (include_angular_momentum) {
+    Vector3d k = Ak*qdvec;
+    kdot_des = -params.Kp_ang*k; // TODO: parameterize
+  }
+
+  //----------------------------------------------------------------------
+  // QP cost function ----------------------------------------------------
+  //
+  //  min: quad(Jdot*qd + J*qdd,R_ls)+quad(C*x+D*(Jdot*qd + J*qdd),Qy) + (2*x'*S + s1')*(A*x + B*(Jdot*qd + J*qdd)) + w*quad(qddot_ref - qdd) + quad(u,R) + quad(epsilon)
+  VectorXd& f = output.f;
+  f.resize(nparams);
+  {
+    if (nc > 0) {
+      // NOTE: moved Hqp calcs below, because I compute the inverse directly for FastQP (and sparse Hqp for gurobi)
+
+      Vector2d Jdot_xy_qd = Jdot_xy*qdvec;
+      RowVector2d fqp_xy = (input.C_ls*xlimp).transpose()*input.Qy*input.D_ls;
+      fqp_xy += Jdot_xy_qd.transpose()*R_DQyD_ls;
+      fqp_xy += (input.S*x_bar + 0.5*input.s1).transpose()*input.B_ls;
+      fqp_xy -= input.u0.transpose()*R_DQyD_ls;
+      fqp_xy -= input.y0.transpose()*input.Qy*input.D_ls;
+      fqp.noalias() = fqp_xy*J_xy;
+      fqp -= (params.w_qdd.array()*qddot_des.array()).matrix().transpose();
+      if (include_angular_momentum) {
+        Vector3d Akdot_qd = Akdot*qdvec;
+        RowVector3d kdot_err_W = (Akdot_qd - kdot_des).transpose()*params.W_kdot;
+        fqp.noalias() += kdot_err_W*Ak;
+      }
+      f.head(nq) = fqp.transpose();
+     } else {
+      f.head(nq) = -qddot_des;
+    }
+  }
+  f.tail(nf+neps).setZero();
+
+  // add in body spatial equality constraints.  count their rows first, so
+  // that Aeq can be filled in row order
+  Matrix<double,6,1> body_vdot;
+  Vector4d orig(0,0,0,1);
+  int body_idx;
+  int n_body_accel_eq = 0;
+  for (int i=0; i<n_body_accel_inputs; i++) {
+    if (params.body_accel_input_weights(i) < 0 && !inSupport(active_supports,(int)(body_accel_inputs[i][0])-1)) {
+      for (int j=0; j<6; j++)
+        if (!std::isnan(body_accel_inputs[i][j+1])) n_body_accel_eq++;
+    }
+  }
+
+  int neq = 6+neps+n_body_accel_eq+num_condof;
+  SparseMatrix<double,RowMajor>& Aeq = output.Aeq;
+  VectorXd& beq = output.beq;
+  Aeq.resize(neq,nparams);  // keeps the nonzero storage of the last tick
+  beq.setZero(neq);
+
+  // constrained floating base dynamics
+  //  H_float*qdd - J_float'*lambda - Dbar_float*beta = -C_float
+  for (int i=0; i<6; i++) {
+    Aeq.startVec(i);
+    appendNonzeros(Aeq,i,0,H_float.row(i));
+    if (nc>0) appendNonzeros(Aeq,i,nq,D_float.row(i),-1.0);
+  }
+  beq.topRows(6) = -C_float;
+
+  if (nc > 0) {
+    // relative acceleration constraint: Jp*qdd + eps = -Jpdot*qd
+    for (int i=0; i<neps; i++) {
+      Aeq.startVec(6+i);
+      appendNonzeros(Aeq,6+i,0,Jp.row(i));
+      Aeq.insertBack(6+i,nq+nf+i) = 1.0;
+    }
+    // beq.segment(6,neps) = (-Jpdot - 1.0*Jp)*qdvec; // TODO: parameterize
+    beq.segment(6,neps).noalias() = -Jpdot*qdvec; // TODO: parameterize
+  }
+
+  int equality_ind = 6+neps;
+  for (int i=0; i<n_body_accel_inputs; i++) {
+    if (params.body_accel_input_weights(i) < 0) {
+      // negative implies constraint
+      body_vdot = body_accel_inputs[i].bottomRows(6);
+      body_idx = (int)(body_accel_inputs[i][0])-1;
+
+      if (!inSupport(active_supports,body_idx)) {
+        r->forwardJac(body_idx,orig,1,Jb);
+        r->forwardJacDot(body_idx,orig,1,Jbdot);
+
+        for (int j=0; j<6; j++) {
+          if (!std::isnan(body_vdot[j])) {
+            Aeq.startVec(equality_ind);
+            appendNonzeros(Aeq,equality_ind,0,Jb.row(j));
+            beq[equality_ind++] = -Jbdot.row(j).dot(qdvec) + body_vdot[j];
+          }
+        }
+      }
+    }
+  }
+
+  if (num_condof>0) {
+    // add joint acceleration constraints
+    for (int i=0; i<num_condof; i++) {
+      Aeq.startVec(equality_ind);
+      Aeq.insertBack(equality_ind,(int)input.condof[i]-1) = 1.0;
+      beq[equality_ind++] = qddot_des[(int)input.condof[i]-1];
+    }
+  }
+  Aeq.finalize();
+
+  Ain.setZero(2*nu,nparams);  // note: obvious sparsity here
+  bin.setZero(2*nu);
+
+  // linear input saturation constraints
+  // u=B_act'*(H_act*qdd + C_act - Jz_act'*z - Dbar_act*beta)
+  // using transpose instead of inverse because B is orthogonal
+  Ain.topLeftCorner(nu,nq).noalias() = B_act.transpose()*H_act;
+  Ain.block(0,nq,nu,nc*nd).noalias() = -B_act.transpose()*D_act;
+  bin.head(nu) = params.umax;
+  bin.head(nu).noalias() -= B_act.transpose()*C_act;
+
+  Ain.block(nu,0,nu,nparams) = -1*Ain.block(0,0,nu,nparams);
+  bin.segment(nu,nu) = params.umax - params.umin;
+  bin.segment(nu,nu) -= bin.head(nu);
+
+
+  GRBmodel * model = NULL;
+  int info=-1;
+
+  // set obj,lb,up
+  lb.resize(nparams);
+  ub.resize(nparams);
+  lb.head(nq) = -1e3*VectorXd::Ones(nq);
+  ub.head(nq) = 1e3*VectorXd::Ones(nq);
+  lb.segment(nq,nf) = VectorXd::Zero(nf);
+  ub.segment(nq,nf) = 1e3*VectorXd::Ones(nf);
+  lb.tail(neps) = -params.slack_limit*VectorXd::Ones(neps);
+  ub.tail(neps) = params.slack_limit*VectorXd::Ones(neps);
+
+  VectorXd& alpha = output.alpha;
+  alpha.resize(nparams);
+
+  MatrixXd &Hqp = output.Hqp;
+  MatrixXd &Qnfdiag = output.Qnfdiag, &Qneps = output.Qneps;
+  QBlkDiag.resize( nc>0 ? 3 : 1 );  // nq, nf, neps   // this one is for gurobi
+
+  MatrixXd &Ain_lb_ub = output.Ain_lb_ub;
+  VectorXd &bin_lb_ub = output.bin_lb_ub;
+  Ain_lb_ub.resize(2*nu+2*nparams,nparams);
+  bin_lb_ub.resize(2*nu+2*nparams);
+
+  #ifdef USE_MATRIX_INVERSION_LEMMA
+  bool include_body_accel_cost_terms = n_body_accel_inputs > 0 && params.body_accel_input_weights.array().maxCoeff() > 1e-10;
+  if (input.use_fast_qp && !include_angular_momentum && !include_body_accel_cost_terms)
+  {
+    // TODO: update to include angular momentum, body accel objectives.
+
+  	//    We want Hqp inverse, which I can compute efficiently using the
+  	//    matrix inversion lemma (see wikipedia):
+  	//    inv(A + U'CV) = inv(A) - inv(A)*U* inv([ inv(C)+ V*inv(A)*U ]) V inv(A)
+  	if (nc>0) {
+      Wi = (1/(params.w_qdd.array() + REG)).matrix();
+  		if (R_DQyD_ls.trace()>1e-15) { // R_DQyD_ls is not zero
+        // inv(inv(R) + J*Wi*J') = inv(I + R*J*Wi*J')*R, so neither R nor the
+        // 2x2 system gets inverted explicitly
+        Wi_J_xyt.noalias() = Wi.asDiagonal()*J_xy.transpose();
+        Matrix2d J_Wi_Jt;
+        J_Wi_Jt.noalias() = J_xy*Wi_J_xyt;
+        Matrix2d KR = (Matrix2d::Identity() + R_DQyD_ls*J_Wi_Jt).partialPivLu().solve(R_DQyD_ls);
+        G.noalias() = KR*Wi_J_xyt.transpose();
+        Hqp.noalias() = -Wi_J_xyt*G;
+        Hqp.diagonal() += Wi;
+      }
+  	}
+    else {
+    	Hqp = MatrixXd::Constant(nq,1,1/(1+REG));
+  	}
+
+	  #ifdef TEST_FAST_QP
+  	  if (nc>0) {
+        MatrixXd Hqp_test(nq,nq);
+        MatrixXd W = (params.w_qdd.array() + REG).matrix().asDiagonal();
+        Hqp_test = (J_xy.transpose()*R_DQyD_ls*J_xy + W).inverse();
+    	  if (((Hqp_test-Hqp).array().abs()).maxCoeff() > 1e-6) {
+    		  throw runtime_error("Q submatrix inverse from matrix inversion lemma does not match direct Q inverse.");
+        }
+      }
+	  #endif
+
+    Qnfdiag = MatrixXd::Constant(nf,1,1/REG);
+    Qneps = MatrixXd::Constant(neps,1,1/(.001+REG));
+
+    QBlkDiag[0] = &Hqp;
+    if (nc>0) {
+    	QBlkDiag[1] = &Qnfdiag;
+    	QBlkDiag[2] = &Qneps;     // quadratic slack var cost, Q(nparams-neps:end,nparams-neps:end)=eye(neps)
+    }
+
+    Ain_lb_ub << Ain, 			     // note: obvious sparsity here
+    		-MatrixXd::Identity(nparams,nparams),
+    		MatrixXd::Identity(nparams,nparams);
+    bin_lb_ub << bin, -lb, ub;
+
+    info = fastqp.solveThatTakesQinv(QBlkDiag, f, Aeq, beq, Ain_lb_ub, bin_lb_ub, active, alpha);
+
+    if (info<0)  	cerr << "fastQP info = " << info << ".  Calling gurobi." << endl;
+  }
+  else {
+  #endif
+    if (nc>0) {
+      J_xyt_R.noalias() = J_xy.transpose()*R_DQyD_ls;
+      Hqp.noalias() = J_xyt_R*J_xy;
+      if (include_angular_momentum) {
+        Akt_W.noalias() = Ak.transpose()*params.W_kdot;
+        Hqp.noalias() += Akt_W*Ak;
+      }
+      Hqp.diagonal() += params.w_qdd;
+      Hqp.diagonal().array() += REG;
+    } else {
+      Hqp = MatrixXd::Constant(nq,1,1+REG);
+    }
+
+
+    // add in body spatial acceleration cost terms
+    int w_i;
+    for (int i=0; i<n_body_accel_inputs; i++) {
+      w_i=params.body_accel_input_weights(i);
+      if (w_i > 0) {
+        body_vdot = body_accel_inputs[i].bottomRows(6);
+        body_idx = (int)(body_accel_inputs[i][0])-1;
+
+        if (!inSupport(active_supports,body_idx)) {
+          r->forwardJac(body_idx,orig,1,Jb);
+          r->forwardJacDot(body_idx,orig,1,Jbdot);
+
+          for (int j=0; j<6; j++) {
+            if (!std::isnan(body_vdot[j])) {
+              Hqp.noalias() += w_i*(Jb.row(j)).transpose()*Jb.row(j);
+              f.head(nq) += w_i*(Jbdot.row(j).dot(qdvec) - body_vdot[j])*Jb.row(j).transpose();
+            }
+          }
+        }
+      }
+    }
+
+    Qnfdiag = MatrixXd::Constant(nf,1,params.w_grf+REG);
+    Qneps = MatrixXd::Constant(neps,1,params.w_slack+REG);
+
+    QBlkDiag[0] = &Hqp;
+    if (nc>0) {
+      QBlkDiag[1] = &Qnfdiag;
+      QBlkDiag[2] = &Qneps;     // quadratic slack var cost, Q(nparams-neps:end,nparams-neps:end)=eye(neps)
+    }
+
+    Ain_lb_ub << Ain,            // note: obvious sparsity here
+        -MatrixXd::Identity(nparams,nparams),
+        MatrixXd::Identity(nparams,nparams);
+    bin_lb_ub << bin, -lb, ub;
+
+
+    if (input.use_fast_qp)
+    { // set up and call fastqp
+      info = fastqp.solve(QBlkDiag, f, Aeq, beq, Ain_lb_ub, bin_lb_ub, active, alpha);
+      if (info<0)    cerr << "fastQP info=" << info << "... calling Gurobi." << endl;
+    }
+    else {
+      // use gurobi active set
+      model = gurobiActiveSetQP(env,QBlkDiag,f,Aeq,beq,Ain,bin,lb,ub,vbasis,vbasis_len,cbasis,cbasis_len,alpha);
+      CGE(GRBgetintattr(model,"NumVars",&vbasis_len), env);
+      CGE(GRBgetintattr(model,"NumConstrs",&cbasis_len), env);
+      info=66;
+      //info = -1;
+    }
+
+    if (info<0) {
+      model = gurobiQP(env,QBlkDiag,f,Aeq,beq,Ain,bin,lb,ub,active,alpha);
+      int status; CGE(GRBgetintattr(model, "Status", &status), env);
+      if (status!=2) cerr << "Gurobi reports non-optimal status = " << status << endl;
+    }
+  #ifdef USE_MATRIX_INVERSION_LEMMA
+  }
+  #endif
+
+  if (model) {
+    GRBfreemodel(model);
+  }
+
+  //----------------------------------------------------------------------
+  // Solve for inputs ----------------------------------------------------
+  output.info = info;
+  output.qdd = alpha.head(nq);
+
+  // use transpose because B_act is orthogonal
+  tau = C_act;
+  tau.noalias() += H_act*output.qdd;
+  tau.noalias() -= D_act*alpha.segment(nq,nc*nd);
+  output.u.noalias() = B_act.transpose()*tau;
+  //y = B_act.jacobiSvd(ComputeThinU|ComputeThinV).solve(H_act*qdd + C_act - Jz_act.transpose()*lambda - D_act*beta);
+
+  if (nc>0) {
+    // note: Sdot is 0 for ZMP/double integrator dynamics, so we omit that term here
+    Vector2d xy_accel = Jdot_xy*qdvec;
+    xy_accel.noalias() += J_xy*output.qdd;
+    output.Vdot = ((2*x_bar.transpose()*input.S + input.s1.transpose())*(input.A_ls*x_bar + input.B_ls*xy_accel) + input.s1dot.transpose()*x_bar)(0) + input.s2dot;
+  } else {
+    output.Vdot = 0;
+  }
+
+  auto tick_stop = chrono::high_resolution_clock::now();
+  latency.add(chrono::duration_cast<chrono::nanoseconds>(tick_stop-tick_start).count()/1e3);
+}
@@ -0,0 +1,163 @@
+#ifndef _QP_CONTROLLER_H_
+#define _QP_CONTROLLER_H_
+
+/*
+ * The whole-body QP controller behind QPControllermex, usable without MATLAB.
+ * Parameters are set once at construction; every tick takes a
+ * QPControllerInput and fills a QPControllerOutput.  The controller and the
+ * output keep their matrices between ticks, so a caller that reuses one
+ * input and one output per controller does not allocate once the support
+ * configuration settles.
+ */
+
+#include <set>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <Eigen/Dense>
+#include <Eigen/Sparse>
+#include <Eigen/StdVector>
+
+#include "controlUtil.h"
+#include "drake/fastQP.h"
+#include "drake/gurobiQP.h"
+
+// Histogram of tick latencies in 1 us bins up to 10 ms.
+// Slower ticks land in the last bin, but the maximum is kept exactly.
+struct TickLatencyHistogram {
+  static const int num_bins = 10000;
+  std::vector<long> counts;
+  long num_ticks;
+  double max_us;
+
+  TickLatencyHistogram() : counts(num_bins,0), num_ticks(0), max_us(0.0) {}
+
+  void add(double us) {
+    int bin = (int) us;
+    counts[bin<num_bins ? bin : num_bins-1]++;
+    num_ticks++;
+    if (us>max_us) max_us = us;
+  }
+
+  // upper edge of the bin holding the p-th quantile, in microseconds
+  double percentile(double p) const {
+    long target = (long) ceil(p*num_ticks), cumulative = 0;
+    for (int i=0; i<num_bins-1; i++) {
+      cumulative += counts[i];
+      if (cumulative>=target && cumulative>0) return std::min((double)(i+1),max_us);
+    }
+    return max_us;
+  }
+};
+
+struct QPControllerParams {
+  Eigen::MatrixXd B; // input matrix of the robot
+  Eigen::VectorXd umin, umax;
+  Eigen::VectorXd w_qdd; // qdd objective function weight vector
+  Eigen::MatrixXd W_kdot; // quadratic cost for angular momentum rate: (kdot_des - kdot)'*W*(kdot_des - kdot)
+  double w_grf; // scalar ground reaction force weight
+  double w_slack; // scalar slack var weight
+  double slack_limit; // maximum absolute magnitude of acceleration slack variable values
+  double Kp_ang; // angular momentum (k) P gain
+  Eigen::VectorXd body_accel_input_weights; // negative values signal constraints
+  int gurobi_method;
+};
+
+struct QPControllerInput {
+  bool use_fast_qp;
+  Eigen::VectorXd qddot_des;
+  Eigen::VectorXd q, qd;
+  // one [body index (1-based); 6 spatial accelerations] vector per body_accel_input_weights entry
+  std::vector<Eigen::VectorXd,Eigen::aligned_allocator<Eigen::VectorXd>> body_accel_inputs;
+  Eigen::VectorXd condof; // 1-based indices of the joints whose accelerations are constrained to qddot_des
+  std::vector<SupportStateElement> supports;
+
+  // ZMP/LIMP tracking problem
+  Eigen::Matrix4d A_ls;
+  Eigen::Matrix<double,4,2> B_ls;
+  Eigen::Matrix2d Qy, R_ls;
+  Eigen::Matrix<double,2,4> C_ls;
+  Eigen::Matrix2d D_ls;
+  Eigen::Matrix4d S;
+  Eigen::Vector4d s1, s1dot;
+  double s2dot;
+  Eigen::Vector4d x0;
+  Eigen::Vector2d u0, y0;
+
+  double mu;
+  double terrain_height; // nonzero if we're using DRCFlatTerrainMap
+};
+
+struct QPControllerOutput {
+  Eigen::VectorXd u;
+  Eigen::VectorXd qdd;
+  int info;
+  std::vector<int> active_supports; // body indices of the supports in contact
+  double Vdot;
+
+  // the QP that was solved, over [qdd; contact forces; slacks]
+  Eigen::VectorXd alpha;
+  Eigen::MatrixXd Hqp;
+  Eigen::VectorXd f;
+  Eigen::SparseMatrix<double,Eigen::RowMajor> Aeq; // only the structural nonzeros are stored
+  Eigen::VectorXd beq;
+  Eigen::MatrixXd Ain_lb_ub;
+  Eigen::VectorXd bin_lb_ub;
+  Eigen::MatrixXd Qnfdiag, Qneps;
+};
+
+class QPController
+{
+public:
+  // map_ptr is handed to collisionDetect; NULL means flat terrain
+  QPController(RigidBodyManipulator* r, const QPControllerParams& params, void* map_ptr);
+  ~QPController();
+
+  // throws std::runtime_error on bad support inputs
+  void update(const QPControllerInput& input, QPControllerOutput& output);
+
+  const TickLatencyHistogram& getLatency() const { return latency; }
+
+  // contact against a height map instead of map_ptr/input.terrain_height.
+  // the terrain is not copied and has to outlive the controller; NULL goes
+  // back to map_ptr
+  void setTerrain(const HeightMapTerrain* terrain) { height_map = terrain; }
+
+private:
+  RigidBodyManipulator* r;
+  QPControllerParams params;
+  void* map_ptr;
+  const HeightMapTerrain* height_map;
+  Eigen::MatrixXd B_act;
+
+  GRBenv *env;
+  std::set<int> active;
+  FastQPSolver fastqp; // keeps its workspaces between ticks
+  // gurobi active set params
+  int *vbasis;
+  int *cbasis;
+  int vbasis_len;
+  int cbasis_len;
+
+  // per-tick workspaces.  they keep their sizes between ticks, so they only
+  // reallocate when the support configuration (and with it nc) changes
+  Eigen::MatrixXd H, H_float, H_act;
+  Eigen::VectorXd C, C_float, C_act;
+  Eigen::MatrixXd J, Jdot;
+  Eigen::MatrixXd J_xy, Jdot_xy;
+  Eigen::RowVectorXd fqp;
+  Eigen::MatrixXd Ag, Agdot; // centroidal momentum matrix
+  Eigen::MatrixXd Ak, Akdot; // centroidal angular momentum matrix
+  Eigen::MatrixXd Jz, Jp, Jpdot, D, D_float, D_act;
+  Eigen::MatrixXd Jb, Jbdot;
+  Eigen::MatrixXd Ain;
+  Eigen::VectorXd bin, lb, ub, tau;
+  std::vector<Eigen::MatrixXd*> QBlkDiag;
+  Eigen::MatrixXd J_xyt_R, Akt_W; // J_xy'*R_DQyD_ls and Ak'*W_kdot, for Hqp
+  Eigen::VectorXd Wi; // inverse of the diagonal qdd cost, for the matrix inversion lemma
+  Eigen::MatrixXd Wi_J_xyt, G; // Wi*J_xy' and inv(I + R_DQyD_ls*J_xy*Wi*J_xy')*R_DQyD_ls*J_xy*Wi
+
+  TickLatencyHistogram latency;
+};
+
+#endif
@@ -612,6 +612,15 @@ classdef QPController < MIMODrakeSystem
       varargout = {y};
     end
   end
+
+  function stats = getTickLatency(obj)
+    % returns the number of QPControllermex ticks so far and their p50, p99
+    % and max latencies (in seconds)
+    if ~obj.use_mex
+      error('tick latencies are only recorded by QPControllermex');
+    end
+    stats = QPControllermex(obj.mex_ptr.data,'latency');
+  end
   end
 
   properties (SetAccess=private)
@@ -0,0 +1,243 @@
+#include <cmath>
+#include "TimeSteppingSimulator.h"
+
+using namespace std;
+using namespace Eigen;
+
+TimeSteppingSimulator::TimeSteppingSimulator(RigidBodyManipulator* r, double timestep, void* map_ptr, double terrain_height)
+  : timestep(timestep), mu(1.0), active_tol(0.01), r(r), map_ptr(map_ptr), terrain_height(terrain_height), height_map(NULL), nC(0), mC(2*m_surface_tangents)
+{
+  int nq = r->num_dof;
+  free_col.assign(nq,-1);
+  for (int i=0; i<nq; i++) {
+    if (r->joint_limit_min[i] == r->joint_limit_max[i]) continue;
+    free_col[i] = (int) free_dofs.size();
+    free_dofs.push_back(i);
+    if (!std::isinf(r->joint_limit_min[i])) {
+      limit_dofs.push_back(i);
+      limit_signs.push_back(1.0);
+    }
+    if (!std::isinf(r->joint_limit_max[i])) {
+      limit_dofs.push_back(i);
+      limit_signs.push_back(-1.0);
+    }
+  }
+
+  for (int i=1; i<r->num_bodies; i++) {
+    int num_pts = r->bodies[i].contact_pts.cols();
+    if (num_pts == 0) continue;
+    SupportStateElement se;
+    se.body_idx = i;
+    for (int j=0; j<num_pts; j++)
+      se.contact_pt_inds.insert(j);
+    se.contact_surface = -1;  // the terrain
+    contacts.push_back(se);
+    for (int j=0; j<num_pts; j++) {
+      ContactFeature f = {i, se.contact_surface, j};
+      contact_features.push_back(f);
+    }
+    nC += num_pts;
+  }
+
+  limit_impulses = VectorXd::Zero(limit_dofs.size());
+  resetStats();
+}
+
+void TimeSteppingSimulator::resetStats()
+{
+  stats.num_steps = 0;
+  stats.num_lcp_solves = 0;
+  stats.num_resolves = 0;
+  stats.num_warm_starts = 0;
+  stats.num_pivots = 0;
+  stats.num_cached_contacts = 0;
+}
+
+void TimeSteppingSimulator::clearImpulseCache()
+{
+  impulse_cache.clear();
+  limit_impulses.setZero();
+}
+
+void TimeSteppingSimulator::cacheImpulses()
+{
+  int nL = (int) limit_dofs.size();
+  limit_impulses = z.head(nL);
+  for (int k=0; k<nC; k++) {
+    if (z(nL+k) <= 0.0) {
+      impulse_cache.erase(contact_features[k]);
+      continue;
+    }
+    ContactImpulse& impulse = impulse_cache[contact_features[k]];
+    impulse.normal = z(nL+k);
+    impulse.tangent.resize(mC);
+    for (int d=0; d<mC; d++)
+      impulse.tangent[d] = z(nL+nC+k*mC+d);
+    impulse.lambda = z(nL+nC+mC*nC+k);
+  }
+}
+
+bool TimeSteppingSimulator::update(const VectorXd& q, const VectorXd& qd, const VectorXd& tau, VectorXd& qn, VectorXd& qdn)
+{
+  int nq = r->num_dof, nf = (int) free_dofs.size(), nL = (int) limit_dofs.size();
+  int nz = nL + (mC+2)*nC;
+  double h = timestep;
+  double* q_ptr = const_cast<double*>(q.data());
+  double* qd_ptr = const_cast<double*>(qd.data());
+
+  stats.num_steps++;
+  r->doKinematics(q_ptr,false,qd_ptr);
+
+  // Set up the LCP (see TimeSteppingRigidBodyManipulator.m):
+  //   z >= 0, M*z + w >= 0, z'*(M*z + w) = 0
+  // with z = [h*cL; h*cN; h*beta; lambda] and
+  //   J = [JL; n; D; zeros(nC,num_q)]
+  // over the free dofs.  beta and the rows of D are ordered by contact, then
+  // by friction direction.
+  J = MatrixXd::Zero(nz,nf);
+  phiL.resize(nL);
+  for (int k=0; k<nL; k++) {
+    int i = limit_dofs[k];
+    phiL(k) = (limit_signs[k] > 0) ? q(i) - r->joint_limit_min[i] : r->joint_limit_max[i] - q(i);
+    J(k,free_col[i]) = limit_signs[k];
+  }
+  phiC.resize(nC);
+  if (nC > 0) {
+    if (height_map)
+      contactConstraints(r,nC,contacts,*height_map,n,D,Jp,Jpdot);
+    else
+      contactConstraints(r,nC,contacts,map_ptr,n,D,Jp,Jpdot,terrain_height);
+    VectorXd phi;
+    int k = 0;
+    for (vector<SupportStateElement>::iterator iter=contacts.begin(); iter!=contacts.end(); iter++) {
+      int num_pts = height_map ? contactPhi(r,*iter,*height_map,phi) : contactPhi(r,*iter,map_ptr,phi,terrain_height);
+      phiC.segment(k,num_pts) = phi;
+      k += num_pts;
+    }
+    for (int j=0; j<nf; j++) {
+      J.block(nL,j,nC,1) = n.col(free_dofs[j]);
+      J.block(nL+nC,j,mC*nC,1) = D.row(free_dofs[j]).transpose();
+    }
+  }
+
+  H.resize(nq,nq);
+  C.resize(nq);
+  r->HandC(q_ptr,qd_ptr,(MatrixXd*)NULL,H,C,(MatrixXd*)NULL,(MatrixXd*)NULL,(MatrixXd*)NULL);
+  Hf.resize(nf,nf);
+  tauf.resize(nf);
+  qdf.resize(nf);
+  for (int i=0; i<nf; i++) {
+    tauf(i) = tau(free_dofs[i]) - C(free_dofs[i]);
+    qdf(i) = qd(free_dofs[i]);
+    for (int j=0; j<nf; j++)
+      Hf(i,j) = H(free_dofs[i],free_dofs[j]);
+  }
+  Hllt.compute(Hf);
+  if (Hllt.info() != Success)
+    return false;
+  wqdn = qdf + h*Hllt.solve(tauf);
+
+  // s(1:nL+nC) = phi + h*J*qdn and s(beta rows) = D*qdn (the lambda rows of J are zero)
+  w = J*wqdn;
+  w.head(nL+nC) *= h;
+  w.head(nL) += phiL;
+  w.segment(nL,nC) += phiC;
+
+  // the impulses of the last step are the guess for this one
+  z_guess = VectorXd::Zero(nz);
+  z_guess.head(nL) = limit_impulses;
+  for (int k=0; k<nC; k++) {
+    map<ContactFeature,ContactImpulse>::const_iterator cached = impulse_cache.find(contact_features[k]);
+    if (cached == impulse_cache.end()) continue;
+    z_guess(nL+k) = cached->second.normal;
+    for (int d=0; d<mC; d++)
+      z_guess(nL+nC+k*mC+d) = cached->second.tangent[d];
+    z_guess(nL+nC+mC*nC+k) = cached->second.lambda;
+    stats.num_cached_contacts++;
+  }
+
+  // only the constraints that could be hit within one step, or that were
+  // pushing on the last one, go into the LCP
+  active.assign(nz,false);
+  for (int i=0; i<nL+nC; i++) {
+    if (i < nL)
+      active[i] = phiL(i) + h*J.row(i).dot(qdf) < active_tol;
+    else
+      active[i] = phiC(i-nL) + h*J.row(i).dot(qdf) < active_tol;
+    active[i] = active[i] || z_guess(i) > 0.0;
+  }
+  for (int k=0; k<nC; k++) {
+    for (int d=0; d<=mC; d++)  // the friction directions and lambda of contact k follow its normal
+      active[nL+nC+((d<mC) ? k*mC+d : mC*nC+k)] = active[nL+k];
+  }
+
+  bool solved, resolved = false;
+  while (1) {
+    active_ind.clear();
+    for (int i=0; i<nz; i++)
+      if (active[i]) active_ind.push_back(i);
+    int na = (int) active_ind.size();
+
+    // M(active,active) = diag(h or 1)*J_a*inv(H)*J_a' + the friction cone couplings
+    J_active.resize(na,nf);
+    for (int a=0; a<na; a++)
+      J_active.row(a) = J.row(active_ind[a]);
+    Mqdn = Hllt.solve(J_active.transpose());
+    M_active.noalias() = J_active*Mqdn;
+    w_active.resize(na);
+    active_pos.assign(nz,-1);
+    for (int a=0; a<na; a++) {
+      active_pos[active_ind[a]] = a;
+      if (active_ind[a] < nL+nC) M_active.row(a) *= h;
+      w_active(a) = w(active_ind[a]);
+    }
+    for (int k=0; k<nC; k++) {
+      int lambda = active_pos[nL+nC+mC*nC+k];
+      if (lambda < 0) continue;
+      M_active(lambda,active_pos[nL+k]) = mu;
+      for (int d=0; d<mC; d++) {
+        int beta = active_pos[nL+nC+k*mC+d];
+        M_active(beta,lambda) = 1.0;
+        M_active(lambda,beta) = -1.0;
+      }
+    }
+
+    z_active.resize(na);
+    for (int a=0; a<na; a++)
+      z_active(a) = z_guess(active_ind[a]);
+    solved = lcp.solve(M_active,w_active,z_active);
+    stats.num_lcp_solves++;
+    stats.num_pivots += lcp.numPivots();
+    if (lcp.warmStartHit()) stats.num_warm_starts++;
+
+    z = VectorXd::Zero(nz);
+    for (int a=0; a<na; a++)
+      z(active_ind[a]) = z_active(a);
+    dqdn.noalias() = Mqdn*z_active;
+
+    // only worry about the constraints that really matter
+    bool missed = false;
+    for (int i=0; i<nL+nC; i++) {
+      if (active[i] || w(i) + h*J.row(i).dot(dqdn) >= 0) continue;
+      missed = true;
+      active[i] = true;
+      if (i >= nL) {  // add back in the related contact terms
+        int k = i-nL;
+        for (int d=0; d<mC; d++)
+          active[nL+nC+k*mC+d] = true;
+        active[nL+nC+mC*nC+k] = true;
+      }
+    }
+    if (!missed) break;
+    if (!resolved) stats.num_resolves++;
+    resolved = true;
+    z_guess = z;
+  }
+  cacheImpulses();
+
+  qdn = VectorXd::Zero(nq);
+  for (int i=0; i<nf; i++)
+    qdn(free_dofs[i]) = wqdn(i) + dqdn(i);
+  qn = q + h*qdn;
+  return solved;
+}
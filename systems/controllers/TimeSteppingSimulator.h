@@ -0,0 +1,131 @@
+#ifndef _TIME_STEPPING_SIMULATOR_H_
+#define _TIME_STEPPING_SIMULATOR_H_
+
+/*
+ * A native version of TimeSteppingRigidBodyManipulator's update.  Every step
+ * solves the LCP of equation (7) in Anitescu97 for the joint limit and
+ * terrain contact impulses z, then integrates
+ *   qdn = qd + H\(h*(tau - C) + J'*z),  qn = q + h*qdn
+ * with H and C from HandC.  The contacts are the contact_pts of every body
+ * against the terrain of collisionDetect (the map behind map_ptr, flat
+ * ground at terrain_height, or a HeightMapTerrain given to setTerrain), with
+ * the friction cone of contactConstraints.
+ * Dofs whose joint limits coincide (e.g. the fixed joints of a URDF) are held
+ * in place.
+ *
+ * The impulses of every contact are cached from one step to the next, keyed
+ * by the contact (body, the other body or -1 for the terrain, and the index
+ * of the contact point on the body), along with those of the joint limits.
+ * A constraint that was pushing on the last step goes into the active set
+ * even if the velocity test would leave it out, and the LCP is warm started
+ * from the cached impulses, so resting contact is usually resolved with a
+ * single linear solve.
+ */
+
+#include <map>
+#include <vector>
+#include <Eigen/Dense>
+#include <Eigen/Cholesky>
+
+#include "controlUtil.h"
+#include "drake/LCP.h"
+
+struct ContactFeature
+{
+  int body_a;
+  int body_b;   // -1 for the terrain
+  int feature;  // contact point of body_a
+
+  bool operator<(const ContactFeature& other) const {
+    if (body_a != other.body_a) return body_a < other.body_a;
+    if (body_b != other.body_b) return body_b < other.body_b;
+    return feature < other.feature;
+  }
+};
+
+struct ContactImpulse
+{
+  double normal;                // h*cN
+  std::vector<double> tangent;  // h*beta, one per friction direction
+  double lambda;
+};
+
+struct TimeSteppingStats
+{
+  long num_steps;
+  long num_lcp_solves;      // more than one per step when constraints were missed
+  long num_resolves;        // steps that had to re-solve for missed constraints
+  long num_warm_starts;     // lcp solves that the cached impulses got right
+  long num_pivots;
+  long num_cached_contacts; // contacts that were pushing on the step before
+};
+
+class TimeSteppingSimulator
+{
+public:
+  // map_ptr is handed to collisionDetect; NULL means flat terrain
+  TimeSteppingSimulator(RigidBodyManipulator* r, double timestep, void* map_ptr=NULL, double terrain_height=0.0);
+
+  // one step from [q;qd] under the joint torques tau.  returns false if the
+  // mass matrix is not positive definite (qn and qdn are left alone), or if
+  // the LCP could not be solved, in which case the step goes ahead without
+  // any constraint impulses
+  bool update(const Eigen::VectorXd& q, const Eigen::VectorXd& qd, const Eigen::VectorXd& tau, Eigen::VectorXd& qn, Eigen::VectorXd& qdn);
+
+  double timestep;
+  double mu;          // coefficient of friction with the terrain
+  double active_tol;  // constraints that would be closer than this after a step at the current velocity enter the LCP
+
+  // the last step
+  int getNumContacts() const { return nC; }
+  const Eigen::VectorXd& getImpulses() const { return z; }  // [cL; cN; beta; lambda], all times h
+  const LCPSolver& getLCPSolver() const { return lcp; }
+
+  // counts over all the steps since the last reset
+  const TimeSteppingStats& getStats() const { return stats; }
+  void resetStats();
+
+  // forget the cached impulses, e.g. after moving the robot by hand
+  void clearImpulseCache();
+
+  // contact against a height map instead of map_ptr/terrain_height.  the
+  // terrain is not copied and has to outlive the simulator; NULL goes back to
+  // map_ptr
+  void setTerrain(const HeightMapTerrain* terrain) { height_map = terrain; }
+
+private:
+  RigidBodyManipulator* r;
+  void* map_ptr;
+  double terrain_height;
+  const HeightMapTerrain* height_map;
+
+  std::vector<SupportStateElement> contacts;  // every body with contact points, with all of them
+  std::vector<int> free_dofs;                 // the dofs that are not held in place
+  std::vector<int> free_col;                  // column of each dof among the free dofs (-1 if held)
+  std::vector<int> limit_dofs;                // the dof of each joint limit row
+  std::vector<double> limit_signs;            // +1 for a lower limit, -1 for an upper one
+  int nC, mC;                                 // number of contacts and friction directions per contact
+  std::vector<ContactFeature> contact_features;  // the key of each contact
+
+  LCPSolver lcp;
+  TimeSteppingStats stats;
+  std::map<ContactFeature,ContactImpulse> impulse_cache;  // the contacts that were pushing on the last step
+  Eigen::VectorXd limit_impulses;                          // h*cL of the last step
+
+  void cacheImpulses();
+
+  // per-step workspaces
+  Eigen::MatrixXd H, Hf;
+  Eigen::VectorXd C, tauf, qdf;
+  Eigen::LLT<Eigen::MatrixXd> Hllt;
+  Eigen::MatrixXd n, D, Jp, Jpdot;
+  Eigen::VectorXd phiC, phiL;
+  Eigen::MatrixXd J;
+  Eigen::VectorXd wqdn, w, z, z_guess, dqdn;
+  std::vector<bool> active;
+  std::vector<int> active_ind, active_pos;
+  Eigen::MatrixXd J_active, Mqdn, M_active;  // Mqdn = inv(H)*J_active'
+  Eigen::VectorXd w_active, z_active;
+};
+
+#endif
@@ -1,4 +1,13 @@
 #include "controlUtil.h"
+#include <stdexcept>
+#include <sstream>
+
+static void throwBadContactPoint(int pt, int num_pts)
+{
+  std::ostringstream msg;
+  msg << "requesting contact pt " << pt << " but body only has " << num_pts << " pts";
+  throw std::runtime_error(msg.str());
+}
 
 template <typename DerivedA, typename DerivedB>
 void getRows(std::set<int> &rows, MatrixBase<DerivedA> const &M, MatrixBase<DerivedB> &Msub)
@@ -25,21 +34,7 @@ void getCols(std::set<int> &cols, MatrixBase<DerivedA> const &M, MatrixBase<Deri
     Msub.col(i++) = M.col(*iter);
 }
 
-mxArray* myGetProperty(const mxArray* pobj, const char* propname)
-{
-  mxArray* pm = mxGetProperty(pobj,0,propname);
-  if (!pm) mexErrMsgIdAndTxt("DRC:ControlUtil:BadInput","ControlUtil is trying to load object property '%s', but failed.", propname);
-  return pm;
-}
-
-mxArray* myGetField(const mxArray* pobj, const char* propname)
-{
-  mxArray* pm = mxGetField(pobj,0,propname);
-  if (!pm) mexErrMsgIdAndTxt("DRC:ControlUtil:BadInput","ControlUtil is trying to load object field '%s', but failed.", propname);
-  return pm;
-}
-
-bool inSupport(std::vector<SupportStateElement> supports, int body_idx) {
+bool inSupport(const std::vector<SupportStateElement>& supports, int body_idx) {
   for (int i=0; i<supports.size(); i++) {
     if (supports[i].body_idx == body_idx)
       return true;
@@ -91,35 +86,78 @@ void surfaceTangents(const Vector3d & normal, Matrix<double,3,m_surface_tangents
   }
 }
 
-int contactPhi(RigidBodyManipulator* r, SupportStateElement& supp, void *map_ptr, VectorXd &phi, double terrain_height)
+// the terrain point and normal for each of the contact points: from the
+// height map if there is one, otherwise from collisionDetect
+static void terrainContacts(void* map_ptr, const HeightMapTerrain* height_map, double terrain_height, const Matrix3Xd& contact_pos, Matrix3Xd& pos, Matrix3Xd& normal)
+{
+  if (height_map) {
+    height_map->collisionDetect(contact_pos,pos,normal);
+    return;
+  }
+  int N = contact_pos.cols();
+  pos.resize(3,N);
+  normal.resize(3,N);
+  Vector3d pos_k, normal_k;
+  for (int k=0; k<N; k++) {
+    collisionDetect(map_ptr,contact_pos.col(k),pos_k,&normal_k,terrain_height);
+    pos.col(k) = pos_k;
+    normal.col(k) = normal_k;
+  }
+}
+
+// the world positions of the contact points of the supports, in order
+template <typename SupportIterator>
+static int contactPositions(RigidBodyManipulator* r, SupportIterator begin, SupportIterator end, Matrix3Xd& contact_pos)
+{
+  int nc = 0;
+  for (SupportIterator iter=begin; iter!=end; iter++)
+    nc += iter->contact_pt_inds.size();
+  contact_pos.resize(3,nc);
+
+  Vector3d pos; Vector4d tmp;
+  int k = 0;
+  for (SupportIterator iter=begin; iter!=end; iter++) {
+    RigidBody* b = &(r->bodies[iter->body_idx]);
+    for (std::set<int>::const_iterator pt_iter=iter->contact_pt_inds.begin(); pt_iter!=iter->contact_pt_inds.end(); pt_iter++) {
+      if (*pt_iter<0 || *pt_iter>=b->contact_pts.cols()) 
+        throwBadContactPoint(*pt_iter,b->contact_pts.cols());
+      tmp = b->contact_pts.col(*pt_iter);
+      r->forwardKin(iter->body_idx,tmp,0,pos);
+      contact_pos.col(k++) = pos;
+    }
+  }
+  return nc;
+}
+
+static int contactPhi(RigidBodyManipulator* r, SupportStateElement& supp, void *map_ptr, const HeightMapTerrain* height_map, VectorXd &phi, double terrain_height)
 {
-  RigidBody* b = &(r->bodies[supp.body_idx]);
-  int nc = supp.contact_pt_inds.size();
+  Matrix3Xd contact_pos, pos, normal;
+  int nc = contactPositions(r,&supp,&supp+1,contact_pos);
   phi.resize(nc);
 
   if (nc<1) return nc;
 
-  Vector3d contact_pos,pos,posB,normal; Vector4d tmp;
-
-  int i=0;
-  for (std::set<int>::iterator pt_iter=supp.contact_pt_inds.begin(); pt_iter!=supp.contact_pt_inds.end(); pt_iter++) {
-    if (*pt_iter<0 || *pt_iter>=b->contact_pts.cols()) 
-      mexErrMsgIdAndTxt("DRC:ControlUtil:BadInput","requesting contact pt %d but body only has %d pts",*pt_iter,b->contact_pts.cols());
-    
-    tmp = b->contact_pts.col(*pt_iter);
-    r->forwardKin(supp.body_idx,tmp,0,contact_pos);
-    collisionDetect(map_ptr,contact_pos,pos,NULL,terrain_height);
-    pos -= contact_pos;  // now -rel_pos in matlab version
-    
-    phi(i) = pos.norm();
-    if (pos.dot(normal)>0)
+  terrainContacts(map_ptr,height_map,terrain_height,contact_pos,pos,normal);
+  pos -= contact_pos;  // now -rel_pos in matlab version
+  for (int i=0; i<nc; i++) {
+    phi(i) = pos.col(i).norm();
+    if (pos.col(i).dot(normal.col(i))>0)
       phi(i)=-phi(i);
-    i++;
   }
   return nc;
 }
 
-int contactConstraints(RigidBodyManipulator *r, int nc, std::vector<SupportStateElement>& supp, void *map_ptr, MatrixXd &n, MatrixXd &D, MatrixXd &Jp, MatrixXd &Jpdot,double terrain_height)
+int contactPhi(RigidBodyManipulator* r, SupportStateElement& supp, void *map_ptr, VectorXd &phi, double terrain_height)
+{
+  return contactPhi(r,supp,map_ptr,(const HeightMapTerrain*)NULL,phi,terrain_height);
+}
+
+int contactPhi(RigidBodyManipulator* r, SupportStateElement& supp, const HeightMapTerrain& terrain, VectorXd &phi)
+{
+  return contactPhi(r,supp,NULL,&terrain,phi,0.0);
+}
+
+static int contactConstraints(RigidBodyManipulator *r, int nc, std::vector<SupportStateElement>& supp, void *map_ptr, const HeightMapTerrain* height_map, MatrixXd &n, MatrixXd &D, MatrixXd &Jp, MatrixXd &Jpdot,double terrain_height)
 {
   int j, k=0, nq = r->num_dof;
 
@@ -128,20 +166,24 @@ int contactConstraints(RigidBodyManipulator *r, int nc, std::vector<SupportState
   Jp.resize(3*nc,nq);
   Jpdot.resize(3*nc,nq);
   
-  Vector3d contact_pos,pos,posB,normal; Vector4d tmp;
+  Vector3d normal; Vector4d tmp;
   MatrixXd J(3,nq);
   Matrix<double,3,m_surface_tangents> d;
+  Matrix3Xd contact_pos, pos, normals;
+
+  if (nc>0) {
+    // look up the terrain under all of the contact points at once
+    contactPositions(r,supp.begin(),supp.end(),contact_pos);
+    terrainContacts(map_ptr,height_map,terrain_height,contact_pos,pos,normals);
+  }
   
   for (std::vector<SupportStateElement>::iterator iter = supp.begin(); iter!=supp.end(); iter++) {
-    RigidBody* b = &(r->bodies[iter->body_idx]);
     if (nc>0) {
       for (std::set<int>::iterator pt_iter=iter->contact_pt_inds.begin(); pt_iter!=iter->contact_pt_inds.end(); pt_iter++) {
-        if (*pt_iter<0 || *pt_iter>=b->contact_pts.cols()) mexErrMsgIdAndTxt("DRC:ControlUtil:BadInput","requesting contact pt %d but body only has %d pts",*pt_iter,b->contact_pts.cols());
-        tmp = b->contact_pts.col(*pt_iter);
-        r->forwardKin(iter->body_idx,tmp,0,contact_pos);
+        tmp = r->bodies[iter->body_idx].contact_pts.col(*pt_iter);
         r->forwardJac(iter->body_idx,tmp,0,J);
 
-        collisionDetect(map_ptr,contact_pos,pos,&normal,terrain_height);
+        normal = normals.col(k);
         surfaceTangents(normal,d);
 
         n.row(k) = normal.transpose()*J;
@@ -164,8 +206,17 @@ int contactConstraints(RigidBodyManipulator *r, int nc, std::vector<SupportState
   return k;
 }
 
+int contactConstraints(RigidBodyManipulator *r, int nc, std::vector<SupportStateElement>& supp, void *map_ptr, MatrixXd &n, MatrixXd &D, MatrixXd &Jp, MatrixXd &Jpdot,double terrain_height)
+{
+  return contactConstraints(r,nc,supp,map_ptr,(const HeightMapTerrain*)NULL,n,D,Jp,Jpdot,terrain_height);
+}
+
+int contactConstraints(RigidBodyManipulator *r, int nc, std::vector<SupportStateElement>& supp, const HeightMapTerrain& terrain, MatrixXd &n, MatrixXd &D, MatrixXd &Jp, MatrixXd &Jpdot)
+{
+  return contactConstraints(r,nc,supp,NULL,&terrain,n,D,Jp,Jpdot,0.0);
+}
 
-int contactConstraintsBV(RigidBodyManipulator *r, int nc, double mu, std::vector<SupportStateElement>& supp, void *map_ptr, MatrixXd &B, MatrixXd &JB, MatrixXd &Jp, MatrixXd &Jpdot,double terrain_height)
+static int contactConstraintsBV(RigidBodyManipulator *r, int nc, double mu, const std::vector<SupportStateElement>& supp, void *map_ptr, const HeightMapTerrain* height_map, MatrixXd &B, MatrixXd &JB, MatrixXd &Jp, MatrixXd &Jpdot,double terrain_height)
 {
   int j, k=0, nq = r->num_dof;
 
@@ -174,21 +225,25 @@ int contactConstraintsBV(RigidBodyManipulator *r, int nc, double mu, std::vector
   Jp.resize(3*nc,nq);
   Jpdot.resize(3*nc,nq);
   
-  Vector3d contact_pos,pos,posB,normal; Vector4d tmp;
+  Vector3d normal; Vector4d tmp;
   MatrixXd J(3,nq);
   Matrix<double,3,m_surface_tangents> d;
+  Matrix3Xd contact_pos, pos, normals;
   double norm = sqrt(1+mu*mu); // because normals and ds are orthogonal, the norm has a simple form
+
+  if (nc>0) {
+    // look up the terrain under all of the contact points at once
+    contactPositions(r,supp.begin(),supp.end(),contact_pos);
+    terrainContacts(map_ptr,height_map,terrain_height,contact_pos,pos,normals);
+  }
   
-  for (std::vector<SupportStateElement>::iterator iter = supp.begin(); iter!=supp.end(); iter++) {
-    RigidBody* b = &(r->bodies[iter->body_idx]);
+  for (std::vector<SupportStateElement>::const_iterator iter = supp.begin(); iter!=supp.end(); iter++) {
     if (nc>0) {
-      for (std::set<int>::iterator pt_iter=iter->contact_pt_inds.begin(); pt_iter!=iter->contact_pt_inds.end(); pt_iter++) {
-        if (*pt_iter<0 || *pt_iter>=b->contact_pts.cols()) mexErrMsgIdAndTxt("DRC:ControlUtil:BadInput","requesting contact pt %d but body only has %d pts",*pt_iter,b->contact_pts.cols());
-        tmp = b->contact_pts.col(*pt_iter);
-        r->forwardKin(iter->body_idx,tmp,0,contact_pos);
+      for (std::set<int>::const_iterator pt_iter=iter->contact_pt_inds.begin(); pt_iter!=iter->contact_pt_inds.end(); pt_iter++) {
+        tmp = r->bodies[iter->body_idx].contact_pts.col(*pt_iter);
         r->forwardJac(iter->body_idx,tmp,0,J);
 
-        collisionDetect(map_ptr,contact_pos,pos,&normal,terrain_height);
+        normal = normals.col(k);
         surfaceTangents(normal,d);
         for (j=0; j<m_surface_tangents; j++) {
           B.col(2*k*m_surface_tangents+j) = (normal + mu*d.col(j)) / norm; 
@@ -212,5 +267,15 @@ int contactConstraintsBV(RigidBodyManipulator *r, int nc, double mu, std::vector
   return k;
 }
 
+int contactConstraintsBV(RigidBodyManipulator *r, int nc, double mu, const std::vector<SupportStateElement>& supp, void *map_ptr, MatrixXd &B, MatrixXd &JB, MatrixXd &Jp, MatrixXd &Jpdot,double terrain_height)
+{
+  return contactConstraintsBV(r,nc,mu,supp,map_ptr,(const HeightMapTerrain*)NULL,B,JB,Jp,Jpdot,terrain_height);
+}
+
+int contactConstraintsBV(RigidBodyManipulator *r, int nc, double mu, const std::vector<SupportStateElement>& supp, const HeightMapTerrain& terrain, MatrixXd &B, MatrixXd &JB, MatrixXd &Jp, MatrixXd &Jpdot)
+{
+  return contactConstraintsBV(r,nc,mu,supp,NULL,&terrain,B,JB,Jp,Jpdot,0.0);
+}
+
 template void getRows(std::set<int> &, const MatrixBase< MatrixXd > &, MatrixBase< MatrixXd > &);
 template void getCols(std::set<int> &, const MatrixBase< MatrixXd > &, MatrixBase< MatrixXd > &);
@@ -1,7 +1,6 @@
 #ifndef _CONTROL_UTIL_H_
 #define _CONTROL_UTIL_H_
 
-#include <mex.h>
 #define _USE_MATH_DEFINES
 #include <math.h>
 #include <set>
@@ -14,6 +13,7 @@
 #endif
 
 #include "drake/RigidBodyManipulator.h"
+#include "drake/HeightMapTerrain.h"
 
 const int m_surface_tangents = 2;  // number of faces in the friction cone approx
 
@@ -30,13 +30,17 @@ void getRows(std::set<int> &rows, MatrixBase<DerivedA> const &M, MatrixBase<Deri
 template <typename DerivedA, typename DerivedB>
 void getCols(std::set<int> &cols, MatrixBase<DerivedA> const &M, MatrixBase<DerivedB> &Msub);
 
-mxArray* myGetProperty(const mxArray* pobj, const char* propname);
-mxArray* myGetField(const mxArray* pobj, const char* propname);
-bool inSupport(std::vector<SupportStateElement> supports, int body_idx);
+bool inSupport(const std::vector<SupportStateElement>& supports, int body_idx);
 void collisionDetect(void* map_ptr, Vector3d const & contact_pos, Vector3d &pos, Vector3d *normal, double terrain_height);
 void surfaceTangents(const Vector3d & normal, Matrix<double,3,m_surface_tangents> & d);
 int contactPhi(RigidBodyManipulator* r, SupportStateElement& supp, void *map_ptr, VectorXd &phi, double terrain_height);
 int contactConstraints(RigidBodyManipulator *r, int nc, std::vector<SupportStateElement>& supp, void *map_ptr, MatrixXd &n, MatrixXd &D, MatrixXd &Jp, MatrixXd &Jpdot,double terrain_height);
-int contactConstraintsBV(RigidBodyManipulator *r, int nc, double mu, std::vector<SupportStateElement>& supp, void *map_ptr, MatrixXd &B, MatrixXd &JB, MatrixXd &Jp, MatrixXd &Jpdot,double terrain_height);
+int contactConstraintsBV(RigidBodyManipulator *r, int nc, double mu, const std::vector<SupportStateElement>& supp, void *map_ptr, MatrixXd &B, MatrixXd &JB, MatrixXd &Jp, MatrixXd &Jpdot,double terrain_height);
 
-#endif
\ No newline at end of file
+// the same against a height map instead of map_ptr/terrain_height, with one
+// terrain lookup for all of the contact points
+int contactPhi(RigidBodyManipulator* r, SupportStateElement& supp, const HeightMapTerrain& terrain, VectorXd &phi);
+int contactConstraints(RigidBodyManipulator *r, int nc, std::vector<SupportStateElement>& supp, const HeightMapTerrain& terrain, MatrixXd &n, MatrixXd &D, MatrixXd &Jp, MatrixXd &Jpdot);
+int contactConstraintsBV(RigidBodyManipulator *r, int nc, double mu, const std::vector<SupportStateElement>& supp, const HeightMapTerrain& terrain, MatrixXd &B, MatrixXd &JB, MatrixXd &Jp, MatrixXd &Jpdot);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,74 @@
+/*
+ * Drops a URDF model onto flat ground with TimeSteppingSimulator (no input
+ * torques) and reports how much faster than real time the simulation ran.
+ *
+ * usage: simulateURDF urdf_filename [num_steps] [timestep]
+ */
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include "URDFRigidBodyManipulator.h"
+#include "TimeSteppingSimulator.h"
+
+using namespace std;
+
+int main(int argc, char* argv[])
+{
+  if (argc<2) {
+    cerr << "Usage: simulateURDF urdf_filename [num_steps] [timestep]" << endl;
+    return -1;
+  }
+  int num_steps = (argc>2) ? atoi(argv[2]) : 1000;
+  double h = (argc>3) ? atof(argv[3]) : 1e-3;
+
+  URDFRigidBodyManipulator* model = loadURDFfromFile(argv[1]);
+  if (!model) {
+    cerr << "ERROR: Failed to load model from " << argv[1] << endl;
+    return -1;
+  }
+  int nq = model->num_dof;
+  map<string,int>::const_iterator base_z_iter = findWithSuffix(model->dof_map[0],"base_z");
+  if (base_z_iter == model->dof_map[0].end()) {
+    cerr << "ERROR: " << argv[1] << " has no floating base" << endl;
+    delete model;
+    return -1;
+  }
+  int base_z = base_z_iter->second;
+
+  // start with the lowest contact point 10cm above the ground
+  VectorXd q = VectorXd::Zero(nq), qd = VectorXd::Zero(nq), tau = VectorXd::Zero(nq), qn, qdn;
+  model->doKinematics(q.data());
+  double min_z = 0.0;
+  for (int i=1; i<model->num_bodies; i++) {
+    if (model->bodies[i].contact_pts.cols()==0) continue;
+    MatrixXd pts(3,model->bodies[i].contact_pts.cols());
+    model->forwardKin(i,model->bodies[i].contact_pts,0,pts);
+    min_z = min(min_z,pts.row(2).minCoeff());
+  }
+  q(base_z) = 0.1 - min_z;
+
+  TimeSteppingSimulator sim(model,h);
+  long num_failed = 0;
+
+  auto start = chrono::high_resolution_clock::now();
+  for (int k=0; k<num_steps; k++) {
+    if (!sim.update(q,qd,tau,qn,qdn))
+      num_failed++;
+    q = qn;
+    qd = qdn;
+  }
+  auto stop = chrono::high_resolution_clock::now();
+  double wall_time = chrono::duration_cast<chrono::nanoseconds>(stop-start).count()/1e9;
+
+  printf("%s: %d steps of %g s, %d contact points\n", argv[1], num_steps, h, sim.getNumContacts());
+  printf("  simulated %g s in %g s: real-time factor %.2f (%.1f us/step)\n", num_steps*h, wall_time, num_steps*h/wall_time, wall_time*1e6/num_steps);
+  const TimeSteppingStats& stats = sim.getStats();
+  printf("  %ld LCP solves (%ld steps re-solved for missed constraints), %.2f pivots/step\n", stats.num_lcp_solves, stats.num_resolves, (double)stats.num_pivots/num_steps);
+  printf("  %ld warm starts taken, %.1f cached contacts/step, %ld failed steps\n", stats.num_warm_starts, (double)stats.num_cached_contacts/num_steps, num_failed);
+  printf("  final base height %g, speed %g\n", q(base_z), qd.norm());
+
+  bool success = (num_failed == 0) && q.allFinite() && qd.allFinite();
+  delete model;
+  return success ? 0 : 1;
+}
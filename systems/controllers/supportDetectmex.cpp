@@ -1,3 +1,5 @@
+#include <mex.h>
+#include <stdexcept>
 #include "controlUtil.h"
 
 using namespace std;
@@ -104,7 +106,11 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
           contact_bodies.insert((int)se.body_idx); 
         }
       } else {
-        contactPhi(pdata->r,se,pdata->map_ptr,phi,terrain_height);
+        try {
+          contactPhi(pdata->r,se,pdata->map_ptr,phi,terrain_height);
+        } catch (const runtime_error& e) {
+          mexErrMsgIdAndTxt("DRC:supportDetectmex:BadInput","%s",e.what());
+        }
         if (phi.minCoeff()<=contact_threshold || contact_sensor(i)==1) { // any contact below threshold (kinematically) OR contact sensor says yes contact
           active_supports.push_back(se);
           num_active_contact_pts += nc;
@@ -1,5 +1,5 @@
-function distance = collisionRaycast(obj, kinsol, origins, ray_endpoints)
-% function distance = collisionRaycast(obj,kinsol, origin, point_on_ray)
+function [distance, normal, body_idx] = collisionRaycast(obj, kinsol, origins, ray_endpoints)
+% function [distance, normal, body_idx] = collisionRaycast(obj,kinsol, origin, point_on_ray)
 %
 % Uses bullet to perform a raycast, returning the distance or -1 on no hit. 
 %
@@ -15,6 +15,8 @@ function distance = collisionRaycast(obj, kinsol, origins, ray_endpoints)
 %
 % @retval distance distance to the nearest hit on the ray, or -1 on no
 %    collision.
+% @retval normal 3 x N surface normals at the hits (zero on no collision)
+% @retval body_idx index of the body that was hit, or 0 on no collision
 
 checkDependency('bullet');
 
@@ -33,4 +35,4 @@ if (kinsol.mex ~= true)
     'Call doKinematics using mex before proceeding (got kinsol.mex ~= true).');
 end
 
-distance = collisionRaycastmex(obj.mex_model_ptr, origins, ray_endpoints);
\ No newline at end of file
+[distance, normal, body_idx] = collisionRaycastmex(obj.mex_model_ptr, origins, ray_endpoints);
\ No newline at end of file
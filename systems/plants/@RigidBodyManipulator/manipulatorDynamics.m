@@ -207,7 +207,7 @@ else
     dC(:,m.NB+1:end) = dC(:,m.NB+1:end) + diag(m.damping);
     
     ind = find(abs(qd)<m.coulomb_window');
-    dind = sign(qd(ind))./m.coulomb_window(ind)' .* m.coulomb_friction(ind)';
+    dind = 1./m.coulomb_window(ind)' .* m.coulomb_friction(ind)';
     fc_drv = zeros(m.NB,1);
     fc_drv(ind) =dind;
     dC(:,m.NB+1:end) = dC(:,m.NB+1:end)+ diag(fc_drv);
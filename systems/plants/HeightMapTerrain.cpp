@@ -0,0 +1,112 @@
+#include <cmath>
+#include <algorithm>
+#include <iostream>
+#include "HeightMapTerrain.h"
+
+using namespace std;
+using namespace Eigen;
+
+HeightMapTerrain::HeightMapTerrain(const MatrixXd& heights, double x0, double y0, double dx, double dy, Interpolation interpolation)
+  : interpolation(interpolation), heights(heights), x0(x0), y0(y0), dx(dx), dy(dy)
+{
+  if (heights.rows() < 1 || heights.cols() < 1 || dx <= 0.0 || dy <= 0.0) {
+    cerr << "HeightMapTerrain: needs at least one height and positive grid spacings" << endl;
+    this->heights = MatrixXd::Zero(2,2);
+    this->dx = this->dy = 1.0;
+  }
+  // a single row or column is a terrain that is constant along that axis
+  if (this->heights.rows() == 1)
+    this->heights = this->heights.replicate(2,1).eval();
+  if (this->heights.cols() == 1)
+    this->heights = this->heights.replicate(1,2).eval();
+
+  // central differences inside the grid, one-sided ones at its border
+  int m = rows(), n = cols();
+  hx.resize(m,n);
+  hy.resize(m,n);
+  hxy.resize(m,n);
+  for (int i=0; i<m; i++) {
+    int ip = min(i+1,m-1), im = max(i-1,0);
+    for (int j=0; j<n; j++) {
+      int jp = min(j+1,n-1), jm = max(j-1,0);
+      hx(i,j) = (this->heights(ip,j) - this->heights(im,j))/(ip-im);
+      hy(i,j) = (this->heights(i,jp) - this->heights(i,jm))/(jp-jm);
+      hxy(i,j) = (this->heights(ip,jp) - this->heights(ip,jm) - this->heights(im,jp) + this->heights(im,jm))/((ip-im)*(jp-jm));
+    }
+  }
+}
+
+void HeightMapTerrain::locate(double x, double y, int& i, int& j, double& tx, double& ty) const
+{
+  double u = (x - x0)/dx, v = (y - y0)/dy;
+  u = min(max(u,0.0),(double)(rows()-1));
+  v = min(max(v,0.0),(double)(cols()-1));
+  i = min((int) u,rows()-2);
+  j = min((int) v,cols()-2);
+  tx = u - i;
+  ty = v - j;
+}
+
+double HeightMapTerrain::interpolate(int i, int j, double tx, double ty, double& dzdx, double& dzdy) const
+{
+  double z00 = heights(i,j), z10 = heights(i+1,j), z01 = heights(i,j+1), z11 = heights(i+1,j+1);
+
+  if (interpolation == BILINEAR) {
+    double a = z10 - z00, b = z01 - z00, c = z00 - z10 - z01 + z11;
+    dzdx = (a + c*ty)/dx;
+    dzdy = (b + c*tx)/dy;
+    return z00 + a*tx + b*ty + c*tx*ty;
+  }
+
+  // bicubic hermite patch: z = X'*C*F*C'*Y with X = [1 tx tx^2 tx^3] and
+  // Y = [1 ty ty^2 ty^3], F the values and derivatives at the corners
+  static const Matrix4d C = (Matrix4d() << 1,0,0,0, 0,0,1,0, -3,3,-2,-1, 2,-2,1,1).finished();
+  Matrix4d F;
+  F << z00, z01, hy(i,j), hy(i,j+1),
+       z10, z11, hy(i+1,j), hy(i+1,j+1),
+       hx(i,j), hx(i,j+1), hxy(i,j), hxy(i,j+1),
+       hx(i+1,j), hx(i+1,j+1), hxy(i+1,j), hxy(i+1,j+1);
+  Matrix4d A = C*F*C.transpose();
+  Vector4d X(1,tx,tx*tx,tx*tx*tx), Y(1,ty,ty*ty,ty*ty*ty);
+  Vector4d dX(0,1,2*tx,3*tx*tx), dY(0,1,2*ty,3*ty*ty);
+  Vector4d AY = A*Y;
+  dzdx = dX.dot(AY)/dx;
+  dzdy = X.dot(A*dY)/dy;
+  return X.dot(AY);
+}
+
+double HeightMapTerrain::getHeight(double x, double y) const
+{
+  int i, j;
+  double tx, ty, dzdx, dzdy;
+  locate(x,y,i,j,tx,ty);
+  return interpolate(i,j,tx,ty,dzdx,dzdy);
+}
+
+double HeightMapTerrain::getHeight(double x, double y, Vector3d& normal) const
+{
+  int i, j;
+  double tx, ty, dzdx, dzdy;
+  locate(x,y,i,j,tx,ty);
+  double z = interpolate(i,j,tx,ty,dzdx,dzdy);
+  // the terrain does not change past its border, so it is flat out there
+  if ((x - x0)/dx < 0.0 || (x - x0)/dx > rows()-1) dzdx = 0.0;
+  if ((y - y0)/dy < 0.0 || (y - y0)/dy > cols()-1) dzdy = 0.0;
+  normal << -dzdx, -dzdy, 1.0;
+  normal.normalize();
+  return z;
+}
+
+void HeightMapTerrain::collisionDetect(const Matrix3Xd& pts, Matrix3Xd& pos, Matrix3Xd& normal) const
+{
+  int N = (int) pts.cols();
+  pos.resize(3,N);
+  normal.resize(3,N);
+  Vector3d normal_k;
+  for (int k=0; k<N; k++) {
+    pos(0,k) = pts(0,k);
+    pos(1,k) = pts(1,k);
+    pos(2,k) = getHeight(pts(0,k),pts(1,k),normal_k);
+    normal.col(k) = normal_k;
+  }
+}
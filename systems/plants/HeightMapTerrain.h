@@ -0,0 +1,50 @@
+#ifndef _HEIGHTMAPTERRAIN_H_
+#define _HEIGHTMAPTERRAIN_H_
+
+#include <Eigen/Dense>
+
+/*
+ * Terrain given by its height on a regular grid, like
+ * RigidBodyHeightMapTerrain.m, for the contact queries of the controllers and
+ * the time-stepping simulator.  heights(i,j) is the height of the terrain at
+ *   x = x0 + i*dx,  y = y0 + j*dy
+ * (the grid is aligned with the world x and y axes).  Between the grid points
+ * the height is interpolated bilinearly, or with bicubic Hermite patches that
+ * are C1 across the cells; outside the grid the border values continue.
+ *
+ * The slopes at the grid points (for the bicubic patches) are computed once in
+ * the constructor, so a height and normal query only reads the four corners of
+ * the cell it falls in.  The normal is that of the interpolated surface.
+ */
+class HeightMapTerrain
+{
+public:
+  enum Interpolation { BILINEAR, BICUBIC };
+
+  HeightMapTerrain(const Eigen::MatrixXd& heights, double x0, double y0, double dx, double dy, Interpolation interpolation=BILINEAR);
+
+  double getHeight(double x, double y) const;
+  double getHeight(double x, double y, Eigen::Vector3d& normal) const;
+
+  // the terrain point below (or above) each column of pts, and the terrain
+  // normal there.  this is what controlUtil's collisionDetect reports for the
+  // other kinds of terrain, with one call for all of the contact points
+  void collisionDetect(const Eigen::Matrix3Xd& pts, Eigen::Matrix3Xd& pos, Eigen::Matrix3Xd& normal) const;
+
+  int rows() const { return (int) heights.rows(); }
+  int cols() const { return (int) heights.cols(); }
+
+  Interpolation interpolation;
+
+private:
+  // the cell that (x,y) falls in and the position inside it (in [0,1]^2)
+  void locate(double x, double y, int& i, int& j, double& tx, double& ty) const;
+  // height and slope (per unit x and y) inside cell (i,j)
+  double interpolate(int i, int j, double tx, double ty, double& dzdx, double& dzdy) const;
+
+  Eigen::MatrixXd heights;
+  Eigen::MatrixXd hx, hy, hxy;  // derivatives at the grid points, per grid step
+  double x0, y0, dx, dy;
+};
+
+#endif // _HEIGHTMAPTERRAIN_H_
@@ -0,0 +1,120 @@
+#include "RigidBodyManipulator.h"
+
+using namespace std;
+using namespace Eigen;
+
+KinematicsCache::KinematicsCache(void)
+  : kinematicsInit(false), secondDerivativesCached(false), num_queries(0), num_query_hits(0), num_query_misses(0)
+{
+}
+
+KinematicsCache::KinematicsCache(const RigidBodyManipulator& model)
+  : kinematicsInit(false), secondDerivativesCached(false), num_queries(0), num_query_hits(0), num_query_misses(0)
+{
+  resize(model);
+}
+
+void KinematicsCache::resize(const RigidBodyManipulator& model)
+{
+  int num_dof = model.num_dof, NB = model.NB, num_bodies = model.num_bodies;
+
+  T.resize(num_bodies);
+  Tdot.resize(num_bodies);
+  dTdq.resize(num_bodies);
+  dTdqdot.resize(num_bodies);
+  ddTdqdq.resize(num_bodies);
+  for (int i=0; i<num_bodies; i++) {
+    int m = model.bodies[i].ancestor_dof_list.size();
+    T[i] = Matrix4d::Identity();
+    Tdot[i] = Matrix4d::Zero();
+    dTdq[i] = MatrixXd::Zero(3*m,4);
+    dTdqdot[i] = MatrixXd::Zero(3*m,4);
+    ddTdqdq[i] = MatrixXd::Zero(3*m*m,4);
+  }
+
+  q = VectorXd::Zero(num_dof);
+  qd = VectorXd::Zero(num_dof);
+  kinematicsInit = false;
+  secondDerivativesCached = false;
+  queries.clear();
+  num_queries = 0;
+
+  S.assign(NB,Vector6d::Zero());
+  Xup.assign(NB,PluckerTransform());
+  v.assign(NB,Vector6d::Zero());
+  avp.assign(NB,Vector6d::Zero());
+  fvp.assign(NB,Vector6d::Zero());
+  IC.assign(NB,Matrix6d::Zero());
+  U.assign(NB,Vector6d::Zero());
+  D = VectorXd::Zero(NB);
+  u = VectorXd::Zero(NB);
+
+  dXupdq.assign(NB,Matrix6d::Zero());
+  dIC.resize(NB);
+  for (int i=0; i<NB; i++)
+    dIC[i].assign(NB,Matrix6d::Zero());
+
+  // don't need to resize dcross (it gets resized in dcrm)
+  dvdq.assign(NB,MatrixXd::Zero(6,num_dof));
+  dvdqd.assign(NB,MatrixXd::Zero(6,num_dof));
+  davpdq.assign(NB,MatrixXd::Zero(6,num_dof));
+  davpdqd.assign(NB,MatrixXd::Zero(6,num_dof));
+  dfvpdq.assign(NB,MatrixXd::Zero(6,num_dof));
+  dfvpdqd.assign(NB,MatrixXd::Zero(6,num_dof));
+  dvJdqd_mat = MatrixXd::Zero(6,num_dof);
+
+  bc = Vector3d::Zero();
+  bJ = MatrixXd::Zero(3,num_dof);
+
+  Ic.assign(NB,Matrix6d::Zero());
+  dIc.assign(NB,Matrix6d::Zero());
+  phi.assign(NB,Vector6d::Zero());
+  Xworld.assign(NB,Matrix6d::Zero());
+  dXworld.assign(NB,Matrix6d::Zero());
+  dXup.assign(NB,Matrix6d::Zero());
+
+  Xg = Matrix6d::Zero();
+  dXg = Matrix6d::Zero();
+  Xcom = Matrix6d::Zero();
+  Jcom = MatrixXd::Zero(3,num_dof);
+  dXcom = Matrix6d::Zero();
+  dXidq = Matrix6d::Zero();
+}
+
+bool KinematicsCache::isValid(const double* q, bool b_compute_second_derivatives) const
+{
+  if (!kinematicsInit) return false;
+  if (b_compute_second_derivatives && !secondDerivativesCached) return false;
+  for (int i = 0; i < this->q.size(); i++) {
+    if (q[i] - this->q[i] > 1e-8 || q[i] - this->q[i] < -1e-8)
+      return false;
+  }
+  return true;
+}
+
+const MatrixXd* KinematicsCache::findQuery(KinematicQueryKind kind, int body_or_frame_ind, const MatrixXd& pts, int rotation_type, const set<int>& robotnum)
+{
+  for (int i = 0; i < num_queries; i++) {
+    const KinematicQuery& query = queries[i];
+    if (query.kind == kind && query.body_or_frame_ind == body_or_frame_ind && query.rotation_type == rotation_type &&
+        query.pts.rows() == pts.rows() && query.pts.cols() == pts.cols() && query.pts == pts && query.robotnum == robotnum) {
+      num_query_hits++;
+      return &query.result;
+    }
+  }
+  num_query_misses++;
+  return NULL;
+}
+
+MatrixXd& KinematicsCache::addQuery(KinematicQueryKind kind, int body_or_frame_ind, const MatrixXd& pts, int rotation_type, const set<int>& robotnum)
+{
+  if (num_queries == static_cast<int>(queries.size()))
+    queries.push_back(KinematicQuery());
+  KinematicQuery& query = queries[num_queries++];
+  query.kind = kind;
+  query.body_or_frame_ind = body_or_frame_ind;
+  query.rotation_type = rotation_type;
+  query.robotnum = robotnum;
+  query.pts = pts;
+  return query.result;
+}
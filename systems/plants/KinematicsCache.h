@@ -0,0 +1,124 @@
+#ifndef _KINEMATICSCACHE_H_
+#define _KINEMATICSCACHE_H_
+
+#include <vector>
+#include <set>
+#include <Eigen/Dense>
+#include <Eigen/StdVector>
+
+#include "SpatialAlgebra.h"
+
+class RigidBodyManipulator;
+
+/*
+ * Everything RigidBodyManipulator computes for a particular state (q,qd): the
+ * kinematics of every rigid body, and the workspaces of the dynamics and
+ * center-of-mass routines.  The manipulator itself only holds the model, so
+ * one manipulator can be evaluated from several threads at once as long as
+ * each thread uses its own cache.
+ *
+ * A cache belongs to the manipulator it was created for, and must be created
+ * (or resized) after that manipulator has been compiled.
+ */
+class KinematicsCache {
+public:
+  KinematicsCache(void);
+  KinematicsCache(const RigidBodyManipulator& model);
+
+  void resize(const RigidBodyManipulator& model);
+
+  // true if the kinematics stored here were computed at q (and include the second derivatives, if those are requested)
+  bool isValid(const double* q, bool b_compute_second_derivatives) const;
+
+  // kinematics of each rigid body
+  /*
+   * the gradients are stored only with respect to the body's ancestor dofs (m = bodies[i].ancestor_dof_list.size()):
+   *   dTdq[i] = [dT(1,:)dqa1; dT(1,:)dqa2; ...; dT(1,:)dqam; dT(2,:)dqa1 ...]   (3*m x 4)
+   *   ddTdqdq[i] = [d(dTdq)dqa1; d(dTdq)dqa2; ...]   (3*m*m x 4)
+   * where qak = q(ancestor_dof_list[k]).  all other derivatives are structurally zero.
+   */
+  std::vector<Eigen::Matrix4d,Eigen::aligned_allocator<Eigen::Matrix4d> > T;
+  std::vector<Eigen::MatrixXd> dTdq;
+  std::vector<Eigen::MatrixXd> dTdqdot;
+  std::vector<Eigen::Matrix4d,Eigen::aligned_allocator<Eigen::Matrix4d> > Tdot;
+  std::vector<Eigen::MatrixXd> ddTdqdq;
+
+  Eigen::VectorXd q, qd;  // the state the kinematics above were computed at
+  bool kinematicsInit;
+  bool secondDerivativesCached;
+
+  /*
+   * results of the *Cached queries of RigidBodyManipulator at the state above,
+   * keyed on (kind, body or frame, points, rotation_type, robotnum), so that
+   * several constraints asking for the same body's kinematics at one state share
+   * one evaluation.  doKinematics empties the list whenever it computes a new
+   * state (the entries beyond num_queries are kept to reuse their storage).
+   */
+  enum KinematicQueryKind { FORWARD_KIN, FORWARD_JAC, COM, COM_JAC };
+  struct KinematicQuery {
+    KinematicQueryKind kind;
+    int body_or_frame_ind;
+    int rotation_type;
+    std::set<int> robotnum;
+    Eigen::MatrixXd pts;
+    Eigen::MatrixXd result;
+  };
+  std::vector<KinematicQuery> queries;
+  int num_queries;
+  long num_query_hits, num_query_misses;  // running totals, the caller may reset them
+
+  // the stored result of the query, or NULL (counts a hit or a miss)
+  const Eigen::MatrixXd* findQuery(KinematicQueryKind kind, int body_or_frame_ind, const Eigen::MatrixXd& pts, int rotation_type, const std::set<int>& robotnum);
+  // a new entry for the query, the caller fills in its result
+  Eigen::MatrixXd& addQuery(KinematicQueryKind kind, int body_or_frame_ind, const Eigen::MatrixXd& pts, int rotation_type, const std::set<int>& robotnum);
+
+  // variables for featherstone dynamics (fixed-size, so that HandC does not allocate)
+  std::vector<Vector6d,Eigen::aligned_allocator<Vector6d> > S;
+  std::vector<PluckerTransform> Xup;
+  std::vector<Vector6d,Eigen::aligned_allocator<Vector6d> > v;
+  std::vector<Vector6d,Eigen::aligned_allocator<Vector6d> > avp;
+  std::vector<Vector6d,Eigen::aligned_allocator<Vector6d> > fvp;
+  std::vector<Matrix6d,Eigen::aligned_allocator<Matrix6d> > IC;
+
+  // variables for articulated-body forward dynamics (IC and fvp double as the articulated inertias and bias forces)
+  std::vector<Vector6d,Eigen::aligned_allocator<Vector6d> > U;
+  Eigen::VectorXd D, u;
+
+  //Variables for gradient calculations
+  std::vector<Matrix6d,Eigen::aligned_allocator<Matrix6d> > dXupdq;
+  std::vector<std::vector<Matrix6d,Eigen::aligned_allocator<Matrix6d> > > dIC;
+
+  std::vector<Eigen::MatrixXd> dvdq;
+  std::vector<Eigen::MatrixXd> dvdqd;
+  std::vector<Eigen::MatrixXd> davpdq;
+  std::vector<Eigen::MatrixXd> davpdqd;
+  std::vector<Eigen::MatrixXd> dfvpdq;
+  std::vector<Eigen::MatrixXd> dfvpdqd;
+  Eigen::MatrixXd dvJdqd_mat;
+  Eigen::MatrixXd dcross;
+
+  // preallocate for COM functions
+  Eigen::Vector3d bc;
+  Eigen::VectorXd dbcdq;
+  Eigen::MatrixXd bJ;
+
+  // preallocate for CMM function
+  Matrix6d Xg; // spatial centroidal projection matrix
+  Matrix6d dXg;  // dXg_dq * qd
+  std::vector<Matrix6d,Eigen::aligned_allocator<Matrix6d> > Ic; // body spatial inertias
+  std::vector<Matrix6d,Eigen::aligned_allocator<Matrix6d> > dIc; // derivative of body spatial inertias
+  std::vector<Vector6d,Eigen::aligned_allocator<Vector6d> > phi; // joint axis vectors
+  std::vector<Matrix6d,Eigen::aligned_allocator<Matrix6d> > Xworld; // spatial transforms from world to each body
+  std::vector<Matrix6d,Eigen::aligned_allocator<Matrix6d> > dXworld; // dXworld_dq * qd
+  std::vector<Matrix6d,Eigen::aligned_allocator<Matrix6d> > dXup; // dXup_dq * qd
+  Matrix6d Xcom; // spatial transform from centroid to world
+  Eigen::MatrixXd Jcom;
+  Matrix6d dXcom;
+  PluckerTransform Xi;
+  Matrix6d dXidq;
+
+public:
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+#endif // _KINEMATICSCACHE_H_
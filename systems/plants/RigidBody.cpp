@@ -1,5 +1,6 @@
 
 #include "RigidBodyManipulator.h"
+#include <algorithm>
 
 using namespace std;
 
@@ -12,70 +13,37 @@ RigidBody::RigidBody(void)
 	mass = 0.0;
 	floating = 0;
 	com << Vector3d::Zero(), 1;
-	T = Matrix4d::Identity();
-	Tdot = Matrix4d::Zero();
 	Ttree = Matrix4d::Identity();
 	T_body_to_joint = Matrix4d::Identity();
 }
 
-void RigidBody::setN(int n) {
-  dTdq = MatrixXd::Zero(3*n,4);
-  dTdqdot = MatrixXd::Zero(3*n,4);
-  ddTdqdq = MatrixXd::Zero(3*n*n,4);
-}
-
 void RigidBody::computeAncestorDOFs(RigidBodyManipulator* model)
 {
+  ancestor_dof_list.clear();
+  parent_ancestor_inds.clear();
+  joint_ancestor_inds.clear();
+
   if (dofnum>=0) {
-    int i,j;
+    int j;
     if (parent>=0) {
       ancestor_dofs = model->bodies[parent].ancestor_dofs;
-      ddTdqdq_nonzero_rows = model->bodies[parent].ddTdqdq_nonzero_rows;
     }
 
-    if (floating==1) {
-    	for (j=0; j<6; j++) {
-    		ancestor_dofs.insert(dofnum+j);
-    		for (i=0; i<3*model->NB; i++) {
-    			ddTdqdq_nonzero_rows.insert(i*model->NB + dofnum + j);
-    			ddTdqdq_nonzero_rows.insert(3*model->NB*dofnum + i + j);
-    		}
-    	}
-    } else if (floating==2) {
-    	for (j=0; j<7; j++) {
-    		ancestor_dofs.insert(dofnum+j);
-    		for (i=0; i<3*model->NB; i++) {
-    			ddTdqdq_nonzero_rows.insert(i*model->NB + dofnum + j);
-    			ddTdqdq_nonzero_rows.insert(3*model->NB*dofnum + i + j);
-    		}
-    	}
-    }
-    else {
-    	ancestor_dofs.insert(dofnum);
-    	for (i=0; i<3*model->NB; i++) {
-    		ddTdqdq_nonzero_rows.insert(i*model->NB + dofnum);
-    		ddTdqdq_nonzero_rows.insert(3*model->NB*dofnum + i);
-    	}
-    }
+    int num_joint_dofs = 1;
+    if (floating==1) num_joint_dofs = 6;
+    else if (floating==2) num_joint_dofs = 7;
+    for (j=0; j<num_joint_dofs; j++)
+      ancestor_dofs.insert(dofnum+j);
 
+    ancestor_dof_list.assign(ancestor_dofs.begin(),ancestor_dofs.end());
 
-    // compute matrix blocks
-    IndexRange ind;  ind.start=-1; ind.length=0;
-    for (i=0; i<3*model->NB*model->NB; i++) {
-      if (ddTdqdq_nonzero_rows.find(i)!=ddTdqdq_nonzero_rows.end()) {
-        if (ind.start<0) ind.start=i;
-      } else {
-        if (ind.start>=0) {
-          ind.length = i-ind.start;
-          ddTdqdq_nonzero_rows_grouped.insert(ind);
-          ind.start = -1;
-        }
-      }
-    }
-    if (ind.start>=0) {
-      ind.length = i-ind.start;
-      ddTdqdq_nonzero_rows_grouped.insert(ind);
+    // map the parent's (and this joint's) dofs into the compact index space of this body
+    if (parent>=0) {
+      for (vector<int>::const_iterator iter = model->bodies[parent].ancestor_dof_list.begin(); iter != model->bodies[parent].ancestor_dof_list.end(); iter++)
+        parent_ancestor_inds.push_back(lower_bound(ancestor_dof_list.begin(),ancestor_dof_list.end(),*iter) - ancestor_dof_list.begin());
     }
+    for (j=0; j<num_joint_dofs; j++)
+      joint_ancestor_inds.push_back(lower_bound(ancestor_dof_list.begin(),ancestor_dof_list.end(),dofnum+j) - ancestor_dof_list.begin());
   }
 }
 
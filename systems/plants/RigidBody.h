@@ -6,16 +6,6 @@
 #include <set>
 #include <Eigen/StdVector>
 
-class IndexRange {
- public:
-  int start;
-  int length;
-  
-  bool operator<(const IndexRange& other) const {
-    return start<other.start;
-  }
-};
-
 class RigidBodyManipulator;
 
 using namespace Eigen;
@@ -24,7 +14,6 @@ class RigidBody {
 public:
   RigidBody();
 
-  void setN(int n);
   void computeAncestorDOFs(RigidBodyManipulator* model);
 
 public:
@@ -42,14 +31,9 @@ public:
   Matrix4d T_body_to_joint;
 
   std::set<int> ancestor_dofs;
-  std::set<int> ddTdqdq_nonzero_rows;
-  std::set<IndexRange> ddTdqdq_nonzero_rows_grouped;
-
-  Matrix4d T;
-  MatrixXd dTdq;
-  MatrixXd dTdqdot;
-  Matrix4d Tdot;
-  MatrixXd ddTdqdq;
+  std::vector<int> ancestor_dof_list;  // sorted ancestor_dofs; entry k labels column k of the compact gradients in KinematicsCache
+  std::vector<int> parent_ancestor_inds;  // position in ancestor_dof_list of each of the parent's ancestor dofs
+  std::vector<int> joint_ancestor_inds;  // position in ancestor_dof_list of each of this body's own joint dofs
 
   double mass;
   Vector4d com;  // this actually stores [com;1] (because that's what's needed in the kinematics functions)
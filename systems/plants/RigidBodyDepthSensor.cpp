@@ -0,0 +1,126 @@
+#include <cmath>
+#include <limits>
+#include <iostream>
+#include <algorithm>
+#include "RigidBodyDepthSensor.h"
+
+using namespace std;
+using namespace Eigen;
+
+// 16x16 = 256 rays, the size of the chunks that collisionRaycast hands to each
+// thread (edge tiles are cut short, see RigidBodyDepthSensor.h)
+static const int tile_size = 16;
+
+RigidBodyDepthSensor::RigidBodyDepthSensor(RigidBodyManipulator* model, int frame_id, const PinholeIntrinsics& intrinsics, double range, const Matrix4d& T_sensor_to_frame)
+  : model(model), frame_id(frame_id), T_sensor_to_frame(T_sensor_to_frame), range(range), num_rows(0), num_cols(0)
+{
+  if (intrinsics.width < 1 || intrinsics.height < 1 || intrinsics.fx <= 0.0 || intrinsics.fy <= 0.0 || !(range > 0.0) || std::isinf(range)) {
+    cerr << "RigidBodyDepthSensor: needs at least one pixel, positive focal lengths and a finite positive range" << endl;
+    setRays(Matrix3Xd(3,0),VectorXd(0));
+    return;
+  }
+  num_rows = intrinsics.height;
+  num_cols = intrinsics.width;
+
+  Matrix3Xd pixel_directions(3,num_rows*num_cols);
+  VectorXd pixel_depth_scale(num_rows*num_cols);
+  for (int u=0; u<num_cols; u++) {
+    for (int v=0; v<num_rows; v++) {
+      Vector3d direction(1.0, -(u-intrinsics.cx)/intrinsics.fx, -(v-intrinsics.cy)/intrinsics.fy);
+      direction.normalize();
+      pixel_directions.col(v+u*num_rows) = direction;
+      pixel_depth_scale(v+u*num_rows) = direction(0);
+    }
+  }
+  setRays(pixel_directions,pixel_depth_scale);
+}
+
+RigidBodyDepthSensor::RigidBodyDepthSensor(RigidBodyManipulator* model, int frame_id, const DrakeCollision::RayFan& fan)
+  : model(model), frame_id(frame_id), T_sensor_to_frame(Matrix4d::Identity()), range(fan.range),
+    num_rows(fan.num_elevation), num_cols(fan.num_azimuth)
+{
+  if (num_rows < 1 || num_cols < 1 || !(range > 0.0) || std::isinf(range)) {
+    cerr << "RigidBodyDepthSensor: needs at least one ray and a finite positive range" << endl;
+    num_rows = num_cols = 0;
+    setRays(Matrix3Xd(3,0),VectorXd(0));
+    return;
+  }
+  T_sensor_to_frame.topLeftCorner<3,3>() = fan.orientation;
+  T_sensor_to_frame.topRightCorner<3,1>() = fan.origin;
+
+  // the same fan at the sensor origin with unit range gives the directions
+  DrakeCollision::RayFan unit_fan(fan);
+  unit_fan.origin.setZero();
+  unit_fan.orientation.setIdentity();
+  unit_fan.range = 1.0;
+  Matrix3Xd fan_origins, fan_directions;
+  unit_fan.getRays(fan_origins,fan_directions);
+
+  // fan ray i*num_azimuth+j is image row i, column j
+  Matrix3Xd pixel_directions(3,num_rows*num_cols);
+  for (int i=0; i<num_rows; i++)
+    for (int j=0; j<num_cols; j++)
+      pixel_directions.col(i+j*num_rows) = fan_directions.col(i*num_cols+j);
+  setRays(pixel_directions,VectorXd::Ones(num_rows*num_cols));
+}
+
+void RigidBodyDepthSensor::setRays(const Matrix3Xd& pixel_directions, const VectorXd& pixel_depth_scale)
+{
+  int N = (int) pixel_directions.cols();
+  directions.resize(3,N);
+  depth_scale.resize(N);
+  pixel_index.clear();
+  pixel_index.reserve(N);
+  for (int tile_col=0; tile_col<num_cols; tile_col+=tile_size) {
+    for (int tile_row=0; tile_row<num_rows; tile_row+=tile_size) {
+      for (int u=tile_col; u<min(tile_col+tile_size,num_cols); u++) {
+        for (int v=tile_row; v<min(tile_row+tile_size,num_rows); v++) {
+          int k = (int) pixel_index.size();
+          pixel_index.push_back(v+u*num_rows);
+          directions.col(k) = pixel_directions.col(v+u*num_rows);
+          depth_scale(k) = pixel_depth_scale(v+u*num_rows);
+        }
+      }
+    }
+  }
+  distances = VectorXd::Constant(N,-1.0);
+  origin_world.setZero();
+  R_sensor_to_world.setIdentity();
+}
+
+bool RigidBodyDepthSensor::update()
+{
+  MatrixXd T_sensor(T_sensor_to_frame), T_sensor_to_world(3,4);
+  model->forwardKin(frame_id,T_sensor,0,T_sensor_to_world);
+  R_sensor_to_world = T_sensor_to_world.leftCols(3);
+  origin_world = T_sensor_to_world.col(3);
+
+  int N = numRays();
+  origins.resize(3,N);
+  origins.colwise() = origin_world;
+  ray_endpoints.noalias() = (range*R_sensor_to_world)*directions;
+  ray_endpoints.colwise() += origin_world;
+  return model->collisionRaycast(origins,ray_endpoints,distances,NULL,NULL);
+}
+
+void RigidBodyDepthSensor::getDepthImage(MatrixXd& depth) const
+{
+  depth.resize(num_rows,num_cols);
+  for (int k=0; k<numRays(); k++)
+    depth(pixel_index[k]) = (distances(k) < 0.0) ? range : distances(k)*depth_scale(k);
+}
+
+void RigidBodyDepthSensor::getPointCloud(Matrix3Xd& points, bool in_sensor_frame) const
+{
+  int num_hits = (int) (distances.array() >= 0.0).count();
+  points.resize(3,num_hits);
+  int i = 0;
+  for (int k=0; k<numRays(); k++) {
+    if (distances(k) < 0.0) continue;
+    points.col(i++) = distances(k)*directions.col(k);
+  }
+  if (!in_sensor_frame) {
+    points = R_sensor_to_world*points;
+    points.colwise() += origin_world;
+  }
+}
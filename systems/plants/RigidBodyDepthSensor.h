@@ -0,0 +1,85 @@
+#ifndef _RIGIDBODYDEPTHSENSOR_H_
+#define _RIGIDBODYDEPTHSENSOR_H_
+
+#include <vector>
+#include <Eigen/Dense>
+#include "RigidBodyManipulator.h"
+
+/*
+ * A native version of RigidBodyDepthCamera.m and RigidBodyLidar.m: a depth
+ * camera or laser scanner attached to a body or frame of the model, which
+ * casts all of its rays against the collision model with the batched
+ * RigidBodyManipulator::collisionRaycast.
+ *
+ * The sensor looks along the +x axis of its frame, with y to the left and z
+ * up, like the MATLAB sensors.  The rays are generated once, in the sensor
+ * frame, in the constructor; update() only moves them to the pose of the
+ * frame in the last doKinematics.  They are cast in 16x16 pixel tiles, so
+ * that each chunk of rays that the raycast hands to a thread covers a compact
+ * patch of the image, and with it a small part of the collision world.
+ *
+ * The tiles along the right and bottom edges are cut short when the image
+ * size is not a multiple of 16, and they are not padded.  The tiles after the
+ * first short one then no longer line up with the 256 ray chunks, so a chunk
+ * spans the end of one tile and the start of the next.  That only costs some
+ * locality, the results are the same.  A laser fan with a single elevation is
+ * one row of 16 ray tiles, so a chunk covers 256 consecutive azimuths.
+ */
+struct PinholeIntrinsics {
+  int width, height;  // in pixels
+  double fx, fy;      // focal lengths, in pixels
+  double cx, cy;      // principal point, in pixels (column, row)
+};
+
+class RigidBodyDepthSensor
+{
+public:
+  // a pinhole depth camera.  pixel (row v, column u) looks along
+  //   [1; -(u-cx)/fx; -(v-cy)/fy]
+  // in the sensor frame, and its depth is measured along the sensor x axis
+  RigidBodyDepthSensor(RigidBodyManipulator* model, int frame_id, const PinholeIntrinsics& intrinsics, double range,
+                       const Eigen::Matrix4d& T_sensor_to_frame = Eigen::Matrix4d::Identity());
+
+  // a laser scanner sweeping fan, whose origin and orientation are relative
+  // to the frame.  the image has a row per elevation and a column per
+  // azimuth, and its depth is the distance along the ray
+  RigidBodyDepthSensor(RigidBodyManipulator* model, int frame_id, const DrakeCollision::RayFan& fan);
+
+  // casts all of the rays from the pose of the frame in the last
+  // doKinematics.  returns false if the collision model could not raycast
+  bool update();
+
+  // the results of the last update.  rays with no hit within range read
+  // range in the depth image (as in RigidBodyDepthCamera.m) and are left out
+  // of the point cloud
+  void getDepthImage(Eigen::MatrixXd& depth) const;
+  void getPointCloud(Eigen::Matrix3Xd& points, bool in_sensor_frame=false) const;
+  const Eigen::VectorXd& getDistances() const { return distances; }  // along each ray, in tile order; -1 on no hit
+
+  int rows() const { return num_rows; }
+  int cols() const { return num_cols; }
+  int numRays() const { return (int) directions.cols(); }
+
+private:
+  // fills in directions, depth_scale and pixel_index from the directions of
+  // the pixels in column-major order
+  void setRays(const Eigen::Matrix3Xd& pixel_directions, const Eigen::VectorXd& pixel_depth_scale);
+
+  RigidBodyManipulator* model;
+  int frame_id;
+  Eigen::Matrix4d T_sensor_to_frame;
+  double range;
+  int num_rows, num_cols;
+
+  Eigen::Matrix3Xd directions;      // unit ray directions in the sensor frame, in tile order
+  Eigen::VectorXd depth_scale;      // depth of a hit per unit distance along each ray
+  std::vector<int> pixel_index;     // column-major image index of each ray
+
+  // from the last update
+  Eigen::Vector3d origin_world;
+  Eigen::Matrix3d R_sensor_to_world;
+  Eigen::Matrix3Xd origins, ray_endpoints;
+  Eigen::VectorXd distances;
+};
+
+#endif // _RIGIDBODYDEPTHSENSOR_H_
@@ -1,12 +1,29 @@
 #ifndef __RIGIDBODYIK_H__
 #define __RIGIDBODYIK_H__
 #include <string>
+#include <memory>
 #include <Eigen/Dense>
 #include <Eigen/StdVector>
 class RigidBodyManipulator;
 class RigidBodyConstraint;
 class IKoptions;
 
+/*
+ * The solvers below keep no state between calls, so separate calls can be made
+ * from different threads, as long as each thread uses its own model (and
+ * constraints constructed on that model), since the constraints evaluate
+ * kinematics through the model.  That makes them safe to call concurrently,
+ * not faster: the bundled SNOPT is not reentrant, so by default each solve
+ * holds a lock for its whole SNOPT call, and the constraint and kinematics
+ * evaluations happen inside that call.  Concurrent solves therefore run one
+ * after another, and only the setup outside SNOPT overlaps.  The solves only
+ * run in parallel when drake is built with SNOPT_REENTRANT against a SNOPT
+ * that keeps all of its state in the workspaces each problem owns (see
+ * systems/plants/CMakeLists.txt).  InverseKinPointwiseSession is the
+ * exception, it keeps its solver state between calls, so a session should
+ * only be used by one thread at a time.
+ */
+
 template <typename DerivedA, typename DerivedB, typename DerivedC>
 void inverseKin(RigidBodyManipulator* model, const Eigen::MatrixBase<DerivedA> &q_seed, const Eigen::MatrixBase<DerivedB> &q_nom, const int num_constraints, RigidBodyConstraint** const constraint_array, Eigen::MatrixBase<DerivedC> &q_sol, int &INFO, std::vector<std::string> &infeasible_constraint, const IKoptions &ikoptions); 
 /*
@@ -47,6 +64,29 @@ void approximateIK(RigidBodyManipulator* model, const Eigen::MatrixBase<DerivedA
  * @param ikoptions  Same as in inverseKin
  */
 
+struct IKSeedStatistics
+{
+  Eigen::VectorXd q_seed;
+  Eigen::VectorXd q_sol;
+  int INFO;             // as in inverseKin, or -1 if the seed was skipped
+  bool cancelled;       // skipped or stopped early because another seed had already succeeded
+  double solve_time;    // wall clock seconds spent solving from this seed
+};
+
+void inverseKinMultiStart(const std::vector<RigidBodyManipulator*> &models, const std::vector<RigidBodyConstraint**> &constraint_arrays, const int num_constraints, const Eigen::MatrixXd &q_seed, const Eigen::VectorXd &q_nom, const int num_random_seeds, Eigen::VectorXd &q_sol, int &INFO, std::vector<std::string> &infeasible_constraint, std::vector<IKSeedStatistics> &seed_statistics, const IKoptions &ikoptions);
+/*
+ * inverseKinMultiStart solves the same problem as inverseKin from several seeds, and skips or stops the remaining solves as soon as one of them succeeds (INFO < 10). The seeds only run in parallel, one thread per model, when drake is built with SNOPT_REENTRANT (see above). Otherwise every solve would hold the SNOPT lock from start to finish, so the seeds are solved one after another on the calling thread, in order, and only models[0] and constraint_arrays[0] are used
+ * @param models    One model per thread. The constraints evaluate kinematics through their model, so each thread needs its own copy of the robot. Without SNOPT_REENTRANT one model is enough
+ * @param constraint_arrays   constraint_arrays[i] holds the same num_constraints constraints as constraint_arrays[0], but constructed on models[i]
+ * @param q_seed    An nq x k double matrix. The user seeds, which are tried first
+ * @param q_nom     Same as in inverseKin
+ * @param num_random_seeds    The number of additional seeds, drawn uniformly within the joint limits of models[0]. Joints without finite limits keep their q_nom value
+ * @return q_sol    The solution of the successful seed that is closest to q_nom. If no seed succeeds, the result of the seed with the fewest infeasible constraints, and of those the one with the lowest INFO
+ * @return INFO, infeasible_constraint     Same as in inverseKin, for the seed that q_sol comes from. INFO = 91 (and q_sol = q_nom) if the arguments are invalid, e.g. there are no seeds
+ * @return seed_statistics    One entry per seed, the user seeds followed by the random ones
+ * @param ikoptions   Same as in inverseKin
+ */
+
 template <typename DerivedA, typename DerivedB, typename DerivedC>
 void inverseKinPointwise(RigidBodyManipulator* model, const int nT, const double* t, const Eigen::MatrixBase<DerivedA> &q_seed, const Eigen::MatrixBase<DerivedB> &q_nom, const int num_constraints, RigidBodyConstraint** const constraint_array, Eigen::MatrixBase<DerivedC> &q_sol, int* INFO, std::vector<std::string> &infeasible_constraint, const IKoptions &ikoptions); 
 /*
@@ -64,6 +104,37 @@ void inverseKinPointwise(RigidBodyManipulator* model, const int nT, const double
  *                    if ikoptions.sequentialSeedFlag = true, then the at time t[i], if t[i-1] is solved successfully, then q_sol.col(i-1) would be used as the seed for t[i]. If the solver fails to find a posture at t[i-1], then q_seed.col(i) would be used as the seed for t[i]
  *                    if ikoptions.sequentialSeedFlag = false, then q_seed.col(i) would always be used as the seed at t[i]
  */
+
+class InverseKinPointwiseSession
+{
+  public:
+    InverseKinPointwiseSession(RigidBodyManipulator* model, const int num_constraints, RigidBodyConstraint** const constraint_array, const IKoptions &ikoptions);
+    ~InverseKinPointwiseSession();
+
+    template <typename DerivedA, typename DerivedB, typename DerivedC>
+    void solve(double t, const Eigen::MatrixBase<DerivedA> &q_seed, const Eigen::MatrixBase<DerivedB> &q_nom, Eigen::MatrixBase<DerivedC> &q_sol, int &INFO, std::vector<std::string> &infeasible_constraint);
+
+    int numWarmStarts() const;
+
+  private:
+    class Impl;
+    std::unique_ptr<Impl> impl;
+};
+/*
+ * InverseKinPointwiseSession solves a stream of single time inverse kinematics
+ * problems with a fixed set of constraints, for instance one per control tick
+ * when tracking a teleoperation target.  It sorts the constraints and sets up
+ * the SNOPT workspace once, in the constructor, and each solve() warm starts
+ * SNOPT from the basis of the previous solve, as long as that solve succeeded
+ * and the constraints active at t give the same problem layout.  Seeding solve()
+ * with the previous q_sol makes the most of the warm start.
+ * @param model, num_constraints, constraint_array, ikoptions   Same as in inverseKin. The constraints and the model must outlive the session
+ * solve   Same as inverseKin at time t
+ * @param t         The time at which the constraints are evaluated
+ * @param q_seed, q_nom, q_sol, INFO, infeasible_constraint    Same as in inverseKin
+ * numWarmStarts   How many of the solves so far were warm started
+ */
+
 template <typename DerivedA, typename DerivedB, typename DerivedC, typename DerivedD, typename DerivedE, typename DerivedF>
 void inverseKinTraj(RigidBodyManipulator* model, const int nT, const double* t, const Eigen::MatrixBase<DerivedA> &qdot0_seed, const Eigen::MatrixBase<DerivedB> &q_seed, const Eigen::MatrixBase<DerivedC> &q_nom, const int num_constraints, RigidBodyConstraint** const constraint_array, Eigen::MatrixBase<DerivedD> &q_sol, Eigen::MatrixBase<DerivedE> &qdot_sol, Eigen::MatrixBase<DerivedF> &qddot_sol, int &INFO, std::vector<std::string> &infeasible_constraint, IKoptions ikoptions); 
 /*
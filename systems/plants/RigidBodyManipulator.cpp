@@ -6,6 +6,8 @@
 #include <algorithm>
 #include <string>
 #include <regex>
+#include <limits>
+#include <atomic>
 
 //DEBUG
 //#include <stdexcept>
@@ -21,11 +23,10 @@ bool isnotnan(const MatrixBase<Derived>& x)
   return (x.array() == x.array()).all();
 }
 
-void Xrotz(double theta, MatrixXd* X) {
+void Xrotz(double theta, Matrix6d* X) {
 	double c = cos(theta);
 	double s = sin(theta);
 
-	(*X).resize(6,6);
 	*X <<  c, s, 0, 0, 0, 0,
 		  -s, c, 0, 0, 0, 0,
 		   0, 0, 1, 0, 0, 0,
@@ -34,11 +35,10 @@ void Xrotz(double theta, MatrixXd* X) {
 		   0, 0, 0, 0, 0, 1;
 }
 
-void dXrotz(double theta, MatrixXd* dX) {
+void dXrotz(double theta, Matrix6d* dX) {
 	double dc = -sin(theta);
 	double ds = cos(theta);
 
-	(*dX).resize(6,6);
 	*dX << dc, ds, 0, 0, 0, 0,
       	  -ds, dc, 0, 0, 0, 0,
        		0, 0, 0, 0, 0, 0,
@@ -47,8 +47,7 @@ void dXrotz(double theta, MatrixXd* dX) {
        		0, 0, 0, 0, 0, 0;
 }
 
-void Xtrans(Vector3d r, MatrixXd* X) {
-	(*X).resize(6,6);
+void Xtrans(const Vector3d& r, Matrix6d* X) {
 	*X <<  	1, 0, 0, 0, 0, 0,
 		   	0, 1, 0, 0, 0, 0,
 		   	0, 0, 1, 0, 0, 0,
@@ -67,8 +66,7 @@ void dXtrans(MatrixXd* dX) {
 	(*dX)(16,0) = 1;
 }
 
-void dXtransPitch(MatrixXd* dX) {
-	(*dX).resize(6,6);
+void dXtransPitch(Matrix6d* dX) {
 	*dX << 0, 0, 0, 0, 0, 0,
            0, 0, 0, 0, 0, 0,
            0, 0, 0, 0, 0, 0,
@@ -78,31 +76,36 @@ void dXtransPitch(MatrixXd* dX) {
 }
 
 
-void jcalc(int pitch, double q, MatrixXd* Xj, VectorXd* S) {
-	(*Xj).resize(6,6);
-	(*S).resize(6);
+// rotation about the joint axis as a compact transform (same as Xrotz)
+Matrix3d Erotz(double theta) {
+	double c = cos(theta);
+	double s = sin(theta);
+	Matrix3d E;
+	E <<  c, s, 0,
+		 -s, c, 0,
+		  0, 0, 1;
+	return E;
+}
 
+void jcalc(int pitch, double q, PluckerTransform* Xj, Vector6d* S) {
 	if (pitch == 0) { // revolute joint
-	  	Xrotz(q,Xj);
+		Xj->E = Erotz(q);
+		Xj->r = Vector3d::Zero();
 	    *S << 0,0,1,0,0,0;
 	}
 	else if (pitch == INF) { // prismatic joint
-  		Xtrans(Vector3d(0.0,0.0,q),Xj);
+		Xj->E = Matrix3d::Identity();
+		Xj->r = Vector3d(0.0,0.0,q);
   		*S << 0,0,0,0,0,1;
 	}
 	else { // helical joint
-		MatrixXd A(6,6);
-		MatrixXd B(6,6);
-		Xrotz(q,&A);
-	    Xtrans(Vector3d(0.0,0.0,q*pitch),&B);
-		*Xj = A*B;
+		Xj->E = Erotz(q);
+		Xj->r = Vector3d(0.0,0.0,q*pitch);
   		*S << 0,0,1,0,0,pitch;
 	}
 }
 
-void djcalc(int pitch, double q, MatrixXd* dXj) {
-	(*dXj).resize(6,6);
-
+void djcalc(int pitch, double q, Matrix6d* dXj) {
 	if (pitch == 0) { // revolute joint
   		dXrotz(q,dXj);
 	}
@@ -110,7 +113,7 @@ void djcalc(int pitch, double q, MatrixXd* dXj) {
   		dXtransPitch(dXj);
     }
 	else { // helical joint
-	    MatrixXd X(6,6),Xj(6,6),dXrz(6,6),dXjp(6,6);
+	    Matrix6d X,Xj,dXrz,dXjp;
 	    Xrotz(q,&Xj);
 	    dXrotz(q,&dXrz);
 	    Xtrans(Vector3d(0.0,0.0,q*pitch),&X);
@@ -119,31 +122,7 @@ void djcalc(int pitch, double q, MatrixXd* dXj) {
 	}
 }
 
-MatrixXd crm(VectorXd v)
-{
-  	MatrixXd vcross(6,6);
-  	vcross << 0, -v[2], v[1], 0, 0, 0,
-	    	v[2], 0,-v[0], 0, 0, 0,
-	   	   -v[1], v[0], 0, 0, 0, 0,
-	    	0, -v[5], v[4], 0, -v[2], v[1],
-	    	v[5], 0,-v[3], v[2], 0, -v[0],
-	   	   -v[4], v[3], 0,-v[1], v[0], 0;
-  	return vcross;
-}
-
-MatrixXd crf(VectorXd v)
-{
- 	MatrixXd vcross(6,6);
- 	vcross << 0,-v[2], v[1], 0,-v[5], v[4],
-	    	v[2], 0,-v[0], v[5], 0,-v[3],
-	   	   -v[1], v[0], 0,-v[4], v[3], 0,
-	    	0, 0, 0, 0,-v[2], v[1],
-	    	0, 0, 0, v[2], 0,-v[0],
-	    	0, 0, 0,-v[1], v[0], 0;
- 	return vcross;
-}
-
-void dcrm(VectorXd v, VectorXd x, MatrixXd dv, MatrixXd dx, MatrixXd* dvcross) {
+void dcrm(const Vector6d& v, const Vector6d& x, const MatrixXd& dv, const MatrixXd& dx, MatrixXd* dvcross) {
  	(*dvcross).resize(6,dv.cols());
  	(*dvcross).row(0) = -dv.row(2)*x[1] + dv.row(1)*x[2] - v[2]*dx.row(1) + v[1]*dx.row(2);
 	(*dvcross).row(1) =  dv.row(2)*x[0] - dv.row(0)*x[2] + v[2]*dx.row(0) - v[0]*dx.row(2);
@@ -153,7 +132,7 @@ void dcrm(VectorXd v, VectorXd x, MatrixXd dv, MatrixXd dx, MatrixXd* dvcross) {
   	(*dvcross).row(5) = -dv.row(4)*x[0] + dv.row(3)*x[1] - dv.row(1)*x[3] + dv.row(0)*x[4] - v[4]*dx.row(0) + v[3]*dx.row(1) - v[1]*dx.row(3) + v[0]*dx.row(4);
 }
 
-void dcrf(VectorXd v, VectorXd x, MatrixXd dv, MatrixXd dx, MatrixXd* dvcross) {
+void dcrf(const Vector6d& v, const Vector6d& x, const MatrixXd& dv, const MatrixXd& dx, MatrixXd* dvcross) {
  	(*dvcross).resize(6,dv.cols());
  	(*dvcross).row(0) =  dv.row(2)*x[1] - dv.row(1)*x[2] + dv.row(5)*x[4] - dv.row(4)*x[5] + v[2]*dx.row(1) - v[1]*dx.row(2) + v[5]*dx.row(4) - v[4]*dx.row(5);
   	(*dvcross).row(1) = -dv.row(2)*x[0] + dv.row(0)*x[2] - dv.row(5)*x[3] + dv.row(3)*x[5] - v[2]*dx.row(0) + v[0]*dx.row(2) - v[5]*dx.row(3) + v[3]*dx.row(5);
@@ -263,7 +242,8 @@ RigidBodyManipulator::RigidBodyManipulator(int ndof, int num_featherstone_bodies
   :  collision_model(DrakeCollision::newModel())
 {
   num_dof=0; NB=0; num_bodies=0; num_frames=0;
-  a_grav = VectorXd::Zero(6);
+  num_threads=0;
+  a_grav = Vector6d::Zero();
   resize(ndof,num_featherstone_bodies,num_rigid_body_objects,num_rigid_body_frames);
 }
 
@@ -302,21 +282,9 @@ void RigidBodyManipulator::resize(int ndof, int num_featherstone_bodies, int num
   // note: these are std:vectors (and the above are eigen vectors)
   Xtree.resize(NB);
   I.resize(NB);
-  S.resize(NB);
-  Xup.resize(NB);
-  v.resize(NB);
-  avp.resize(NB);
-  fvp.resize(NB);
-  IC.resize(NB);
   for(int i=last_NB; i < NB; i++) {
-    Xtree[i] = MatrixXd::Zero(6,6);
-    I[i] = MatrixXd::Zero(6,6);
-    S[i] = VectorXd::Zero(6);
-    Xup[i] = MatrixXd::Zero(6,6);
-    v[i] = VectorXd::Zero(6);
-    avp[i] = VectorXd::Zero(6);
-    fvp[i] = VectorXd::Zero(6);
-    IC[i] = MatrixXd::Zero(6,6);
+    Xtree[i] = Matrix6d::Zero();
+    I[i] = Matrix6d::Zero();
   }
 
   if (num_rigid_body_objects<0)
@@ -325,7 +293,6 @@ void RigidBodyManipulator::resize(int ndof, int num_featherstone_bodies, int num
     num_bodies = num_rigid_body_objects;
 
   bodies.resize(num_bodies);
-  for(int i=0; i < num_bodies; i++) { bodies[i].setN(NB); }
   for(int i=last_num_bodies; i<num_bodies; i++) { bodies[i].dofnum = i-1; } // setup default dofnums
 
   collision_model->resize(num_bodies);
@@ -333,70 +300,10 @@ void RigidBodyManipulator::resize(int ndof, int num_featherstone_bodies, int num
   num_frames = num_rigid_body_frames;
   frames.resize(num_frames);
 
-  //Variable allocation for gradient calculations
-  dXupdq.resize(NB);
-  dIC.resize(NB);
-  for(int i=0; i < NB; i++) {
-    dIC[i].resize(NB);
-    for(int j=0; j < NB; j++) {
-      dIC[i][j] = MatrixXd::Zero(6,6);
-    }
-  }
-
-  // don't need to resize dcross (it gets resized in dcrm)
-
-  dvdq.resize(NB);
-  dvdqd.resize(NB);
-  davpdq.resize(NB);
-  davpdqd.resize(NB);
-  dfvpdq.resize(NB);
-  dfvpdqd.resize(NB);
-
-  dvJdqd_mat = MatrixXd::Zero(6,num_dof);
-  for(int i=0; i < NB; i++) {
-    dvdq[i] = MatrixXd::Zero(6,num_dof);
-    dvdqd[i] = MatrixXd::Zero(6,num_dof);
-    davpdq[i] = MatrixXd::Zero(6,num_dof);
-    davpdqd[i] = MatrixXd::Zero(6,num_dof);
-    dfvpdq[i] = MatrixXd::Zero(6,num_dof);
-    dfvpdqd[i] = MatrixXd::Zero(6,num_dof);
-  }
-
-  // preallocate for COM functions
-  bc = Vector3d::Zero();
-  bJ = MatrixXd::Zero(3,num_dof);
-  bdJ = MatrixXd::Zero(3,num_dof*num_dof);
-  dTdTmult = MatrixXd::Zero(3*num_dof,4);
-
-  // preallocate for CMM function
-  Ic.resize(NB); // body spatial inertias
-  dIc.resize(NB); // derivative of body spatial inertias
-  phi.resize(NB); // joint axis vectors
-  Xworld.resize(NB); // spatial transforms from world to each body
-  dXworld.resize(NB); // dXworld_dq * qd
-  dXup.resize(NB); // dXup_dq * qd
-  for(int i=0; i < NB; i++) {
-    Ic[i] = MatrixXd::Zero(6,6);
-    dIc[i] = MatrixXd::Zero(6,6);
-    phi[i] = VectorXd::Zero(6);
-    Xworld[i] = MatrixXd::Zero(6,6);
-    dXworld[i] = MatrixXd::Zero(6,6);
-    dXup[i] = MatrixXd::Zero(6,6);
-  }
-
-  Xg = MatrixXd::Zero(6,6); // spatial centroidal projection matrix for a single body
-  dXg = MatrixXd::Zero(6,6);  // dXg_dq * qd
-  Xcom = MatrixXd::Zero(6,6); // spatial transform from centroid to world
-  Jcom = MatrixXd::Zero(3,num_dof);
-  dXcom = MatrixXd::Zero(6,6);
-  Xi = MatrixXd::Zero(6,6);
-  dXidq = MatrixXd::Zero(6,6);
+  batch_caches.clear();
 
   initialized = false;
-  kinematicsInit = false;
-  cached_q.resize(num_dof);
-  cached_qd.resize(num_dof);
-  secondDerivativesCached = 0;
+  default_cache.resize(*this);
 }
 
 
@@ -407,6 +314,10 @@ void RigidBodyManipulator::compile(void)
     bodies[i].computeAncestorDOFs(this);
   }
 
+  // the caches are sized by the ancestor dofs of each body
+  default_cache.resize(*this);
+  batch_caches.clear();
+
   initialized=true;
 }
 
@@ -418,9 +329,14 @@ void RigidBodyManipulator::addCollisionElement(const int body_ind, Matrix4d T_el
 
 void RigidBodyManipulator::updateCollisionElements(const int body_ind)
 {
-  collision_model->updateElementsForBody(body_ind, bodies[body_ind].T);
+  collision_model->updateElementsForBody(body_ind, default_cache.T[body_ind]);
 };
 
+void RigidBodyManipulator::getCollisionElementUpdateCounts(long& num_updated, long& num_skipped) const
+{
+  collision_model->getElementUpdateCounts(num_updated, num_skipped);
+}
+
 bool RigidBodyManipulator::setCollisionFilter(const int body_ind,
                                               const uint16_t group,
                                               const uint16_t mask)
@@ -479,7 +395,37 @@ bool RigidBodyManipulator::getPairwiseClosestPoint(const int body_indA, const in
 
 bool RigidBodyManipulator::collisionRaycast(const Matrix3Xd &origins, const Matrix3Xd &ray_endpoints, VectorXd &distances)
 {
-  return collision_model->collisionRaycast(origins, ray_endpoints, distances);
+  return collisionRaycast(origins, ray_endpoints, distances, NULL, NULL);
+}
+
+bool RigidBodyManipulator::collisionRaycast(const Matrix3Xd &origins, const Matrix3Xd &ray_endpoints, VectorXd &distances, Matrix3Xd* normals, vector<int>* body_idx)
+{
+  // neighboring rays (e.g. in a scan) point in similar directions, so contiguous chunks keep each chunk's broadphase query small
+  const int rays_per_chunk = 256;
+  int N = origins.cols();
+  int num_chunks = (N+rays_per_chunk-1)/rays_per_chunk;
+  distances.resize(N);
+  if (normals) normals->resize(3,N);
+  if (body_idx) body_idx->resize(N);
+
+  if (num_chunks <= 1)
+    return collision_model->collisionRaycast(origins, ray_endpoints, 0, N, distances, normals, body_idx);
+
+  if (!thread_pool)
+    thread_pool = shared_ptr<ThreadPool>(new ThreadPool(num_threads));
+  vector<char> success(num_chunks);
+  thread_pool->parallelFor(num_chunks, [&](int thread_index, int k) {
+    int first = k*rays_per_chunk;
+    success[k] = collision_model->collisionRaycast(origins, ray_endpoints, first, min(rays_per_chunk,N-first), distances, normals, body_idx);
+  });
+  return find(success.begin(), success.end(), 0) == success.end();
+}
+
+bool RigidBodyManipulator::collisionRaycast(const DrakeCollision::RayFan &fan, VectorXd &distances, Matrix3Xd* normals, vector<int>* body_idx)
+{
+  Matrix3Xd origins, ray_endpoints;
+  fan.getRays(origins, ray_endpoints);
+  return collisionRaycast(origins, ray_endpoints, distances, normals, body_idx);
 }
 
 bool RigidBodyManipulator::collisionDetect( VectorXd& phi,
@@ -493,6 +439,18 @@ bool RigidBodyManipulator::collisionDetect( VectorXd& phi,
   return collision_model->closestPointsAllBodies(bodyA_idx,bodyB_idx,xA,xB,normal,phi,bodies_idx);
 };
 
+bool RigidBodyManipulator::collisionDetect( VectorXd& phi,
+                                            MatrixXd& normal,
+                                            MatrixXd& xA,
+                                            MatrixXd& xB,
+                                            vector<int>& bodyA_idx,
+                                            vector<int>& bodyB_idx,
+                                            vector<int>& bodies_idx,
+                                            double distance_threshold)
+{
+  return collision_model->closestPointsAllBodies(bodyA_idx,bodyB_idx,xA,xB,normal,phi,bodies_idx,distance_threshold);
+};
+
 bool RigidBodyManipulator::allCollisions(vector<int>& bodyA_idx,
                                          vector<int>& bodyB_idx,
                                          MatrixXd& ptsA, MatrixXd& ptsB)
@@ -514,11 +472,34 @@ bool RigidBodyManipulator::allCollisions(vector<int>& bodyA_idx,
 //};
 
 void RigidBodyManipulator::doKinematics(double* q, bool b_compute_second_derivatives, double* qd)
+{
+  if (default_cache.isValid(q,b_compute_second_derivatives)) {
+    return;
+  }
+
+  if (!initialized) { compile(); }
+
+  doKinematics(default_cache,q,b_compute_second_derivatives,qd);
+
+  for (int i = 0; i < num_bodies; i++) {
+    if (bodies[i].parent>=0) {
+      //DEBUG
+      //cout << "RigidBodyManipulator::doKinematics: updating body " << i << " ..." << endl;
+      //END_DEBUG
+      collision_model->updateElementsForBody(i,default_cache.T[i]);
+      //DEBUG
+      //cout << "RigidBodyManipulator::doKinematics: done updating body " << i << endl;
+      //END_DEBUG
+    }
+  }
+}
+
+void RigidBodyManipulator::doKinematics(KinematicsCache& cache, double* q, bool b_compute_second_derivatives, double* qd) const
 {
   //DEBUG
   //try{
   //END_DEBUG
-  int i,j,k,l;
+  int i,j,k,l,kk;
 
   //DEBUG
   //cout << "RigidBodyManipulator::doKinematics: q = " << endl;
@@ -526,240 +507,178 @@ void RigidBodyManipulator::doKinematics(double* q, bool b_compute_second_derivat
     //cout << q[i] << endl;
   //}
   //END_DEBUG
-  //Check against cached values for bodies[1];
-  if (kinematicsInit) {
-    bool skip = true;
-    if (b_compute_second_derivatives && !secondDerivativesCached)
-      skip = false;
-    for (i = 0; i < num_dof; i++) {
-      if (q[i] - cached_q[i] > 1e-8 || q[i] - cached_q[i] < -1e-8) {
-        skip = false;
-        break;
-      }
-    }
-    if (skip) {
-      return;
-    }
+  //Check against cached values
+  if (cache.isValid(q,b_compute_second_derivatives)) {
+    return;
   }
 
-  if (!initialized) { compile(); }
-
-  Matrix4d TJ, dTJ, ddTJ, Tbinv, Tb, Tmult, dTmult, dTdotmult, TdTmult, TJdot, dTJdot, TddTmult;
-  Matrix4d fb_dTJ[6], fb_dTJdot[6], fb_dTmult[6], fb_ddTJ[3][3];  // will be 7 when quats implemented...
+  Matrix4d TJ, Tbinv, Tb, Tmult, TdTmult, TJdot, dTdotmult, TddTmult;
+  Matrix4d dTJ[6], dTJdot[6], dTmult[6], ddTJ[6][6];  // derivatives w.r.t. the joint dofs (will be 7 when quats implemented...)
+  MatrixXd dTdqmult, ddTdqdqmult;
 
   Matrix3d rx,drx,ddrx,ry,dry,ddry,rz,drz,ddrz;
 
   for (i = 0; i < num_bodies; i++) {
     int parent = bodies[i].parent;
     if (parent < 0) {
-      bodies[i].T = bodies[i].Ttree;
-      //dTdq, ddTdqdq initialized as all zeros
-    } else if (bodies[i].floating == 1) {
-      double qi[6];
-      for (j=0; j<6; j++) qi[j] = q[bodies[i].dofnum+j];
-
-      rotx(qi[3],rx,drx,ddrx);
-      roty(qi[4],ry,dry,ddry);
-      rotz(qi[5],rz,drz,ddrz);
-
-      Tb = bodies[i].T_body_to_joint;
-      Tbinv = Tb.inverse();
-
-      TJ = Matrix4d::Identity();  TJ.block<3,3>(0,0) = rz*ry*rx;  TJ(0,3)=qi[0]; TJ(1,3)=qi[1]; TJ(2,3)=qi[2];
-
-      Tmult = bodies[i].Ttree * Tbinv * TJ * Tb;
-      bodies[i].T = bodies[parent].T * Tmult;
-
-      // see notes below
-      bodies[i].dTdq = bodies[parent].dTdq * Tmult;
-      dTmult = bodies[i].Ttree * Tbinv * dTJ * Tb;
-      TdTmult = bodies[parent].T * dTmult;
-
-      fb_dTJ[0] << 0,0,0,1, 0,0,0,0, 0,0,0,0, 0,0,0,0;
-      fb_dTJ[1] << 0,0,0,0, 0,0,0,1, 0,0,0,0, 0,0,0,0;
-      fb_dTJ[2] << 0,0,0,0, 0,0,0,0, 0,0,0,1, 0,0,0,0;
-      fb_dTJ[3] = Matrix4d::Zero(); fb_dTJ[3].block<3,3>(0,0) = rz*ry*drx;
-      fb_dTJ[4] = Matrix4d::Zero(); fb_dTJ[4].block<3,3>(0,0) = rz*dry*rx;
-      fb_dTJ[5] = Matrix4d::Zero(); fb_dTJ[5].block<3,3>(0,0) = drz*ry*rx;
-
-      for (j=0; j<6; j++) {
-        fb_dTmult[j] = bodies[i].Ttree * Tbinv * fb_dTJ[j] * Tb;
-        TdTmult = bodies[parent].T * fb_dTmult[j];
-        bodies[i].dTdq.row(bodies[i].dofnum + j) += TdTmult.row(0);
-        bodies[i].dTdq.row(bodies[i].dofnum + j + num_dof) += TdTmult.row(1);
-        bodies[i].dTdq.row(bodies[i].dofnum + j + 2*num_dof) += TdTmult.row(2);
-      }
-
-      if (b_compute_second_derivatives) {
-        fb_ddTJ[0][0] << rz*ry*ddrx, MatrixXd::Zero(3,1), MatrixXd::Zero(1,4);
-        fb_ddTJ[0][1] << rz*dry*drx, MatrixXd::Zero(3,1), MatrixXd::Zero(1,4);
-        fb_ddTJ[0][2] << drz*ry*drx, MatrixXd::Zero(3,1), MatrixXd::Zero(1,4);
-        fb_ddTJ[1][0] << rz*dry*drx, MatrixXd::Zero(3,1), MatrixXd::Zero(1,4);
-        fb_ddTJ[1][1] << rz*ddry*rx, MatrixXd::Zero(3,1), MatrixXd::Zero(1,4);
-        fb_ddTJ[1][2] << drz*dry*rx, MatrixXd::Zero(3,1), MatrixXd::Zero(1,4);
-        fb_ddTJ[2][0] << drz*ry*drx, MatrixXd::Zero(3,1), MatrixXd::Zero(1,4);
-        fb_ddTJ[2][1] << drz*dry*rx, MatrixXd::Zero(3,1), MatrixXd::Zero(1,4);
-        fb_ddTJ[2][2] << ddrz*ry*rx, MatrixXd::Zero(3,1), MatrixXd::Zero(1,4);
-
-        // ddTdqdq = [d(dTdq)dq1; d(dTdq)dq2; ...]
-        bodies[i].ddTdqdq = MatrixXd::Zero(3*num_dof*num_dof,4);  // note: could be faster if I skipped this (like I do for floating == 0 below)
-
-        //        bodies[i].ddTdqdq = bodies[parent].ddTdqdq * Tmult;
-        for (set<IndexRange>::iterator iter = bodies[parent].ddTdqdq_nonzero_rows_grouped.begin(); iter != bodies[parent].ddTdqdq_nonzero_rows_grouped.end(); iter++) {
-          bodies[i].ddTdqdq.block(iter->start,0,iter->length,4) = bodies[parent].ddTdqdq.block(iter->start,0,iter->length,4) * Tmult;
+      cache.T[i] = bodies[i].Ttree;
+      //dTdq, ddTdqdq are empty (the body has no ancestor dofs)
+    } else if (bodies[i].floating == 2) {
+      cerr << "mex kinematics for quaternion floating bases are not implemented yet" << endl;
+    } else {
+      int num_joint_dofs;
+
+      if (bodies[i].floating == 1) {
+        num_joint_dofs = 6;
+        double qi[6];
+        for (j=0; j<6; j++) qi[j] = q[bodies[i].dofnum+j];
+
+        rotx(qi[3],rx,drx,ddrx);
+        roty(qi[4],ry,dry,ddry);
+        rotz(qi[5],rz,drz,ddrz);
+
+        TJ = Matrix4d::Identity();  TJ.block<3,3>(0,0) = rz*ry*rx;  TJ(0,3)=qi[0]; TJ(1,3)=qi[1]; TJ(2,3)=qi[2];
+
+        dTJ[0] << 0,0,0,1, 0,0,0,0, 0,0,0,0, 0,0,0,0;
+        dTJ[1] << 0,0,0,0, 0,0,0,1, 0,0,0,0, 0,0,0,0;
+        dTJ[2] << 0,0,0,0, 0,0,0,0, 0,0,0,1, 0,0,0,0;
+        dTJ[3] = Matrix4d::Zero(); dTJ[3].block<3,3>(0,0) = rz*ry*drx;
+        dTJ[4] = Matrix4d::Zero(); dTJ[4].block<3,3>(0,0) = rz*dry*rx;
+        dTJ[5] = Matrix4d::Zero(); dTJ[5].block<3,3>(0,0) = drz*ry*rx;
+
+        if (b_compute_second_derivatives) {
+          // only the rotational block is non-zero
+          for (j=0; j<6; j++)
+            for (k=0; k<6; k++)
+              ddTJ[j][k] = Matrix4d::Zero();
+          ddTJ[3][3].block<3,3>(0,0) = rz*ry*ddrx;
+          ddTJ[3][4].block<3,3>(0,0) = rz*dry*drx;
+          ddTJ[3][5].block<3,3>(0,0) = drz*ry*drx;
+          ddTJ[4][3].block<3,3>(0,0) = rz*dry*drx;
+          ddTJ[4][4].block<3,3>(0,0) = rz*ddry*rx;
+          ddTJ[4][5].block<3,3>(0,0) = drz*dry*rx;
+          ddTJ[5][3].block<3,3>(0,0) = drz*ry*drx;
+          ddTJ[5][4].block<3,3>(0,0) = drz*dry*rx;
+          ddTJ[5][5].block<3,3>(0,0) = ddrz*ry*rx;
         }
 
-        for (j=0; j<6; j++) {
-          dTmult = bodies[i].Ttree * Tbinv * fb_dTJ[j] * Tb;
-          dTdTmult = bodies[parent].dTdq * dTmult;
-          for (k=0; k<3*num_dof; k++) {
-            bodies[i].ddTdqdq.row(3*num_dof*(bodies[i].dofnum+j) + k) += dTdTmult.row(k);
-          }
+        if (qd) {
+          double qdi[6];
 
-          for (l=0; l<3; l++) {
-            for (k=0;k<num_dof;k++) {
-              if (k>=bodies[i].dofnum && k<=bodies[i].dofnum+j) {
-                bodies[i].ddTdqdq.row(bodies[i].dofnum+j + (3*k+l)*num_dof) += dTdTmult.row(l*num_dof+k);
-              } else {
-                bodies[i].ddTdqdq.row(bodies[i].dofnum+j + (3*k+l)*num_dof) += dTdTmult.row(l*num_dof+k);
-              }
-            }
+          TJdot = Matrix4d::Zero();
+          for (j=0; j<6; j++) {
+            qdi[j] = qd[bodies[i].dofnum+j];
+            TJdot += dTJ[j]*qdi[j];
           }
 
-          if (j>=3) {
-          	for (k=3; k<6; k++) {
-              TddTmult = bodies[parent].T*bodies[i].Ttree * Tbinv * fb_ddTJ[j-3][k-3] * Tb;
-              bodies[i].ddTdqdq.row(3*num_dof*(bodies[i].dofnum+k) + bodies[i].dofnum+j) += TddTmult.row(0);
-              bodies[i].ddTdqdq.row(3*num_dof*(bodies[i].dofnum+k) + bodies[i].dofnum+j + num_dof) += TddTmult.row(1);
-              bodies[i].ddTdqdq.row(3*num_dof*(bodies[i].dofnum+k) + bodies[i].dofnum+j + 2*num_dof) += TddTmult.row(2);
-          	}
-          }
-        }
-      }
-      if (qd) {
-        double qdi[6];
-
-        TJdot = Matrix4d::Zero();
-        for (int j=0; j<6; j++) {
-          qdi[j] = qd[bodies[i].dofnum+j];
-          TJdot += fb_dTJ[j]*qdi[j];
+          dTJdot[0] = Matrix4d::Zero();
+          dTJdot[1] = Matrix4d::Zero();
+          dTJdot[2] = Matrix4d::Zero();
+          dTJdot[3] = Matrix4d::Zero();  dTJdot[3].block<3,3>(0,0) = (drz*qdi[5])*ry*drx + rz*(dry*qdi[4])*drx + rz*ry*(ddrx*qdi[3]);
+          dTJdot[4] = Matrix4d::Zero();  dTJdot[4].block<3,3>(0,0) = (drz*qdi[5])*dry*rx + rz*(ddry*qdi[4])*rx + rz*dry*(drx*qdi[3]);
+          dTJdot[5] = Matrix4d::Zero();  dTJdot[5].block<3,3>(0,0) = (ddrz*qdi[5])*ry*rx + drz*(dry*qdi[4])*rx + drz*ry*(drx*qdi[3]);
         }
-
-        fb_dTJdot[0] = Matrix4d::Zero();
-        fb_dTJdot[1] = Matrix4d::Zero();
-        fb_dTJdot[2] = Matrix4d::Zero();
-        fb_dTJdot[3] = Matrix4d::Zero();  fb_dTJdot[3].block<3,3>(0,0) = (drz*qdi[5])*ry*drx + rz*(dry*qdi[4])*drx + rz*ry*(ddrx*qdi[3]);
-        fb_dTJdot[4] = Matrix4d::Zero();  fb_dTJdot[4].block<3,3>(0,0) = (drz*qdi[5])*dry*rx + rz*(ddry*qdi[4])*rx + rz*dry*(drx*qdi[3]);
-        fb_dTJdot[5] = Matrix4d::Zero();  fb_dTJdot[5].block<3,3>(0,0) = (ddrz*qdi[5])*ry*rx + drz*(dry*qdi[4])*rx + drz*ry*(drx*qdi[3]);
-
-        dTdotmult = bodies[i].Ttree * Tbinv * TJdot * Tb;
-        bodies[i].Tdot = bodies[parent].Tdot*Tmult + bodies[parent].T * dTdotmult;
-
-        bodies[i].dTdqdot = bodies[parent].dTdqdot* Tmult + bodies[parent].dTdq * dTdotmult;
-
-        for (int j=0; j<6; j++) {
-          dTdotmult = bodies[parent].Tdot*fb_dTmult[j] + bodies[parent].T*bodies[i].Ttree*Tbinv*fb_dTJdot[j]*Tb;
-          bodies[i].dTdqdot.row(bodies[i].dofnum + j) += dTdotmult.row(0);
-          bodies[i].dTdqdot.row(bodies[i].dofnum + j + num_dof) += dTdotmult.row(1);
-          bodies[i].dTdqdot.row(bodies[i].dofnum + j + 2*num_dof) += dTdotmult.row(2);
+      } else {
+        num_joint_dofs = 1;
+        double qi = q[bodies[i].dofnum];
+        Tjcalc(bodies[i].pitch,qi,&TJ);
+        dTjcalc(bodies[i].pitch,qi,&dTJ[0]);
+        if (b_compute_second_derivatives || qd)
+          ddTjcalc(bodies[i].pitch,qi,&ddTJ[0][0]);
+
+        if (qd) {
+          double qdi = qd[bodies[i].dofnum];
+          TJdot = dTJ[0]*qdi;
+          dTJdot[0] = ddTJ[0][0]*qdi;
         }
       }
 
-    } else if (bodies[i].floating == 2) {
-      cerr << "mex kinematics for quaternion floating bases are not implemented yet" << endl;
-    } else {
-      double qi = q[bodies[i].dofnum];
-      Tjcalc(bodies[i].pitch,qi,&TJ);
-      dTjcalc(bodies[i].pitch,qi,&dTJ);
-
       Tb = bodies[i].T_body_to_joint;
       Tbinv = Tb.inverse();
 
       Tmult = bodies[i].Ttree * Tbinv * TJ * Tb;
-
-      bodies[i].T = bodies[parent].T * Tmult;
+      cache.T[i] = cache.T[parent] * Tmult;
+      for (j=0; j<num_joint_dofs; j++)
+        dTmult[j] = bodies[i].Ttree * Tbinv * dTJ[j] * Tb;
 
       /*
-       * note the unusual format of dTdq(chosen for efficiently calculating jacobians from many pts)
-       * dTdq = [dT(1,:)dq1; dT(1,:)dq2; ...; dT(1,:)dqN; dT(2,dq1) ...]
+       * note the unusual format of dTdq (chosen for efficiently calculating jacobians from many pts)
+       * dTdq = [dT(1,:)dqa1; dT(1,:)dqa2; ...; dT(1,:)dqam; dT(2,:)dqa1 ...]
+       * where qa are the ancestor dofs of the body.  the parent's ancestor dofs are a subset of the
+       * body's ancestor dofs; the remaining ones belong to this joint.
        */
-
-      bodies[i].dTdq = bodies[parent].dTdq * Tmult;  // note: could only compute non-zero entries here
-
-      dTmult = bodies[i].Ttree * Tbinv * dTJ * Tb;
-      TdTmult = bodies[parent].T * dTmult;
-      bodies[i].dTdq.row(bodies[i].dofnum) += TdTmult.row(0);
-      bodies[i].dTdq.row(bodies[i].dofnum + num_dof) += TdTmult.row(1);
-      bodies[i].dTdq.row(bodies[i].dofnum + 2*num_dof) += TdTmult.row(2);
+      const vector<int>& parent_inds = bodies[i].parent_ancestor_inds;
+      const vector<int>& joint_inds = bodies[i].joint_ancestor_inds;
+      int m = bodies[i].ancestor_dof_list.size(), mp = parent_inds.size();
+
+      dTdqmult = cache.dTdq[parent] * Tmult;
+      for (l=0; l<3; l++) {
+        for (k=0; k<mp; k++)
+          cache.dTdq[i].row(l*m + parent_inds[k]) = dTdqmult.row(l*mp + k);
+      }
+      for (j=0; j<num_joint_dofs; j++) {
+        TdTmult = cache.T[parent] * dTmult[j];
+        for (l=0; l<3; l++)
+          cache.dTdq[i].row(l*m + joint_inds[j]) = TdTmult.row(l);
+      }
 
       if (b_compute_second_derivatives) {
-        //ddTdqdq = [d(dTdq)dq1; d(dTdq)dq2; ...]
-        //	bodies[i].ddTdqdq = bodies[parent].ddTdqdq * Tmult; // pushed this into the loop below to exploit the sparsity
-        for (set<IndexRange>::iterator iter = bodies[parent].ddTdqdq_nonzero_rows_grouped.begin(); iter != bodies[parent].ddTdqdq_nonzero_rows_grouped.end(); iter++) {
-          bodies[i].ddTdqdq.block(iter->start,0,iter->length,4) = bodies[parent].ddTdqdq.block(iter->start,0,iter->length,4) * Tmult;
-        }
-
-        dTdTmult = bodies[parent].dTdq * dTmult;
-        for (j = 0; j < 3*num_dof; j++) {
-          bodies[i].ddTdqdq.row(3*num_dof*(bodies[i].dofnum) + j) = dTdTmult.row(j);
+        //ddTdqdq = [d(dTdq)dqa1; d(dTdq)dqa2; ...]
+        ddTdqdqmult = cache.ddTdqdq[parent] * Tmult;
+        for (kk=0; kk<mp; kk++) {
+          for (l=0; l<3; l++) {
+            for (k=0; k<mp; k++)
+              cache.ddTdqdq[i].row(3*m*parent_inds[kk] + l*m + parent_inds[k]) = ddTdqdqmult.row(3*mp*kk + l*mp + k);
+          }
         }
 
-        // ind = reshape(reshape(body.dofnum+0:num_dof:3*num_dof*num_dof,3,[])',[],1); % ddTdqidq
-        for (j = 0; j < 3; j++) {
-          for (k = 0; k < num_dof; k++) {
-            if (k == bodies[i].dofnum) {
-              bodies[i].ddTdqdq.row(bodies[i].dofnum + (3*k+j)*num_dof) += dTdTmult.row(j*num_dof+k);
-            } else {
-              bodies[i].ddTdqdq.row(bodies[i].dofnum + (3*k+j)*num_dof) = dTdTmult.row(j*num_dof+k);
+        for (j=0; j<num_joint_dofs; j++) {
+          // mixed terms (joint dof, parent's ancestor dof) are symmetric
+          dTdqmult = cache.dTdq[parent] * dTmult[j];
+          for (l=0; l<3; l++) {
+            for (k=0; k<mp; k++) {
+              cache.ddTdqdq[i].row(3*m*joint_inds[j] + l*m + parent_inds[k]) = dTdqmult.row(l*mp + k);
+              cache.ddTdqdq[i].row(3*m*parent_inds[k] + l*m + joint_inds[j]) = dTdqmult.row(l*mp + k);
             }
           }
-        }
 
-        ddTjcalc(bodies[i].pitch,qi,&ddTJ);
-        TddTmult = bodies[parent].T*bodies[i].Ttree * Tbinv * ddTJ * Tb;
-
-        bodies[i].ddTdqdq.row(3*num_dof*(bodies[i].dofnum) + bodies[i].dofnum) += TddTmult.row(0);
-        bodies[i].ddTdqdq.row(3*num_dof*(bodies[i].dofnum) + bodies[i].dofnum + num_dof) += TddTmult.row(1);
-        bodies[i].ddTdqdq.row(3*num_dof*(bodies[i].dofnum) + bodies[i].dofnum + 2*num_dof) += TddTmult.row(2);
+          for (k=0; k<num_joint_dofs; k++) {
+            TddTmult = cache.T[parent]*bodies[i].Ttree * Tbinv * ddTJ[j][k] * Tb;
+            for (l=0; l<3; l++)
+              cache.ddTdqdq[i].row(3*m*joint_inds[k] + l*m + joint_inds[j]) = TddTmult.row(l);
+          }
+        }
       }
 
       if (qd) {
-        double qdi = qd[bodies[i].dofnum];
-        TJdot = dTJ*qdi;
-        ddTjcalc(bodies[i].pitch,qi,&ddTJ);
-        dTJdot = ddTJ*qdi;
-
 //        body.Tdot = body.parent.Tdot*body.Ttree*inv(body.T_body_to_joint)*TJ*body.T_body_to_joint + body.parent.T*body.Ttree*inv(body.T_body_to_joint)*TJdot*body.T_body_to_joint;
         dTdotmult = bodies[i].Ttree * Tbinv * TJdot * Tb;
-        bodies[i].Tdot = bodies[parent].Tdot*Tmult + bodies[parent].T * dTdotmult;
+        cache.Tdot[i] = cache.Tdot[parent]*Tmult + cache.T[parent] * dTdotmult;
+
 //        body.dTdqdot = body.parent.dTdqdot*body.Ttree*inv(body.T_body_to_joint)*TJ*body.T_body_to_joint + body.parent.dTdq*body.Ttree*inv(body.T_body_to_joint)*TJdot*body.T_body_to_joint;
-        bodies[i].dTdqdot = bodies[parent].dTdqdot* Tmult + bodies[parent].dTdq * dTdotmult;
+        dTdqmult = cache.dTdqdot[parent]* Tmult + cache.dTdq[parent] * dTdotmult;
+        for (l=0; l<3; l++) {
+          for (k=0; k<mp; k++)
+            cache.dTdqdot[i].row(l*m + parent_inds[k]) = dTdqmult.row(l*mp + k);
+        }
 
-//        body.dTdqdot(this_dof_ind,:) = body.dTdqdot(this_dof_ind,:) + body.parent.Tdot(1:3,:)*body.Ttree*inv(body.T_body_to_joint)*dTJ*body.T_body_to_joint + body.parent.T(1:3,:)*body.Ttree*inv(body.T_body_to_joint)*dTJdot*body.T_body_to_joint;
-        dTdotmult = bodies[parent].Tdot*dTmult + bodies[parent].T*bodies[i].Ttree*Tbinv*dTJdot*Tb;
-        bodies[i].dTdqdot.row(bodies[i].dofnum) += dTdotmult.row(0);
-        bodies[i].dTdqdot.row(bodies[i].dofnum + num_dof) += dTdotmult.row(1);
-        bodies[i].dTdqdot.row(bodies[i].dofnum + 2*num_dof) += dTdotmult.row(2);
+//        body.dTdqdot(this_dof_ind,:) = body.parent.Tdot(1:3,:)*body.Ttree*inv(body.T_body_to_joint)*dTJ*body.T_body_to_joint + body.parent.T(1:3,:)*body.Ttree*inv(body.T_body_to_joint)*dTJdot*body.T_body_to_joint;
+        for (j=0; j<num_joint_dofs; j++) {
+          dTdotmult = cache.Tdot[parent]*dTmult[j] + cache.T[parent]*bodies[i].Ttree*Tbinv*dTJdot[j]*Tb;
+          for (l=0; l<3; l++)
+            cache.dTdqdot[i].row(l*m + joint_inds[j]) = dTdotmult.row(l);
+        }
       }
     }
-
-    if (bodies[i].parent>=0) {
-      //DEBUG
-      //cout << "RigidBodyManipulator::doKinematics: updating body " << i << " ..." << endl;
-      //END_DEBUG
-      collision_model->updateElementsForBody(i,bodies[i].T);
-      //DEBUG
-      //cout << "RigidBodyManipulator::doKinematics: done updating body " << i << endl;
-      //END_DEBUG
-    }
   }
 
-  kinematicsInit = true;
+  cache.kinematicsInit = true;
   for (i = 0; i < num_dof; i++) {
-    cached_q[i] = q[i];
-    if (qd) cached_qd[i] = qd[i];
+    cache.q[i] = q[i];
+    if (qd) cache.qd[i] = qd[i];
   }
-  secondDerivativesCached = b_compute_second_derivatives;
+  cache.secondDerivativesCached = b_compute_second_derivatives;
+  cache.num_queries = 0;  // the stored query results belong to the previous state
   //DEBUG
   //} catch (const out_of_range& oor) {
     //string msg("In RigidBodyManipulator::doKinematics:\n");
@@ -770,73 +689,75 @@ void RigidBodyManipulator::doKinematics(double* q, bool b_compute_second_derivat
 
 
 template <typename Derived>
-void RigidBodyManipulator::getCMM(double* const q, double* const qd, MatrixBase<Derived> &A, MatrixBase<Derived> &Adot)
+void RigidBodyManipulator::getCMM(KinematicsCache& cache, double* const q, double* const qd, MatrixBase<Derived> &A, MatrixBase<Derived> &Adot) const
 {
   // returns the centroidal momentum matrix as described in Orin & Goswami 2008
   //
   // h = A*qd, where h(4:6) is the total linear momentum and h(1:3) is the
   // total angular momentum in the centroid frame (world fram translated to COM).
 
-  Vector3d com; getCOM(com);
-  Xtrans(-com,&Xcom);
+  Vector3d com; getCOM(cache,com);
+  Xtrans(-com,&cache.Xcom);
 
-  getCOMJac(Jcom);
+  getCOMJac(cache,cache.Jcom);
   Map<VectorXd> qdvec(qd,num_dof);
-  Vector3d com_dot = Jcom*qdvec;
-  dXcom = MatrixXd::Zero(6,6);
-  dXcom(5,1) = 1*com_dot(0);
-  dXcom(4,2) = -1*com_dot(0);
-  dXcom(5,0) = -1*com_dot(1);
-  dXcom(3,2) = 1*com_dot(1);
-  dXcom(4,0) = 1*com_dot(2);
-  dXcom(3,1) = -1*com_dot(2);
+  Vector3d com_dot = cache.Jcom*qdvec;
+  cache.dXcom = Matrix6d::Zero();
+  cache.dXcom(5,1) = 1*com_dot(0);
+  cache.dXcom(4,2) = -1*com_dot(0);
+  cache.dXcom(5,0) = -1*com_dot(1);
+  cache.dXcom(3,2) = 1*com_dot(1);
+  cache.dXcom(4,0) = 1*com_dot(2);
+  cache.dXcom(3,1) = -1*com_dot(2);
 
   A = MatrixXd::Zero(6,num_dof);
   Adot = MatrixXd::Zero(6,num_dof);
 
   for (int i=0; i < NB; i++) {
-    Ic[i] = I[i];
-    dIc[i] = MatrixXd::Zero(6,6);
+    cache.Ic[i] = I[i];
+    cache.dIc[i] = Matrix6d::Zero();
   }
 
   int n;
   for (int i=NB-1; i >= 0; i--) {
     n = dofnum[i];
-    jcalc(pitch[i],q[n],&Xi,&phi[i]);
-    Xup[i] = Xi * Xtree[i];
+    jcalc(pitch[i],q[n],&cache.Xi,&cache.phi[i]);
+    cache.Xup[i] = cache.Xi * PluckerTransform(Xtree[i]);
 
-    djcalc(pitch[i], q[n], &dXidq);
-    dXup[i] = dXidq * Xtree[i] * qd[n];
+    djcalc(pitch[i], q[n], &cache.dXidq);
+    cache.dXup[i] = cache.dXidq * Xtree[i] * qd[n];
 
     if (parent[i] >= 0) {
-      Ic[parent[i]] += Xup[i].transpose()*Ic[i]*Xup[i];
-      dIc[parent[i]] += (dXup[i].transpose()*Ic[i] + Xup[i].transpose()*dIc[i])*Xup[i] + Xup[i].transpose()*Ic[i]*dXup[i];
+      Matrix6d Xupi = cache.Xup[i].toMatrix();
+      cache.Ic[parent[i]] += Xupi.transpose()*cache.Ic[i]*Xupi;
+      cache.dIc[parent[i]] += (cache.dXup[i].transpose()*cache.Ic[i] + Xupi.transpose()*cache.dIc[i])*Xupi + Xupi.transpose()*cache.Ic[i]*cache.dXup[i];
     }
   }
 
 
   for (int i=0; i < NB; i++) {
+    Matrix6d Xupi = cache.Xup[i].toMatrix();
     if (parent[i] >= 0) {
-      Xworld[i] = Xup[i] * Xworld[parent[i]];
-      dXworld[i] = dXup[i]*Xworld[parent[i]] + Xup[i]*dXworld[parent[i]];
+      cache.Xworld[i] = Xupi * cache.Xworld[parent[i]];
+      cache.dXworld[i] = cache.dXup[i]*cache.Xworld[parent[i]] + Xupi*cache.dXworld[parent[i]];
     }
     else {
-      Xworld[i] = Xup[i];
-      dXworld[i] = dXup[i];
+      cache.Xworld[i] = Xupi;
+      cache.dXworld[i] = cache.dXup[i];
     }
 
-    Xg = Xworld[i] * Xcom; // spatial transform from centroid to body
-    dXg = dXworld[i] * Xcom + Xworld[i] * dXcom;
+    cache.Xg = cache.Xworld[i] * cache.Xcom; // spatial transform from centroid to body
+    cache.dXg = cache.dXworld[i] * cache.Xcom + cache.Xworld[i] * cache.dXcom;
 
     n = dofnum[i];
-    A.col(n) = Xg.transpose()*Ic[i]*phi[i];
-    Adot.col(n) = dXg.transpose()*Ic[i]*phi[i] + Xg.transpose()*dIc[i]*phi[i];
+    A.col(n) = cache.Xg.transpose()*cache.Ic[i]*cache.phi[i];
+    Adot.col(n) = cache.dXg.transpose()*cache.Ic[i]*cache.phi[i] + cache.Xg.transpose()*cache.dIc[i]*cache.phi[i];
   }
 }
 
 
 template <typename Derived>
-void RigidBodyManipulator::getCOM(MatrixBase<Derived> &com, const std::set<int> &robotnum)
+void RigidBodyManipulator::getCOM(KinematicsCache& cache, MatrixBase<Derived> &com, const std::set<int> &robotnum) const
 {
   double m = 0.0;
   double bm;
@@ -848,8 +769,8 @@ void RigidBodyManipulator::getCOM(MatrixBase<Derived> &com, const std::set<int>
     {
       bm = bodies[i].mass;
       if (bm>0) {
-        forwardKin(i,bodies[i].com,0,bc);
-        com = (m*com + bm*bc)/(m+bm);
+        forwardKin(cache,i,bodies[i].com,0,cache.bc);
+        com = (m*com + bm*cache.bc)/(m+bm);
         m = m+bm;
       }
     }
@@ -857,7 +778,7 @@ void RigidBodyManipulator::getCOM(MatrixBase<Derived> &com, const std::set<int>
 }
 
 template <typename Derived>
-void RigidBodyManipulator::getCOMJac(MatrixBase<Derived> &Jcom, const std::set<int> &robotnum)
+void RigidBodyManipulator::getCOMJac(KinematicsCache& cache, MatrixBase<Derived> &Jcom, const std::set<int> &robotnum) const
 {
   double m = 0.0;
   double bm;
@@ -869,16 +790,22 @@ void RigidBodyManipulator::getCOMJac(MatrixBase<Derived> &Jcom, const std::set<i
     {
       bm = bodies[i].mass;
       if (bm>0) {
-        forwardJac(i,bodies[i].com,0,bJ);
-        Jcom = (m*Jcom + bm*bJ)/(m+bm);
+        // accumulate directly into the columns of the body's ancestor dofs
+        const vector<int>& dofs = bodies[i].ancestor_dof_list;
+        int nd = dofs.size();
+        cache.dbcdq = cache.dTdq[i]*bodies[i].com;
+        for (int l=0; l<3; l++)
+          for (int k=0; k<nd; k++)
+            Jcom(l,dofs[k]) += bm*cache.dbcdq(l*nd+k);
         m = m+bm;
       }
     }
   }
+  if (m>0) Jcom /= m;
 }
 
 template <typename Derived>
-void RigidBodyManipulator::getCOMJacDot(MatrixBase<Derived> &Jcomdot, const std::set<int> &robotnum)
+void RigidBodyManipulator::getCOMJacDot(KinematicsCache& cache, MatrixBase<Derived> &Jcomdot, const std::set<int> &robotnum) const
 {
   double m = 0.0;
   double bm;
@@ -890,8 +817,8 @@ void RigidBodyManipulator::getCOMJacDot(MatrixBase<Derived> &Jcomdot, const std:
     {
       bm = bodies[i].mass;
       if (bm>0) {
-        forwardJacDot(i,bodies[i].com,0,bJ);
-        Jcomdot = (m*Jcomdot + bm*bJ)/(m+bm);
+        forwardJacDot(cache,i,bodies[i].com,0,cache.bJ);
+        Jcomdot = (m*Jcomdot + bm*cache.bJ)/(m+bm);
         m = m+bm;
       }
     }
@@ -899,7 +826,7 @@ void RigidBodyManipulator::getCOMJacDot(MatrixBase<Derived> &Jcomdot, const std:
 }
 
 template <typename Derived>
-void RigidBodyManipulator::getCOMdJac(MatrixBase<Derived> &dJcom, const std::set<int> &robotnum)
+void RigidBodyManipulator::getCOMdJac(KinematicsCache& cache, MatrixBase<Derived> &dJcom, const std::set<int> &robotnum) const
 {
   double m = 0.0;
   double bm;
@@ -911,12 +838,19 @@ void RigidBodyManipulator::getCOMdJac(MatrixBase<Derived> &dJcom, const std::set
     {
       bm = bodies[i].mass;
       if (bm>0) {
-        forwarddJac(i,bodies[i].com,bdJ);
-        dJcom = (m*dJcom + bm*bdJ)/(m+bm);
+        // accumulate directly into the columns of the body's ancestor dofs
+        const vector<int>& dofs = bodies[i].ancestor_dof_list;
+        int nd = dofs.size();
+        cache.dbcdq = cache.ddTdqdq[i]*bodies[i].com;
+        for (int kk=0; kk<nd; kk++)
+          for (int l=0; l<3; l++)
+            for (int k=0; k<nd; k++)
+              dJcom(l,dofs[k]*num_dof + dofs[kk]) += bm*cache.dbcdq(3*nd*kk + l*nd + k);
         m = m+bm;
       }
     }
   }
+  if (m>0) dJcom /= m;
 }
 
 int RigidBodyManipulator::getNumContacts(const set<int> &body_idx)
@@ -934,7 +868,7 @@ int RigidBodyManipulator::getNumContacts(const set<int> &body_idx)
 
 
 template <typename Derived>
-void RigidBodyManipulator::getContactPositions(MatrixBase<Derived> &pos, const set<int> &body_idx)
+void RigidBodyManipulator::getContactPositions(KinematicsCache& cache, MatrixBase<Derived> &pos, const set<int> &body_idx) const
 {
   int n=0,nc,nb=body_idx.size(),bi;
   if (nb==0) nb=num_bodies;
@@ -948,7 +882,7 @@ void RigidBodyManipulator::getContactPositions(MatrixBase<Derived> &pos, const s
       // note: it's possible to pass pos.block in directly but requires such an ugly hack that I think it's not worth it:
       // http://eigen.tuxfamily.org/dox/TopicFunctionTakingEigenTypes.html
       p.resize(3,nc);
-      forwardKin(bi,bodies[bi].contact_pts,0,p);
+      forwardKin(cache,bi,bodies[bi].contact_pts,0,p);
       pos.block(0,n,3,nc) = p;
       n += nc;
     }
@@ -956,7 +890,7 @@ void RigidBodyManipulator::getContactPositions(MatrixBase<Derived> &pos, const s
 }
 
 template <typename Derived>
-void RigidBodyManipulator::getContactPositionsJac(MatrixBase<Derived> &J, const set<int> &body_idx)
+void RigidBodyManipulator::getContactPositionsJac(KinematicsCache& cache, MatrixBase<Derived> &J, const set<int> &body_idx) const
 {
   int n=0,nc,nb=body_idx.size(),bi;
   if (nb==0) nb=num_bodies;
@@ -968,7 +902,7 @@ void RigidBodyManipulator::getContactPositionsJac(MatrixBase<Derived> &J, const
     nc = bodies[bi].contact_pts.cols();
     if (nc>0) {
       p.resize(3*nc,num_dof);
-      forwardJac(bi,bodies[bi].contact_pts,0,p);
+      forwardJac(cache,bi,bodies[bi].contact_pts,0,p);
       J.block(3*n,0,3*nc,num_dof) = p;
       n += nc;
     }
@@ -976,7 +910,7 @@ void RigidBodyManipulator::getContactPositionsJac(MatrixBase<Derived> &J, const
 }
 
 template <typename Derived>
-void RigidBodyManipulator::getContactPositionsJacDot(MatrixBase<Derived> &Jdot, const set<int> &body_idx)
+void RigidBodyManipulator::getContactPositionsJacDot(KinematicsCache& cache, MatrixBase<Derived> &Jdot, const set<int> &body_idx) const
 {
   int n=0,nc,nb=body_idx.size(),bi;
   if (nb==0) nb=num_bodies;
@@ -988,7 +922,7 @@ void RigidBodyManipulator::getContactPositionsJacDot(MatrixBase<Derived> &Jdot,
     nc = bodies[bi].contact_pts.cols();
     if (nc>0) {
       p.resize(3*nc,num_dof);
-      forwardJacDot(bi,bodies[bi].contact_pts,0,p);
+      forwardJacDot(cache,bi,bodies[bi].contact_pts,0,p);
       Jdot.block(3*n,0,3*nc,num_dof) = p;
       n += nc;
     }
@@ -996,7 +930,7 @@ void RigidBodyManipulator::getContactPositionsJacDot(MatrixBase<Derived> &Jdot,
 }
 
 /* [body_ind,Tframe] = parseBodyOrFrameID(body_or_frame_id) */
-int RigidBodyManipulator::parseBodyOrFrameID(const int body_or_frame_id, Matrix4d& Tframe)
+int RigidBodyManipulator::parseBodyOrFrameID(const int body_or_frame_id, Matrix4d& Tframe) const
 {
   int body_ind=0;
   if (body_or_frame_id == -1) {
@@ -1012,6 +946,32 @@ int RigidBodyManipulator::parseBodyOrFrameID(const int body_or_frame_id, Matrix4
   return body_ind;
 }
 
+const MatrixXd& RigidBodyManipulator::cachedQuery(KinematicsCache& cache, KinematicsCache::KinematicQueryKind kind, const int body_or_frame_ind, const MatrixXd& pts, const int rotation_type, const std::set<int> &robotnum) const
+{
+  const MatrixXd* stored = cache.findQuery(kind,body_or_frame_ind,pts,rotation_type,robotnum);
+  if (stored) return *stored;
+
+  MatrixXd& result = cache.addQuery(kind,body_or_frame_ind,pts,rotation_type,robotnum);
+  switch (kind) {
+    case KinematicsCache::FORWARD_KIN:
+      forwardKin(cache,body_or_frame_ind,pts,rotation_type,result);
+      break;
+    case KinematicsCache::FORWARD_JAC:
+      result.resize((rotation_type==0 ? 3 : (rotation_type==1 ? 6 : 7))*pts.cols(),num_dof);
+      forwardJac(cache,body_or_frame_ind,pts,rotation_type,result);
+      break;
+    case KinematicsCache::COM:
+      result.resize(3,1);
+      getCOM(cache,result,robotnum);
+      break;
+    case KinematicsCache::COM_JAC:
+      result.resize(3,num_dof);
+      getCOMJac(cache,result,robotnum);
+      break;
+  }
+  return result;
+}
+
 /*
  * rotation_type  0, no rotation
  * 		  1, output Euler angles
@@ -1019,12 +979,12 @@ int RigidBodyManipulator::parseBodyOrFrameID(const int body_or_frame_id, Matrix4
  */
 
 template <typename DerivedA, typename DerivedB>
-void RigidBodyManipulator::forwardKin(const int body_or_frame_id, const MatrixBase<DerivedA>& pts, const int rotation_type, MatrixBase<DerivedB> &x)
+void RigidBodyManipulator::forwardKin(KinematicsCache& cache, const int body_or_frame_id, const MatrixBase<DerivedA>& pts, const int rotation_type, MatrixBase<DerivedB> &x) const
 {
   int n_pts = pts.cols(); Matrix4d Tframe;
   int body_ind = parseBodyOrFrameID(body_or_frame_id,Tframe);
 
-  MatrixXd T = bodies[body_ind].T.topLeftCorner(3,4)*Tframe;
+  MatrixXd T = cache.T[body_ind].topLeftCorner(3,4)*Tframe;
 
   if (rotation_type == 0) {
     x = T*pts;
@@ -1082,27 +1042,30 @@ void RigidBodyManipulator::forwardKin(const int body_or_frame_id, const MatrixBa
 }
 
 template <typename DerivedA, typename DerivedB, typename DerivedC, typename DerivedD>
-void RigidBodyManipulator::bodyKin(const int body_or_frame_id, const MatrixBase<DerivedA>& pts, MatrixBase<DerivedB> &x, MatrixBase<DerivedC> *J, MatrixBase<DerivedD> *P)
+void RigidBodyManipulator::bodyKin(KinematicsCache& cache, const int body_or_frame_id, const MatrixBase<DerivedA>& pts, MatrixBase<DerivedB> &x, MatrixBase<DerivedC> *J, MatrixBase<DerivedD> *P) const
 {
   Matrix4d Tframe;
   int body_ind = parseBodyOrFrameID(body_or_frame_id,Tframe);
 
-  MatrixXd Tinv = (bodies[body_ind].T*Tframe).inverse();
+  MatrixXd Tinv = (cache.T[body_ind]*Tframe).inverse();
   x = Tinv.topLeftCorner(3,4)*pts;
 
   if (J) {
     int i;
-    MatrixXd dTdq =  bodies[body_ind].dTdq.topLeftCorner(3*num_dof,4)*Tframe;
+    const vector<int>& dofs = bodies[body_ind].ancestor_dof_list;
+    int m = dofs.size();
+    MatrixXd dTdq =  cache.dTdq[body_ind]*Tframe;
     MatrixXd dTinvdq = dTdq*Tinv;
-    for (i=0;i<num_dof;i++) {
+    J->setZero();
+    for (i=0;i<m;i++) {
       MatrixXd dTinvdqi = MatrixXd::Zero(4,4);
       dTinvdqi.row(0) = dTinvdq.row(i);
-      dTinvdqi.row(1) = dTinvdq.row(num_dof+i);
-      dTinvdqi.row(2) = dTinvdq.row(2*num_dof+i);
+      dTinvdqi.row(1) = dTinvdq.row(m+i);
+      dTinvdqi.row(2) = dTinvdq.row(2*m+i);
       dTinvdqi = -Tinv*dTinvdqi;
       MatrixXd dxdqi = dTinvdqi.topLeftCorner(3,4)*pts;
       dxdqi.resize(dxdqi.rows()*dxdqi.cols(),1);
-      J->col(i) = dxdqi;
+      J->col(dofs[i]) = dxdqi;
     }
   }
   if (P) {
@@ -1115,30 +1078,38 @@ void RigidBodyManipulator::bodyKin(const int body_or_frame_id, const MatrixBase<
 }
 
 template <typename DerivedA, typename DerivedB>
-void RigidBodyManipulator::forwardJac(const int body_or_frame_id, const MatrixBase<DerivedA> &pts, const int rotation_type, MatrixBase<DerivedB> &J)
+void RigidBodyManipulator::forwardJac(KinematicsCache& cache, const int body_or_frame_id, const MatrixBase<DerivedA> &pts, const int rotation_type, MatrixBase<DerivedB> &J) const
 {
   int n_pts = pts.cols(); Matrix4d Tframe;
   int body_ind = parseBodyOrFrameID(body_or_frame_id,Tframe);
 
-  MatrixXd dTdq =  bodies[body_ind].dTdq.topLeftCorner(3*num_dof,4)*Tframe;
+  // dTdq only stores the rows of the body's ancestor dofs; scatter them into the full jacobian
+  const vector<int>& dofs = bodies[body_ind].ancestor_dof_list;
+  int m = dofs.size();
+
+  MatrixXd dTdq =  cache.dTdq[body_ind]*Tframe;
   MatrixXd tmp =dTdq*pts;
-  MatrixXd Jt = Map<MatrixXd>(tmp.data(),num_dof,3*n_pts);
-  J.topLeftCorner(3*n_pts,num_dof) = Jt.transpose();
+  J.topLeftCorner(3*n_pts,num_dof).setZero();
+  for (int j=0; j<n_pts; j++)
+    for (int l=0; l<3; l++)
+      for (int k=0; k<m; k++)
+        J(3*j+l,dofs[k]) = tmp(l*m+k,j);
 
   if (rotation_type == 1) {
-    Matrix3d R = (bodies[body_ind].T*Tframe).topLeftCorner(3,3);
+    Matrix3d R = (cache.T[body_ind]*Tframe).topLeftCorner(3,3);
     /*
      * note the unusual format of dTdq(chosen for efficiently calculating jacobians from many pts)
-     * dTdq = [dT(1,:)dq1; dT(1,:)dq2; ...; dT(1,:)dqN; dT(2,dq1) ...]
+     * dTdq = [dT(1,:)dqa1; dT(1,:)dqa2; ...; dT(1,:)dqam; dT(2,dqa1) ...]
      */
 
-    VectorXd dR21_dq(num_dof),dR22_dq(num_dof),dR20_dq(num_dof),dR00_dq(num_dof),dR10_dq(num_dof);
-    for (int i=0; i<num_dof; i++) {
-      dR21_dq(i) = dTdq(2*num_dof+i,1);
-      dR22_dq(i) = dTdq(2*num_dof+i,2);
-      dR20_dq(i) = dTdq(2*num_dof+i,0);
-      dR00_dq(i) = dTdq(i,0);
-      dR10_dq(i) = dTdq(num_dof+i,0);
+    VectorXd dR21_dq = VectorXd::Zero(num_dof),dR22_dq = VectorXd::Zero(num_dof),dR20_dq = VectorXd::Zero(num_dof),dR00_dq = VectorXd::Zero(num_dof),dR10_dq = VectorXd::Zero(num_dof);
+    for (int k=0; k<m; k++) {
+      int i = dofs[k];
+      dR21_dq(i) = dTdq(2*m+k,1);
+      dR22_dq(i) = dTdq(2*m+k,2);
+      dR20_dq(i) = dTdq(2*m+k,0);
+      dR00_dq(i) = dTdq(k,0);
+      dR10_dq(i) = dTdq(m+k,0);
     }
     double sqterm1 = R(2,1)*R(2,1) + R(2,2)*R(2,2);
     double sqterm2 = R(0,0)*R(0,0) + R(1,0)*R(1,0);
@@ -1156,19 +1127,20 @@ void RigidBodyManipulator::forwardJac(const int body_or_frame_id, const MatrixBa
     }
     J=Jfull;
   } else if(rotation_type == 2) {
-    Matrix3d R = (bodies[body_ind].T*Tframe).topLeftCorner(3,3);
-
-    VectorXd dR21_dq(num_dof),dR22_dq(num_dof),dR20_dq(num_dof),dR00_dq(num_dof),dR10_dq(num_dof),dR01_dq(num_dof),dR02_dq(num_dof),dR11_dq(num_dof),dR12_dq(num_dof);
-    for (int i=0; i<num_dof; i++) {
-      dR21_dq(i) = dTdq(2*num_dof+i,1);
-      dR22_dq(i) = dTdq(2*num_dof+i,2);
-      dR20_dq(i) = dTdq(2*num_dof+i,0);
-      dR00_dq(i) = dTdq(i,0);
-      dR10_dq(i) = dTdq(num_dof+i,0);
-      dR01_dq(i) = dTdq(i,1);
-      dR02_dq(i) = dTdq(i,2);
-      dR11_dq(i) = dTdq(num_dof+i,1);
-      dR12_dq(i) = dTdq(num_dof+i,2);
+    Matrix3d R = (cache.T[body_ind]*Tframe).topLeftCorner(3,3);
+
+    VectorXd dR21_dq = VectorXd::Zero(num_dof),dR22_dq = VectorXd::Zero(num_dof),dR20_dq = VectorXd::Zero(num_dof),dR00_dq = VectorXd::Zero(num_dof),dR10_dq = VectorXd::Zero(num_dof),dR01_dq = VectorXd::Zero(num_dof),dR02_dq = VectorXd::Zero(num_dof),dR11_dq = VectorXd::Zero(num_dof),dR12_dq = VectorXd::Zero(num_dof);
+    for (int k=0; k<m; k++) {
+      int i = dofs[k];
+      dR21_dq(i) = dTdq(2*m+k,1);
+      dR22_dq(i) = dTdq(2*m+k,2);
+      dR20_dq(i) = dTdq(2*m+k,0);
+      dR00_dq(i) = dTdq(k,0);
+      dR10_dq(i) = dTdq(m+k,0);
+      dR01_dq(i) = dTdq(k,1);
+      dR02_dq(i) = dTdq(k,2);
+      dR11_dq(i) = dTdq(m+k,1);
+      dR12_dq(i) = dTdq(m+k,2);
     }
 
   	Vector4d case_check;
@@ -1223,31 +1195,38 @@ void RigidBodyManipulator::forwardJac(const int body_or_frame_id, const MatrixBa
 }
 
 template <typename DerivedA, typename DerivedB>
-void RigidBodyManipulator::forwardJacDot(const int body_or_frame_id, const MatrixBase<DerivedA> &pts, const int rotation_type, MatrixBase<DerivedB>& Jdot)
+void RigidBodyManipulator::forwardJacDot(KinematicsCache& cache, const int body_or_frame_id, const MatrixBase<DerivedA> &pts, const int rotation_type, MatrixBase<DerivedB>& Jdot) const
 {
   int n_pts = pts.cols(); Matrix4d Tframe;
   int body_ind = parseBodyOrFrameID(body_or_frame_id,Tframe);
 
-	MatrixXd tmp = bodies[body_ind].dTdqdot*Tframe*pts;
-	MatrixXd Jdott = Map<MatrixXd>(tmp.data(),num_dof,3*n_pts);
-	Jdot = Jdott.transpose();
+	const vector<int>& dofs = bodies[body_ind].ancestor_dof_list;
+	int m = dofs.size();
+
+	MatrixXd tmp = cache.dTdqdot[body_ind]*Tframe*pts;
+	Jdot = MatrixXd::Zero(3*n_pts,num_dof);
+	for (int j=0; j<n_pts; j++)
+		for (int l=0; l<3; l++)
+			for (int k=0; k<m; k++)
+				Jdot(3*j+l,dofs[k]) = tmp(l*m+k,j);
 
 	if (rotation_type==1) {
 
-		MatrixXd dTdqdot =  bodies[body_ind].dTdqdot*Tframe;
-		Matrix3d R = (bodies[body_ind].T*Tframe).topLeftCorner(3,3);
+		MatrixXd dTdqdot =  cache.dTdqdot[body_ind]*Tframe;
+		Matrix3d R = (cache.T[body_ind]*Tframe).topLeftCorner(3,3);
 		/*
 		 * note the unusual format of dTdq(chosen for efficiently calculating jacobians from many pts)
-		 * dTdq = [dT(1,:)dq1; dT(1,:)dq2; ...; dT(1,:)dqN; dT(2,dq1) ...]
+		 * dTdq = [dT(1,:)dqa1; dT(1,:)dqa2; ...; dT(1,:)dqam; dT(2,dqa1) ...]
 		 */
 
-		VectorXd dR21_dq(num_dof),dR22_dq(num_dof),dR20_dq(num_dof),dR00_dq(num_dof),dR10_dq(num_dof);
-		for (int i=0; i<num_dof; i++) {
-			dR21_dq(i) = dTdqdot(2*num_dof+i,1);
-			dR22_dq(i) = dTdqdot(2*num_dof+i,2);
-			dR20_dq(i) = dTdqdot(2*num_dof+i,0);
-			dR00_dq(i) = dTdqdot(i,0);
-			dR10_dq(i) = dTdqdot(num_dof+i,0);
+		VectorXd dR21_dq = VectorXd::Zero(num_dof),dR22_dq = VectorXd::Zero(num_dof),dR20_dq = VectorXd::Zero(num_dof),dR00_dq = VectorXd::Zero(num_dof),dR10_dq = VectorXd::Zero(num_dof);
+		for (int k=0; k<m; k++) {
+			int i = dofs[k];
+			dR21_dq(i) = dTdqdot(2*m+k,1);
+			dR22_dq(i) = dTdqdot(2*m+k,2);
+			dR20_dq(i) = dTdqdot(2*m+k,0);
+			dR00_dq(i) = dTdqdot(k,0);
+			dR10_dq(i) = dTdqdot(m+k,0);
 		}
 		double sqterm1 = R(2,1)*R(2,1) + R(2,2)*R(2,2);
 		double sqterm2 = R(0,0)*R(0,0) + R(1,0)*R(1,0);
@@ -1268,96 +1247,100 @@ void RigidBodyManipulator::forwardJacDot(const int body_or_frame_id, const Matri
 }
 
 template <typename DerivedA, typename DerivedB>
-void RigidBodyManipulator::forwarddJac(const int body_or_frame_id, const MatrixBase<DerivedA> &pts, MatrixBase<DerivedB>& dJ)
+void RigidBodyManipulator::forwarddJac(KinematicsCache& cache, const int body_or_frame_id, const MatrixBase<DerivedA> &pts, MatrixBase<DerivedB>& dJ) const
 {
   int n_pts = pts.cols(); Matrix4d Tframe;
   int body_ind = parseBodyOrFrameID(body_or_frame_id,Tframe);
 
-  int i,j;
-  MatrixXd dJ_reshaped = MatrixXd(num_dof, 3*n_pts*num_dof);
-  MatrixXd tmp = MatrixXd(3*num_dof,n_pts);
-  for (i = 0; i < num_dof; i++) {
-    tmp = bodies[body_ind].ddTdqdq.block(i*num_dof*3,0,3*num_dof,4)*Tframe*pts;  //dim*num_dof x n_pts
-    for (j = 0; j < n_pts; j++) {
-      dJ_reshaped.block(i,j*3*num_dof,1,3*num_dof) = tmp.col(j).transpose();
-    }
-    //       dJ_reshaped.row(i) << tmp.col(0).transpose(), tmp.col(1).transpose();
+  // ddTdqdq only stores the blocks of the body's ancestor dofs
+  const vector<int>& dofs = bodies[body_ind].ancestor_dof_list;
+  int m = dofs.size();
+
+  int i,j,k,l;
+  dJ = MatrixXd::Zero(3*n_pts,num_dof*num_dof);
+  MatrixXd tmp = MatrixXd(3*m,n_pts);
+  for (i = 0; i < m; i++) {
+    tmp = cache.ddTdqdq[body_ind].block(i*m*3,0,3*m,4)*Tframe*pts;  //dim*m x n_pts
+    for (j = 0; j < n_pts; j++)
+      for (l = 0; l < 3; l++)
+        for (k = 0; k < m; k++)
+          dJ(3*j+l,dofs[k]*num_dof + dofs[i]) = tmp(l*m+k,j);
   }
-  MatrixXd dJ_t = Map<MatrixXd>(dJ_reshaped.data(), num_dof*num_dof, 3*n_pts);
-  dJ = dJ_t.transpose();
 }
 
 template <typename DerivedA, typename DerivedB, typename DerivedC, typename DerivedD, typename DerivedE, typename DerivedF>
-void RigidBodyManipulator::HandC(double * const q, double * const qd, MatrixBase<DerivedA> * const f_ext, MatrixBase<DerivedB> &H, MatrixBase<DerivedC> &C, MatrixBase<DerivedD> *dH, MatrixBase<DerivedE> *dC, MatrixBase<DerivedF> * const df_ext)
+void RigidBodyManipulator::HandC(KinematicsCache& cache, double * const q, double * const qd, MatrixBase<DerivedA> * const f_ext, MatrixBase<DerivedB> &H, MatrixBase<DerivedC> &C, MatrixBase<DerivedD> *dH, MatrixBase<DerivedE> *dC, MatrixBase<DerivedF> * const df_ext) const
 {
   H = MatrixXd::Zero(num_dof,num_dof);
   if (dH) *dH = MatrixXd::Zero(num_dof*num_dof,num_dof);
   // C gets overwritten completely in the algorithm below
 
-  VectorXd vJ(6), fh(6), dfh(6), dvJdqd(6);
-  MatrixXd XJ(6,6), dXJdq(6,6);
+  Vector6d vJ, fh, dfh, dvJdqd;
+  PluckerTransform XJ;
+  Matrix6d dXJdq, Xupi;
   int i,j,k,n,np,nk;
 
   for (i=0; i<NB; i++) {
     n = dofnum[i];
-    jcalc(pitch[i],q[n],&XJ,&(S[i]));
-    vJ = S[i] * qd[n];
-    Xup[i] = XJ * Xtree[i];
+    jcalc(pitch[i],q[n],&XJ,&(cache.S[i]));
+    vJ = cache.S[i] * qd[n];
+    cache.Xup[i] = XJ * PluckerTransform(Xtree[i]);
 
     if (parent[i] < 0) {
-      v[i] = vJ;
-      avp[i] = Xup[i] * (-a_grav);
+      cache.v[i] = vJ;
+      cache.avp[i] = cache.Xup[i].apply(-a_grav);
     } else {
-      v[i] = Xup[i]*v[parent[i]] + vJ;
-      avp[i] = Xup[i]*avp[parent[i]] + crm(v[i])*vJ;
+      cache.v[i] = cache.Xup[i].apply(cache.v[parent[i]]) + vJ;
+      cache.avp[i] = cache.Xup[i].apply(cache.avp[parent[i]]) + crossMotion(cache.v[i],vJ);
     }
-    fvp[i] = I[i]*avp[i] + crf(v[i])*I[i]*v[i];
+    cache.fvp[i] = I[i]*cache.avp[i] + crossForce(cache.v[i],I[i]*cache.v[i]);
     if (f_ext)
-      fvp[i] = fvp[i] - f_ext->col(i);
-    IC[i] = I[i];
+      cache.fvp[i] -= f_ext->col(i);
+    cache.IC[i] = I[i];
 
     //Calculate gradient information if it is requested
     if (dH || dC) {
       djcalc(pitch[i], q[n], &dXJdq);
-      dXupdq[i] = dXJdq * Xtree[i];
+      cache.dXupdq[i] = dXJdq * Xtree[i];
 
       for (j=0; j<NB; j++) {
-        dIC[i][j] = MatrixXd::Zero(6,6);
+        cache.dIC[i][j] = Matrix6d::Zero();
       }
     }
 
     if (dC) {
-      dvJdqd = S[i];
+      dvJdqd = cache.S[i];
       if (parent[i] < 0) {
-        dvdqd[i].col(n) = dvJdqd;
-        davpdq[i].col(n) = dXupdq[i] * (-a_grav);
+        cache.dvdqd[i].col(n) = dvJdqd;
+        cache.davpdq[i].col(n) = cache.dXupdq[i] * (-a_grav);
       } else {
         j = parent[i];
-        dvdq[i] = Xup[i]*dvdq[j];
-        dvdq[i].col(n) += dXupdq[i]*v[j];
-        dvdqd[i] = Xup[i]*dvdqd[j];
-        dvdqd[i].col(n) += dvJdqd;
-
-        davpdq[i] = Xup[i]*davpdq[j];
-        davpdq[i].col(n) += dXupdq[i]*avp[j];
+        Xupi = cache.Xup[i].toMatrix();
+        cache.dvdq[i] = Xupi*cache.dvdq[j];
+        cache.dvdq[i].col(n) += cache.dXupdq[i]*cache.v[j];
+        cache.dvdqd[i] = Xupi*cache.dvdqd[j];
+        cache.dvdqd[i].col(n) += dvJdqd;
+
+        cache.davpdq[i] = Xupi*cache.davpdq[j];
+        cache.davpdq[i].col(n) += cache.dXupdq[i]*cache.avp[j];
         for (k=0; k < NB; k++) {
-          dcrm(v[i],vJ,dvdq[i].col(k),VectorXd::Zero(6),&(dcross));
-          davpdq[i].col(k) += dcross;
+          dcrm(cache.v[i],vJ,cache.dvdq[i].col(k),MatrixXd::Zero(6,1),&(cache.dcross));
+          cache.davpdq[i].col(k) += cache.dcross;
         }
 
-        dvJdqd_mat = MatrixXd::Zero(6,NB);
-        dvJdqd_mat.col(n) = dvJdqd;
-        dcrm(v[i],vJ,dvdqd[i],dvJdqd_mat,&(dcross));
-        davpdqd[i] = Xup[i]*davpdqd[j] + dcross;
+        cache.dvJdqd_mat = MatrixXd::Zero(6,NB);
+        cache.dvJdqd_mat.col(n) = dvJdqd;
+        dcrm(cache.v[i],vJ,cache.dvdqd[i],cache.dvJdqd_mat,&(cache.dcross));
+        cache.davpdqd[i] = Xupi*cache.davpdqd[j] + cache.dcross;
       }
 
-      dcrf(v[i],I[i]*v[i],dvdq[i],I[i]*dvdq[i],&(dcross));
-      dfvpdq[i] = I[i]*davpdq[i] + dcross;
-      dcrf(v[i],I[i]*v[i],dvdqd[i],I[i]*dvdqd[i],&(dcross));
-      dfvpdqd[i] = I[i]*davpdqd[i] + dcross;
+      dcrf(cache.v[i],I[i]*cache.v[i],cache.dvdq[i],I[i]*cache.dvdq[i],&(cache.dcross));
+      cache.dfvpdq[i] = I[i]*cache.davpdq[i] + cache.dcross;
+      dcrf(cache.v[i],I[i]*cache.v[i],cache.dvdqd[i],I[i]*cache.dvdqd[i],&(cache.dcross));
+      cache.dfvpdqd[i] = I[i]*cache.davpdqd[i] + cache.dcross;
       if (df_ext) {
-	dfvpdq[i] = dfvpdq[i] - df_ext->block(i*6,0,6,num_dof);
-	dfvpdqd[i] = dfvpdqd[i] - df_ext->block(i*6,num_dof,6,num_dof);
+	cache.dfvpdq[i] = cache.dfvpdq[i] - df_ext->block(i*6,0,6,num_dof);
+	cache.dfvpdqd[i] = cache.dfvpdqd[i] - df_ext->block(i*6,num_dof,6,num_dof);
       }
 
     }
@@ -1365,7 +1348,7 @@ void RigidBodyManipulator::HandC(double * const q, double * const qd, MatrixBase
 
   for (i=(NB-1); i>=0; i--) {
     n = dofnum[i];
-    C(n) = (S[i]).transpose() * fvp[i] + damping[i]*qd[n];
+    C(n) = cache.S[i].dot(cache.fvp[i]) + damping[i]*qd[n];
 
     if (qd[n] >= coulomb_window[i]) {
       C(n) += coulomb_friction[i];
@@ -1378,48 +1361,46 @@ void RigidBodyManipulator::HandC(double * const q, double * const qd, MatrixBase
     }
 
     if (dC) {
-      (*dC).block(n,0,1,NB) = S[i].transpose()*dfvpdq[i];
-      (*dC).block(n,NB,1,NB) = S[i].transpose()*dfvpdqd[i];
+      (*dC).block(n,0,1,NB) = cache.S[i].transpose()*cache.dfvpdq[i];
+      (*dC).block(n,NB,1,NB) = cache.S[i].transpose()*cache.dfvpdqd[i];
       (*dC)(n,NB+n) += damping[i];
 
-      if (qd[n]<0 && qd[n]>-coulomb_window[i]) {
-        (*dC)(n,NB+n) -= 1/coulomb_window[i] * coulomb_friction[i];
-      }
-      else if (qd[n]>=0 && qd[n]<coulomb_window[i]) {
+      if (qd[n]>-coulomb_window[i] && qd[n]<coulomb_window[i]) {
         (*dC)(n,NB+n) += 1/coulomb_window[i] * coulomb_friction[i];
       }
     }
 
     if (parent[i] >= 0) {
-      fvp[parent[i]] += (Xup[i]).transpose()*fvp[i];
-      IC[parent[i]] += (Xup[i]).transpose()*IC[i]*Xup[i];
+      cache.fvp[parent[i]] += cache.Xup[i].applyTranspose(cache.fvp[i]);
+      cache.IC[parent[i]] += cache.Xup[i].transformInertia(cache.IC[i]);
 
+      if (dH || dC) Xupi = cache.Xup[i].toMatrix();
       if (dH) {
         for (k=0; k < NB; k++) {
-          dIC[parent[i]][k] += Xup[i].transpose()*dIC[i][k]*Xup[i];
+          cache.dIC[parent[i]][k] += Xupi.transpose()*cache.dIC[i][k]*Xupi;
         }
-        dIC[parent[i]][n] += dXupdq[i].transpose()*IC[i]*Xup[i] + Xup[i].transpose()*IC[i]*dXupdq[i];
+        cache.dIC[parent[i]][n] += cache.dXupdq[i].transpose()*cache.IC[i]*Xupi + Xupi.transpose()*cache.IC[i]*cache.dXupdq[i];
       }
 
       if (dC) {
-        dfvpdq[parent[i]] += Xup[i].transpose()*dfvpdq[i];
-        dfvpdq[parent[i]].col(n) += dXupdq[i].transpose()*fvp[i];
-        dfvpdqd[parent[i]] += Xup[i].transpose()*dfvpdqd[i];
+        cache.dfvpdq[parent[i]] += Xupi.transpose()*cache.dfvpdq[i];
+        cache.dfvpdq[parent[i]].col(n) += cache.dXupdq[i].transpose()*cache.fvp[i];
+        cache.dfvpdqd[parent[i]] += Xupi.transpose()*cache.dfvpdqd[i];
       }
     }
   }
 
   for (i=0; i<NB; i++) {
     n = dofnum[i];
-    fh = IC[i] * S[i];
-    H(n,n) = (S[i]).transpose() * fh;
+    fh = cache.IC[i] * cache.S[i];
+    H(n,n) = cache.S[i].dot(fh);
     j=i;
     while (parent[j] >= 0) {
-      fh = (Xup[j]).transpose() * fh;
+      fh = cache.Xup[j].applyTranspose(fh);
       j = parent[j];
       np = dofnum[j];
 
-      H(n,np) = (S[j]).transpose() * fh;
+      H(n,np) = cache.S[j].dot(fh);
       H(np,n) = H(n,np);
     }
   }
@@ -1429,21 +1410,21 @@ void RigidBodyManipulator::HandC(double * const q, double * const qd, MatrixBase
       nk = dofnum[k];
       for (i=0; i < NB; i++) {
         n = dofnum[i];
-        fh = IC[i] * S[i];
-        dfh = dIC[i][nk] * S[i]; //dfh/dqk
-        (*dH)(n + n*NB,nk) = S[i].transpose() * dfh;
+        fh = cache.IC[i] * cache.S[i];
+        dfh = cache.dIC[i][nk] * cache.S[i]; //dfh/dqk
+        (*dH)(n + n*NB,nk) = cache.S[i].dot(dfh);
         j = i;
         while (parent[j] >= 0) {
           if (j==k) {
-            dfh = Xup[j].transpose() * dfh + dXupdq[j].transpose() * fh;
+            dfh = cache.Xup[j].applyTranspose(dfh) + cache.dXupdq[j].transpose() * fh;
           } else {
-            dfh = Xup[j].transpose() * dfh;
+            dfh = cache.Xup[j].applyTranspose(dfh);
           }
-          fh = Xup[j].transpose() * fh;
+          fh = cache.Xup[j].applyTranspose(fh);
 
           j = parent[j];
           np = dofnum[j];
-          (*dH)(n + (np)*NB,nk) = S[j].transpose() * dfh;
+          (*dH)(n + (np)*NB,nk) = cache.S[j].dot(dfh);
           (*dH)(np + (n)*NB,nk) = (*dH)(n + np*NB,nk);
         }
       }
@@ -1451,6 +1432,302 @@ void RigidBodyManipulator::HandC(double * const q, double * const qd, MatrixBase
   }
 }
 
+template <typename DerivedA, typename DerivedB, typename DerivedC, typename DerivedD, typename DerivedE>
+void RigidBodyManipulator::inverseDynamics(KinematicsCache& cache, double * const q, double * const qd, const MatrixBase<DerivedA> &qdd, MatrixBase<DerivedB> * const f_ext, MatrixBase<DerivedC> &tau, MatrixBase<DerivedD> *dtau, MatrixBase<DerivedE> * const df_ext) const
+{
+  // recursive Newton-Euler algorithm; this is HandC's velocity-product pass with qdd folded into avp
+  Vector6d vJ;
+  PluckerTransform XJ;
+  Matrix6d dXJdq, Xupi;
+  int i,j,n;
+
+  for (i=0; i<NB; i++) {
+    n = dofnum[i];
+    jcalc(pitch[i],q[n],&XJ,&(cache.S[i]));
+    vJ = cache.S[i] * qd[n];
+    cache.Xup[i] = XJ * PluckerTransform(Xtree[i]);
+
+    if (parent[i] < 0) {
+      cache.v[i] = vJ;
+      cache.avp[i] = cache.Xup[i].apply(-a_grav) + cache.S[i]*qdd(n);
+    } else {
+      cache.v[i] = cache.Xup[i].apply(cache.v[parent[i]]) + vJ;
+      cache.avp[i] = cache.Xup[i].apply(cache.avp[parent[i]]) + cache.S[i]*qdd(n) + crossMotion(cache.v[i],vJ);
+    }
+    cache.fvp[i] = I[i]*cache.avp[i] + crossForce(cache.v[i],I[i]*cache.v[i]);
+    if (f_ext)
+      cache.fvp[i] -= f_ext->col(i);
+
+    if (dtau) {
+      djcalc(pitch[i], q[n], &dXJdq);
+      cache.dXupdq[i] = dXJdq * Xtree[i];
+
+      if (parent[i] < 0) {
+        cache.dvdq[i].setZero();
+        cache.dvdqd[i].setZero();
+        cache.dvdqd[i].col(n) = cache.S[i];
+        cache.davpdq[i].setZero();
+        cache.davpdq[i].col(n) = cache.dXupdq[i] * (-a_grav);
+        cache.davpdqd[i].setZero();
+      } else {
+        j = parent[i];
+        Xupi = cache.Xup[i].toMatrix();
+        cache.dvdq[i] = Xupi*cache.dvdq[j];
+        cache.dvdq[i].col(n) += cache.dXupdq[i]*cache.v[j];
+        cache.dvdqd[i] = Xupi*cache.dvdqd[j];
+        cache.dvdqd[i].col(n) += cache.S[i];
+
+        cache.davpdq[i] = Xupi*cache.davpdq[j];
+        cache.davpdq[i].col(n) += cache.dXupdq[i]*cache.avp[j];
+        dcrm(cache.v[i],vJ,cache.dvdq[i],MatrixXd::Zero(6,num_dof),&(cache.dcross));
+        cache.davpdq[i] += cache.dcross;
+
+        cache.dvJdqd_mat = MatrixXd::Zero(6,num_dof);
+        cache.dvJdqd_mat.col(n) = cache.S[i];
+        dcrm(cache.v[i],vJ,cache.dvdqd[i],cache.dvJdqd_mat,&(cache.dcross));
+        cache.davpdqd[i] = Xupi*cache.davpdqd[j] + cache.dcross;
+      }
+
+      dcrf(cache.v[i],I[i]*cache.v[i],cache.dvdq[i],I[i]*cache.dvdq[i],&(cache.dcross));
+      cache.dfvpdq[i] = I[i]*cache.davpdq[i] + cache.dcross;
+      dcrf(cache.v[i],I[i]*cache.v[i],cache.dvdqd[i],I[i]*cache.dvdqd[i],&(cache.dcross));
+      cache.dfvpdqd[i] = I[i]*cache.davpdqd[i] + cache.dcross;
+      if (df_ext) {
+        cache.dfvpdq[i] -= df_ext->block(i*6,0,6,num_dof);
+        cache.dfvpdqd[i] -= df_ext->block(i*6,num_dof,6,num_dof);
+      }
+    }
+  }
+
+  for (i=(NB-1); i>=0; i--) {
+    n = dofnum[i];
+    tau(n) = cache.S[i].dot(cache.fvp[i]) + damping[i]*qd[n];
+
+    if (qd[n] >= coulomb_window[i]) {
+      tau(n) += coulomb_friction[i];
+    }
+    else if (qd[n] <= -coulomb_window[i]) {
+      tau(n) -= coulomb_friction[i];
+    }
+    else {
+      tau(n) += qd[n]/coulomb_window[i] * coulomb_friction[i];
+    }
+
+    if (dtau) {
+      dtau->block(n,0,1,num_dof) = cache.S[i].transpose()*cache.dfvpdq[i];
+      dtau->block(n,num_dof,1,num_dof) = cache.S[i].transpose()*cache.dfvpdqd[i];
+      (*dtau)(n,num_dof+n) += damping[i];
+
+      if (qd[n]>-coulomb_window[i] && qd[n]<coulomb_window[i]) {
+        (*dtau)(n,num_dof+n) += 1/coulomb_window[i] * coulomb_friction[i];
+      }
+    }
+
+    if (parent[i] >= 0) {
+      cache.fvp[parent[i]] += cache.Xup[i].applyTranspose(cache.fvp[i]);
+
+      if (dtau) {
+        Xupi = cache.Xup[i].toMatrix();
+        cache.dfvpdq[parent[i]] += Xupi.transpose()*cache.dfvpdq[i];
+        cache.dfvpdq[parent[i]].col(n) += cache.dXupdq[i].transpose()*cache.fvp[i];
+        cache.dfvpdqd[parent[i]] += Xupi.transpose()*cache.dfvpdqd[i];
+      }
+    }
+  }
+}
+
+template <typename DerivedA, typename DerivedB, typename DerivedC, typename DerivedD, typename DerivedE>
+bool RigidBodyManipulator::forwardDynamics(KinematicsCache& cache, double * const q, double * const qd, const MatrixBase<DerivedA> &tau, MatrixBase<DerivedB> * const f_ext, MatrixBase<DerivedC> &qdd, MatrixBase<DerivedD> *dqdd, MatrixBase<DerivedE> * const df_ext) const
+{
+  // articulated-body algorithm, see Featherstone, "Rigid Body Dynamics Algorithms" (2008), table 7.1
+  Vector6d vJ, Ia_c;
+  PluckerTransform XJ;
+  Matrix6d Ia;
+  int i,n;
+
+  for (i=0; i<NB; i++) {
+    n = dofnum[i];
+    jcalc(pitch[i],q[n],&XJ,&(cache.S[i]));
+    vJ = cache.S[i] * qd[n];
+    cache.Xup[i] = XJ * PluckerTransform(Xtree[i]);
+
+    if (parent[i] < 0)
+      cache.v[i] = vJ;
+    else
+      cache.v[i] = cache.Xup[i].apply(cache.v[parent[i]]) + vJ;
+    cache.avp[i] = crossMotion(cache.v[i],vJ);  // velocity-product acceleration (c_i)
+    cache.IC[i] = I[i];  // articulated-body inertia (I^A_i)
+    cache.fvp[i] = crossForce(cache.v[i],I[i]*cache.v[i]);  // articulated-body bias force (p^A_i)
+    if (f_ext)
+      cache.fvp[i] -= f_ext->col(i);
+  }
+
+  for (i=(NB-1); i>=0; i--) {
+    n = dofnum[i];
+    cache.U[i] = cache.IC[i] * cache.S[i];
+    cache.D[i] = cache.S[i].dot(cache.U[i]);
+    if (cache.D[i] <= numeric_limits<double>::epsilon()*cache.IC[i].trace()) {
+      // nothing with inertia moves with joint i (e.g. a chain of massless
+      // links), so H is singular and qdd is not determined
+      qdd.setConstant(numeric_limits<double>::quiet_NaN());
+      return false;
+    }
+    cache.u[i] = tau(n) - cache.S[i].dot(cache.fvp[i]) - damping[i]*qd[n];
+
+    if (qd[n] >= coulomb_window[i]) {
+      cache.u[i] -= coulomb_friction[i];
+    }
+    else if (qd[n] <= -coulomb_window[i]) {
+      cache.u[i] += coulomb_friction[i];
+    }
+    else {
+      cache.u[i] -= qd[n]/coulomb_window[i] * coulomb_friction[i];
+    }
+
+    if (parent[i] >= 0) {
+      Ia = cache.IC[i] - cache.U[i]*cache.U[i].transpose()/cache.D[i];
+      Ia_c = Ia*cache.avp[i] + cache.U[i]*(cache.u[i]/cache.D[i]);
+      cache.IC[parent[i]] += cache.Xup[i].transformInertia(Ia);
+      cache.fvp[parent[i]] += cache.Xup[i].applyTranspose(cache.fvp[i] + Ia_c);
+    }
+  }
+
+  for (i=0; i<NB; i++) {
+    n = dofnum[i];
+    if (parent[i] < 0)
+      cache.avp[i] += cache.Xup[i].apply(-a_grav);
+    else
+      cache.avp[i] += cache.Xup[i].apply(cache.avp[parent[i]]);
+    qdd(n) = (cache.u[i] - cache.U[i].dot(cache.avp[i]))/cache.D[i];
+    cache.avp[i] += cache.S[i]*qdd(n);
+  }
+
+  if (dqdd) {
+    // differentiate inverseDynamics(cache,q,qd,qdd) = tau:  dqdd/dx = H^{-1} (dtau/dx - dID/dx)
+    MatrixXd H(num_dof,num_dof), dID(num_dof,2*num_dof);
+    VectorXd C(num_dof), ID(num_dof);
+    HandC(cache,q,qd,f_ext,H,C,(MatrixXd*)NULL,(MatrixXd*)NULL,(MatrixXd*)NULL);
+    inverseDynamics(cache,q,qd,qdd,f_ext,ID,&dID,df_ext);
+
+    LDLT<MatrixXd> ldlt(H);
+    dqdd->leftCols(2*num_dof) = -ldlt.solve(dID);
+    dqdd->rightCols(num_dof) = ldlt.solve(MatrixXd::Identity(num_dof,num_dof));
+  }
+  return true;
+}
+
+void RigidBodyManipulator::setNumThreads(int num_threads)
+{
+  this->num_threads = num_threads;
+  thread_pool.reset();
+  batch_caches.clear();
+}
+
+void RigidBodyManipulator::prepareBatchCaches(void)
+{
+  if (!initialized) { compile(); }
+
+  if (!thread_pool)
+    thread_pool = shared_ptr<ThreadPool>(new ThreadPool(num_threads));
+
+  while ((int)batch_caches.size() < thread_pool->numThreads())
+    batch_caches.push_back(shared_ptr<KinematicsCache>(new KinematicsCache(*this)));
+}
+
+void RigidBodyManipulator::forwardKinBatch(const int body_or_frame_id, const MatrixXd &pts, const int rotation_type, const MatrixXd &q, vector<MatrixXd> &x, vector<MatrixXd> *J)
+{
+  int N = q.cols();
+  int rows_per_pt = (rotation_type==0) ? 3 : ((rotation_type==1) ? 6 : 7);
+  prepareBatchCaches();
+  x.resize(N);
+  if (J) J->resize(N);
+
+  thread_pool->parallelFor(N, [&](int thread_index, int k) {
+    KinematicsCache& cache = *batch_caches[thread_index];
+    VectorXd qk = q.col(k);
+    doKinematics(cache,qk.data());
+    forwardKin(cache,body_or_frame_id,pts,rotation_type,x[k]);
+    if (J) {
+      (*J)[k].resize(rows_per_pt*pts.cols(),num_dof);
+      forwardJac(cache,body_or_frame_id,pts,rotation_type,(*J)[k]);
+    }
+  });
+}
+
+void RigidBodyManipulator::getCOMBatch(const MatrixXd &q, MatrixXd &com, vector<MatrixXd> *Jcom, const set<int> &robotnum)
+{
+  int N = q.cols();
+  prepareBatchCaches();
+  com.resize(3,N);
+  if (Jcom) Jcom->resize(N);
+
+  thread_pool->parallelFor(N, [&](int thread_index, int k) {
+    KinematicsCache& cache = *batch_caches[thread_index];
+    VectorXd qk = q.col(k);
+    MatrixXd comk;
+    doKinematics(cache,qk.data());
+    getCOM(cache,comk,robotnum);
+    com.col(k) = comk;
+    if (Jcom)
+      getCOMJac(cache,(*Jcom)[k],robotnum);
+  });
+}
+
+void RigidBodyManipulator::HandCBatch(const MatrixXd &q, const MatrixXd &qd, vector<MatrixXd> &H, MatrixXd &C, vector<MatrixXd> *dH, vector<MatrixXd> *dC)
+{
+  int N = q.cols();
+  prepareBatchCaches();
+  H.resize(N);
+  C.resize(num_dof,N);
+  if (dH) dH->resize(N);
+  if (dC) dC->resize(N);
+
+  thread_pool->parallelFor(N, [&](int thread_index, int k) {
+    KinematicsCache& cache = *batch_caches[thread_index];
+    VectorXd qk = q.col(k), qdk = qd.col(k), Ck(num_dof);
+    H[k].resize(num_dof,num_dof);
+    if (dH) (*dH)[k].resize(num_dof*num_dof,num_dof);
+    if (dC) (*dC)[k].resize(num_dof,2*num_dof);
+    HandC(cache,qk.data(),qdk.data(),(MatrixXd*)NULL,H[k],Ck,dH ? &(*dH)[k] : (MatrixXd*)NULL,dC ? &(*dC)[k] : (MatrixXd*)NULL,(MatrixXd*)NULL);
+    C.col(k) = Ck;
+  });
+}
+
+void RigidBodyManipulator::inverseDynamicsBatch(const MatrixXd &q, const MatrixXd &qd, const MatrixXd &qdd, MatrixXd &tau, vector<MatrixXd> *dtau)
+{
+  int N = q.cols();
+  prepareBatchCaches();
+  tau.resize(num_dof,N);
+  if (dtau) dtau->resize(N);
+
+  thread_pool->parallelFor(N, [&](int thread_index, int k) {
+    KinematicsCache& cache = *batch_caches[thread_index];
+    VectorXd qk = q.col(k), qdk = qd.col(k), qddk = qdd.col(k), tauk(num_dof);
+    if (dtau) (*dtau)[k].resize(num_dof,2*num_dof);
+    inverseDynamics(cache,qk.data(),qdk.data(),qddk,(MatrixXd*)NULL,tauk,dtau ? &(*dtau)[k] : (MatrixXd*)NULL,(MatrixXd*)NULL);
+    tau.col(k) = tauk;
+  });
+}
+
+bool RigidBodyManipulator::forwardDynamicsBatch(const MatrixXd &q, const MatrixXd &qd, const MatrixXd &tau, MatrixXd &qdd, vector<MatrixXd> *dqdd)
+{
+  int N = q.cols();
+  prepareBatchCaches();
+  qdd.resize(num_dof,N);
+  if (dqdd) dqdd->resize(N);
+
+  atomic<bool> ok(true);
+  thread_pool->parallelFor(N, [&](int thread_index, int k) {
+    KinematicsCache& cache = *batch_caches[thread_index];
+    VectorXd qk = q.col(k), qdk = qd.col(k), tauk = tau.col(k), qddk(num_dof);
+    if (dqdd) (*dqdd)[k].resize(num_dof,3*num_dof);
+    if (!forwardDynamics(cache,qk.data(),qdk.data(),tauk,(MatrixXd*)NULL,qddk,dqdd ? &(*dqdd)[k] : (MatrixXd*)NULL,(MatrixXd*)NULL))
+      ok = false;
+    qdd.col(k) = qddk;
+  });
+  return ok;
+}
+
 int RigidBodyManipulator::findLinkInd(string linkname, int robot)
 {
   std::transform(linkname.begin(), linkname.end(), linkname.begin(), ::tolower); // convert to lower case
@@ -1507,43 +1784,47 @@ int RigidBodyManipulator::findLinkInd(string linkname, int robot)
 
 
 // explicit instantiations (required for linking):
-template void RigidBodyManipulator::getCMM(double * const, double * const, MatrixBase< Map<MatrixXd> > &, MatrixBase< Map<MatrixXd> > &);
-template void RigidBodyManipulator::getCMM(double * const, double * const, MatrixBase< MatrixXd > &, MatrixBase< MatrixXd > &);
-template void RigidBodyManipulator::getCOM(MatrixBase< Map<Vector3d> > &,const set<int> &);
-template void RigidBodyManipulator::getCOM(MatrixBase< Map<MatrixXd> > &,const set<int> &);
-template void RigidBodyManipulator::getCOMJac(MatrixBase< Map<MatrixXd> > &,const set<int> &);
-template void RigidBodyManipulator::getCOMdJac(MatrixBase< Map<MatrixXd> > &,const set<int> &);
-template void RigidBodyManipulator::getCOMJacDot(MatrixBase< Map<MatrixXd> > &,const set<int> &);
-template void RigidBodyManipulator::getCOM(MatrixBase< Vector3d > &,const set<int> &);
-template void RigidBodyManipulator::getCOM(MatrixBase< MatrixXd > &,const set<int> &);
-template void RigidBodyManipulator::getCOMJac(MatrixBase< MatrixXd > &,const set<int> &);
-template void RigidBodyManipulator::getCOMdJac(MatrixBase< MatrixXd > &,const set<int> &);
-template void RigidBodyManipulator::getCOMJacDot(MatrixBase< MatrixXd > &,const set<int> &);
-
-template void RigidBodyManipulator::getContactPositions(MatrixBase <MatrixXd > &, const set<int> &);
-template void RigidBodyManipulator::getContactPositionsJac(MatrixBase <MatrixXd > &,const set<int> &);
-template void RigidBodyManipulator::getContactPositionsJacDot(MatrixBase <MatrixXd > &,const set<int> &);
-
-template void RigidBodyManipulator::forwardKin(const int, const MatrixBase< MatrixXd >&, const int, MatrixBase< Map<MatrixXd> > &);
-template void RigidBodyManipulator::forwardJac(const int, const MatrixBase< MatrixXd > &, const int, MatrixBase< Map<MatrixXd> > &);
-template void RigidBodyManipulator::forwarddJac(const int, const MatrixBase< MatrixXd > &, MatrixBase< Map<MatrixXd> >&);
-template void RigidBodyManipulator::forwardKin(const int, const MatrixBase< MatrixXd >&, const int, MatrixBase< MatrixXd > &);
-template void RigidBodyManipulator::forwardJac(const int, const MatrixBase< MatrixXd > &, const int, MatrixBase< MatrixXd > &);
-template void RigidBodyManipulator::forwardJacDot(const int, const MatrixBase< MatrixXd > &, const int, MatrixBase< Map<MatrixXd> >&);
-template void RigidBodyManipulator::forwardJacDot(const int, const MatrixBase< MatrixXd > &, const int, MatrixBase< MatrixXd >&);
-template void RigidBodyManipulator::forwardJacDot(const int, const MatrixBase< Vector4d > &, const int, MatrixBase< MatrixXd >&);
-template void RigidBodyManipulator::forwarddJac(const int, const MatrixBase< MatrixXd > &, MatrixBase< MatrixXd >&);
-template void RigidBodyManipulator::forwardKin(const int, MatrixBase< Vector4d > const&, const int, MatrixBase< Vector3d > &);
-template void RigidBodyManipulator::forwardKin(const int, MatrixBase< Vector4d > const&, const int, MatrixBase< Matrix<double,6,1> > &);
-template void RigidBodyManipulator::forwardKin(const int, MatrixBase< Vector4d > const&, const int, MatrixBase< Matrix<double,7,1> > &);
-template void RigidBodyManipulator::forwardKin(const int, MatrixBase< Map<MatrixXd> > const&, const int, MatrixBase< MatrixXd > &);
-template void RigidBodyManipulator::forwardJac(const int, MatrixBase< Map<MatrixXd> > const&, const int, MatrixBase< MatrixXd > &);
+template void RigidBodyManipulator::getCMM(KinematicsCache&, double * const, double * const, MatrixBase< Map<MatrixXd> > &, MatrixBase< Map<MatrixXd> > &) const;
+template void RigidBodyManipulator::getCMM(KinematicsCache&, double * const, double * const, MatrixBase< MatrixXd > &, MatrixBase< MatrixXd > &) const;
+template void RigidBodyManipulator::getCOM(KinematicsCache&, MatrixBase< Map<Vector3d> > &,const set<int> &) const;
+template void RigidBodyManipulator::getCOM(KinematicsCache&, MatrixBase< Map<MatrixXd> > &,const set<int> &) const;
+template void RigidBodyManipulator::getCOMJac(KinematicsCache&, MatrixBase< Map<MatrixXd> > &,const set<int> &) const;
+template void RigidBodyManipulator::getCOMdJac(KinematicsCache&, MatrixBase< Map<MatrixXd> > &,const set<int> &) const;
+template void RigidBodyManipulator::getCOMJacDot(KinematicsCache&, MatrixBase< Map<MatrixXd> > &,const set<int> &) const;
+template void RigidBodyManipulator::getCOM(KinematicsCache&, MatrixBase< Vector3d > &,const set<int> &) const;
+template void RigidBodyManipulator::getCOM(KinematicsCache&, MatrixBase< MatrixXd > &,const set<int> &) const;
+template void RigidBodyManipulator::getCOMJac(KinematicsCache&, MatrixBase< MatrixXd > &,const set<int> &) const;
+template void RigidBodyManipulator::getCOMdJac(KinematicsCache&, MatrixBase< MatrixXd > &,const set<int> &) const;
+template void RigidBodyManipulator::getCOMJacDot(KinematicsCache&, MatrixBase< MatrixXd > &,const set<int> &) const;
+
+template void RigidBodyManipulator::getContactPositions(KinematicsCache&, MatrixBase <MatrixXd > &, const set<int> &) const;
+template void RigidBodyManipulator::getContactPositionsJac(KinematicsCache&, MatrixBase <MatrixXd > &,const set<int> &) const;
+template void RigidBodyManipulator::getContactPositionsJacDot(KinematicsCache&, MatrixBase <MatrixXd > &,const set<int> &) const;
+
+template void RigidBodyManipulator::forwardKin(KinematicsCache&, const int, const MatrixBase< MatrixXd >&, const int, MatrixBase< Map<MatrixXd> > &) const;
+template void RigidBodyManipulator::forwardJac(KinematicsCache&, const int, const MatrixBase< MatrixXd > &, const int, MatrixBase< Map<MatrixXd> > &) const;
+template void RigidBodyManipulator::forwarddJac(KinematicsCache&, const int, const MatrixBase< MatrixXd > &, MatrixBase< Map<MatrixXd> >&) const;
+template void RigidBodyManipulator::forwardKin(KinematicsCache&, const int, const MatrixBase< MatrixXd >&, const int, MatrixBase< MatrixXd > &) const;
+template void RigidBodyManipulator::forwardJac(KinematicsCache&, const int, const MatrixBase< MatrixXd > &, const int, MatrixBase< MatrixXd > &) const;
+template void RigidBodyManipulator::forwardJacDot(KinematicsCache&, const int, const MatrixBase< MatrixXd > &, const int, MatrixBase< Map<MatrixXd> >&) const;
+template void RigidBodyManipulator::forwardJacDot(KinematicsCache&, const int, const MatrixBase< MatrixXd > &, const int, MatrixBase< MatrixXd >&) const;
+template void RigidBodyManipulator::forwardJacDot(KinematicsCache&, const int, const MatrixBase< Vector4d > &, const int, MatrixBase< MatrixXd >&) const;
+template void RigidBodyManipulator::forwarddJac(KinematicsCache&, const int, const MatrixBase< MatrixXd > &, MatrixBase< MatrixXd >&) const;
+template void RigidBodyManipulator::forwardKin(KinematicsCache&, const int, MatrixBase< Vector4d > const&, const int, MatrixBase< Vector3d > &) const;
+template void RigidBodyManipulator::forwardKin(KinematicsCache&, const int, MatrixBase< Vector4d > const&, const int, MatrixBase< Matrix<double,6,1> > &) const;
+template void RigidBodyManipulator::forwardKin(KinematicsCache&, const int, MatrixBase< Vector4d > const&, const int, MatrixBase< Matrix<double,7,1> > &) const;
+template void RigidBodyManipulator::forwardKin(KinematicsCache&, const int, MatrixBase< Map<MatrixXd> > const&, const int, MatrixBase< MatrixXd > &) const;
+template void RigidBodyManipulator::forwardJac(KinematicsCache&, const int, MatrixBase< Map<MatrixXd> > const&, const int, MatrixBase< MatrixXd > &) const;
 //template void RigidBodyManipulator::forwardKin(const int, const MatrixBase< Vector4d >&, const int, MatrixBase< Vector3d > &);
-template void RigidBodyManipulator::forwardJac(const int, const MatrixBase< Vector4d > &, const int, MatrixBase< MatrixXd > &);
+template void RigidBodyManipulator::forwardJac(KinematicsCache&, const int, const MatrixBase< Vector4d > &, const int, MatrixBase< MatrixXd > &) const;
 //template void RigidBodyManipulator::forwardJacDot(const int, const MatrixBase< Vector4d > &, MatrixBase< MatrixXd >&);
 //template void RigidBodyManipulator::forwarddJac(const int, const MatrixBase< Vector4d > &, MatrixBase< MatrixXd >&);
-template void RigidBodyManipulator::bodyKin(const int, const MatrixBase< MatrixXd >&, MatrixBase< Map<MatrixXd> > &, MatrixBase< Map<MatrixXd> > *, MatrixBase< Map<MatrixXd> > *);
-template void RigidBodyManipulator::bodyKin(const int, const MatrixBase< MatrixXd >&, MatrixBase< MatrixXd > &, MatrixBase< MatrixXd > *, MatrixBase< MatrixXd > *);
-
-template void RigidBodyManipulator::HandC(double* const, double * const, MatrixBase< Map<MatrixXd> > * const, MatrixBase< Map<MatrixXd> > &, MatrixBase< Map<VectorXd> > &, MatrixBase< Map<MatrixXd> > *, MatrixBase< Map<MatrixXd> > *, MatrixBase< Map<MatrixXd> > *);
-template void RigidBodyManipulator::HandC(double* const, double * const, MatrixBase< MatrixXd > * const, MatrixBase< MatrixXd > &, MatrixBase< VectorXd > &, MatrixBase< MatrixXd > *, MatrixBase< MatrixXd > *, MatrixBase< MatrixXd > *);
+template void RigidBodyManipulator::bodyKin(KinematicsCache&, const int, const MatrixBase< MatrixXd >&, MatrixBase< Map<MatrixXd> > &, MatrixBase< Map<MatrixXd> > *, MatrixBase< Map<MatrixXd> > *) const;
+template void RigidBodyManipulator::bodyKin(KinematicsCache&, const int, const MatrixBase< MatrixXd >&, MatrixBase< MatrixXd > &, MatrixBase< MatrixXd > *, MatrixBase< MatrixXd > *) const;
+
+template void RigidBodyManipulator::HandC(KinematicsCache&, double* const, double * const, MatrixBase< Map<MatrixXd> > * const, MatrixBase< Map<MatrixXd> > &, MatrixBase< Map<VectorXd> > &, MatrixBase< Map<MatrixXd> > *, MatrixBase< Map<MatrixXd> > *, MatrixBase< Map<MatrixXd> > *) const;
+template void RigidBodyManipulator::HandC(KinematicsCache&, double* const, double * const, MatrixBase< MatrixXd > * const, MatrixBase< MatrixXd > &, MatrixBase< VectorXd > &, MatrixBase< MatrixXd > *, MatrixBase< MatrixXd > *, MatrixBase< MatrixXd > *) const;
+template void RigidBodyManipulator::inverseDynamics(KinematicsCache&, double* const, double * const, const MatrixBase< Map<VectorXd> > &, MatrixBase< Map<MatrixXd> > * const, MatrixBase< Map<VectorXd> > &, MatrixBase< Map<MatrixXd> > *, MatrixBase< Map<MatrixXd> > * const) const;
+template void RigidBodyManipulator::inverseDynamics(KinematicsCache&, double* const, double * const, const MatrixBase< VectorXd > &, MatrixBase< MatrixXd > * const, MatrixBase< VectorXd > &, MatrixBase< MatrixXd > *, MatrixBase< MatrixXd > * const) const;
+template bool RigidBodyManipulator::forwardDynamics(KinematicsCache&, double* const, double * const, const MatrixBase< Map<VectorXd> > &, MatrixBase< Map<MatrixXd> > * const, MatrixBase< Map<VectorXd> > &, MatrixBase< Map<MatrixXd> > *, MatrixBase< Map<MatrixXd> > * const) const;
+template bool RigidBodyManipulator::forwardDynamics(KinematicsCache&, double* const, double * const, const MatrixBase< VectorXd > &, MatrixBase< MatrixXd > * const, MatrixBase< VectorXd > &, MatrixBase< MatrixXd > *, MatrixBase< MatrixXd > * const) const;
@@ -10,6 +10,9 @@
 
 #include "RigidBody.h"
 #include "RigidBodyFrame.h"
+#include "KinematicsCache.h"
+#include "SpatialAlgebra.h"
+#include "ThreadPool.h"
 
 #define INF -2147483648
 using namespace Eigen;
@@ -25,57 +28,178 @@ public:
   void resize(int num_dof, int num_featherstone_bodies=-1, int num_rigid_body_objects=-1, int num_rigid_body_frames=0);
 
   void compile(void);  // call me after the model is loaded
-  void doKinematics(double* q, bool b_compute_second_derivatives=false, double* qd=NULL);
+  /*
+   * The kinematics and dynamics methods below come in pairs.  The versions that
+   * take a KinematicsCache store all of their intermediate results in that cache
+   * and leave the manipulator untouched, so any number of threads can evaluate
+   * one (compiled) manipulator at once as long as each uses its own cache.  The
+   * versions without a cache use default_cache.
+   */
+  void doKinematics(KinematicsCache& cache, double* q, bool b_compute_second_derivatives=false, double* qd=NULL) const;
+  void doKinematics(double* q, bool b_compute_second_derivatives=false, double* qd=NULL);  // also updates the collision model
 
   template <typename Derived>
-  void getCMM(double* const q, double* const qd, MatrixBase<Derived> &A, MatrixBase<Derived> &Adot);
+  void getCMM(KinematicsCache& cache, double* const q, double* const qd, MatrixBase<Derived> &A, MatrixBase<Derived> &Adot) const;
+  template <typename Derived>
+  void getCMM(double* const q, double* const qd, MatrixBase<Derived> &A, MatrixBase<Derived> &Adot)
+    { getCMM(default_cache,q,qd,A,Adot); }
 
   template <typename Derived>
-  void getCOM(MatrixBase<Derived> &com,const std::set<int> &robotnum = RigidBody::defaultRobotNumSet);
+  void getCOM(KinematicsCache& cache, MatrixBase<Derived> &com,const std::set<int> &robotnum = RigidBody::defaultRobotNumSet) const;
+  template <typename Derived>
+  void getCOM(MatrixBase<Derived> &com,const std::set<int> &robotnum = RigidBody::defaultRobotNumSet)
+    { getCOM(default_cache,com,robotnum); }
 
   template <typename Derived>
-  void getCOMJac(MatrixBase<Derived> &J,const std::set<int> &robotnum = RigidBody::defaultRobotNumSet);
+  void getCOMJac(KinematicsCache& cache, MatrixBase<Derived> &J,const std::set<int> &robotnum = RigidBody::defaultRobotNumSet) const;
+  template <typename Derived>
+  void getCOMJac(MatrixBase<Derived> &J,const std::set<int> &robotnum = RigidBody::defaultRobotNumSet)
+    { getCOMJac(default_cache,J,robotnum); }
 
   template <typename Derived>
-  void getCOMJacDot(MatrixBase<Derived> &Jdot,const std::set<int> &robotnum = RigidBody::defaultRobotNumSet);
+  void getCOMJacDot(KinematicsCache& cache, MatrixBase<Derived> &Jdot,const std::set<int> &robotnum = RigidBody::defaultRobotNumSet) const;
+  template <typename Derived>
+  void getCOMJacDot(MatrixBase<Derived> &Jdot,const std::set<int> &robotnum = RigidBody::defaultRobotNumSet)
+    { getCOMJacDot(default_cache,Jdot,robotnum); }
 
   template <typename Derived>
-  void getCOMdJac(MatrixBase<Derived> &dJ, const std::set<int> &robotnum = RigidBody::defaultRobotNumSet);
+  void getCOMdJac(KinematicsCache& cache, MatrixBase<Derived> &dJ, const std::set<int> &robotnum = RigidBody::defaultRobotNumSet) const;
+  template <typename Derived>
+  void getCOMdJac(MatrixBase<Derived> &dJ, const std::set<int> &robotnum = RigidBody::defaultRobotNumSet)
+    { getCOMdJac(default_cache,dJ,robotnum); }
 
   int getNumContacts(const std::set<int> &body_idx);// = emptyIntSet);
 
   template <typename Derived>
-    void getContactPositions(MatrixBase<Derived> &pos, const std::set<int> &body_idx);// = emptyIntSet);
-  
+    void getContactPositions(KinematicsCache& cache, MatrixBase<Derived> &pos, const std::set<int> &body_idx) const;
   template <typename Derived>
-    void getContactPositionsJac(MatrixBase<Derived> &J, const std::set<int> &body_idx);// = emptyIntSet);
-  
+    void getContactPositions(MatrixBase<Derived> &pos, const std::set<int> &body_idx)  // = emptyIntSet
+    { getContactPositions(default_cache,pos,body_idx); }
+
+  template <typename Derived>
+    void getContactPositionsJac(KinematicsCache& cache, MatrixBase<Derived> &J, const std::set<int> &body_idx) const;
+  template <typename Derived>
+    void getContactPositionsJac(MatrixBase<Derived> &J, const std::set<int> &body_idx)  // = emptyIntSet
+    { getContactPositionsJac(default_cache,J,body_idx); }
+
+  template <typename Derived>
+    void getContactPositionsJacDot(KinematicsCache& cache, MatrixBase<Derived> &Jdot, const std::set<int> &body_idx) const;
   template <typename Derived>
-    void getContactPositionsJacDot(MatrixBase<Derived> &Jdot, const std::set<int> &body_idx);// = emptyIntSet);
+    void getContactPositionsJacDot(MatrixBase<Derived> &Jdot, const std::set<int> &body_idx)  // = emptyIntSet
+    { getContactPositionsJacDot(default_cache,Jdot,body_idx); }
 
   template <typename DerivedA, typename DerivedB>
-  void forwardKin(const int body_or_frame_ind, const MatrixBase<DerivedA>& pts, const int rotation_type, MatrixBase<DerivedB> &x);
+  void forwardKin(KinematicsCache& cache, const int body_or_frame_ind, const MatrixBase<DerivedA>& pts, const int rotation_type, MatrixBase<DerivedB> &x) const;
+  template <typename DerivedA, typename DerivedB>
+  void forwardKin(const int body_or_frame_ind, const MatrixBase<DerivedA>& pts, const int rotation_type, MatrixBase<DerivedB> &x)
+    { forwardKin(default_cache,body_or_frame_ind,pts,rotation_type,x); }
 
   template <typename DerivedA, typename DerivedB>
-  void forwardJacDot(const int body_ind, const MatrixBase<DerivedA>& pts, const int, MatrixBase<DerivedB> &Jdot);
+  void forwardJacDot(KinematicsCache& cache, const int body_ind, const MatrixBase<DerivedA>& pts, const int rotation_type, MatrixBase<DerivedB> &Jdot) const;
+  template <typename DerivedA, typename DerivedB>
+  void forwardJacDot(const int body_ind, const MatrixBase<DerivedA>& pts, const int rotation_type, MatrixBase<DerivedB> &Jdot)
+    { forwardJacDot(default_cache,body_ind,pts,rotation_type,Jdot); }
 
   template <typename DerivedA, typename DerivedB>
-  void forwardJac(const int body_ind, const MatrixBase<DerivedA>& pts, const int rotation_type, MatrixBase<DerivedB> &J);
+  void forwardJac(KinematicsCache& cache, const int body_ind, const MatrixBase<DerivedA>& pts, const int rotation_type, MatrixBase<DerivedB> &J) const;
+  template <typename DerivedA, typename DerivedB>
+  void forwardJac(const int body_ind, const MatrixBase<DerivedA>& pts, const int rotation_type, MatrixBase<DerivedB> &J)
+    { forwardJac(default_cache,body_ind,pts,rotation_type,J); }
+
+  /*
+   * forwardKin, forwardJac, getCOM and getCOMJac through the query list of the
+   * cache: repeating a query at the same state copies the stored result instead
+   * of recomputing it (see KinematicsCache::queries).
+   */
+  template <typename DerivedA, typename DerivedB>
+  void forwardKinCached(KinematicsCache& cache, const int body_or_frame_ind, const MatrixBase<DerivedA>& pts, const int rotation_type, MatrixBase<DerivedB> &x) const
+    { x = cachedQuery(cache,KinematicsCache::FORWARD_KIN,body_or_frame_ind,pts,rotation_type,RigidBody::defaultRobotNumSet); }
+  template <typename DerivedA, typename DerivedB>
+  void forwardKinCached(const int body_or_frame_ind, const MatrixBase<DerivedA>& pts, const int rotation_type, MatrixBase<DerivedB> &x)
+    { forwardKinCached(default_cache,body_or_frame_ind,pts,rotation_type,x); }
+
+  template <typename DerivedA, typename DerivedB>
+  void forwardJacCached(KinematicsCache& cache, const int body_or_frame_ind, const MatrixBase<DerivedA>& pts, const int rotation_type, MatrixBase<DerivedB> &J) const
+    { J = cachedQuery(cache,KinematicsCache::FORWARD_JAC,body_or_frame_ind,pts,rotation_type,RigidBody::defaultRobotNumSet); }
+  template <typename DerivedA, typename DerivedB>
+  void forwardJacCached(const int body_or_frame_ind, const MatrixBase<DerivedA>& pts, const int rotation_type, MatrixBase<DerivedB> &J)
+    { forwardJacCached(default_cache,body_or_frame_ind,pts,rotation_type,J); }
+
+  template <typename Derived>
+  void getCOMCached(KinematicsCache& cache, MatrixBase<Derived> &com, const std::set<int> &robotnum = RigidBody::defaultRobotNumSet) const
+    { com = cachedQuery(cache,KinematicsCache::COM,-1,MatrixXd(),0,robotnum); }
+  template <typename Derived>
+  void getCOMCached(MatrixBase<Derived> &com, const std::set<int> &robotnum = RigidBody::defaultRobotNumSet)
+    { getCOMCached(default_cache,com,robotnum); }
+
+  template <typename Derived>
+  void getCOMJacCached(KinematicsCache& cache, MatrixBase<Derived> &J, const std::set<int> &robotnum = RigidBody::defaultRobotNumSet) const
+    { J = cachedQuery(cache,KinematicsCache::COM_JAC,-1,MatrixXd(),0,robotnum); }
+  template <typename Derived>
+  void getCOMJacCached(MatrixBase<Derived> &J, const std::set<int> &robotnum = RigidBody::defaultRobotNumSet)
+    { getCOMJacCached(default_cache,J,robotnum); }
 
   template <typename DerivedA, typename DerivedB>
-  void forwarddJac(const int body_ind, const MatrixBase<DerivedA>& pts, MatrixBase<DerivedB> &dJ);
+  void forwarddJac(KinematicsCache& cache, const int body_ind, const MatrixBase<DerivedA>& pts, MatrixBase<DerivedB> &dJ) const;
+  template <typename DerivedA, typename DerivedB>
+  void forwarddJac(const int body_ind, const MatrixBase<DerivedA>& pts, MatrixBase<DerivedB> &dJ)
+    { forwarddJac(default_cache,body_ind,pts,dJ); }
 
   template <typename DerivedA, typename DerivedB, typename DerivedC, typename DerivedD>
-  void bodyKin(const int body_ind, const MatrixBase<DerivedA>& pts, MatrixBase<DerivedB> &x, MatrixBase<DerivedC> *J=NULL, MatrixBase<DerivedD> *P=NULL);
+  void bodyKin(KinematicsCache& cache, const int body_ind, const MatrixBase<DerivedA>& pts, MatrixBase<DerivedB> &x, MatrixBase<DerivedC> *J=NULL, MatrixBase<DerivedD> *P=NULL) const;
+  template <typename DerivedA, typename DerivedB, typename DerivedC, typename DerivedD>
+  void bodyKin(const int body_ind, const MatrixBase<DerivedA>& pts, MatrixBase<DerivedB> &x, MatrixBase<DerivedC> *J=NULL, MatrixBase<DerivedD> *P=NULL)
+    { bodyKin(default_cache,body_ind,pts,x,J,P); }
 
 
   template <typename DerivedA, typename DerivedB, typename DerivedC, typename DerivedD, typename DerivedE, typename DerivedF>
-  void HandC(double* const q, double * const qd, MatrixBase<DerivedA> * const f_ext, MatrixBase<DerivedB> &H, MatrixBase<DerivedC> &C, MatrixBase<DerivedD> *dH=NULL, MatrixBase<DerivedE> *dC=NULL, MatrixBase<DerivedF> * const df_ext=NULL);
+  void HandC(KinematicsCache& cache, double* const q, double * const qd, MatrixBase<DerivedA> * const f_ext, MatrixBase<DerivedB> &H, MatrixBase<DerivedC> &C, MatrixBase<DerivedD> *dH=NULL, MatrixBase<DerivedE> *dC=NULL, MatrixBase<DerivedF> * const df_ext=NULL) const;
+  template <typename DerivedA, typename DerivedB, typename DerivedC, typename DerivedD, typename DerivedE, typename DerivedF>
+  void HandC(double* const q, double * const qd, MatrixBase<DerivedA> * const f_ext, MatrixBase<DerivedB> &H, MatrixBase<DerivedC> &C, MatrixBase<DerivedD> *dH=NULL, MatrixBase<DerivedE> *dC=NULL, MatrixBase<DerivedF> * const df_ext=NULL)
+    { HandC(default_cache,q,qd,f_ext,H,C,dH,dC,df_ext); }
+
+  // O(n) recursive Newton-Euler inverse dynamics: tau = H*qdd + C, without forming H.
+  // dtau, if requested, is num_dof x 2*num_dof: [dtau/dq, dtau/dqd] (dtau/dqdd is just H)
+  template <typename DerivedA, typename DerivedB, typename DerivedC, typename DerivedD, typename DerivedE>
+  void inverseDynamics(KinematicsCache& cache, double* const q, double * const qd, const MatrixBase<DerivedA> &qdd, MatrixBase<DerivedB> * const f_ext, MatrixBase<DerivedC> &tau, MatrixBase<DerivedD> *dtau=NULL, MatrixBase<DerivedE> * const df_ext=NULL) const;
+  template <typename DerivedA, typename DerivedB, typename DerivedC, typename DerivedD, typename DerivedE>
+  void inverseDynamics(double* const q, double * const qd, const MatrixBase<DerivedA> &qdd, MatrixBase<DerivedB> * const f_ext, MatrixBase<DerivedC> &tau, MatrixBase<DerivedD> *dtau=NULL, MatrixBase<DerivedE> * const df_ext=NULL)
+    { inverseDynamics(default_cache,q,qd,qdd,f_ext,tau,dtau,df_ext); }
+
+  // O(n) articulated-body forward dynamics: qdd = H^{-1}(tau - C).
+  // dqdd, if requested, is num_dof x 3*num_dof: [dqdd/dq, dqdd/dqd, dqdd/dtau]
+  // returns false (and qdd = NaN) if H is singular because some joint moves
+  // no inertia, e.g. at the end of a chain of massless links
+  template <typename DerivedA, typename DerivedB, typename DerivedC, typename DerivedD, typename DerivedE>
+  bool forwardDynamics(KinematicsCache& cache, double* const q, double * const qd, const MatrixBase<DerivedA> &tau, MatrixBase<DerivedB> * const f_ext, MatrixBase<DerivedC> &qdd, MatrixBase<DerivedD> *dqdd=NULL, MatrixBase<DerivedE> * const df_ext=NULL) const;
+  template <typename DerivedA, typename DerivedB, typename DerivedC, typename DerivedD, typename DerivedE>
+  bool forwardDynamics(double* const q, double * const qd, const MatrixBase<DerivedA> &tau, MatrixBase<DerivedB> * const f_ext, MatrixBase<DerivedC> &qdd, MatrixBase<DerivedD> *dqdd=NULL, MatrixBase<DerivedE> * const df_ext=NULL)
+    { return forwardDynamics(default_cache,q,qd,tau,f_ext,qdd,dqdd,df_ext); }
+
+  /*
+   * Batch evaluation: each column of q (and qd, qdd, tau) is one configuration,
+   * and the configurations are evaluated in parallel.  Every worker thread has
+   * its own KinematicsCache, so these leave default_cache untouched.
+   */
+  void setNumThreads(int num_threads);  // num_threads<=0 means one per hardware thread (the default)
+
+  void forwardKinBatch(const int body_or_frame_id, const MatrixXd &pts, const int rotation_type, const MatrixXd &q, std::vector<MatrixXd> &x, std::vector<MatrixXd> *J=NULL);
+
+  void getCOMBatch(const MatrixXd &q, MatrixXd &com, std::vector<MatrixXd> *Jcom=NULL, const std::set<int> &robotnum = RigidBody::defaultRobotNumSet);
+
+  void HandCBatch(const MatrixXd &q, const MatrixXd &qd, std::vector<MatrixXd> &H, MatrixXd &C, std::vector<MatrixXd> *dH=NULL, std::vector<MatrixXd> *dC=NULL);
+
+  void inverseDynamicsBatch(const MatrixXd &q, const MatrixXd &qd, const MatrixXd &qdd, MatrixXd &tau, std::vector<MatrixXd> *dtau=NULL);
+
+  bool forwardDynamicsBatch(const MatrixXd &q, const MatrixXd &qd, const MatrixXd &tau, MatrixXd &qdd, std::vector<MatrixXd> *dqdd=NULL);  // false if forwardDynamics failed for any column
 
   void addCollisionElement(const int body_ind, Matrix4d T_elem_to_lnk, DrakeCollision::Shape shape, std::vector<double> params);
 
   void updateCollisionElements(const int body_ind);
 
+  // see DrakeCollision::Model::getElementUpdateCounts
+  void getCollisionElementUpdateCounts(long& num_updated, long& num_skipped) const;
+
   bool setCollisionFilter(const int body_ind, const uint16_t group, 
                           const uint16_t mask);
 
@@ -89,6 +213,12 @@ public:
   
   bool collisionRaycast(const Matrix3Xd &origins, const Matrix3Xd &ray_endpoints, VectorXd &distances);
 
+  // batched version, with the rays split into chunks over the thread pool (see setNumThreads).
+  // normals and body_idx are optional (pass NULL)
+  bool collisionRaycast(const Matrix3Xd &origins, const Matrix3Xd &ray_endpoints, VectorXd &distances, Matrix3Xd* normals, std::vector<int>* body_idx);
+
+  bool collisionRaycast(const DrakeCollision::RayFan &fan, VectorXd &distances, Matrix3Xd* normals=NULL, std::vector<int>* body_idx=NULL);
+
   //bool closestPointsAllBodies( MatrixXd& ptsA, MatrixXd& ptsB,
                                //MatrixXd& normal, VectorXd& distance,
                                //std::vector<int>& bodyA_idx, 
@@ -100,6 +230,14 @@ public:
                         std::vector<int>& bodyB_idx,
                         std::vector<int>& bodies_idx);
 
+  // only reports the pairs closer than distance_threshold
+  bool collisionDetect( VectorXd& phi, MatrixXd& normal, 
+                        MatrixXd& xA, MatrixXd& xB, 
+                        std::vector<int>& bodyA_idx, 
+                        std::vector<int>& bodyB_idx,
+                        std::vector<int>& bodies_idx,
+                        double distance_threshold);
+
 
   bool allCollisions(std::vector<int>& bodyA_idx, std::vector<int>& bodyB_idx, 
                      MatrixXd& ptsA, MatrixXd& ptsB);
@@ -132,62 +270,25 @@ public:
   VectorXd coulomb_friction;
   VectorXd coulomb_window;
   VectorXd static_friction;
-  std::vector<MatrixXd> Xtree;
-  std::vector<MatrixXd> I;
-  VectorXd a_grav;
+  std::vector<Matrix6d,Eigen::aligned_allocator<Matrix6d> > Xtree;
+  std::vector<Matrix6d,Eigen::aligned_allocator<Matrix6d> > I;
+  Vector6d a_grav;
 
-  VectorXd cached_q, cached_qd;  // these should be private
+  KinematicsCache default_cache;  // used by the methods that do not take a cache
 
 
 private:
-  int parseBodyOrFrameID(const int body_or_frame_id, Matrix4d& Tframe);
-
-  // variables for featherstone dynamics
-  std::vector<VectorXd> S;
-  std::vector<MatrixXd> Xup;
-  std::vector<VectorXd> v;
-  std::vector<VectorXd> avp;
-  std::vector<VectorXd> fvp;
-  std::vector<MatrixXd> IC;
-
-  //Variables for gradient calculations
-  MatrixXd dTdTmult;
-  std::vector<MatrixXd> dXupdq;
-  std::vector<std::vector<MatrixXd>> dIC;
-
-  std::vector<MatrixXd> dvdq;
-  std::vector<MatrixXd> dvdqd;
-  std::vector<MatrixXd> davpdq;
-  std::vector<MatrixXd> davpdqd;
-  std::vector<MatrixXd> dfvpdq;
-  std::vector<MatrixXd> dfvpdqd;
-  MatrixXd dvJdqd_mat;
-  MatrixXd dcross;
-
-  // preallocate for COM functions
-  Vector3d bc;
-  MatrixXd bJ;
-  MatrixXd bdJ;
-
-  // preallocate for CMM function
-  MatrixXd Xg; // spatial centroidal projection matrix
-  MatrixXd dXg;  // dXg_dq * qd  
-  std::vector<MatrixXd> Ic; // body spatial inertias
-  std::vector<MatrixXd> dIc; // derivative of body spatial inertias
-  std::vector<VectorXd> phi; // joint axis vectors
-  std::vector<MatrixXd> Xworld; // spatial transforms from world to each body
-  std::vector<MatrixXd> dXworld; // dXworld_dq * qd
-  std::vector<MatrixXd> dXup; // dXup_dq * qd 
-  MatrixXd Xcom; // spatial transform from centroid to world
-  MatrixXd Jcom; 
-  MatrixXd dXcom;
-  MatrixXd Xi;
-  MatrixXd dXidq;
+  int parseBodyOrFrameID(const int body_or_frame_id, Matrix4d& Tframe) const;
+  const MatrixXd& cachedQuery(KinematicsCache& cache, KinematicsCache::KinematicQueryKind kind, const int body_or_frame_ind, const MatrixXd& pts, const int rotation_type, const std::set<int> &robotnum) const;
+
+  // state for the batch methods
+  void prepareBatchCaches(void);
+  int num_threads;
+  std::shared_ptr<ThreadPool> thread_pool;
+  std::vector<std::shared_ptr<KinematicsCache> > batch_caches;  // one per thread
 
   int num_contact_pts;
   bool initialized;
-  bool kinematicsInit;
-  int secondDerivativesCached;
 
   std::shared_ptr< DrakeCollision::Model > collision_model;
   
@@ -0,0 +1,113 @@
+#include <cmath>
+#include <limits>
+#include <iostream>
+#include <atomic>
+#include "RolloutEngine.h"
+
+using namespace std;
+using namespace Eigen;
+
+RolloutEngine::RolloutEngine(const RigidBodyManipulator& model, int num_threads)
+  : timestep(1e-3), duration(1.0), record_every(1), model(model),
+    num_states(2*model.num_dof), num_inputs(model.num_dof), pool(num_threads)
+{
+  for (int i=0; i<pool.numThreads(); i++)
+    workspaces.push_back(shared_ptr<Workspace>(new Workspace(model)));
+}
+
+void RolloutEngine::run(const Controller& controller, const MatrixXd& x0, const vector<unsigned int>& seeds, RolloutTrajectories& traj)
+{
+  int num_rollouts = x0.cols();
+  if (x0.rows() != num_states || (int) seeds.size() != num_rollouts) {
+    cerr << "RolloutEngine: x0 has to be " << num_states << " x num_rollouts, with one seed per rollout" << endl;
+    return;
+  }
+  if (input_noise_std.size() != 0 && input_noise_std.size() != num_inputs) {
+    cerr << "RolloutEngine: input_noise_std has to have " << num_inputs << " elements (or none)" << endl;
+    return;
+  }
+
+  int num_steps = (int) ceil(duration/timestep - 1e-9);
+  num_steps = ((num_steps + record_every - 1)/record_every)*record_every;  // end on a sample
+
+  traj.num_rollouts = num_rollouts;
+  traj.num_samples = num_steps/record_every + 1;
+  traj.t.resize(traj.num_samples);
+  for (int i=0; i<traj.num_samples; i++)
+    traj.t(i) = i*record_every*timestep;
+  traj.x.resize(num_rollouts*traj.num_samples,num_states);
+  traj.u.resize(num_rollouts*traj.num_samples,num_inputs);
+  traj.num_valid.assign(num_rollouts,0);
+
+  atomic<int> num_singular(0);
+  pool.parallelFor(num_rollouts, [&](int thread_index, int k) {
+    if (!rollout(*workspaces[thread_index],controller,k,x0,seeds[k],num_steps,traj))
+      num_singular++;
+  });
+  if (num_singular > 0)
+    cerr << "RolloutEngine: the mass matrix became singular in " << num_singular << " rollouts, which were cut off there" << endl;
+}
+
+bool RolloutEngine::rollout(Workspace& ws, const Controller& controller, int k, const MatrixXd& x0, unsigned int seed, int num_steps, RolloutTrajectories& traj)
+{
+  double h = timestep;
+  ws.generator.seed(seed);
+  ws.randn.reset();
+  ws.x = x0.col(k);
+  ws.u.resize(num_inputs);
+
+  int sample = 0;
+  bool ok = true;
+  for (int s=0; s<=num_steps; s++) {
+    ws.u.setZero();
+    controller(k,s*h,ws.x,ws.u);
+    if (input_noise_std.size() > 0) {
+      ws.noise.resize(num_inputs);
+      for (int j=0; j<num_inputs; j++)
+        ws.noise(j) = ws.randn(ws.generator);
+      ws.u += input_noise_std.cwiseProduct(ws.noise);
+    }
+
+    if (s % record_every == 0) {
+      traj.x.row(traj.row(k,sample)) = ws.x.transpose();
+      traj.u.row(traj.row(k,sample)) = ws.u.transpose();
+      sample++;
+    }
+    if (s == num_steps) break;
+
+    // classic RK4 with the input held over the step
+    ok = dynamics(ws,ws.x,ws.k1);
+    ws.xtmp = ws.x + 0.5*h*ws.k1;
+    ok = ok && dynamics(ws,ws.xtmp,ws.k2);
+    ws.xtmp = ws.x + 0.5*h*ws.k2;
+    ok = ok && dynamics(ws,ws.xtmp,ws.k3);
+    ws.xtmp = ws.x + h*ws.k3;
+    ok = ok && dynamics(ws,ws.xtmp,ws.k4);
+    if (!ok)
+      break;
+    ws.x += (h/6.0)*(ws.k1 + 2.0*ws.k2 + 2.0*ws.k3 + ws.k4);
+
+    if (!ws.x.allFinite())
+      break;
+  }
+
+  traj.num_valid[k] = sample;
+  if (sample < traj.num_samples) {
+    traj.x.block(traj.row(k,sample),0,traj.num_samples-sample,num_states).setConstant(numeric_limits<double>::quiet_NaN());
+    traj.u.block(traj.row(k,sample),0,traj.num_samples-sample,num_inputs).setConstant(numeric_limits<double>::quiet_NaN());
+  }
+  return ok;
+}
+
+bool RolloutEngine::dynamics(Workspace& ws, const VectorXd& x, VectorXd& xdot)
+{
+  int nq = model.num_dof;
+  ws.q = x.head(nq);
+  ws.qd = x.tail(nq);
+  ws.qdd.resize(nq);
+  bool ok = model.forwardDynamics(ws.cache,ws.q.data(),ws.qd.data(),ws.u,(MatrixXd*)NULL,ws.qdd,(MatrixXd*)NULL,(MatrixXd*)NULL);
+  xdot.resize(2*nq);
+  xdot.head(nq) = ws.qd;
+  xdot.tail(nq) = ws.qdd;
+  return ok;
+}
@@ -0,0 +1,82 @@
+#ifndef _ROLLOUTENGINE_H_
+#define _ROLLOUTENGINE_H_
+
+#include <vector>
+#include <memory>
+#include <random>
+#include <functional>
+#include <Eigen/Dense>
+
+#include "RigidBodyManipulator.h"
+
+/*
+ * Trajectories of a batch of rollouts, stored by column: column j of x holds
+ * state j of every sample of every rollout, with sample i of rollout k in row
+ * k*num_samples+i.  So one rollout is a contiguous block of rows, and one
+ * state (e.g. for a histogram over the batch) is a contiguous column.
+ */
+struct RolloutTrajectories
+{
+  int num_rollouts;
+  int num_samples;  // per rollout, including the initial state
+  Eigen::VectorXd t;  // the sample times (the same for every rollout)
+  Eigen::MatrixXd x;  // num_rollouts*num_samples x num_states, [q;qd]
+  Eigen::MatrixXd u;  // num_rollouts*num_samples x num_inputs, the input (noise included) applied from each sample on
+  std::vector<int> num_valid;  // samples of each rollout before its state stopped being finite (or the mass matrix became singular); the rest are NaN
+
+  int row(int rollout, int sample) const { return rollout*num_samples + sample; }
+};
+
+/*
+ * Simulates many closed-loop rollouts of a RigidBodyManipulator at once, e.g.
+ * to check a region of attraction (LQRTree) or the robustness of a controller
+ * to noise (DrakeSystemWGaussianNoise) by Monte Carlo.
+ *
+ * Every rollout starts from its own column of x0 and integrates
+ *   qdd = forwardDynamics(q, qd, u + diag(input_noise_std)*randn)
+ * with fixed-step RK4, holding the input over each step.  The controller is
+ * called once per step with (rollout, t, x, u) and has to fill in u (the joint
+ * torques); it is called from several threads at once.  The noise of a rollout
+ * comes from a generator seeded with that rollout's seed, so the trajectories
+ * do not depend on the number of threads or on which thread ran what.
+ *
+ * The rollouts are spread over a thread pool.  Each thread has its own
+ * KinematicsCache and integration workspace, and the model is only read, so it
+ * has to be compiled before the engine is created.  Contact is not modeled.
+ */
+class RolloutEngine
+{
+public:
+  typedef std::function<void(int rollout, double t, const Eigen::VectorXd& x, Eigen::VectorXd& u)> Controller;
+
+  RolloutEngine(const RigidBodyManipulator& model, int num_threads=0);  // num_threads<=0 means one per hardware thread
+
+  // x0 is num_states x num_rollouts, and seeds holds one seed per rollout
+  void run(const Controller& controller, const Eigen::MatrixXd& x0, const std::vector<unsigned int>& seeds, RolloutTrajectories& traj);
+
+  int numThreads() const { return pool.numThreads(); }
+
+  double timestep;
+  double duration;
+  int record_every;                 // record every this many steps
+  Eigen::VectorXd input_noise_std;  // standard deviation of the noise added to each input, empty for none
+
+private:
+  struct Workspace {
+    Workspace(const RigidBodyManipulator& model) : cache(model) {}
+    KinematicsCache cache;
+    Eigen::VectorXd x, u, noise, xtmp, q, qd, qdd, k1, k2, k3, k4;
+    std::mt19937 generator;
+    std::normal_distribution<double> randn;
+  };
+
+  bool rollout(Workspace& ws, const Controller& controller, int k, const Eigen::MatrixXd& x0, unsigned int seed, int num_steps, RolloutTrajectories& traj);
+  bool dynamics(Workspace& ws, const Eigen::VectorXd& x, Eigen::VectorXd& xdot);
+
+  const RigidBodyManipulator& model;
+  int num_states, num_inputs;
+  ThreadPool pool;
+  std::vector<std::shared_ptr<Workspace> > workspaces;  // one per thread
+};
+
+#endif // _ROLLOUTENGINE_H_
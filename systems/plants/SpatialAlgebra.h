@@ -0,0 +1,124 @@
+#ifndef _SPATIALALGEBRA_H_
+#define _SPATIALALGEBRA_H_
+
+#include <Eigen/Dense>
+
+/*
+ * Fixed-size spatial vector algebra for the featherstone dynamics.  Everything
+ * here lives on the stack, so the dynamics loops never touch the heap.
+ *
+ * Spatial vectors are ordered [angular; linear], as in Featherstone's
+ * "Rigid Body Dynamics Algorithms" (2008).
+ */
+
+typedef Eigen::Matrix<double,6,1> Vector6d;
+typedef Eigen::Matrix<double,6,6> Matrix6d;
+
+inline Eigen::Matrix3d skew(const Eigen::Vector3d& r)
+{
+  Eigen::Matrix3d rx;
+  rx <<     0, -r[2],  r[1],
+         r[2],     0, -r[0],
+        -r[1],  r[0],     0;
+  return rx;
+}
+
+/*
+ * A Plucker coordinate transform stored in compact form as a rotation E and a
+ * translation r (expressed in the source frame):
+ *   X = [E 0; -E*skew(r) E]
+ * Applying it to a spatial vector costs two 3x3 products instead of a 6x6 one.
+ */
+class PluckerTransform {
+public:
+  Eigen::Matrix3d E;
+  Eigen::Vector3d r;
+
+  PluckerTransform() : E(Eigen::Matrix3d::Identity()), r(Eigen::Vector3d::Zero()) {};
+
+  PluckerTransform(const Eigen::Matrix3d& E, const Eigen::Vector3d& r) : E(E), r(r) {};
+
+  explicit PluckerTransform(const Matrix6d& X)
+  {
+    E = X.topLeftCorner<3,3>();
+    Eigen::Matrix3d rx = -E.transpose()*X.bottomLeftCorner<3,3>();
+    r << rx(2,1), rx(0,2), rx(1,0);
+  };
+
+  Matrix6d toMatrix() const
+  {
+    Matrix6d X;
+    X << E, Eigen::Matrix3d::Zero(), -E*skew(r), E;
+    return X;
+  };
+
+  // (this * other) as 6x6 matrices
+  PluckerTransform operator*(const PluckerTransform& other) const
+  {
+    return PluckerTransform(E*other.E, other.r + other.E.transpose()*r);
+  };
+
+  // X*m for a motion vector m
+  Vector6d apply(const Vector6d& m) const
+  {
+    Vector6d y;
+    y.head<3>() = E*m.head<3>();
+    y.tail<3>() = E*(m.tail<3>() - r.cross(m.head<3>()));
+    return y;
+  };
+
+  // X'*f for a force vector f (i.e. the force transform back into the source frame)
+  Vector6d applyTranspose(const Vector6d& f) const
+  {
+    Vector6d y;
+    y.tail<3>() = E.transpose()*f.tail<3>();
+    y.head<3>() = E.transpose()*f.head<3>() + r.cross(y.tail<3>());
+    return y;
+  };
+
+  // X'*I*X for a spatial inertia (or any 6x6 force-from-motion map) I
+  Matrix6d transformInertia(const Matrix6d& I) const
+  {
+    Matrix6d X = toMatrix();
+    return X.transpose()*I*X;
+  };
+};
+
+// spatial cross product operator for motion vectors: crm(v)*m = v x m
+inline Matrix6d crm(const Vector6d& v)
+{
+  Matrix6d vcross;
+  vcross << 0, -v[2], v[1], 0, 0, 0,
+            v[2], 0,-v[0], 0, 0, 0,
+           -v[1], v[0], 0, 0, 0, 0,
+            0, -v[5], v[4], 0, -v[2], v[1],
+            v[5], 0,-v[3], v[2], 0, -v[0],
+           -v[4], v[3], 0,-v[1], v[0], 0;
+  return vcross;
+}
+
+// spatial cross product operator for force vectors: crf(v)*f = v x* f
+inline Matrix6d crf(const Vector6d& v)
+{
+  return -crm(v).transpose();
+}
+
+// crm(v)*m without forming the 6x6 operator
+inline Vector6d crossMotion(const Vector6d& v, const Vector6d& m)
+{
+  Vector6d y;
+  y.head<3>() = v.head<3>().cross(m.head<3>());
+  y.tail<3>() = v.head<3>().cross(m.tail<3>()) + v.tail<3>().cross(m.head<3>());
+  return y;
+}
+
+// crf(v)*f without forming the 6x6 operator
+inline Vector6d crossForce(const Vector6d& v, const Vector6d& f)
+{
+  Vector6d y;
+  y.head<3>() = v.head<3>().cross(f.head<3>()) + v.tail<3>().cross(f.tail<3>());
+  y.tail<3>() = v.head<3>().cross(f.tail<3>());
+  return y;
+}
+
+#endif // _SPATIALALGEBRA_H_
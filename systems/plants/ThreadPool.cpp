@@ -0,0 +1,81 @@
+#include "ThreadPool.h"
+
+using namespace std;
+
+ThreadPool::ThreadPool(int num_threads)
+  : task(NULL), num_tasks(0), next_task(0), num_busy_workers(0), generation(0), stopping(false)
+{
+  if (num_threads <= 0)
+    num_threads = thread::hardware_concurrency();
+  if (num_threads <= 0)  // hardware_concurrency is allowed to return 0 if it can't tell
+    num_threads = 1;
+  this->num_threads = num_threads;
+
+  // the calling thread does its share of the work as thread 0
+  for (int i=1; i<num_threads; i++)
+    workers.push_back(thread(&ThreadPool::workerLoop,this,i));
+}
+
+ThreadPool::~ThreadPool(void)
+{
+  {
+    lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  work_available.notify_all();
+  for (size_t i=0; i<workers.size(); i++)
+    workers[i].join();
+}
+
+void ThreadPool::parallelFor(int n, const function<void(int,int)>& f)
+{
+  if (n <= 0) return;
+  if (workers.empty() || n == 1) {
+    for (int i=0; i<n; i++) f(0,i);
+    return;
+  }
+
+  {
+    lock_guard<std::mutex> lock(mutex);
+    task = &f;
+    num_tasks = n;
+    next_task = 0;
+    num_busy_workers = workers.size();
+    generation++;
+  }
+  work_available.notify_all();
+
+  runTasks(0);
+
+  unique_lock<std::mutex> lock(mutex);
+  work_done.wait(lock, [this]{ return num_busy_workers == 0; });
+  task = NULL;
+}
+
+void ThreadPool::workerLoop(int thread_index)
+{
+  unsigned long last_generation = 0;
+  while (true) {
+    {
+      unique_lock<std::mutex> lock(mutex);
+      work_available.wait(lock, [&]{ return stopping || generation != last_generation; });
+      if (stopping) return;
+      last_generation = generation;
+    }
+
+    runTasks(thread_index);
+
+    {
+      lock_guard<std::mutex> lock(mutex);
+      if (--num_busy_workers == 0)
+        work_done.notify_one();
+    }
+  }
+}
+
+void ThreadPool::runTasks(int thread_index)
+{
+  int i;
+  while ((i = next_task++) < num_tasks)
+    (*task)(thread_index,i);
+}
@@ -0,0 +1,47 @@
+#ifndef _THREADPOOL_H_
+#define _THREADPOOL_H_
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+
+/*
+ * A fixed set of worker threads for data-parallel loops.
+ *
+ * parallelFor(n,f) calls f(thread_index,i) once for every i in [0,n), spreading
+ * the indices over the workers and the calling thread, and returns when all of
+ * the calls have finished.  thread_index is in [0,numThreads()) and is unique
+ * among the concurrently running calls, so f can use it to pick per-thread
+ * scratch data.  parallelFor itself must not be called concurrently (or
+ * recursively) on the same pool.
+ */
+class ThreadPool {
+public:
+  ThreadPool(int num_threads=0);  // num_threads<=0 means one per hardware thread
+  ~ThreadPool(void);
+
+  int numThreads(void) const { return num_threads; };
+
+  void parallelFor(int n, const std::function<void(int,int)>& f);
+
+private:
+  void workerLoop(int thread_index);
+  void runTasks(int thread_index);
+
+  int num_threads;
+  std::vector<std::thread> workers;
+
+  std::mutex mutex;
+  std::condition_variable work_available, work_done;
+  const std::function<void(int,int)>* task;
+  int num_tasks;
+  std::atomic<int> next_task;
+  int num_busy_workers;
+  unsigned long generation;  // incremented for every parallelFor, so that workers can tell new work from spurious wakeups
+  bool stopping;
+};
+
+#endif // _THREADPOOL_H_
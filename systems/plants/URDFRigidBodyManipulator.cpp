@@ -4,6 +4,7 @@
 #include <fstream>
 #include <sstream>
 #include <map>
+#include <cfloat>
 
 #include "URDFRigidBodyManipulator.h"
 #include "urdf_interface/model.h"
@@ -173,6 +174,77 @@ void poseToTransform(const urdf::Pose& pose, Matrix4d& T)
           0, 0, 0, 1;
 }
 
+// rotation (as a homogeneous transform) that takes the unit vector axis onto the z axis
+Matrix4d axisToZTransform(const Vector3d& axis)
+{
+  Vector3d zvec; zvec << 0,0,1;
+  Vector3d rot_axis = axis.cross(zvec);
+  double angle = acos(axis.dot(zvec));
+  double qx,qy,qz,qw;
+  if (rot_axis.squaredNorm()<.0001) //  then it's a scaling of the z axis.
+    rot_axis << 0,1,0;
+  rot_axis.normalize();
+  qw=cos(angle/2.0);
+  qx=rot_axis(0)*sin(angle/2.0);
+  qy=rot_axis(1)*sin(angle/2.0);
+  qz=rot_axis(2)*sin(angle/2.0);
+
+  Matrix4d T;
+  T <<    qw*qw + qx*qx - qy*qy - qz*qz, 2*qx*qy - 2*qw*qz, 2*qx*qz + 2*qw*qy, 0,
+          2*qx*qy + 2*qw*qz,  qw*qw + qy*qy - qx*qx - qz*qz, 2*qy*qz - 2*qw*qx, 0,
+          2*qx*qz - 2*qw*qy, 2*qy*qz + 2*qw*qx, qw*qw + qz*qz - qx*qx - qy*qy, 0,
+          0, 0, 0, 1;
+  return T;
+}
+
+// the featherstone transform from a parent frame to a child frame posed at T in the parent
+Matrix6d transformToXtree(const Matrix4d& T)
+{
+  return PluckerTransform(T.topLeftCorner<3,3>().transpose(),T.topRightCorner<3,1>()).toMatrix();
+}
+
+// spatial inertia of a link about (and in the coordinates of) its link frame
+Matrix6d linkSpatialInertia(const urdf::Inertial& inertial)
+{
+  Matrix4d T;
+  poseToTransform(inertial.origin,T);
+  Matrix3d R = T.topLeftCorner<3,3>();
+  Matrix3d Ic;
+  Ic << inertial.ixx, inertial.ixy, inertial.ixz,
+        inertial.ixy, inertial.iyy, inertial.iyz,
+        inertial.ixz, inertial.iyz, inertial.izz;
+  Ic = R*Ic*R.transpose();
+
+  double m = inertial.mass;
+  Matrix3d cx = skew(T.topRightCorner<3,1>());
+  Matrix6d I;
+  I << Ic + m*cx*cx.transpose(), m*cx,
+       m*cx.transpose(), m*Matrix3d::Identity();
+  return I;
+}
+
+// appends the points of a collision element that can touch the terrain (see
+// RigidBodyGeometry/getTerrainContactPoints): the corners of a box and the
+// center of a zero-radius sphere
+void addTerrainContactPoints(RigidBody& body, DrakeCollision::Shape shape, const vector<double>& params, const Matrix4d& T)
+{
+  MatrixXd pts;
+  if (shape == DrakeCollision::Shape::BOX) {
+    pts.resize(4,8);
+    for (int i=0; i<8; i++)
+      pts.col(i) << ((i&1) ? .5 : -.5)*params[0], ((i&2) ? .5 : -.5)*params[1], ((i&4) ? .5 : -.5)*params[2], 1;
+  } else if (shape == DrakeCollision::Shape::SPHERE && params[0] == 0.0) {
+    pts = Vector4d(0,0,0,1);
+  } else {
+    return;
+  }
+  pts = T*pts;
+
+  int n = body.contact_pts.cols();
+  body.contact_pts.conservativeResize(4,n+pts.cols());
+  body.contact_pts.rightCols(pts.cols()) = pts;
+}
+
 URDFRigidBodyManipulator::URDFRigidBodyManipulator(void)
 : 
   RigidBodyManipulator(0,0,1)
@@ -223,14 +295,6 @@ bool URDFRigidBodyManipulator::addURDF(boost::shared_ptr<urdf::ModelInterface> _
 
     	bodies[index].linkname = l->first;
     	bodies[index].jointname = j->name;
-        if(l->second->inertial == nullptr)
-        {
-          bodies[index].mass = 0.0;
-        }
-        else
-        {
-          bodies[index].mass = l->second->inertial->mass;
-        }
 //    	cout << "body[" << index << "] linkname: " << bodies[index].linkname << ", jointname: " << bodies[index].jointname << endl;
 
         bodies[index].robotnum = robotnum;
@@ -245,7 +309,6 @@ bool URDFRigidBodyManipulator::addURDF(boost::shared_ptr<urdf::ModelInterface> _
     			if (pjn == jointname_to_jointnum.end()) ROS_ERROR("can't find joint %s.  this shouldn't happen", pj->name.c_str());
 
     			bodies[index].parent = pjn->second;
-    			parent[index-1] = pjn->second-1;
     		} else { // the parent body is the floating base
             	string jointname="base";
                 map<string, int>::iterator jn=jointname_to_jointnum.find(jointname);
@@ -255,17 +318,14 @@ bool URDFRigidBodyManipulator::addURDF(boost::shared_ptr<urdf::ModelInterface> _
     	}
 
     	bodies[index].dofnum = _dofnum;
-    	dofnum[index-1] = _dofnum;
 
     	// set pitch and floating
     	switch (j->type) {
     	case urdf::Joint::PRISMATIC:
-    		pitch[index-1] = INF;
     		bodies[index].pitch = INF;
     		bodies[index].floating=0;
     		break;
       default:  // continuous, rotary, fixed, ...
-      	pitch[index-1] = 0.0;
       	bodies[index].pitch = 0.0;
       	bodies[index].floating=0;
       	break;
@@ -275,24 +335,8 @@ bool URDFRigidBodyManipulator::addURDF(boost::shared_ptr<urdf::ModelInterface> _
       {
       	poseToTransform(j->parent_to_joint_origin_transform,bodies[index].Ttree);
 
-        Vector3d zvec; zvec << 0,0,1;
         Vector3d joint_axis; joint_axis << j->axis.x, j->axis.y, j->axis.z;
-        Vector3d axis = joint_axis.cross(zvec);
-        double angle = acos(joint_axis.dot(zvec));
-        double qx,qy,qz,qw;
-        if (axis.squaredNorm()<.0001) //  then it's a scaling of the z axis.
-          axis << 0,1,0;
-        axis.normalize();
-        qw=cos(angle/2.0);
-        qx=axis(0)*sin(angle/2.0);
-        qy=axis(1)*sin(angle/2.0);
-        qz=axis(2)*sin(angle/2.0);
-
-        bodies[index].T_body_to_joint <<
-                qw*qw + qx*qx - qy*qy - qz*qz, 2*qx*qy - 2*qw*qz, 2*qx*qz + 2*qw*qy, 0,
-                2*qx*qy + 2*qw*qz,  qw*qw + qy*qy - qx*qx - qz*qz, 2*qy*qz - 2*qw*qx, 0,
-                2*qx*qz - 2*qw*qy, 2*qy*qz + 2*qw*qx, qw*qw + qz*qz - qx*qx - qy*qy, 0,
-                0, 0, 0, 1;
+        bodies[index].T_body_to_joint = axisToZTransform(joint_axis);
       }
 
     } else { // no joint, this link is attached directly to the floating base
@@ -324,10 +368,14 @@ bool URDFRigidBodyManipulator::addURDF(boost::shared_ptr<urdf::ModelInterface> _
       // pitch is irrelevant
       bodies[index].Ttree = Matrix4d::Identity();
       bodies[index].T_body_to_joint = Matrix4d::Identity();
+    }
 
-      // todo: set up featherstone structure (dynamics)
-      parent[index-1] = -1;
-      dofnum[index-1] = _dofnum;
+    if (l->second->inertial) {
+      bodies[index].mass = l->second->inertial->mass;
+      const urdf::Vector3& c = l->second->inertial->origin.position;
+      bodies[index].com << c.x, c.y, c.z, 1;
+    } else {
+      bodies[index].mass = 0.0;
     }
 
     if (!l->second->collision_groups.empty()) { // then at least one collision element exists
@@ -387,6 +435,7 @@ bool URDFRigidBodyManipulator::addURDF(boost::shared_ptr<urdf::ModelInterface> _
         		break;
           }
           addCollisionElement(index,T,shape,params);
+          addTerrainContactPoints(bodies[index],shape,params,T);
         }
       }
       if (bodies[index].parent<0) {
@@ -395,6 +444,65 @@ bool URDFRigidBodyManipulator::addURDF(boost::shared_ptr<urdf::ModelInterface> _
     }
   }
 
+  // set up featherstone structure (dynamics).  the featherstone bodies are
+  // indexed like the dofs, and each one moves along (or about) its own z axis,
+  // so its frame is the link frame rotated by T_body_to_joint.  the floating
+  // base is a chain of six: x, y, z, then yaw, pitch and roll (rz*ry*rx, as
+  // in doKinematics), with the base link's inertia on the last one.
+  {
+    const Vector3d base_axes[6] = {Vector3d::UnitX(), Vector3d::UnitY(), Vector3d::UnitZ(), Vector3d::UnitZ(), Vector3d::UnitY(), Vector3d::UnitX()};
+    const int base_dof_offsets[6] = {0, 1, 2, 5, 4, 3};
+    vector<Matrix4d,aligned_allocator<Matrix4d> > T_body_to_joint(NB,Matrix4d::Identity());
+
+    int base_index = findWithSuffix(jointname_to_jointnum,"base")->second;
+    for (int i=base_index; i<num_bodies; i++) {
+      RigidBody& b = bodies[i];
+      int n;
+      boost::shared_ptr<urdf::Link> link = _urdf_model->links_.at(b.linkname);
+      if (b.floating) {
+        for (int k=0; k<6; k++) {
+          n = b.dofnum+k;
+          parent[n] = (k==0) ? -1 : n-1;
+          dofnum[n] = b.dofnum+base_dof_offsets[k];
+          pitch[n] = (k<3) ? INF : 0;
+          damping[n] = 0.0;
+          coulomb_friction[n] = 0.0;
+          static_friction[n] = 0.0;
+          coulomb_window[n] = DBL_EPSILON;
+          T_body_to_joint[n] = axisToZTransform(base_axes[k]);
+          Xtree[n] = transformToXtree(((k==0) ? Matrix4d::Identity() : T_body_to_joint[n-1])*T_body_to_joint[n].inverse());
+          I[n] = Matrix6d::Zero();
+        }
+        n = b.dofnum+5;
+      } else {
+        const RigidBody& p = bodies[b.parent];
+        int pn = p.floating ? p.dofnum+5 : p.dofnum;
+        n = b.dofnum;
+        parent[n] = (b.parent>0) ? pn : -1;
+        dofnum[n] = b.dofnum;
+        pitch[n] = b.pitch;
+        damping[n] = 0.0;
+        coulomb_friction[n] = 0.0;
+        if (link->parent_joint && link->parent_joint->dynamics) {
+          damping[n] = link->parent_joint->dynamics->damping;
+          coulomb_friction[n] = link->parent_joint->dynamics->friction;
+        }
+        static_friction[n] = 0.0;
+        coulomb_window[n] = DBL_EPSILON;
+        T_body_to_joint[n] = b.T_body_to_joint;
+        Xtree[n] = transformToXtree(((b.parent>0) ? T_body_to_joint[pn] : Matrix4d::Identity())*b.Ttree*b.T_body_to_joint.inverse());
+      }
+
+      if (link->inertial) {
+        PluckerTransform X(T_body_to_joint[n].topLeftCorner<3,3>().transpose(),Vector3d::Zero());
+        I[n] = X.transformInertia(linkSpatialInertia(*link->inertial));
+      } else {
+        I[n] = Matrix6d::Zero();
+      }
+    }
+    a_grav << 0,0,0,0,0,-9.81;
+  }
+
   compile();  
   return true;
 }
@@ -674,9 +782,14 @@ void setJointLimits(boost::shared_ptr<urdf::ModelInterface> urdf_model, boost::s
     case urdf::Joint::REVOLUTE:
     case urdf::Joint::CONTINUOUS:
     case urdf::Joint::PRISMATIC:
-    case urdf::Joint::FIXED:
-      joint_limit_min[dofname_to_dofnum.at(j->name)] = j->limits->lower;
-      joint_limit_max[dofname_to_dofnum.at(j->name)] = j->limits->upper;
+      if (j->limits) {  // prismatic joints may leave them out
+        joint_limit_min[dofname_to_dofnum.at(j->name)] = j->limits->lower;
+        joint_limit_max[dofname_to_dofnum.at(j->name)] = j->limits->upper;
+      }
+      break;
+    case urdf::Joint::FIXED:  // the dof is only a placeholder, so it stays at zero
+      joint_limit_min[dofname_to_dofnum.at(j->name)] = 0.0;
+      joint_limit_max[dofname_to_dofnum.at(j->name)] = 0.0;
       break;
     case urdf::Joint::FLOATING:
       joint_limit_min[dofname_to_dofnum.at(j->name)] = -1.0/0.0;
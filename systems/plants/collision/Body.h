@@ -6,7 +6,7 @@ namespace DrakeCollision
   class Body {
     public:
       Body() : body_idx(-1), parent_idx(-1), group(DEFAULT_GROUP), 
-      mask(ALL_MASK), elements() {};
+      mask(ALL_MASK), elements(), has_transform(false) {};
 
       void addElement(const int body_idx, const int parent_idx, 
                       const Eigen::Matrix4d& T_elem_to_link, Shape shape, 
@@ -15,6 +15,7 @@ namespace DrakeCollision
         //DEBUG
         //std::cout << "Body::addElement: START" << std::endl;
         //END_DEBUG
+        has_transform = false;  // so that the next update places the new element
         if ((this->body_idx == body_idx) && (this->parent_idx == parent_idx)) {
           //DEBUG
           //std::cout << "Body::addElement: Add new element" << std::endl;
@@ -90,11 +91,19 @@ namespace DrakeCollision
 
       void collideWithGroup(const bitmask& group) { this->mask |= group; };
 
-      void updateElements(const Eigen::Matrix4d& T_link_to_world)
+      // Returns false, without touching the elements, if T_link_to_world is
+      // the same as in the previous update
+      bool updateElements(const Eigen::Matrix4d& T_link_to_world)
       {
-        for (auto elem : elements) {
+        if (has_transform && (this->T_link_to_world == T_link_to_world)) {
+          return false;
+        }
+        this->T_link_to_world = T_link_to_world;
+        has_transform = true;
+        for (auto& elem : elements) {
           elem.updateWorldTransform(T_link_to_world);
         }
+        return true;
       };
 
       bool adjacentTo(const Body& other) const
@@ -117,6 +126,9 @@ namespace DrakeCollision
       bitmask group;
       bitmask  mask;
       std::vector<BulletElement> elements;
+      // the transform from the last updateElements (unaligned, since bodies live in a std::map)
+      Eigen::Matrix<double,4,4,Eigen::DontAlign> T_link_to_world;
+      bool has_transform;
   };
 }
 #endif
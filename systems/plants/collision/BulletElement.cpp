@@ -124,7 +124,7 @@ namespace DrakeCollision
     
   void BulletElement::setWorldTransform(const Matrix4d& T)
   {
-    this->T_elem_to_world = T_elem_to_world;
+    this->T_elem_to_world = T;
 
     btMatrix3x3 rot;
     btVector3 pos;
@@ -1,4 +1,7 @@
 #include <iostream>
+#include <algorithm>
+#include <set>
+#include <LinearMath/btAabbUtil2.h>
 
 #include "DrakeCollision.h"
 #include "BulletModel.h"
@@ -34,10 +37,18 @@ namespace DrakeCollision
     return collides;
   }
 
+  bool OverlappingObjectsCallback::process(const btBroadphaseProxy* proxy)
+  {
+    objects.push_back(static_cast<const btCollisionObject*>(proxy->m_clientObject));
+    return true;
+  }
+
   BulletModel::BulletModel()
     : bt_collision_configuration(),
       bt_collision_broadphase(),
-      filter_callback()
+      filter_callback(),
+      num_elements_updated(0),
+      num_elements_skipped(0)
   {
     bt_collision_dispatcher =  new btCollisionDispatcher( &bt_collision_configuration );
     bt_collision_world = new btCollisionWorld(bt_collision_dispatcher,
@@ -85,9 +96,15 @@ namespace DrakeCollision
   {
     auto iter_for_body( bodies.find(body_idx) );
     if ( iter_for_body!=bodies.end() ) { // Then bodies[body_idx] exists
-      iter_for_body->second.updateElements(T_link_to_world);
-      for (const BulletElement& elem : bodies.at(body_idx).getElements()) {
-        bt_collision_world->updateSingleAabb(elem.bt_obj.get());
+      const ElementVec& elements = iter_for_body->second.getElements();
+      // bodies that haven't moved keep their transforms and bounding boxes
+      if (iter_for_body->second.updateElements(T_link_to_world)) {
+        for (const BulletElement& elem : elements) {
+          bt_collision_world->updateSingleAabb(elem.bt_obj.get());
+        }
+        num_elements_updated += elements.size();
+      } else {
+        num_elements_skipped += elements.size();
       }
       return true;
     } else {
@@ -287,37 +304,80 @@ namespace DrakeCollision
   
   bool BulletModel::collisionRaycast(const Matrix3Xd &origins, const Matrix3Xd &ray_endpoints, VectorXd &distances)
   {
-    
     distances.resize(origins.cols());
-    
-    for (int i = 0; i < origins.cols(); i ++)
-    {
-    
-        btVector3 ray_from_world(origins(0,i), origins(1,i), origins(2,i));
-        btVector3 ray_to_world(ray_endpoints(0,i), ray_endpoints(1,i), ray_endpoints(2,i));
-        
-        btCollisionWorld::ClosestRayResultCallback ray_callback(ray_from_world, ray_to_world);
-        
-        bt_collision_world->rayTest(ray_from_world, ray_to_world, ray_callback);
-        
-        if (ray_callback.hasHit()) {
-            
-            // compute distance to hit
-            
-            btVector3 end = ray_callback.m_hitPointWorld;
-            
-            Vector3d end_eigen(end.getX(), end.getY(), end.getZ());
-            
-            distances(i) = (end_eigen - origins.col(i)).norm();
-            
-            
-        } else {
-            distances(i) = -1;
+    return collisionRaycast(origins, ray_endpoints, 0, origins.cols(), distances, NULL, NULL);
+  }
+
+  bool BulletModel::collisionRaycast(const Matrix3Xd &origins, const Matrix3Xd &ray_endpoints,
+                                     int first, int count, VectorXd &distances,
+                                     Matrix3Xd* normals, vector<int>* body_idx)
+  {
+    if (count <= 0) {
+      return true;
+    }
+
+    // one broadphase query for the bounding box of all of the rays in the batch
+    Vector3d batch_min = origins.middleCols(first,count).rowwise().minCoeff().cwiseMin(
+                           ray_endpoints.middleCols(first,count).rowwise().minCoeff());
+    Vector3d batch_max = origins.middleCols(first,count).rowwise().maxCoeff().cwiseMax(
+                           ray_endpoints.middleCols(first,count).rowwise().maxCoeff());
+    OverlappingObjectsCallback candidates;
+    bt_collision_broadphase.aabbTest(btVector3(batch_min(0), batch_min(1), batch_min(2)),
+                                     btVector3(batch_max(0), batch_max(1), batch_max(2)),
+                                     candidates);
+
+    btTransform ray_from_trans, ray_to_trans;
+    ray_from_trans.setIdentity();
+    ray_to_trans.setIdentity();
+    for (int i = first; i < first+count; ++i) {
+      btVector3 ray_from_world(origins(0,i), origins(1,i), origins(2,i));
+      btVector3 ray_to_world(ray_endpoints(0,i), ray_endpoints(1,i), ray_endpoints(2,i));
+      ray_from_trans.setOrigin(ray_from_world);
+      ray_to_trans.setOrigin(ray_to_world);
+
+      btCollisionWorld::ClosestRayResultCallback ray_callback(ray_from_world, ray_to_world);
+
+      // the same per-object tests that btCollisionWorld::rayTest does, minus
+      // the broadphase traversal.  rayTestSingle is static, so concurrent
+      // calls don't share any state
+      for (const btCollisionObject* bt_obj : candidates.objects) {
+        const btBroadphaseProxy* proxy = bt_obj->getBroadphaseHandle();
+        btScalar hit_fraction = ray_callback.m_closestHitFraction;
+        btVector3 hit_normal;
+        if (ray_callback.needsCollision(const_cast<btBroadphaseProxy*>(proxy)) &&
+            btRayAabb(ray_from_world, ray_to_world, proxy->m_aabbMin, proxy->m_aabbMax,
+                      hit_fraction, hit_normal)) {
+          btCollisionWorld::rayTestSingle(ray_from_trans, ray_to_trans,
+                                          const_cast<btCollisionObject*>(bt_obj),
+                                          bt_obj->getCollisionShape(),
+                                          bt_obj->getWorldTransform(), ray_callback);
+        }
+      }
+
+      if (ray_callback.hasHit()) {
+        btVector3 end = ray_callback.m_hitPointWorld;
+        Vector3d end_eigen(end.getX(), end.getY(), end.getZ());
+        distances(i) = (end_eigen - origins.col(i)).norm();
+        if (normals) {
+          normals->col(i) = toVector3d(ray_callback.m_hitNormalWorld);
+        }
+        if (body_idx) {
+          auto element_data = static_cast< ElementData* >(ray_callback.m_collisionObject->getUserPointer());
+          (*body_idx)[i] = element_data ? element_data->body_idx : -1;
+        }
+      } else {
+        distances(i) = -1;
+        if (normals) {
+          normals->col(i).setZero();
+        }
+        if (body_idx) {
+          (*body_idx)[i] = -1;
         }
+      }
     }
-    
+
     return true;
-  } 
+  }
 
   bool BulletModel::getClosestPoints(const int bodyA_idx, const int bodyB_idx,
           Vector3d& ptA, Vector3d& ptB, Vector3d& normal,
@@ -416,6 +476,87 @@ namespace DrakeCollision
     return has_result;
   };
   
+  bool BulletModel::closestPointsAllBodies(std::vector<int>& bodyA_idx,
+          std::vector<int>& bodyB_idx,
+          MatrixXd& ptsA, MatrixXd& ptsB,
+          MatrixXd& normal,
+          VectorXd& distance,
+          std::vector<int>& bodies_idx,
+          double distance_threshold)
+  {
+    ResultCollShPtr c = std::make_shared<ResultCollector>();
+    if (bodies_idx.size() == 0) {
+      for (auto it = bodies.begin(); it != bodies.end(); ++it) {
+        bodies_idx.push_back(it->first);
+      }
+    }
+
+    // position of each active body in bodies_idx.  every pair is visited once,
+    // from the body that comes first (as in the all-pairs version above)
+    map<int,int> active_rank;
+    for (int i = bodies_idx.size()-1; i >= 0; --i) {
+      if (bodies.count(bodies_idx[i]) > 0) {
+        active_rank[bodies_idx[i]] = i;
+      }
+    }
+
+    btVector3 margin(distance_threshold,distance_threshold,distance_threshold);
+    OverlappingObjectsCallback overlapping;
+    for (int rankA = 0; rankA < bodies_idx.size(); ++rankA) {
+      auto itA = active_rank.find(bodies_idx[rankA]);
+      if (itA == active_rank.end() || itA->second != rankA) {
+        continue;
+      }
+      const Body& bodyA = bodies[itA->first];
+
+      // broadphase: the active bodies with an element near one of bodyA's elements
+      set<int> candidate_ranks;
+      for (const BulletElement& elemA : bodyA.getElements()) {
+        const btBroadphaseProxy* proxyA = elemA.bt_obj->getBroadphaseHandle();
+        overlapping.objects.clear();
+        bt_collision_broadphase.aabbTest(proxyA->m_aabbMin - margin,
+                                         proxyA->m_aabbMax + margin, overlapping);
+        for (const btCollisionObject* bt_obj : overlapping.objects) {
+          if (bt_obj->getUserPointer() == NULL) {
+            continue;
+          }
+          auto element_data = static_cast< ElementData* >(bt_obj->getUserPointer());
+          auto itB = active_rank.find(element_data->body_idx);
+          if ( (itB != active_rank.end()) && (itB->second > rankA) &&
+               bodyA.collidesWith(bodies[itB->first]) ) {
+            candidate_ranks.insert(itB->second);
+          }
+        }
+      }
+
+      // narrowphase on the element pairs whose padded bounding boxes overlap
+      for (int rankB : candidate_ranks) {
+        const Body& bodyB = bodies[bodies_idx[rankB]];
+        for (const BulletElement& elemA : bodyA.getElements()) {
+          const btBroadphaseProxy* proxyA = elemA.bt_obj->getBroadphaseHandle();
+          for (const BulletElement& elemB : bodyB.getElements()) {
+            const btBroadphaseProxy* proxyB = elemB.bt_obj->getBroadphaseHandle();
+            if (TestAabbAgainstAabb2(proxyA->m_aabbMin - margin, proxyA->m_aabbMax + margin,
+                                     proxyB->m_aabbMin, proxyB->m_aabbMax)) {
+              findClosestPointsBtwElements(bodyA.getBodyIdx(),bodyB.getBodyIdx(),
+                                           elemA,elemB,c);
+            }
+          }
+        }
+      }
+    }
+
+    // the bounding boxes are conservative, so drop the pairs that turned out to be farther apart
+    c->pts.erase(remove_if(c->pts.begin(), c->pts.end(),
+                           [distance_threshold](const PointPair& pt) {
+                             return pt.distance > distance_threshold;
+                           }),
+                 c->pts.end());
+    c->getResults(bodyA_idx, bodyB_idx, ptsA, ptsB,normal,distance);
+
+    return (c->pts.size() > 0);
+  };
+
   bool BulletModel::allCollisions(vector<int>& bodyA_idx,
           vector<int>& bodyB_idx,
           MatrixXd& ptsA, MatrixXd& ptsB)
@@ -423,7 +564,14 @@ namespace DrakeCollision
     BulletResultCollector c;
     MatrixXd normals;
     vector<double> distance;
-    bt_collision_world->performDiscreteCollisionDetection();
+    // performDiscreteCollisionDetection would start with updateAabbs, which
+    // recomputes the bounding box of every object.  updateElementsForBody has
+    // already refreshed the ones that moved, so go straight to the broadphase
+    // and the narrowphase.
+    bt_collision_world->computeOverlappingPairs();
+    bt_collision_world->getDispatcher()->dispatchAllCollisionPairs(
+        bt_collision_world->getBroadphase()->getOverlappingPairCache(),
+        bt_collision_world->getDispatchInfo(), bt_collision_world->getDispatcher());
     int numManifolds = bt_collision_world->getDispatcher()->getNumManifolds();
     for (int i=0;i<numManifolds;i++)
     {
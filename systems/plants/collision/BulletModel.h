@@ -25,6 +25,14 @@ namespace DrakeCollision
     BulletModel* parent_model;
   };
 
+  // collects the collision objects whose broadphase bounding boxes overlap a query box
+  struct OverlappingObjectsCallback : public btBroadphaseAabbCallback
+  {
+    virtual bool process(const btBroadphaseProxy* proxy);
+
+    std::vector<const btCollisionObject*> objects;
+  };
+
   struct ElementData 
   {
     int body_idx;
@@ -52,6 +60,18 @@ namespace DrakeCollision
       virtual bool updateElementsForBody(const int body_idx,
                                   const Eigen::Matrix4d& T_link_to_world);
 
+      virtual void getElementUpdateCounts(long& num_updated, long& num_skipped) const
+      {
+        num_updated = num_elements_updated;
+        num_skipped = num_elements_skipped;
+      };
+
+      virtual void resetElementUpdateCounts()
+      {
+        num_elements_updated = 0;
+        num_elements_skipped = 0;
+      };
+
       virtual bool setCollisionFilter(const int body_idx, 
                                       const uint16_t group, 
                                       const uint16_t mask);
@@ -97,6 +117,20 @@ namespace DrakeCollision
                                                Eigen::MatrixXd& normal, 
                                                Eigen::VectorXd& distance,
                                                std::vector<int>& bodies_idx);
+
+      /*
+       * Returns one pair of points for each pair of elements that are closer
+       * than distance_threshold.  The candidate pairs come from the broadphase,
+       * so the cost grows with the number of nearby pairs rather than with the
+       * square of the number of bodies.
+       */
+      virtual bool closestPointsAllBodies(std::vector<int>& bodyA_idx,
+                                               std::vector<int>& bodyB_idx,
+                                               Eigen::MatrixXd& ptsA, Eigen::MatrixXd& ptsB,
+                                               Eigen::MatrixXd& normal,
+                                               Eigen::VectorXd& distance,
+                                               std::vector<int>& bodies_idx,
+                                               double distance_threshold);
       // END Required member functions
 
       virtual const Body& getBody(int body_idx) const
@@ -110,6 +144,11 @@ namespace DrakeCollision
       
       virtual bool collisionRaycast(const Eigen::Matrix3Xd &origins, 
               const Eigen::Matrix3Xd &ray_endpoints, Eigen::VectorXd &distances);
+
+      virtual bool collisionRaycast(const Eigen::Matrix3Xd &origins,
+              const Eigen::Matrix3Xd &ray_endpoints, int first, int count,
+              Eigen::VectorXd &distances, Eigen::Matrix3Xd* normals,
+              std::vector<int>* body_idx);
       
       // For getClosestPoints
       //btGjkEpaPenetrationDepthSolver epa;
@@ -214,6 +253,8 @@ namespace DrakeCollision
       btDbvtBroadphase bt_collision_broadphase;
       OverlapFilterCallback filter_callback;
       std::vector< std::unique_ptr< ElementData > > element_data;
+      long num_elements_updated;
+      long num_elements_skipped;
   };
 }
 #endif
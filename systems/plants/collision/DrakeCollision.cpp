@@ -1,6 +1,7 @@
 
 #include <iostream>
 #include <map>
+#include <cmath>
 
 #include "DrakeCollision.h"
 
@@ -41,6 +42,21 @@ namespace DrakeCollision
   };
   
 
+  void RayFan::getRays(Eigen::Matrix3Xd& origins, Eigen::Matrix3Xd& ray_endpoints) const
+  {
+    int n = numRays();
+    origins = origin.replicate(1,n);
+    ray_endpoints.resize(3,n);
+    for (int i = 0; i < num_elevation; ++i) {
+      double elevation = (num_elevation > 1) ? min_elevation + (max_elevation-min_elevation)*i/(num_elevation-1) : min_elevation;
+      for (int j = 0; j < num_azimuth; ++j) {
+        double azimuth = (num_azimuth > 1) ? min_azimuth + (max_azimuth-min_azimuth)*j/(num_azimuth-1) : min_azimuth;
+        Eigen::Vector3d direction(cos(elevation)*cos(azimuth), cos(elevation)*sin(azimuth), sin(elevation));
+        ray_endpoints.col(i*num_azimuth+j) = origin + range*(orientation*direction);
+      }
+    }
+  }
+
   const bitmask ALL_MASK(std::string(16,'1'));
   const bitmask NONE_MASK(0);
   const bitmask DEFAULT_GROUP(1);
@@ -36,6 +36,13 @@ namespace DrakeCollision
 
     virtual bool updateElementsForBody(const int body_idx, 
 				       const Eigen::Matrix4d& T_link_to_world) { return false; };
+
+    // How many elements updateElementsForBody has refreshed (new world
+    // transform and bounding box), and how many it skipped because their body
+    // had not moved since its previous update
+    virtual void getElementUpdateCounts(long& num_updated, long& num_skipped) const { num_updated = 0; num_skipped = 0; };
+
+    virtual void resetElementUpdateCounts() {};
       
     virtual bool setCollisionFilter(const int body_idx, const uint16_t group, 
 				    const uint16_t mask) { return false; };
@@ -65,6 +72,17 @@ namespace DrakeCollision
 					Eigen::VectorXd& distance,
 					std::vector<int>& bodies_idx) { return false; };
 
+    // Same as above, but only returns the pairs that are closer than
+    // distance_threshold.  Pairs that are clearly farther apart are culled
+    // using their bounding boxes before any closest points are computed.
+    virtual bool closestPointsAllBodies(std::vector<int>& bodyA_idx,
+					std::vector<int>& bodyB_idx,
+					Eigen::MatrixXd& ptsA, Eigen::MatrixXd& ptsB,
+					Eigen::MatrixXd& normal,
+					Eigen::VectorXd& distance,
+					std::vector<int>& bodies_idx,
+					double distance_threshold) { return false; };
+
     virtual bool allCollisions(std::vector<int>& bodyA_idx, 
 			       std::vector<int>& bodyB_idx, 
 			       Eigen::MatrixXd& ptsA, Eigen::MatrixXd& ptsB) { return false; };
@@ -77,6 +95,49 @@ namespace DrakeCollision
     // @param distance to the first collision, or -1 on no collision
     //
     virtual bool collisionRaycast(const Eigen::Matrix3Xd &origin, const Eigen::Matrix3Xd &ray_endpoint, Eigen::VectorXd &distances) { return false; };
+
+    //
+    // Batched raycast over the rays in columns [first, first+count) of origins
+    // and ray_endpoints.  The broadphase is traversed once for the whole range,
+    // after which each ray is only cast against the elements whose bounding
+    // boxes it crosses.  Calls on disjoint ranges may run concurrently.
+    //
+    // The results go into the same columns of the outputs, which must already
+    // have (at least) origins.cols() entries:
+    // @param distances to the first collision, or -1 on no collision
+    // @param normals (optional) world frame surface normal at the hit
+    // @param body_idx (optional) index of the body that was hit, or -1
+    //
+    virtual bool collisionRaycast(const Eigen::Matrix3Xd &origins, const Eigen::Matrix3Xd &ray_endpoints,
+                                  int first, int count, Eigen::VectorXd &distances,
+                                  Eigen::Matrix3Xd* normals, std::vector<int>* body_idx) { return false; };
+  };
+
+  //
+  // A fan of rays from a single origin, as swept by a laser scanner: num_azimuth
+  // rays evenly spaced from min_azimuth to max_azimuth about the sensor z axis,
+  // for each of num_elevation elevation angles from min_elevation to
+  // max_elevation (radians).  orientation rotates sensor frame directions into
+  // the world frame.
+  //
+  struct RayFan {
+    RayFan(const Eigen::Vector3d& origin, double min_azimuth, double max_azimuth, int num_azimuth, double range)
+      : origin(origin), orientation(Eigen::Matrix3d::Identity()),
+        min_azimuth(min_azimuth), max_azimuth(max_azimuth), num_azimuth(num_azimuth),
+        min_elevation(0.0), max_elevation(0.0), num_elevation(1), range(range) {};
+
+    int numRays() const { return num_azimuth*num_elevation; };
+
+    // ray k has azimuth index k % num_azimuth and elevation index k / num_azimuth
+    void getRays(Eigen::Matrix3Xd& origins, Eigen::Matrix3Xd& ray_endpoints) const;
+
+    Eigen::Vector3d origin;
+    Eigen::Matrix3d orientation;
+    double min_azimuth, max_azimuth;
+    int num_azimuth;
+    double min_elevation, max_elevation;
+    int num_elevation;
+    double range;
   };
 
   std::shared_ptr<Model> newModel();
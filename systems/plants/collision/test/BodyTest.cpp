@@ -67,3 +67,67 @@ BOOST_AUTO_TEST_CASE(collideWithGroup_test)
   BOOST_CHECK_MESSAGE( body1.collidesWith(body2), 
                       "Body 1 should collide with body2");
 }
+
+BOOST_AUTO_TEST_CASE(updateElements_test)
+{
+  BulletModel model;
+  Eigen::Matrix4d T = Eigen::Matrix4d::Identity();
+  model.addElement(1, 0, T, SPHERE, vector<double>(1,0.5), false);
+  model.addElement(1, 0, T, BOX, vector<double>(3,1.0), false);
+  model.addElement(2, 0, T, SPHERE, vector<double>(1,0.5), false);
+
+  long num_updated, num_skipped;
+  model.updateElementsForBody(1, T);
+  model.updateElementsForBody(2, T);
+  model.getElementUpdateCounts(num_updated, num_skipped);
+  BOOST_CHECK_EQUAL(num_updated, 3);
+  BOOST_CHECK_EQUAL(num_skipped, 0);
+
+  // only body 2 moves
+  T(0,3) = 1.0;
+  model.updateElementsForBody(1, Eigen::Matrix4d::Identity());
+  model.updateElementsForBody(2, T);
+  model.getElementUpdateCounts(num_updated, num_skipped);
+  BOOST_CHECK_EQUAL(num_updated, 4);
+  BOOST_CHECK_EQUAL(num_skipped, 2);
+  BOOST_CHECK_EQUAL(model.getBody(2).at(0).getWorldTransform(), T);
+
+  model.resetElementUpdateCounts();
+  model.getElementUpdateCounts(num_updated, num_skipped);
+  BOOST_CHECK_EQUAL(num_updated, 0);
+  BOOST_CHECK_EQUAL(num_skipped, 0);
+}
+
+BOOST_AUTO_TEST_CASE(allCollisions_after_skipped_update_test)
+{
+  // allCollisions no longer recomputes every bounding box, so it has to see
+  // the boxes refreshed by updateElementsForBody for the bodies that moved
+  BulletModel model;
+  Eigen::Matrix4d T1 = Eigen::Matrix4d::Identity();
+  Eigen::Matrix4d T2 = Eigen::Matrix4d::Identity();
+  T2(0,3) = 3.0;
+  model.addElement(1, 0, Eigen::Matrix4d::Identity(), SPHERE, vector<double>(1,0.5), false);
+  model.addElement(2, 0, Eigen::Matrix4d::Identity(), SPHERE, vector<double>(1,0.5), false);
+  model.updateElementsForBody(1, T1);
+  model.updateElementsForBody(2, T2);
+
+  vector<int> bodyA_idx, bodyB_idx;
+  Eigen::MatrixXd ptsA, ptsB;
+  BOOST_CHECK(!model.allCollisions(bodyA_idx, bodyB_idx, ptsA, ptsB));
+
+  // body 1 is skipped, body 2 moves into it
+  T2(0,3) = 0.8;
+  model.updateElementsForBody(1, T1);
+  model.updateElementsForBody(2, T2);
+  BOOST_CHECK(model.allCollisions(bodyA_idx, bodyB_idx, ptsA, ptsB));
+
+  T2(0,3) = 3.0;
+  model.updateElementsForBody(1, T1);
+  model.updateElementsForBody(2, T2);
+  BOOST_CHECK(!model.allCollisions(bodyA_idx, bodyB_idx, ptsA, ptsB));
+
+  long num_updated, num_skipped;
+  model.getElementUpdateCounts(num_updated, num_skipped);
+  BOOST_CHECK_EQUAL(num_updated, 4);
+  BOOST_CHECK_EQUAL(num_skipped, 2);
+}
@@ -0,0 +1,148 @@
+#define BOOST_TEST_MODULE Raycast test
+#include <boost/test/unit_test.hpp>
+
+#include <cmath>
+#include <cstdlib>
+#include <chrono>
+#include <iostream>
+
+#include "DrakeCollision.h"
+#include "BulletModel.h"
+
+using namespace DrakeCollision;
+using namespace Eigen;
+using namespace std;
+
+// a sphere of radius 0.5 at (2,0,0) (body 1) and a 1 x 1 x 1 box at (0,-3,0) (body 2)
+static BulletModel* newSphereAndBoxModel()
+{
+  BulletModel* model = new BulletModel();
+  Matrix4d T = Matrix4d::Identity();
+  model->addElement(1, 0, T, SPHERE, vector<double>(1,0.5), false);
+  model->addElement(2, 0, T, BOX, vector<double>(3,1.0), false);
+  T(0,3) = 2.0;
+  model->updateElementsForBody(1, T);
+  T(0,3) = 0.0; T(1,3) = -3.0;
+  model->updateElementsForBody(2, T);
+  return model;
+}
+
+// exposes the collision world, to cast the same rays through btCollisionWorld::rayTest
+class ReferenceRaycastModel : public BulletModel
+{
+  public:
+    btCollisionWorld* getWorld() { return bt_collision_world; }
+};
+
+static double seconds(chrono::high_resolution_clock::time_point start)
+{
+  return chrono::duration_cast<chrono::nanoseconds>(chrono::high_resolution_clock::now()-start).count()/1e9;
+}
+
+BOOST_AUTO_TEST_CASE(rayFanTest)
+{
+  RayFan fan(Vector3d(1,2,3), 0.0, M_PI, 3, 2.0);
+  Matrix3Xd origins, ray_endpoints;
+  fan.getRays(origins, ray_endpoints);
+  BOOST_REQUIRE_EQUAL(origins.cols(), 3);
+  BOOST_REQUIRE_EQUAL(ray_endpoints.cols(), 3);
+  BOOST_CHECK((ray_endpoints.col(0)-Vector3d(3,2,3)).norm() < 1e-12);
+  BOOST_CHECK((ray_endpoints.col(1)-Vector3d(1,4,3)).norm() < 1e-12);
+  BOOST_CHECK((ray_endpoints.col(2)-Vector3d(-1,2,3)).norm() < 1e-12);
+}
+
+BOOST_AUTO_TEST_CASE(batchedRaycastTest)
+{
+  BulletModel* model = newSphereAndBoxModel();
+
+  RayFan fan(Vector3d::Zero(), -M_PI, M_PI, 720, 10.0);
+  Matrix3Xd origins, ray_endpoints;
+  fan.getRays(origins, ray_endpoints);
+  int N = fan.numRays();
+
+  // the whole fan in one batch, and again in small batches
+  VectorXd distances(N), distances_chunked(N);
+  Matrix3Xd normals(3,N);
+  vector<int> body_idx(N);
+  BOOST_REQUIRE(model->collisionRaycast(origins, ray_endpoints, 0, N, distances, &normals, &body_idx));
+  for (int first = 0; first < N; first += 50) {
+    model->collisionRaycast(origins, ray_endpoints, first, min(50,N-first), distances_chunked, NULL, NULL);
+  }
+
+  int num_sphere_hits = 0, num_box_hits = 0;
+  for (int i = 0; i < N; ++i) {
+    BOOST_CHECK_EQUAL(distances(i), distances_chunked(i));
+    Vector3d direction = (ray_endpoints.col(i)-origins.col(i)).normalized();
+    // analytic ray-sphere intersection
+    double b = direction.dot(Vector3d(2,0,0));
+    double disc = b*b - (4.0 - 0.25);
+    if (disc > 1e-3) {
+      BOOST_CHECK_EQUAL(body_idx[i], 1);
+      BOOST_CHECK_CLOSE(distances(i), b - sqrt(disc), 1.0);
+      Vector3d hit = distances(i)*direction;
+      BOOST_CHECK(normals.col(i).dot((hit-Vector3d(2,0,0)).normalized()) > 0.99);
+      num_sphere_hits++;
+    } else if (body_idx[i] == 2) {
+      BOOST_CHECK_CLOSE(distances(i), 2.5/fabs(direction(1)), 1.0);
+      num_box_hits++;
+    } else if (disc < -1e-3) {
+      BOOST_CHECK_EQUAL(distances(i), -1);
+      BOOST_CHECK_EQUAL(body_idx[i], -1);
+    }
+  }
+  BOOST_CHECK(num_sphere_hits > 0);
+  BOOST_CHECK(num_box_hits > 0);
+
+  delete model;
+}
+
+BOOST_AUTO_TEST_CASE(matchesRayTestTest)
+{
+  // spheres and boxes scattered through a 10 m cube, and rays between random
+  // points in it.  the batched raycast has to give the same hits as Bullet's
+  // own rayTest, which goes through the broadphase one ray at a time
+  ReferenceRaycastModel model;
+  srand(0);
+  for (int body = 1; body <= 40; ++body) {
+    Matrix4d T = Matrix4d::Identity();
+    T.topRightCorner<3,1>() = 5.0*Vector3d::Random();
+    if (body % 2) {
+      model.addElement(body, 0, Matrix4d::Identity(), SPHERE, vector<double>(1,0.5), false);
+    } else {
+      model.addElement(body, 0, Matrix4d::Identity(), BOX, vector<double>(3,0.8), false);
+    }
+    model.updateElementsForBody(body, T);
+  }
+
+  const int N = 20000;
+  Matrix3Xd origins = 5.0*Matrix3Xd::Random(3,N), ray_endpoints = 5.0*Matrix3Xd::Random(3,N);
+  VectorXd distances(N);
+  vector<int> body_idx(N);
+  auto start = chrono::high_resolution_clock::now();
+  BOOST_REQUIRE(model.collisionRaycast(origins, ray_endpoints, 0, N, distances, NULL, &body_idx));
+  double t_batched = seconds(start);
+
+  VectorXd reference(N);
+  int num_hits = 0;
+  start = chrono::high_resolution_clock::now();
+  for (int i = 0; i < N; ++i) {
+    btVector3 from(origins(0,i), origins(1,i), origins(2,i));
+    btVector3 to(ray_endpoints(0,i), ray_endpoints(1,i), ray_endpoints(2,i));
+    btCollisionWorld::ClosestRayResultCallback ray_callback(from, to);
+    model.getWorld()->rayTest(from, to, ray_callback);
+    if (ray_callback.hasHit()) {
+      reference(i) = (toVector3d(ray_callback.m_hitPointWorld) - origins.col(i)).norm();
+      num_hits++;
+    } else {
+      reference(i) = -1;
+    }
+  }
+  double t_reference = seconds(start);
+
+  for (int i = 0; i < N; ++i) {
+    BOOST_CHECK_SMALL(distances(i) - reference(i), 1e-9);
+  }
+  BOOST_CHECK(num_hits > 0 && num_hits < N);
+  cout << "batched raycast: " << N/t_batched/1e6 << " million rays/s, btCollisionWorld::rayTest: "
+       << N/t_reference/1e6 << " million rays/s (" << num_hits << " of " << N << " rays hit)" << endl;
+}
@@ -1,5 +1,6 @@
 #include "mex.h"
 #include <iostream>
+#include <algorithm>
 #include "drakeUtil.h"
 #include "RigidBodyManipulator.h"
 #include "math.h"
@@ -45,12 +46,26 @@ void mexFunction( int nlhs, mxArray *plhs[],int nrhs, const mxArray *prhs[] ) {
   memcpy(ray_endpoints.data(), mxGetPr(prhs[2]), sizeof(double)*mxGetNumberOfElements(prhs[2]));
   
   VectorXd distances;
+  Matrix3Xd normals;
+  vector<int> body_idx;
   
-  model->collisionRaycast(origins, ray_endpoints, distances);
+  model->collisionRaycast(origins, ray_endpoints, distances, (nlhs>1) ? &normals : NULL, (nlhs>2) ? &body_idx : NULL);
   
   if (nlhs>0) {
     plhs[0] = mxCreateDoubleMatrix(distances.size(),1,mxREAL);
     memcpy(mxGetPr(plhs[0]), distances.data(), sizeof(double)*distances.size());
   }
+  if (nlhs>1) {
+    plhs[1] = mxCreateDoubleMatrix(3,normals.cols(),mxREAL);
+    memcpy(mxGetPr(plhs[1]), normals.data(), sizeof(double)*3*normals.cols());
+  }
+  if (nlhs>2) {
+    // matlab body indices are 1-based, so misses (-1) come out as 0
+    vector<int32_T> idx(body_idx.size());
+    transform(body_idx.begin(),body_idx.end(),idx.begin(),
+        [](int i){return ++i;});
+    plhs[2] = mxCreateNumericMatrix(idx.size(),1,mxINT32_CLASS,mxREAL);
+    memcpy(mxGetPr(plhs[2]), idx.data(), sizeof(int32_T)*idx.size());
+  }
   
 }
@@ -18,6 +18,28 @@ double angleDiff(double phi1, double phi2)
   return d;
 }
 
+/* The union of the ancestor dofs of the given bodies (or frames, which are resolved to the body they are attached to), sorted. The world has none*/
+static void ancestorDofs(const RigidBodyManipulator* robot, std::initializer_list<int> bodies, std::vector<int> &dofs)
+{
+  std::set<int> dof_set;
+  for(int body_or_frame : bodies)
+  {
+    int body_ind = (body_or_frame<0) ? robot->frames[-body_or_frame-2].body_ind : body_or_frame;
+    const std::set<int> &body_dofs = robot->bodies[body_ind].ancestor_dofs;
+    dof_set.insert(body_dofs.begin(),body_dofs.end());
+  }
+  dofs.assign(dof_set.begin(),dof_set.end());
+}
+
+static void allDofs(const RigidBodyManipulator* robot, std::vector<int> &dofs)
+{
+  dofs.resize(robot->num_dof);
+  for(int i = 0;i<robot->num_dof;i++)
+  {
+    dofs[i] = i;
+  }
+}
+
 void drakePrintMatrix(const MatrixXd &mat)
 {
   for(int i = 0;i<mat.rows();i++)
@@ -117,9 +139,9 @@ void QuasiStaticConstraint::eval(const double* t, const double* weights, VectorX
     int nq = this->robot->num_dof;
     dc.resize(2,nq+this->num_pts);
     Vector3d com;
-    this->robot->getCOM(com,this->m_robotnumset);
+    this->robot->getCOMCached(com,this->m_robotnumset);
     MatrixXd dcom;
-    this->robot->getCOMJac(dcom,this->m_robotnumset);
+    this->robot->getCOMJacCached(dcom,this->m_robotnumset);
     MatrixXd contact_pos(3,this->num_pts);
     MatrixXd dcontact_pos(3*this->num_pts,nq);
     int num_accum_pts = 0;
@@ -129,8 +151,8 @@ void QuasiStaticConstraint::eval(const double* t, const double* weights, VectorX
     {
       MatrixXd body_contact_pos(3,this->num_body_pts[i]);
       MatrixXd dbody_contact_pos(3*this->num_body_pts[i],nq);
-      this->robot->forwardKin(this->bodies[i],this->body_pts[i],0,body_contact_pos);
-      this->robot->forwardJac(this->bodies[i],this->body_pts[i],0,dbody_contact_pos);
+      this->robot->forwardKinCached(this->bodies[i],this->body_pts[i],0,body_contact_pos);
+      this->robot->forwardJacCached(this->bodies[i],this->body_pts[i],0,dbody_contact_pos);
       contact_pos.block(0,num_accum_pts,3,this->num_body_pts[i]) = body_contact_pos;
       dcontact_pos.block(3*num_accum_pts,0,3*this->num_body_pts[i],nq) = dbody_contact_pos;
       for(int j = 0;j<this->num_body_pts[i];j++)
@@ -589,6 +611,11 @@ int SingleTimeKinematicConstraint::getNumConstraint(const double* t) const
   return 0;
 }
 
+void SingleTimeKinematicConstraint::dependentDofs(std::vector<int> &dofs) const
+{
+  allDofs(this->robot,dofs);
+}
+
 void SingleTimeKinematicConstraint::updateRobot(RigidBodyManipulator* robot)
 {
   this->robot = robot;
@@ -672,6 +699,11 @@ int MultipleTimeKinematicConstraint::numValidTime(const double* t, int n_breaks)
   return num_valid_t;
 }
 
+void MultipleTimeKinematicConstraint::dependentDofs(std::vector<int> &dofs) const
+{
+  allDofs(this->robot,dofs);
+}
+
 void MultipleTimeKinematicConstraint::updateRobot(RigidBodyManipulator* robot)
 {
   this->robot = robot;
@@ -817,10 +849,15 @@ WorldPositionConstraint::WorldPositionConstraint(RigidBodyManipulator *model, in
   this->type = RigidBodyConstraint::WorldPositionConstraintType;
 }
 
+void WorldPositionConstraint::dependentDofs(std::vector<int> &dofs) const
+{
+  ancestorDofs(this->robot,{this->body},dofs);
+}
+
 void WorldPositionConstraint::evalPositions(MatrixXd &pos, MatrixXd &J) const
 {
-  this->robot->forwardKin(this->body, this->pts,0,pos);
-  this->robot->forwardJac(this->body, this->pts,0,J);
+  this->robot->forwardKinCached(this->body, this->pts,0,pos);
+  this->robot->forwardJacCached(this->body, this->pts,0,J);
 }
 
 void WorldPositionConstraint::evalNames(const double* t, std::vector<std::string>& cnst_names) const
@@ -863,8 +900,8 @@ WorldCoMConstraint::WorldCoMConstraint(RigidBodyManipulator *model, Vector3d lb,
 
 void WorldCoMConstraint::evalPositions(MatrixXd &pos, MatrixXd &J) const
 {
-  this->robot->getCOM(pos,this->m_robotnum);
-  this->robot->getCOMJac(J,this->m_robotnum);
+  this->robot->getCOMCached(pos,this->m_robotnum);
+  this->robot->getCOMJacCached(J,this->m_robotnum);
 }
 
 
@@ -887,6 +924,19 @@ void WorldCoMConstraint::evalNames(const double* t, std::vector<std::string> &cn
 }
 
 
+void WorldCoMConstraint::dependentDofs(std::vector<int> &dofs) const
+{
+  std::set<int> dof_set;
+  for(int i = 0;i<this->robot->num_bodies;i++)
+  {
+    if(this->m_robotnum.find(this->robot->bodies[i].robotnum) != this->m_robotnum.end())
+    {
+      dof_set.insert(this->robot->bodies[i].ancestor_dofs.begin(),this->robot->bodies[i].ancestor_dofs.end());
+    }
+  }
+  dofs.assign(dof_set.begin(),dof_set.end());
+}
+
 void WorldCoMConstraint::updateRobotnum(const std::set<int> &robotnum)
 {
   this->m_robotnum = robotnum;
@@ -911,19 +961,24 @@ RelativePositionConstraint::RelativePositionConstraint(RigidBodyManipulator* mod
   this->type = RigidBodyConstraint::RelativePositionConstraintType;
 }
 
+void RelativePositionConstraint::dependentDofs(std::vector<int> &dofs) const
+{
+  ancestorDofs(this->robot,{this->bodyA_idx,this->bodyB_idx},dofs);
+}
+
 void RelativePositionConstraint::evalPositions(MatrixXd &pos, MatrixXd &J) const
 {
   int nq = this->robot->num_dof;
   MatrixXd bodyA_pos(3,this->n_pts);
   MatrixXd JA(3*this->n_pts,nq);
-  this->robot->forwardKin(this->bodyA_idx,this->pts,0,bodyA_pos);
-  this->robot->forwardJac(this->bodyA_idx,this->pts,0,JA);
+  this->robot->forwardKinCached(this->bodyA_idx,this->pts,0,bodyA_pos);
+  this->robot->forwardJacCached(this->bodyA_idx,this->pts,0,JA);
   Matrix<double,7,1> wTb;
   MatrixXd dwTb(7,nq);
   Vector4d origin_pt;
   origin_pt << 0,0,0,1.0;
-  this->robot->forwardKin(this->bodyB_idx,origin_pt,2,wTb);
-  this->robot->forwardJac(this->bodyB_idx,origin_pt,2,dwTb);
+  this->robot->forwardKinCached(this->bodyB_idx,origin_pt,2,wTb);
+  this->robot->forwardJacCached(this->bodyB_idx,origin_pt,2,dwTb);
   Vector4d bTw_quat;
   Matrix4d dbTw_quat;
   quatConjugate(wTb.block(3,0,4,1),bTw_quat,dbTw_quat);
@@ -1041,14 +1096,19 @@ WorldQuatConstraint::WorldQuatConstraint(RigidBodyManipulator *model, int body,
   this->type = RigidBodyConstraint::WorldQuatConstraintType;
 }
 
+void WorldQuatConstraint::dependentDofs(std::vector<int> &dofs) const
+{
+  ancestorDofs(this->robot,{this->body},dofs);
+}
+
 void WorldQuatConstraint::evalOrientationProduct(double &prod, MatrixXd &dprod) const
 {
   Matrix<double,7,1>  x;
   MatrixXd J(7,this->robot->num_dof);
   Vector4d pts;
   pts << 0.0,0.0,0.0,1.0;
-  this->robot->forwardKin(this->body,pts,2,x);
-  this->robot->forwardJac(this->body,pts,2,J);
+  this->robot->forwardKinCached(this->body,pts,2,x);
+  this->robot->forwardJacCached(this->body,pts,2,J);
   Vector4d quat = x.tail(4);
   prod = (quat.transpose()*this->quat_des);
   dprod = this->quat_des.transpose()*J.block(3,0,4,this->robot->num_dof);
@@ -1092,6 +1152,11 @@ RelativeQuatConstraint::RelativeQuatConstraint(RigidBodyManipulator* model, int
   this->type = RigidBodyConstraint::RelativeQuatConstraintType;
 }
 
+void RelativeQuatConstraint::dependentDofs(std::vector<int> &dofs) const
+{
+  ancestorDofs(this->robot,{this->bodyA_idx,this->bodyB_idx},dofs);
+}
+
 void RelativeQuatConstraint::evalOrientationProduct(double &prod, MatrixXd &dprod) const
 {
   int nq = this->robot->num_dof;
@@ -1101,10 +1166,10 @@ void RelativeQuatConstraint::evalOrientationProduct(double &prod, MatrixXd &dpro
   MatrixXd J_a(7,nq);
   Matrix<double,7,1> pos_b;
   MatrixXd J_b(7,nq);
-  this->robot->forwardKin(this->bodyA_idx,origin_pt,2,pos_a);
-  this->robot->forwardJac(this->bodyA_idx,origin_pt,2,J_a);
-  this->robot->forwardKin(this->bodyB_idx,origin_pt,2,pos_b);
-  this->robot->forwardJac(this->bodyB_idx,origin_pt,2,J_b);
+  this->robot->forwardKinCached(this->bodyA_idx,origin_pt,2,pos_a);
+  this->robot->forwardJacCached(this->bodyA_idx,origin_pt,2,J_a);
+  this->robot->forwardKinCached(this->bodyB_idx,origin_pt,2,pos_b);
+  this->robot->forwardJacCached(this->bodyB_idx,origin_pt,2,J_b);
   Vector4d quat_a2w = pos_a.block(3,0,4,1);
   MatrixXd dquat_a2w = J_a.block(3,0,4,nq);
   Vector4d quat_b2w = pos_b.block(3,0,4,1);
@@ -1262,14 +1327,19 @@ WorldEulerConstraint::WorldEulerConstraint(RigidBodyManipulator *model, int body
   this->type = RigidBodyConstraint::WorldEulerConstraintType;
 }
 
+void WorldEulerConstraint::dependentDofs(std::vector<int> &dofs) const
+{
+  ancestorDofs(this->robot,{this->body},dofs);
+}
+
 void WorldEulerConstraint::evalrpy(Vector3d &rpy,MatrixXd &J) const
 {
   Vector4d pt;
   pt<<0.0,0.0,0.0,1.0;
   Matrix<double,6,1> x;
   MatrixXd dx(6,this->robot->num_dof);
-  this->robot->forwardKin(this->body,pt,1,x);
-  this->robot->forwardJac(this->body,pt,1,dx);
+  this->robot->forwardKinCached(this->body,pt,1,x);
+  this->robot->forwardJacCached(this->body,pt,1,dx);
   rpy = x.tail(3);
   J = dx.block(3,0,3,this->robot->num_dof);
 }
@@ -1411,14 +1481,19 @@ WorldGazeOrientConstraint::WorldGazeOrientConstraint(RigidBodyManipulator* model
   this->type = RigidBodyConstraint::WorldGazeOrientConstraintType;
 }
 
+void WorldGazeOrientConstraint::dependentDofs(std::vector<int> &dofs) const
+{
+  ancestorDofs(this->robot,{this->body},dofs);
+}
+
 void WorldGazeOrientConstraint::evalOrientation(Vector4d &quat, MatrixXd &dquat_dq) const
 {
   Matrix<double,7,1> x;
   MatrixXd J(7,this->robot->num_dof);
   Vector4d pts;
   pts<<0.0,0.0,0.0,1.0;
-  this->robot->forwardKin(this->body,pts,2,x);
-  this->robot->forwardJac(this->body,pts,2,J);
+  this->robot->forwardKinCached(this->body,pts,2,x);
+  this->robot->forwardJacCached(this->body,pts,2,J);
   quat = x.tail(4);
   dquat_dq = J.block(3,0,4,this->robot->num_dof);
 }
@@ -1483,6 +1558,11 @@ WorldGazeDirConstraint::WorldGazeDirConstraint(RigidBodyManipulator *model, int
   this->type = RigidBodyConstraint::WorldGazeDirConstraintType;
 }
 
+void WorldGazeDirConstraint::dependentDofs(std::vector<int> &dofs) const
+{
+  ancestorDofs(this->robot,{this->body},dofs);
+}
+
 
 void WorldGazeDirConstraint::eval(const double* t, VectorXd &c, MatrixXd &dc) const
 {
@@ -1495,8 +1575,8 @@ void WorldGazeDirConstraint::eval(const double* t, VectorXd &c, MatrixXd &dc) co
     int nq = this->robot->num_dof;
     MatrixXd axis_pos(3,2);
     MatrixXd daxis_pos(6,nq);
-    this->robot->forwardKin(this->body,body_axis_ends,0,axis_pos);
-    this->robot->forwardJac(this->body,body_axis_ends,0,daxis_pos);
+    this->robot->forwardKinCached(this->body,body_axis_ends,0,axis_pos);
+    this->robot->forwardJacCached(this->body,body_axis_ends,0,daxis_pos);
     Vector3d axis_world = axis_pos.col(1)-axis_pos.col(0);
     MatrixXd daxis_world = daxis_pos.block(3,0,3,nq)-daxis_pos.block(0,0,3,nq);
     c.resize(1);
@@ -1554,6 +1634,11 @@ WorldGazeTargetConstraint::WorldGazeTargetConstraint(RigidBodyManipulator* model
   this->type = RigidBodyConstraint::WorldGazeTargetConstraintType;
 }
 
+void WorldGazeTargetConstraint::dependentDofs(std::vector<int> &dofs) const
+{
+  ancestorDofs(this->robot,{this->body},dofs);
+}
+
 void WorldGazeTargetConstraint::eval(const double* t,VectorXd &c, MatrixXd &dc) const
 {
   int num_constraint = this->getNumConstraint(t);
@@ -1569,8 +1654,8 @@ void WorldGazeTargetConstraint::eval(const double* t,VectorXd &c, MatrixXd &dc)
     int nq = this->robot->num_dof;
     MatrixXd axis_ends(3,2);
     MatrixXd daxis_ends(6,nq);
-    this->robot->forwardKin(this->body, body_axis_ends, 0, axis_ends);
-    this->robot->forwardJac(this->body, body_axis_ends, 0, daxis_ends);
+    this->robot->forwardKinCached(this->body, body_axis_ends, 0, axis_ends);
+    this->robot->forwardJacCached(this->body, body_axis_ends, 0, daxis_ends);
     Vector3d world_axis = axis_ends.col(1)-axis_ends.col(0);
     MatrixXd dworld_axis = daxis_ends.block(3,0,3,nq)-daxis_ends.block(0,0,3,nq);
     Vector3d dir = this->target-axis_ends.col(0);
@@ -1616,6 +1701,11 @@ RelativeGazeTargetConstraint::RelativeGazeTargetConstraint(RigidBodyManipulator
   this->type = RigidBodyConstraint::RelativeGazeTargetConstraintType;
 }
 
+void RelativeGazeTargetConstraint::dependentDofs(std::vector<int> &dofs) const
+{
+  ancestorDofs(this->robot,{this->bodyA_idx,this->bodyB_idx},dofs);
+}
+
 void RelativeGazeTargetConstraint::eval(const double* t, VectorXd &c, MatrixXd &dc) const
 {
   if(this->isTimeValid(t))
@@ -1625,18 +1715,18 @@ void RelativeGazeTargetConstraint::eval(const double* t, VectorXd &c, MatrixXd &
     target_pt<<this->target,1.0;
     Vector3d target_pos;
     MatrixXd dtarget_pos(3,nq);
-    this->robot->forwardKin(this->bodyB_idx, target_pt, 0, target_pos);
-    this->robot->forwardJac(this->bodyB_idx, target_pt, 0, dtarget_pos);
+    this->robot->forwardKinCached(this->bodyB_idx, target_pt, 0, target_pos);
+    this->robot->forwardJacCached(this->bodyB_idx, target_pt, 0, dtarget_pos);
     Vector3d origin_pos;
     MatrixXd dorigin_pos(3,nq);
-    this->robot->forwardKin(this->bodyA_idx,this->gaze_origin,0,origin_pos);
-    this->robot->forwardJac(this->bodyA_idx,this->gaze_origin,0,dorigin_pos);
+    this->robot->forwardKinCached(this->bodyA_idx,this->gaze_origin,0,origin_pos);
+    this->robot->forwardJacCached(this->bodyA_idx,this->gaze_origin,0,dorigin_pos);
     Vector3d axis_pos;
     Vector4d axis_pt;
     axis_pt<<this->axis,0.0;
     MatrixXd daxis_pos(3,nq);
-    this->robot->forwardKin(this->bodyA_idx,axis_pt,0,axis_pos);
-    this->robot->forwardJac(this->bodyA_idx,axis_pt,0,daxis_pos);
+    this->robot->forwardKinCached(this->bodyA_idx,axis_pt,0,axis_pos);
+    this->robot->forwardJacCached(this->bodyA_idx,axis_pt,0,daxis_pos);
     Vector3d origin_to_target = target_pos-origin_pos;
     MatrixXd dorigin_to_target = dtarget_pos-dorigin_pos;
     double origin_to_target_norm = origin_to_target.norm();
@@ -1685,6 +1775,11 @@ RelativeGazeDirConstraint(RigidBodyManipulator *robot, int bodyA_idx,
   this->type = RigidBodyConstraint::RelativeGazeDirConstraintType;
 }
 
+void RelativeGazeDirConstraint::dependentDofs(std::vector<int> &dofs) const
+{
+  ancestorDofs(this->robot,{this->bodyA_idx,this->bodyB_idx},dofs);
+}
+
 void RelativeGazeDirConstraint::eval(const double* t, VectorXd &c, MatrixXd &dc) const
 {
   if(this->isTimeValid(t))
@@ -1702,10 +1797,10 @@ void RelativeGazeDirConstraint::eval(const double* t, VectorXd &c, MatrixXd &dc)
     MatrixXd daxis_pos(6,nq);
     MatrixXd dir_pos(3,2);
     MatrixXd ddir_pos(6,nq);
-    this->robot->forwardKin(this->bodyA_idx,body_axis_ends,0,axis_pos);
-    this->robot->forwardJac(this->bodyA_idx,body_axis_ends,0,daxis_pos);
-    this->robot->forwardKin(this->bodyB_idx,body_dir_ends,0,dir_pos);
-    this->robot->forwardJac(this->bodyB_idx,body_dir_ends,0,ddir_pos);
+    this->robot->forwardKinCached(this->bodyA_idx,body_axis_ends,0,axis_pos);
+    this->robot->forwardJacCached(this->bodyA_idx,body_axis_ends,0,daxis_pos);
+    this->robot->forwardKinCached(this->bodyB_idx,body_dir_ends,0,dir_pos);
+    this->robot->forwardJacCached(this->bodyB_idx,body_dir_ends,0,ddir_pos);
     Vector3d axis_world = axis_pos.col(1)-axis_pos.col(0);
     MatrixXd daxis_world = daxis_pos.block(3,0,3,nq)-daxis_pos.block(0,0,3,nq);
     Vector3d dir_world = dir_pos.col(1)-dir_pos.col(0);
@@ -1753,6 +1848,11 @@ Point2PointDistanceConstraint::Point2PointDistanceConstraint(RigidBodyManipulato
   this->type = RigidBodyConstraint::Point2PointDistanceConstraintType;
 }
 
+void Point2PointDistanceConstraint::dependentDofs(std::vector<int> &dofs) const
+{
+  ancestorDofs(this->robot,{this->bodyA,this->bodyB},dofs);
+}
+
 void Point2PointDistanceConstraint::eval(const double* t, VectorXd &c, MatrixXd &dc) const
 {
   if(this->isTimeValid(t))
@@ -1762,8 +1862,8 @@ void Point2PointDistanceConstraint::eval(const double* t, VectorXd &c, MatrixXd
     MatrixXd dposA(3*this->ptA.cols(),this->robot->num_dof);
     if(this->bodyA != -1)
     {
-      this->robot->forwardKin(this->bodyA,this->ptA,0,posA);
-      this->robot->forwardJac(this->bodyA,this->ptA,0,dposA);
+      this->robot->forwardKinCached(this->bodyA,this->ptA,0,posA);
+      this->robot->forwardJacCached(this->bodyA,this->ptA,0,dposA);
     }
     else
     {
@@ -1774,8 +1874,8 @@ void Point2PointDistanceConstraint::eval(const double* t, VectorXd &c, MatrixXd
     MatrixXd dposB(3*this->ptB.cols(),this->robot->num_dof);
     if(this->bodyB != -1)
     {
-      this->robot->forwardKin(this->bodyB,this->ptB,0,posB);
-      this->robot->forwardJac(this->bodyB,this->ptB,0,dposB);
+      this->robot->forwardKinCached(this->bodyB,this->ptB,0,posB);
+      this->robot->forwardJacCached(this->bodyB,this->ptB,0,dposB);
     }
     else
     {
@@ -1862,6 +1962,11 @@ Point2LineSegDistConstraint::Point2LineSegDistConstraint(RigidBodyManipulator* m
   this->type = RigidBodyConstraint::Point2LineSegDistConstraintType;
 }
 
+void Point2LineSegDistConstraint::dependentDofs(std::vector<int> &dofs) const
+{
+  ancestorDofs(this->robot,{this->pt_body,this->line_body},dofs);
+}
+
 void Point2LineSegDistConstraint::eval(const double* t, VectorXd &c, MatrixXd &dc) const
 {
   if(this->isTimeValid(t))
@@ -1869,12 +1974,12 @@ void Point2LineSegDistConstraint::eval(const double* t, VectorXd &c, MatrixXd &d
     int nq = this->robot->num_dof;
     Vector3d pt_pos;
     MatrixXd J_pt(3,nq);
-    this->robot->forwardKin(this->pt_body,this->pt,0,pt_pos);
-    this->robot->forwardJac(this->pt_body,this->pt,0,J_pt);
+    this->robot->forwardKinCached(this->pt_body,this->pt,0,pt_pos);
+    this->robot->forwardJacCached(this->pt_body,this->pt,0,J_pt);
     MatrixXd line_pos(3,2);
     MatrixXd J_line(6,nq);
-    this->robot->forwardKin(this->line_body,this->line_ends,0,line_pos);
-    this->robot->forwardJac(this->line_body,this->line_ends,0,J_line);
+    this->robot->forwardKinCached(this->line_body,this->line_ends,0,line_pos);
+    this->robot->forwardJacCached(this->line_body,this->line_ends,0,J_line);
     Vector3d x0 = pt_pos;
     Vector3d x1 = line_pos.col(0);
     Vector3d x2 = line_pos.col(1);
@@ -1948,6 +2053,11 @@ WorldFixedPositionConstraint::WorldFixedPositionConstraint(RigidBodyManipulator*
   this->type = RigidBodyConstraint::WorldFixedPositionConstraintType;
 }
 
+void WorldFixedPositionConstraint::dependentDofs(std::vector<int> &dofs) const
+{
+  ancestorDofs(this->robot,{this->body},dofs);
+}
+
 int WorldFixedPositionConstraint::getNumConstraint(const double* t, int n_breaks) const
 {
   int num_valid_t = this->numValidTime(t,n_breaks);
@@ -1971,9 +2081,9 @@ void WorldFixedPositionConstraint::eval_valid(const double* valid_t, int num_val
   {
     this->robot->doKinematics((double*) valid_q.data()+i*nq);
     pos[i].resize(3,n_pts);
-    this->robot->forwardKin(this->body,this->pts,0,pos[i]);
+    this->robot->forwardKinCached(this->body,this->pts,0,pos[i]);
     dpos[i].resize(3*n_pts,nq);
-    this->robot->forwardJac(this->body,this->pts,0,dpos[i]);
+    this->robot->forwardJacCached(this->body,this->pts,0,dpos[i]);
   }
   int* next_idx = new int[num_valid_t];
   int* prev_idx = new int[num_valid_t];
@@ -2045,6 +2155,11 @@ WorldFixedOrientConstraint::WorldFixedOrientConstraint(RigidBodyManipulator* rob
   this->type = RigidBodyConstraint::WorldFixedOrientConstraintType;
 }
 
+void WorldFixedOrientConstraint::dependentDofs(std::vector<int> &dofs) const
+{
+  ancestorDofs(this->robot,{this->body},dofs);
+}
+
 int WorldFixedOrientConstraint::getNumConstraint(const double* t, int n_breaks) const
 {
   int num_valid_t = this->numValidTime(t,n_breaks);
@@ -2066,8 +2181,8 @@ void WorldFixedOrientConstraint::eval_valid(const double* valid_t, int num_valid
     this->robot->doKinematics((double*) valid_q.data()+i*nq);
     Matrix<double,7,1> tmp_pos;
     MatrixXd dtmp_pos(7,nq);
-    this->robot->forwardKin(this->body,origin_pt,2,tmp_pos);
-    this->robot->forwardJac(this->body,origin_pt,2,dtmp_pos);
+    this->robot->forwardKinCached(this->body,origin_pt,2,tmp_pos);
+    this->robot->forwardJacCached(this->body,origin_pt,2,dtmp_pos);
     quat[i] = tmp_pos.tail(4);
     dquat[i].resize(4,nq);
     dquat[i] = dtmp_pos.block(3,0,4,nq);
@@ -2132,6 +2247,11 @@ WorldFixedBodyPoseConstraint::WorldFixedBodyPoseConstraint(RigidBodyManipulator
   this->type = RigidBodyConstraint::WorldFixedBodyPoseConstraintType;
 }
 
+void WorldFixedBodyPoseConstraint::dependentDofs(std::vector<int> &dofs) const
+{
+  ancestorDofs(this->robot,{this->body},dofs);
+}
+
 int WorldFixedBodyPoseConstraint::getNumConstraint(const double* t, int n_breaks) const
 {
   int num_valid_t = this->numValidTime(t,n_breaks);
@@ -2158,11 +2278,11 @@ void WorldFixedBodyPoseConstraint::eval_valid(const double* valid_t, int num_val
   {
     this->robot->doKinematics((double*) valid_q.data()+i*nq);
     Matrix<double,7,1> pos_tmp;
-    this->robot->forwardKin(this->body,origin_pt,2,pos_tmp);
+    this->robot->forwardKinCached(this->body,origin_pt,2,pos_tmp);
     pos[i] = pos_tmp.head(3);
     quat[i] = pos_tmp.tail(4);
     MatrixXd J_tmp(7,nq);
-    this->robot->forwardJac(this->body,origin_pt,2,J_tmp);
+    this->robot->forwardJacCached(this->body,origin_pt,2,J_tmp);
     dpos[i].resize(3,nq);
     dpos[i] = J_tmp.block(0,0,3,nq);
     dquat[i].resize(4,nq);
@@ -2350,7 +2470,8 @@ MinDistanceConstraint::eval(const double* t, VectorXd& c, MatrixXd& dc) const
   std::vector<int> idxB;
   std::vector<int> bodies_idx; // empty vector -> all bodies
 
-  robot->collisionDetect(dist,normal,xA,xB,idxA,idxB,bodies_idx);
+  // pairs at least min_distance apart have zero penalty, so they need not be computed at all
+  robot->collisionDetect(dist,normal,xA,xB,idxA,idxB,bodies_idx,min_distance);
 
   int num_pts = xA.cols();
   ddist_dq = MatrixXd::Zero(num_pts,robot->num_dof);
@@ -8,6 +8,7 @@
 #include <Eigen/StdVector>
 #include <set>
 #include <string>
+#include <vector>
 #include <cstdio>
 #include <cstdlib>
 #include <Eigen/Dense>
@@ -252,6 +253,8 @@ class SingleTimeKinematicConstraint: public RigidBodyConstraint
     virtual void eval(const double* t,Eigen::VectorXd &c, Eigen::MatrixXd &dc) const = 0;
     virtual void bounds(const double* t, Eigen::VectorXd &lb, Eigen::VectorXd &ub) const = 0;
     virtual void name(const double* t, std::vector<std::string> &name_str) const = 0;
+    /* The sorted indices of the dofs that the constraint can depend on, all the other columns of dc are always zero. Defaults to all the dofs*/
+    virtual void dependentDofs(std::vector<int> &dofs) const;
     virtual void updateRobot(RigidBodyManipulator *robot);
     virtual ~SingleTimeKinematicConstraint(){};
 };
@@ -269,6 +272,8 @@ class MultipleTimeKinematicConstraint : public RigidBodyConstraint
     virtual void eval_valid(const double* valid_t, int num_valid_t,const Eigen::MatrixXd &valid_q,Eigen::VectorXd &c, Eigen::MatrixXd &dc_valid) const = 0;
     virtual void bounds(const double* t, int n_breaks, Eigen::VectorXd &lb, Eigen::VectorXd &ub) const = 0;
     virtual void name(const double* t, int n_breaks, std::vector<std::string> &name_str) const = 0;
+    /* The sorted indices of the dofs that the constraint can depend on at each time, all the other columns of dc are always zero. Defaults to all the dofs*/
+    virtual void dependentDofs(std::vector<int> &dofs) const;
     virtual void updateRobot(RigidBodyManipulator *robot);
     virtual ~MultipleTimeKinematicConstraint(){};
 };
@@ -301,6 +306,7 @@ class WorldPositionConstraint: public PositionConstraint
     virtual void evalNames(const double* t,std::vector<std::string> &cnst_names) const;
   public:
     WorldPositionConstraint(RigidBodyManipulator *model, int body, const Eigen::MatrixXd &pts, Eigen::MatrixXd lb, Eigen::MatrixXd ub, const Eigen::Vector2d &tspan = DrakeRigidBodyConstraint::default_tspan);
+    virtual void dependentDofs(std::vector<int> &dofs) const;
     virtual ~WorldPositionConstraint();
 };
 
@@ -315,6 +321,7 @@ class WorldCoMConstraint: public PositionConstraint
     static const std::set<int> defaultRobotNumSet;
   public:
     WorldCoMConstraint(RigidBodyManipulator *model, Eigen::Vector3d lb, Eigen::Vector3d ub, const Eigen::Vector2d &tspan = DrakeRigidBodyConstraint::default_tspan, const std::set<int> &robotnum = WorldCoMConstraint::defaultRobotNumSet);
+    virtual void dependentDofs(std::vector<int> &dofs) const;
     void updateRobotnum(const std::set<int> &robotnum);
     virtual ~WorldCoMConstraint(); 
 };
@@ -332,6 +339,7 @@ class RelativePositionConstraint: public PositionConstraint
     virtual void evalNames(const double* t,std::vector<std::string> &cnst_names) const;
   public:
     RelativePositionConstraint(RigidBodyManipulator *model, const Eigen::MatrixXd &pts, const Eigen::MatrixXd &lb, const Eigen::MatrixXd &ub, int bodyA_idx, int bodyB_idx, const Eigen::Matrix<double,7,1> &bTbp, const Eigen::Vector2d &tspan);
+    virtual void dependentDofs(std::vector<int> &dofs) const;
     virtual ~RelativePositionConstraint();
 };
 
@@ -356,6 +364,7 @@ class WorldQuatConstraint: public QuatConstraint
     virtual void evalOrientationProduct(double &prod, Eigen::MatrixXd &dprod) const;
   public:
     WorldQuatConstraint(RigidBodyManipulator *model, int body, Eigen::Vector4d quat_des, double tol, Eigen::Vector2d tspan = DrakeRigidBodyConstraint::default_tspan);
+    virtual void dependentDofs(std::vector<int> &dofs) const;
     virtual void name(const double* t, std::vector<std::string> &name_str) const;
     virtual ~WorldQuatConstraint();
 
@@ -374,6 +383,7 @@ class RelativeQuatConstraint: public QuatConstraint
     virtual void evalOrientationProduct(double &prod, Eigen::MatrixXd &dprod) const;
   public:
     RelativeQuatConstraint(RigidBodyManipulator *model, int bodyA_idx, int bodyB_idx, Eigen::Vector4d &quat_des, double tol, Eigen::Vector2d tspan = DrakeRigidBodyConstraint::default_tspan);
+    virtual void dependentDofs(std::vector<int> &dofs) const;
     virtual void name(const double* t, std::vector<std::string> &name_str) const;
     virtual ~RelativeQuatConstraint();
 
@@ -405,6 +415,7 @@ class WorldEulerConstraint: public EulerConstraint
     virtual void evalrpy(Eigen::Vector3d &rpy, Eigen::MatrixXd &J) const;
   public:
     WorldEulerConstraint(RigidBodyManipulator *model, int body, Eigen::Vector3d lb, Eigen::Vector3d ub, Eigen::Vector2d tspan = DrakeRigidBodyConstraint::default_tspan);
+    virtual void dependentDofs(std::vector<int> &dofs) const;
     virtual void name(const double* t, std::vector<std::string> &name_str) const;
     virtual ~WorldEulerConstraint();
 };
@@ -445,6 +456,7 @@ class WorldGazeOrientConstraint: public GazeOrientConstraint
     virtual void evalOrientation(Eigen::Vector4d &quat, Eigen::MatrixXd &dquat_dq) const;
   public:
     WorldGazeOrientConstraint(RigidBodyManipulator* model, int body, Eigen::Vector3d axis, Eigen::Vector4d quat_des,double conethreshold, double threshold, Eigen::Vector2d tspan = DrakeRigidBodyConstraint::default_tspan);
+    virtual void dependentDofs(std::vector<int> &dofs) const;
     virtual void name(const double* t,std::vector<std::string> &name_str) const;
     virtual ~WorldGazeOrientConstraint(){};
 };
@@ -468,6 +480,7 @@ class WorldGazeDirConstraint: public GazeDirConstraint
     std::string body_name;
   public:
     WorldGazeDirConstraint(RigidBodyManipulator* model, int body,Eigen::Vector3d axis, Eigen::Vector3d dir, double conethreshold, Eigen::Vector2d tspan = DrakeRigidBodyConstraint::default_tspan);
+    virtual void dependentDofs(std::vector<int> &dofs) const;
     virtual void eval(const double* t, Eigen::VectorXd &c, Eigen::MatrixXd &dc) const;
     virtual void name(const double* t, std::vector<std::string> &name_str) const;
     virtual ~WorldGazeDirConstraint(void){};
@@ -493,6 +506,7 @@ class WorldGazeTargetConstraint: public GazeTargetConstraint
     std::string body_name;
   public:
     WorldGazeTargetConstraint(RigidBodyManipulator* model, int body, Eigen::Vector3d axis, Eigen::Vector3d target, Eigen::Vector4d gaze_origin, double conethreshold, Eigen::Vector2d tspan = DrakeRigidBodyConstraint::default_tspan);
+    virtual void dependentDofs(std::vector<int> &dofs) const;
     virtual void eval(const double* t, Eigen::VectorXd &c, Eigen::MatrixXd &dc) const;
     virtual void name(const double* t, std::vector<std::string> &name_str) const;
     virtual ~WorldGazeTargetConstraint(void){};
@@ -507,6 +521,7 @@ class RelativeGazeTargetConstraint: public GazeTargetConstraint
     std::string bodyB_name;
   public:
     RelativeGazeTargetConstraint(RigidBodyManipulator* model, int bodyA_idx, int bodyB_idx, const Eigen::Vector3d &axis, const Eigen::Vector3d &target, const Eigen::Vector4d &gaze_origin,  double conethreshold, Eigen::Vector2d &tspan = DrakeRigidBodyConstraint::default_tspan);
+    virtual void dependentDofs(std::vector<int> &dofs) const;
     virtual void eval(const double* t, Eigen::VectorXd &c, Eigen::MatrixXd &dc) const;
     virtual void name(const double* t, std::vector<std::string> &name_str) const;
     virtual ~RelativeGazeTargetConstraint(void){};
@@ -521,6 +536,7 @@ class RelativeGazeDirConstraint: public GazeDirConstraint
     std::string bodyB_name;
   public:
     RelativeGazeDirConstraint(RigidBodyManipulator* model, int bodyA_idx, int bodyB_idx, const Eigen::Vector3d &axis, const Eigen::Vector3d &dir, double conethreshold, Eigen::Vector2d tspan = DrakeRigidBodyConstraint::default_tspan);
+    virtual void dependentDofs(std::vector<int> &dofs) const;
     virtual void eval(const double* t, Eigen::VectorXd &c, Eigen::MatrixXd &dc) const;
     virtual void name(const double* t, std::vector<std::string> &name_str) const;
     virtual ~RelativeGazeDirConstraint(void){};
@@ -537,6 +553,7 @@ class Point2PointDistanceConstraint: public SingleTimeKinematicConstraint
     Eigen::VectorXd dist_ub;
   public:
     Point2PointDistanceConstraint(RigidBodyManipulator* model, int bodyA, int bodyB, const Eigen::MatrixXd &ptA, const Eigen::MatrixXd &ptB, const Eigen::VectorXd &lb, const Eigen::VectorXd &ub, const Eigen::Vector2d &tspan = DrakeRigidBodyConstraint::default_tspan);
+    virtual void dependentDofs(std::vector<int> &dofs) const;
     virtual void eval(const double* t, Eigen::VectorXd &c, Eigen::MatrixXd &dc) const;
     virtual void name(const double* t, std::vector<std::string> &name_str) const;
     virtual void bounds(const double* t, Eigen::VectorXd &lb, Eigen::VectorXd &ub) const;
@@ -554,6 +571,7 @@ class Point2LineSegDistConstraint: public SingleTimeKinematicConstraint
     double dist_ub;
   public:
     Point2LineSegDistConstraint(RigidBodyManipulator* model, int pt_body, const Eigen::Vector4d &pt, int line_body, const Eigen::Matrix<double,4,2> &line_ends,double dist_lb, double dist_ub, const Eigen::Vector2d &tspan = DrakeRigidBodyConstraint::default_tspan);
+    virtual void dependentDofs(std::vector<int> &dofs) const;
     virtual void eval(const double* t, Eigen::VectorXd &c, Eigen::MatrixXd &dc) const;
     virtual void name(const double* t, std::vector<std::string> &name_str) const;
     virtual void bounds(const double* t, Eigen::VectorXd &lb, Eigen::VectorXd &ub) const;
@@ -570,6 +588,7 @@ class WorldFixedPositionConstraint: public MultipleTimeKinematicConstraint
     Eigen::MatrixXd pts;
   public:
     WorldFixedPositionConstraint(RigidBodyManipulator* model, int body, const Eigen::MatrixXd &pts,const Eigen::Vector2d &tspan = DrakeRigidBodyConstraint::default_tspan);
+    virtual void dependentDofs(std::vector<int> &dofs) const;
     virtual int getNumConstraint(const double* t, int n_breaks) const;
     virtual void eval_valid(const double* valid_t, int num_valid_t,const Eigen::MatrixXd &valid_q,Eigen::VectorXd &c, Eigen::MatrixXd &dc_valid) const;
     virtual void bounds(const double* t,int n_breaks, Eigen::VectorXd &lb, Eigen::VectorXd &ub) const;
@@ -584,6 +603,7 @@ class WorldFixedOrientConstraint: public MultipleTimeKinematicConstraint
     std::string body_name;
   public:
     WorldFixedOrientConstraint(RigidBodyManipulator* model, int body, const Eigen::Vector2d &tspan = DrakeRigidBodyConstraint::default_tspan);
+    virtual void dependentDofs(std::vector<int> &dofs) const;
     virtual int getNumConstraint(const double* t, int n_breaks) const;
     virtual void eval_valid(const double* valid_t, int num_valid_t,const Eigen::MatrixXd &valid_q,Eigen::VectorXd &c, Eigen::MatrixXd &dc_valid) const;
     virtual void bounds(const double* t,int n_breaks, Eigen::VectorXd &lb, Eigen::VectorXd &ub) const;
@@ -598,6 +618,7 @@ class WorldFixedBodyPoseConstraint: public MultipleTimeKinematicConstraint
     std::string body_name;
   public:
     WorldFixedBodyPoseConstraint(RigidBodyManipulator* model, int body, const Eigen::Vector2d &tspan = DrakeRigidBodyConstraint::default_tspan);
+    virtual void dependentDofs(std::vector<int> &dofs) const;
     virtual int getNumConstraint(const double* t, int n_breaks) const;
     virtual void eval_valid(const double* valid_t, int num_valid_t,const Eigen::MatrixXd &valid_q,Eigen::VectorXd &c, Eigen::MatrixXd &dc_valid) const;
     virtual void bounds(const double* t,int n_breaks, Eigen::VectorXd &lb, Eigen::VectorXd &ub) const;
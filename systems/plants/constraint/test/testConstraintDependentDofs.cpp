@@ -0,0 +1,90 @@
+/*
+ * Checks that the columns of the constraint gradients outside of dependentDofs
+ * are zero, since inverseKinBackend only hands those columns to SNOPT.
+ */
+#include <iostream>
+#include <cstdlib>
+#include <algorithm>
+#include "URDFRigidBodyManipulator.h"
+
+#include "../RigidBodyConstraint.h"
+
+using namespace std;
+
+static bool checkColumns(const SingleTimeKinematicConstraint* kc, const MatrixXd &dc, int nq, const char* name)
+{
+  vector<int> dofs;
+  kc->dependentDofs(dofs);
+  if(!is_sorted(dofs.begin(),dofs.end()))
+  {
+    cerr<<name<<": dependentDofs is not sorted"<<endl;
+    return false;
+  }
+  for(int j = 0;j<dc.cols();j++)
+  {
+    if(!binary_search(dofs.begin(),dofs.end(),j%nq) && dc.col(j).lpNorm<Infinity>() != 0.0)
+    {
+      cerr<<name<<": column "<<j<<" of dc is not zero but dof "<<j%nq<<" is not in dependentDofs"<<endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+int main()
+{
+  URDFRigidBodyManipulator* model = loadURDFfromFile("../../examples/Atlas/urdf/atlas_minimal_contact.urdf");
+  if(!model)
+  {
+    cerr << "ERROR: Failed to load model"<<endl;
+    return 1;
+  }
+  int nq = model->num_dof;
+  int l_hand = model->findLinkInd("l_hand");
+  int r_foot = model->findLinkInd("r_foot");
+  int utorso = model->findLinkInd("utorso");
+  Vector2d tspan;
+  tspan<< 0,1;
+  MatrixXd pts(4,2);
+  pts << MatrixXd::Random(3,2), MatrixXd::Ones(1,2);
+  MatrixXd lb = MatrixXd::Constant(3,2,-1.0);
+  MatrixXd ub = MatrixXd::Constant(3,2,1.0);
+  Vector3d com_lb = Vector3d::Constant(-1.0);
+  Vector3d com_ub = Vector3d::Constant(1.0);
+  Vector4d quat_des(1.0,0.0,0.0,0.0);
+  Matrix<double,7,1> bTbp;
+  bTbp<<0.1,0.2,0.3,1.0,0.0,0.0,0.0;
+
+  vector<SingleTimeKinematicConstraint*> kc;
+  vector<const char*> kc_names;
+  kc.push_back(new WorldPositionConstraint(model,l_hand,pts,lb,ub,tspan));
+  kc_names.push_back("WorldPositionConstraint");
+  kc.push_back(new WorldCoMConstraint(model,com_lb,com_ub,tspan));
+  kc_names.push_back("WorldCoMConstraint");
+  kc.push_back(new WorldQuatConstraint(model,r_foot,quat_des,0.1,tspan));
+  kc_names.push_back("WorldQuatConstraint");
+  kc.push_back(new RelativePositionConstraint(model,pts,lb,ub,l_hand,utorso,bTbp,tspan));
+  kc_names.push_back("RelativePositionConstraint");
+
+  bool success = true;
+  double t = 0.5;
+  for(int k = 0;k<10;k++)
+  {
+    VectorXd q = VectorXd::Random(nq);
+    model->doKinematics(q.data());
+    for(int i = 0;i<kc.size();i++)
+    {
+      VectorXd c;
+      MatrixXd dc;
+      kc[i]->eval(&t,c,dc);
+      success = success && checkColumns(kc[i],dc,nq,kc_names[i]);
+    }
+  }
+
+  for(int i = 0;i<kc.size();i++)
+  {
+    delete kc[i];
+  }
+  delete model;
+  return success ? 0 : 1;
+}
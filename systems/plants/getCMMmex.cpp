@@ -22,7 +22,7 @@ void mexFunction( int nlhs, mxArray *plhs[],int nrhs, const mxArray *prhs[] ) {
 
   double* q = mxGetPr(prhs[1]);
   for (int i = 0; i < model->num_dof; i++) {
-    if (q[i] - model->cached_q[i] > 1e-8 || q[i] - model->cached_q[i] < -1e-8) {
+    if (q[i] - model->default_cache.q[i] > 1e-8 || q[i] - model->default_cache.q[i] < -1e-8) {
       mexErrMsgIdAndTxt("Drake:getCMMmex:InvalidKinematics","This kinsol is no longer valid.  Somebody has called doKinematics with a different q since the solution was computed.");
     }
   }
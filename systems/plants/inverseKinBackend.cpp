@@ -5,6 +5,13 @@
 #include <cstdio>
 #include <cstring>
 #include <iostream>
+#include <functional>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <mutex>
+#include <limits>
 
 
 namespace snopt {
@@ -31,100 +38,243 @@ namespace snopt {
 using namespace Eigen;
 using namespace std;
 
-static RigidBodyManipulator* model = nullptr;
-static SingleTimeKinematicConstraint** st_kc_array = nullptr;
-static MultipleTimeKinematicConstraint** mt_kc_array = nullptr;
-static QuasiStaticConstraint* qsc_ptr = nullptr;
-static MatrixXd q_nom;
-static VectorXd q_nom_i;
-static MatrixXd Q;
-static MatrixXd Qa;
-static MatrixXd Qv;
-static bool qscActiveFlag;
-static snopt::integer nx;
-static snopt::integer nF;
-static snopt::integer nG;
-static snopt::integer* nc_array;
-static snopt::integer* nG_array;
-static snopt::integer* nA_array;
-static int nq;
-static double *t = nullptr;
-static double *t_samples = nullptr; 
-static double* ti = nullptr;
-static int num_st_kc;
-static int num_mt_kc;
-static int num_st_lpc;
-static int num_mt_lpc;
-static int* mt_kc_nc;
-static int* st_lpc_nc;
-static int* mt_lpc_nc;
-static int nT;
-static int num_qsc_pts;
-static bool fixInitialState;
-// The following variables are used in inverseKinTraj only
-static snopt::integer* qfree_idx;
-static snopt::integer* qdotf_idx;
-static snopt::integer* qdot0_idx;
-
-static VectorXd q0_fixed;
-static VectorXd qdot0_fixed;
-static snopt::integer qstart_idx;
-static snopt::integer num_qfree;
-static snopt::integer num_qdotfree;
-
-static MatrixXd velocity_mat;
-static MatrixXd velocity_mat_qd0;
-static MatrixXd velocity_mat_qdf;
-static MatrixXd accel_mat;
-static MatrixXd accel_mat_qd0;
-static MatrixXd accel_mat_qdf;
-
-static VectorXd* t_inbetween;
-static snopt::integer num_inbetween_tSamples;
-static MatrixXd* dqInbetweendqknot;
-static MatrixXd* dqInbetweendqd0;
-static MatrixXd* dqInbetweendqdf;
-static snopt::integer* qknot_qsamples_idx;
-
-/* Remeber to delete this*/
-static snopt::integer nF_tmp;
-static snopt::integer nG_tmp;
-static snopt::integer nx_tmp;
-
-static void gevalNumerical(void (*func_ptr)(const VectorXd &, VectorXd &),const VectorXd &x, VectorXd &c, MatrixXd &dc,int order = 2)
+namespace {
+/*
+ * Everything the SNOPT callbacks need about one solve.  Every call to
+ * inverseKinBackend builds its own instance, and the callbacks find it through
+ * its index in the problem table (see lookupProblem), so that separate solves
+ * don't share any state.  The constraints evaluate kinematics through their
+ * model, so concurrent solves need separate models.
+ */
+class InverseKinProblem
+{
+public:
+  InverseKinProblem();
+  ~InverseKinProblem();
+
+  template <typename DerivedA, typename DerivedB, typename DerivedC, typename DerivedD, typename DerivedE>
+  void solve(RigidBodyManipulator* model_input, const int mode, const int nT_input, const double* t_input, const MatrixBase<DerivedA> &q_seed, const MatrixBase<DerivedB> &q_nom_input, const int num_constraints, RigidBodyConstraint** const constraint_array, MatrixBase<DerivedC> &q_sol, MatrixBase<DerivedD> &qdot_sol, MatrixBase<DerivedE> &qddot_sol, int* INFO, vector<string> &infeasible_constraint, const IKoptions &ikoptions);
+
+  /*
+   * solve() is setConstraints, initSnopt and solveKnots in one go.  A problem
+   * that is solved repeatedly with the same constraints (see
+   * InverseKinPointwiseSession) calls the first two once, and then keeps the
+   * constraint layout, the SNOPT workspace and the last SNOPT basis between
+   * calls of solveKnots.
+   */
+  void setConstraints(RigidBodyManipulator* model_input, const int num_constraints, RigidBodyConstraint** const constraint_array);
+  void initSnopt(snopt::integer lenrw_input, snopt::integer leniw_input, snopt::integer lencw_input, const IKoptions &ikoptions);
+  template <typename DerivedA, typename DerivedB, typename DerivedC, typename DerivedD, typename DerivedE>
+  void solveKnots(const int mode, const int nT_input, const double* t_input, const MatrixBase<DerivedA> &q_seed, const MatrixBase<DerivedB> &q_nom_input, MatrixBase<DerivedC> &q_sol, MatrixBase<DerivedD> &qdot_sol, MatrixBase<DerivedE> &qddot_sol, int* INFO, vector<string> &infeasible_constraint, const IKoptions &ikoptions);
+
+  // whether the first knot of solveKnots may warm start from the basis of the previous call
+  bool warm_start_first_knot = false;
+  // how many pointwise SNOPT solves were warm started
+  int num_warm_starts = 0;
+  // when this is set, the pointwise SNOPT solve stops at its next function evaluation (with INFO = 71)
+  const atomic<bool>* cancel = nullptr;
+
+  int IKfun(snopt::doublereal x[], snopt::doublereal F[], snopt::doublereal G[]);
+  int IKtrajfun(snopt::doublereal x[], snopt::doublereal F[], snopt::doublereal G[]);
+
+private:
+  void IK_constraint_fun(double* x,double* c, double* G);
+  void IK_cost_fun(double* x, double &J, double* dJ);
+  void IKtraj_cost_fun(MatrixXd q,const VectorXd &qdot0,const VectorXd &qdotf,double &J,double* dJ);
+  void snoptIKtraj_userfun(const VectorXd &x_vec, VectorXd &c_vec, VectorXd &G_vec);
+  void checkIKtrajGradient(const snopt::doublereal* x, const snopt::integer* iGfun, const snopt::integer* jGvar);
+  snopt::integer trajVarIdx(int k) const;
+  void trajDofColumns(const vector<int> &dofs, vector<int> &cols) const;
+
+  bool samePointwisePattern(snopt::integer nx_i, snopt::integer nF_i, snopt::integer nG_i, const snopt::integer* iGfun, const snopt::integer* jGvar, snopt::integer lenA, const snopt::integer* iAfun, const snopt::integer* jAvar) const;
+
+  RigidBodyManipulator* model = nullptr;
+  SingleTimeKinematicConstraint** st_kc_array = nullptr;
+  MultipleTimeKinematicConstraint** mt_kc_array = nullptr;
+  SingleTimeLinearPostureConstraint** st_lpc_array = nullptr;
+  MultipleTimeLinearPostureConstraint** mt_lpc_array = nullptr;
+  vector<PostureConstraint*> pc_array;
+  QuasiStaticConstraint* qsc_ptr = nullptr;
+  MatrixXd q_nom;
+  VectorXd q_nom_i;
+  MatrixXd Q;
+  MatrixXd Qa;
+  MatrixXd Qv;
+  bool qscActiveFlag;
+  snopt::integer nx;
+  snopt::integer nF;
+  snopt::integer nG;
+  snopt::integer* nc_array = nullptr;
+  snopt::integer* nG_array = nullptr;
+  snopt::integer* nA_array = nullptr;
+  int nq;
+  double *t = nullptr;
+  double *t_samples = nullptr; 
+  double* ti = nullptr;
+  int num_st_kc;
+  int num_mt_kc;
+  int num_st_lpc;
+  int num_mt_lpc;
+  int* mt_kc_nc = nullptr;
+  // the nonzero columns of the kinematic constraint gradients, from dependentDofs
+  vector<vector<int>> st_kc_dofs;
+  vector<vector<int>> st_kc_traj_cols;
+  vector<vector<int>> mt_kc_traj_cols;
+  vector<int> st_lpc_nc;
+  int* mt_lpc_nc = nullptr;
+  int nT;
+  int num_qsc_pts;
+  bool fixInitialState;
+  // The following variables are used in inverseKinTraj only
+  snopt::integer* qfree_idx = nullptr;
+  snopt::integer* qdotf_idx = nullptr;
+  snopt::integer* qdot0_idx = nullptr;
+
+  VectorXd q0_fixed;
+  VectorXd qdot0_fixed;
+  snopt::integer qstart_idx;
+  snopt::integer num_qfree;
+  snopt::integer num_qdotfree;
+
+  // The cubic spline couples the knots of each dof in the same way, so the
+  // velocity and acceleration maps are stored for a single dof. The
+  // interior velocities are qdot(:,1:nT-2) = q*velocity_mat'+qdot0*velocity_mat_qd0'+qdotf*velocity_mat_qdf'
+  // and similarly for qddot with the accel_mat* operators.
+  MatrixXd velocity_mat;
+  VectorXd velocity_mat_qd0;
+  VectorXd velocity_mat_qdf;
+  MatrixXd accel_mat;
+  VectorXd accel_mat_qd0;
+  VectorXd accel_mat_qdf;
+
+  // The in-between samples of interval i are the same combination of the
+  // knots, qdot0 and qdotf for every dof, so only that combination is stored:
+  // q_inbetween(:,j) = q*dqInbetweendqknot[i].row(j)'+qdot0*dqInbetweendqd0[i](j)+qdotf*dqInbetweendqdf[i](j)
+  VectorXd* t_inbetween = nullptr;
+  snopt::integer num_inbetween_tSamples;
+  MatrixXd* dqInbetweendqknot = nullptr;  // nt_i x nT
+  VectorXd* dqInbetweendqd0 = nullptr;    // nt_i
+  VectorXd* dqInbetweendqdf = nullptr;    // nt_i
+  snopt::integer* qknot_qsamples_idx = nullptr;
+
+  // SNOPT workspace, allocated and initialized once by initSnopt
+  snopt::integer lenrw = 0;
+  snopt::integer leniw = 0;
+  snopt::integer lencw = 0;
+  snopt::doublereal* rw = nullptr;
+  snopt::integer* iw = nullptr;
+  char* cw = nullptr;
+
+  // The last pointwise problem handed to SNOPT and its final basis, so that
+  // the next one can warm start if it has the same layout
+  bool pointwise_solved = false;
+  vector<snopt::integer> pointwise_iGfun;
+  vector<snopt::integer> pointwise_jGvar;
+  vector<snopt::integer> pointwise_iAfun;
+  vector<snopt::integer> pointwise_jAvar;
+  vector<snopt::integer> pointwise_xstate;
+  vector<snopt::integer> pointwise_Fstate;
+  vector<snopt::doublereal> pointwise_xmul;
+  vector<snopt::doublereal> pointwise_Fmul;
+  snopt::integer pointwise_nS = 0;
+
+  // this problem's entry in the problem table
+  snopt::integer problem_index;
+
+  /* Remeber to delete this*/
+  snopt::integer nF_tmp;
+  snopt::integer nG_tmp;
+  snopt::integer nx_tmp;
+};
+}
+
+/*
+ * The problems that are being solved.  SNOPT hands its callbacks only the user
+ * workspace, so iu[0] holds the index of the problem in this table.
+ */
+static mutex problem_table_mutex;
+static vector<InverseKinProblem*> problem_table;
+
+static snopt::integer registerProblem(InverseKinProblem* problem)
+{
+  lock_guard<mutex> lock(problem_table_mutex);
+  vector<InverseKinProblem*>::iterator it = find(problem_table.begin(),problem_table.end(),nullptr);
+  if(it != problem_table.end())
+  {
+    *it = problem;
+    return it-problem_table.begin();
+  }
+  problem_table.push_back(problem);
+  return problem_table.size()-1;
+}
+
+static void unregisterProblem(snopt::integer index)
+{
+  lock_guard<mutex> lock(problem_table_mutex);
+  problem_table[index] = nullptr;
+}
+
+static InverseKinProblem* lookupProblem(const snopt::integer iu[])
+{
+  lock_guard<mutex> lock(problem_table_mutex);
+  return problem_table[iu[0]];
+}
+
+/*
+ * The bundled SNOPT is translated by f2c, which keeps the Fortran locals in
+ * statics, so only one thread at a time may be inside SNOPT.  Every SNOPT call
+ * holds this lock, unless the build defines SNOPT_REENTRANT for a SNOPT that
+ * is known to be reentrant.  The lock is held through the user callbacks too,
+ * so the constraint and kinematics evaluations of concurrent solves are
+ * serialized along with SNOPT itself.
+ */
+class SnoptLock
+{
+#ifndef SNOPT_REENTRANT
+public:
+  SnoptLock() : lock(snopt_mutex) {}
+private:
+  static mutex snopt_mutex;
+  lock_guard<mutex> lock;
+#endif
+};
+#ifndef SNOPT_REENTRANT
+mutex SnoptLock::snopt_mutex;
+#endif
+
+/*
+ * Finite-difference jacobian of func at x.  The step has to be well above the
+ * 1e-8 tolerance that doKinematics uses to decide that q has not changed,
+ * otherwise the kinematic constraints see no perturbation at all.
+ */
+static void gevalNumerical(const function<void(const VectorXd &, VectorXd &)>& func,const VectorXd &x, VectorXd &c, MatrixXd &dc,int order = 2, double step = 1e-6)
 {
   int nx = x.rows();
-  (*func_ptr)(x,c);
+  func(x,c);
   int nc = c.rows();
   dc.resize(nc,nx);
-  double err = 1e-10;
+  VectorXd x_perturbed = x;
+  VectorXd c1(nc), c2(nc);
   for(int i = 0;i<nx;i++)
   {
-    VectorXd dx = VectorXd::Zero(nx);
-    dx(i) = err;
-    VectorXd c1(nc);
-    (*func_ptr)(x+dx,c1);
+    x_perturbed(i) = x(i)+step;
+    func(x_perturbed,c1);
     if(order == 1)
     {
-      for(int j = 0;j<nc;j++)
-      {
-        dc(j,i) = (c1(j)-c(j))/err;
-      }
+      dc.col(i) = (c1-c)/step;
     }
-    else if(order == 2)
+    else
     {
-      VectorXd c2(nc);
-      (*func_ptr)(x-dx,c2);
-      for(int j = 0;j<nc;j++)
-      {
-        dc(j,i) = (c1(j)-c2(j))/(2*err);
-      }
+      x_perturbed(i) = x(i)-step;
+      func(x_perturbed,c2);
+      dc.col(i) = (c1-c2)/(2*step);
     }
+    x_perturbed(i) = x(i);
   }
 }
 
 
-static void IK_constraint_fun(double* x,double* c, double* G)
+void InverseKinProblem::IK_constraint_fun(double* x,double* c, double* G)
 {
   double* qsc_weights=nullptr;
   if(qscActiveFlag)
@@ -141,9 +291,12 @@ static void IK_constraint_fun(double* x,double* c, double* G)
     MatrixXd dcnst(nc,nq);
     st_kc_array[i]->eval(ti,cnst,dcnst);
     memcpy(&c[nc_accum],cnst.data(),sizeof(double)*nc);
-    memcpy(&G[ng_accum],dcnst.data(),sizeof(double)*nc*nq);
+    for(int dof : st_kc_dofs[i])
+    {
+      memcpy(&G[ng_accum],dcnst.col(dof).data(),sizeof(double)*nc);
+      ng_accum += nc;
+    }
     nc_accum += nc;
-    ng_accum += nc*nq;
   }
   for(int i = 0;i<num_st_lpc;i++)
   {
@@ -163,7 +316,38 @@ static void IK_constraint_fun(double* x,double* c, double* G)
   }
 } 
 
-static void IK_cost_fun(double* x, double &J, double* dJ)
+/* The index in x of the k'th column of the trajectory gradients, which are ordered as [q of the free knots, qdot0 (if it is free), qdotf]*/
+snopt::integer InverseKinProblem::trajVarIdx(int k) const
+{
+  if(k<nq*num_qfree)
+  {
+    return qfree_idx[k];
+  }
+  else if(fixInitialState)
+  {
+    return qdotf_idx[k-nq*num_qfree];
+  }
+  else if(k<nq*num_qfree+nq)
+  {
+    return qdot0_idx[k-nq*num_qfree];
+  }
+  return qdotf_idx[k-nq*num_qfree-nq];
+}
+
+/* The columns of the trajectory gradients that belong to the given dofs. The interpolation is done dof by dof, so the other columns are zero*/
+void InverseKinProblem::trajDofColumns(const vector<int> &dofs, vector<int> &cols) const
+{
+  cols.clear();
+  for(int j = 0;j<num_qfree+num_qdotfree;j++)
+  {
+    for(int dof : dofs)
+    {
+      cols.push_back(j*nq+dof);
+    }
+  }
+}
+
+void InverseKinProblem::IK_cost_fun(double* x, double &J, double* dJ)
 {
   VectorXd q(nq);
   memcpy(q.data(),x,sizeof(double)*nq);
@@ -173,6 +357,15 @@ static void IK_cost_fun(double* x, double &J, double* dJ)
   memcpy(dJ, dJ_vec.data(),sizeof(double)*nq);
 }
 
+int InverseKinProblem::IKfun(snopt::doublereal x[], snopt::doublereal F[], snopt::doublereal G[])
+{
+  double* q = x;
+  model->doKinematics(q);
+  IK_cost_fun(x,F[0],G);
+  IK_constraint_fun(x,&F[1],&G[nq]);
+  return 0;
+}
+
 static int snoptIKfun(snopt::integer *Status, snopt::integer *n, snopt::doublereal x[],
     snopt::integer *needF, snopt::integer *neF, snopt::doublereal F[],
     snopt::integer *needG, snopt::integer *neG, snopt::doublereal G[],
@@ -180,26 +373,24 @@ static int snoptIKfun(snopt::integer *Status, snopt::integer *n, snopt::doublere
     snopt::integer iu[], snopt::integer *leniu,
     snopt::doublereal ru[], snopt::integer *lenru)
 {
-  double* q = x;
-  model->doKinematics(q);
-  IK_cost_fun(x,F[0],G);
-  IK_constraint_fun(x,&F[1],&G[nq]);
-  return 0;
+  InverseKinProblem* problem = lookupProblem(iu);
+  if(problem->cancel && *problem->cancel)
+  {
+    *Status = -2;
+    return 0;
+  }
+  return problem->IKfun(x,F,G);
 }
 
-static void IKtraj_cost_fun(MatrixXd q,const VectorXd &qdot0,const VectorXd &qdotf,double &J,double* dJ)
+void InverseKinProblem::IKtraj_cost_fun(MatrixXd q,const VectorXd &qdot0,const VectorXd &qdotf,double &J,double* dJ)
 {
-  MatrixXd dJ_vec = MatrixXd::Zero(1,nq*(num_qfree+num_qdotfree));
-  MatrixXd qdot(nq*nT,1);
-  MatrixXd qddot(nq*nT,1);
-  q.resize(nq*nT,1);
-  qdot.block(0,0,nq,1) = qdot0;
-  qdot.block(nq,0,nq*(nT-2),1) = velocity_mat*q+velocity_mat_qd0*qdot0+velocity_mat_qdf*qdotf;
-  qdot.block(nq*(nT-1),0,nq,1) = qdotf;
-  qddot = accel_mat*q+accel_mat_qd0*qdot0+accel_mat_qdf*qdotf;
-  q.resize(nq,nT);
-  qdot.resize(nq,nT);
-  qddot.resize(nq,nT);
+  MatrixXd dJ_mat(nq,num_qfree+num_qdotfree);
+  MatrixXd qdot(nq,nT);
+  MatrixXd qddot(nq,nT);
+  qdot.col(0) = qdot0;
+  qdot.block(0,1,nq,nT-2) = q*velocity_mat.transpose()+qdot0*velocity_mat_qd0.transpose()+qdotf*velocity_mat_qdf.transpose();
+  qdot.col(nT-1) = qdotf;
+  qddot = q*accel_mat.transpose()+qdot0*accel_mat_qd0.transpose()+qdotf*accel_mat_qdf.transpose();
   MatrixXd q_diff = q.block(0,qstart_idx,nq,num_qfree)-q_nom.block(0,qstart_idx,nq,num_qfree);
   MatrixXd tmp1 = 0.5*Qa*qddot;
   MatrixXd tmp2 = tmp1.cwiseProduct(qddot);
@@ -211,38 +402,24 @@ static void IKtraj_cost_fun(MatrixXd q,const VectorXd &qdot0,const VectorXd &qdo
   MatrixXd tmp6 = tmp5.cwiseProduct(q_diff);
   J += tmp6.sum();
   MatrixXd dJdqd = 2*tmp3.block(0,1,nq,nT-2);//[dJdqd(2) dJdqd(3) dJdqd(nT-1)]
-  dJdqd.resize(1,nq*(nT-2));
-  dJ_vec.block(0,0,1,nq*num_qfree) = dJdqd*velocity_mat.block(0,nq*qstart_idx,(nT-2)*nq,nq*num_qfree);
-  MatrixXd dJdqdiff = 2*tmp5;
-  dJdqdiff.resize(1,nq*num_qfree);
-  dJ_vec.block(0,0,1,nq*num_qfree) += dJdqdiff;
   MatrixXd dJdqdd = 2.0*tmp1;
-  dJdqdd.resize(1,nq*nT);
-  dJ_vec.block(0,0,1,nq*num_qfree) += dJdqdd*accel_mat.block(0,nq*qstart_idx,nq*nT,nq*num_qfree);
-  MatrixXd dJdqdotf;
-  dJdqdotf = dJdqdd*accel_mat_qdf+qdotf.transpose()*Qv+dJdqd*velocity_mat_qdf;
-  dJdqdotf.resize(1,nq);
+  dJ_mat.block(0,0,nq,num_qfree) = dJdqd*velocity_mat.block(0,qstart_idx,nT-2,num_qfree);
+  dJ_mat.block(0,0,nq,num_qfree) += 2*tmp5;
+  dJ_mat.block(0,0,nq,num_qfree) += dJdqdd*accel_mat.block(0,qstart_idx,nT,num_qfree);
+  VectorXd dJdqdotf = dJdqdd*accel_mat_qdf+Qv.transpose()*qdotf+dJdqd*velocity_mat_qdf;
   if(fixInitialState)
   {
-    dJ_vec.block(0,nq*num_qfree,1,nq) = dJdqdotf;
+    dJ_mat.col(num_qfree) = dJdqdotf;
   }
   else
   {
-    MatrixXd dJdqdot0;
-    dJdqdot0 = dJdqdd*accel_mat_qd0+qdot0.transpose()*Qv+dJdqd*velocity_mat_qd0;
-    dJdqdot0.resize(1,nq);
-    dJ_vec.block(0,nq*num_qfree,1,nq) = dJdqdot0;
-    dJ_vec.block(0,nq*num_qfree+nq,1,nq) = dJdqdotf;
+    dJ_mat.col(num_qfree) = dJdqdd*accel_mat_qd0+Qv.transpose()*qdot0+dJdqd*velocity_mat_qd0;
+    dJ_mat.col(num_qfree+1) = dJdqdotf;
   }
-  memcpy(dJ,dJ_vec.data(),sizeof(double)*nq*(num_qfree+num_qdotfree));
+  memcpy(dJ,dJ_mat.data(),sizeof(double)*nq*(num_qfree+num_qdotfree));
 }
 
-static int snoptIKtrajfun(snopt::integer *Status, snopt::integer *n, snopt::doublereal x[],
-    snopt::integer *needF, snopt::integer *neF, snopt::doublereal F[],
-    snopt::integer *needG, snopt::integer *neG, snopt::doublereal G[],
-    char *cu, snopt::integer *lencu,
-    snopt::integer iu[], snopt::integer *leniu,
-    snopt::doublereal ru[], snopt::integer *lenru)
+int InverseKinProblem::IKtrajfun(snopt::doublereal x[], snopt::doublereal F[], snopt::doublereal G[])
 {
   VectorXd qdotf = VectorXd::Zero(nq);
   VectorXd qdot0 = VectorXd::Zero(nq);
@@ -293,11 +470,7 @@ static int snoptIKtrajfun(snopt::integer *Status, snopt::integer *n, snopt::doub
   
   for(int i = 0;i<nT-1;i++)
   {
-    q.resize(nq*nT,1);
-    MatrixXd q_inbetween_block_tmp = dqInbetweendqknot[i]*q+dqInbetweendqd0[i]*qdot0+dqInbetweendqdf[i]*qdotf;
-    q_inbetween_block_tmp.resize(nq,t_inbetween[i].size());  
-    q_inbetween.block(0,inbetween_idx,nq,t_inbetween[i].size()) = q_inbetween_block_tmp; 
-    q.resize(nq,nT);
+    q_inbetween.block(0,inbetween_idx,nq,t_inbetween[i].size()) = q*dqInbetweendqknot[i].transpose()+qdot0*dqInbetweendqd0[i].transpose()+qdotf*dqInbetweendqdf[i].transpose();
     for(int j = 0;j<t_inbetween[i].size();j++)
     {
       double t_j = t_inbetween[i](j)+t[i];
@@ -313,19 +486,25 @@ static int snoptIKtrajfun(snopt::integer *Status, snopt::integer *n, snopt::doub
           st_kc_array[k]->eval(&t_j,c_k,dc_k);
           memcpy(F+nf_cum,c_k.data(),sizeof(double)*nc);
           MatrixXd dc_kdx = MatrixXd::Zero(nc,nq*(num_qfree+num_qdotfree));
-          dc_kdx.block(0,0,nc,nq*num_qfree) = dc_k*dqInbetweendqknot[i].block(nq*j,nq*qstart_idx,nq,nq*num_qfree);
+          for(int m = qstart_idx;m<nT;m++)
+          {
+            dc_kdx.block(0,nq*(m-qstart_idx),nc,nq) = dqInbetweendqknot[i](j,m)*dc_k;
+          }
           if(!fixInitialState)
           {
-            dc_kdx.block(0,nq*num_qfree,nc,nq) = dc_k*dqInbetweendqd0[i].block(nq*j,0,nq,nq);
-            dc_kdx.block(0,nq*num_qfree+nq,nc,nq) = dc_k*dqInbetweendqdf[i].block(nq*j,0,nq,nq);
+            dc_kdx.block(0,nq*num_qfree,nc,nq) = dqInbetweendqd0[i](j)*dc_k;
+            dc_kdx.block(0,nq*num_qfree+nq,nc,nq) = dqInbetweendqdf[i](j)*dc_k;
           }
           else
           {
-            dc_kdx.block(0,nq*num_qfree,nc,nq) = dc_k*dqInbetweendqdf[i].block(nq*j,0,nq,nq);
+            dc_kdx.block(0,nq*num_qfree,nc,nq) = dqInbetweendqdf[i](j)*dc_k;
+          }
+          for(int col : st_kc_traj_cols[k])
+          {
+            memcpy(G+nG_cum,dc_kdx.col(col).data(),sizeof(double)*nc);
+            nG_cum += nc;
           }
-          memcpy(G+nG_cum,dc_kdx.data(),sizeof(double)*dc_kdx.size());
           nf_cum += nc;
-          nG_cum += nc*nq*(num_qfree+num_qdotfree);
         }
       }
     }
@@ -348,21 +527,30 @@ static int snoptIKtrajfun(snopt::integer *Status, snopt::integer *n, snopt::doub
     }
     for(int j = 0;j<nT-1;j++)
     {
-      MatrixXd dc_ij = mtkc_dc.block(0,nq*(qknot_qsamples_idx[j]+1-qstart_idx),mt_kc_nc[i],nq*t_inbetween[j].size());
-      mtkc_dc_dx.block(0,0,mt_kc_nc[i],nq*num_qfree) += dc_ij*dqInbetweendqknot[j].block(0,qstart_idx*nq,nq*t_inbetween[j].size(),nq*num_qfree);
-      if(fixInitialState)
+      for(int s = 0;s<t_inbetween[j].size();s++)
       {
-        mtkc_dc_dx.block(0,nq*num_qfree,mt_kc_nc[i],nq) += dc_ij*dqInbetweendqdf[j];
-      }
-      else
-      {
-        mtkc_dc_dx.block(0,nq*num_qfree,mt_kc_nc[i],nq) += dc_ij*dqInbetweendqd0[j];
-        mtkc_dc_dx.block(0,nq*num_qfree+nq,mt_kc_nc[i],nq) += dc_ij*dqInbetweendqdf[j];
+        MatrixXd dc_ijs = mtkc_dc.block(0,nq*(qknot_qsamples_idx[j]+1+s-qstart_idx),mt_kc_nc[i],nq);
+        for(int m = qstart_idx;m<nT;m++)
+        {
+          mtkc_dc_dx.block(0,nq*(m-qstart_idx),mt_kc_nc[i],nq) += dqInbetweendqknot[j](s,m)*dc_ijs;
+        }
+        if(fixInitialState)
+        {
+          mtkc_dc_dx.block(0,nq*num_qfree,mt_kc_nc[i],nq) += dqInbetweendqdf[j](s)*dc_ijs;
+        }
+        else
+        {
+          mtkc_dc_dx.block(0,nq*num_qfree,mt_kc_nc[i],nq) += dqInbetweendqd0[j](s)*dc_ijs;
+          mtkc_dc_dx.block(0,nq*num_qfree+nq,mt_kc_nc[i],nq) += dqInbetweendqdf[j](s)*dc_ijs;
+        }
       }
     }
-    memcpy(G+nG_cum,mtkc_dc_dx.data(),sizeof(double)*mtkc_dc_dx.size());
+    for(int col : mt_kc_traj_cols[i])
+    {
+      memcpy(G+nG_cum,mtkc_dc_dx.col(col).data(),sizeof(double)*mt_kc_nc[i]);
+      nG_cum += mt_kc_nc[i];
+    }
     nf_cum += mt_kc_nc[i];
-    nG_cum += mt_kc_nc[i]*nq*(num_qfree+num_qdotfree);
   }
   for(int i = 0;i<num_mt_lpc;i++)
   {
@@ -371,8 +559,17 @@ static int snoptIKtrajfun(snopt::integer *Status, snopt::integer *n, snopt::doub
   return 0;
 }
 
+static int snoptIKtrajfun(snopt::integer *Status, snopt::integer *n, snopt::doublereal x[],
+    snopt::integer *needF, snopt::integer *neF, snopt::doublereal F[],
+    snopt::integer *needG, snopt::integer *neG, snopt::doublereal G[],
+    char *cu, snopt::integer *lencu,
+    snopt::integer iu[], snopt::integer *leniu,
+    snopt::doublereal ru[], snopt::integer *lenru)
+{
+  return lookupProblem(iu)->IKtrajfun(x,F,G);
+}
 
-static void snoptIKtraj_userfun(const VectorXd &x_vec, VectorXd &c_vec, VectorXd &G_vec)
+void InverseKinProblem::snoptIKtraj_userfun(const VectorXd &x_vec, VectorXd &c_vec, VectorXd &G_vec)
 {
   snopt::doublereal* x = new snopt::doublereal[nx_tmp];
   for(int i = 0;i<nx_tmp;i++)
@@ -381,19 +578,7 @@ static void snoptIKtraj_userfun(const VectorXd &x_vec, VectorXd &c_vec, VectorXd
   }
   snopt::doublereal* F = new snopt::doublereal[nF_tmp];
   snopt::doublereal* G = new snopt::doublereal[nG_tmp];
-  snopt::integer Status = 0;
-  snopt::integer n = nx_tmp;
-  snopt::integer needF = 1;
-  snopt::integer neF = nF_tmp;
-  snopt::integer needG = 1;
-  snopt::integer neG = nG_tmp;
-  char *cu = nullptr;
-  snopt::integer lencu = 0;
-  snopt::integer *iu = nullptr;
-  snopt::integer leniu = 0;
-  snopt::doublereal *ru = nullptr;
-  snopt::integer lenru = 0;
-  snoptIKtrajfun(&Status,&n,x,&needF, &neF, F, &needG, &neG, G, cu, &lencu, iu, &leniu, ru, &lenru);
+  IKtrajfun(x,F,G);
   c_vec.resize(nF_tmp,1);
   for(int i = 0;i<nF_tmp;i++)
   {
@@ -409,41 +594,69 @@ static void snoptIKtraj_userfun(const VectorXd &x_vec, VectorXd &c_vec, VectorXd
   delete[] G;
 }
 
-static void snoptIKtraj_fevalfun(const VectorXd &x, VectorXd &c)
+/*
+ * Compares the user gradient of the trajectory problem at x against central
+ * differences, and reports the worst entry.  This costs 2*nx evaluations of the
+ * whole problem, so it only runs in debug mode.
+ */
+void InverseKinProblem::checkIKtrajGradient(const snopt::doublereal* x, const snopt::integer* iGfun, const snopt::integer* jGvar)
 {
-  VectorXd G;
-  snoptIKtraj_userfun(x,c,G);
+  nx_tmp = nx;
+  nG_tmp = nG;
+  nF_tmp = nF;
+  VectorXd x_vec = Map<const VectorXd>(x,nx);
+  VectorXd c_vec, G_vec;
+  snoptIKtraj_userfun(x_vec,c_vec,G_vec);
+  MatrixXd df_userfun = MatrixXd::Zero(nF,nx);
+  for(int i = 0;i<nG;i++)
+  {
+    df_userfun(iGfun[i]-1,jGvar[i]-1) = G_vec(i);
+  }
+  MatrixXd df_numerical;
+  VectorXd G_unused;
+  gevalNumerical([this,&G_unused](const VectorXd &x, VectorXd &c) { snoptIKtraj_userfun(x,c,G_unused); },x_vec,c_vec,df_numerical);
+  MatrixXd df_err = (df_userfun-df_numerical).cwiseAbs();
+  int max_err_row,max_err_col;
+  double max_err = df_err.maxCoeff(&max_err_row,&max_err_col);
+  printf("The maximum gradient numerical error is %e, in row %d, col %d\nuser gradient is %e\n2nd order numerical gradient is %e\n",max_err,max_err_row+1,max_err_col+1,df_userfun(max_err_row,max_err_col),df_numerical(max_err_row,max_err_col));
+  if(nF>1)
+  {
+    printf("The maximum gradient numerical error, except in the cost function, is %e\n",df_err.bottomRows(nF-1).maxCoeff());
+  }
 }
 
-template <typename DerivedA, typename DerivedB, typename DerivedC, typename DerivedD, typename DerivedE>
-void inverseKinBackend(RigidBodyManipulator* model_input, const int mode, const int nT_input, const double* t_input, const MatrixBase<DerivedA> &q_seed, const MatrixBase<DerivedB> &q_nom_input, const int num_constraints, RigidBodyConstraint** const constraint_array, MatrixBase<DerivedC> &q_sol, MatrixBase<DerivedD> &qdot_sol, MatrixBase<DerivedE> &qddot_sol, int* INFO, vector<string> &infeasible_constraint, const IKoptions &ikoptions)
+InverseKinProblem::InverseKinProblem()
+  : problem_index(registerProblem(this))
+{
+}
+
+InverseKinProblem::~InverseKinProblem()
+{
+  unregisterProblem(problem_index);
+  delete[] st_kc_array;
+  delete[] mt_kc_array;
+  delete[] st_lpc_array;
+  delete[] mt_lpc_array;
+  std::free(rw); std::free(iw);
+  delete[] cw;
+}
+
+void InverseKinProblem::setConstraints(RigidBodyManipulator* model_input, const int num_constraints, RigidBodyConstraint** const constraint_array)
 {
   model = model_input;
-  nT = nT_input;
-  t = const_cast<double*>(t_input);
   nq = model->num_dof;
-  q_nom = q_nom_input;
-  if(q_seed.rows() != nq || q_seed.cols() != nT || q_nom.rows() != nq || q_nom.cols() != nT)
-  {
-    cerr<<"Drake:inverseKinBackend: q_seed and q_nom must be of size nq x nT"<<endl;
-  }
   num_st_kc = 0;
   num_mt_kc = 0;
   num_st_lpc = 0;
   num_mt_lpc = 0;
   int num_qsc = 0;
+  delete[] st_kc_array; delete[] mt_kc_array; delete[] st_lpc_array; delete[] mt_lpc_array;
   st_kc_array = new SingleTimeKinematicConstraint*[num_constraints];
   mt_kc_array = new MultipleTimeKinematicConstraint*[num_constraints];
-  SingleTimeLinearPostureConstraint** st_lpc_array = new SingleTimeLinearPostureConstraint*[num_constraints];
-  MultipleTimeLinearPostureConstraint** mt_lpc_array = new MultipleTimeLinearPostureConstraint*[num_constraints];
+  st_lpc_array = new SingleTimeLinearPostureConstraint*[num_constraints];
+  mt_lpc_array = new MultipleTimeLinearPostureConstraint*[num_constraints];
+  pc_array.clear();
   qsc_ptr = nullptr;
-  MatrixXd joint_limit_min(nq,nT);
-  MatrixXd joint_limit_max(nq,nT);
-  for(int i = 0;i<nT;i++)
-  {
-    joint_limit_min.col(i) = model->joint_limit_min;
-    joint_limit_max.col(i) = model->joint_limit_max;
-  }
   for(int i = 0;i<num_constraints;i++)
   {
     RigidBodyConstraint* constraint =  constraint_array[i];
@@ -469,21 +682,7 @@ void inverseKinBackend(RigidBodyManipulator* model_input, const int mode, const
     }
     else if(constraint_category == RigidBodyConstraint::PostureConstraintCategory)
     {
-      VectorXd joint_min, joint_max;
-      PostureConstraint* pc = static_cast<PostureConstraint*>(constraint);
-      for(int j = 0;j<nT;j++)
-      {
-        pc->bounds(&t[j],joint_min,joint_max);
-        for(int k = 0;k<nq;k++)
-        {
-          joint_limit_min(k,j) = (joint_limit_min(k,j)>joint_min[k]? joint_limit_min(k,j):joint_min[k]);
-          joint_limit_max(k,j) = (joint_limit_max(k,j)<joint_max[k]? joint_limit_max(k,j):joint_max[k]);
-          if(joint_limit_min(k,j)>joint_limit_max(k,j))
-          {
-            cerr<<"Drake:inverseKinBackend:BadInputs Some posture constraint has lower bound larger than the upper bound of other posture constraint for joint "<<k<< " at "<<j<<"'th time "<<endl;
-          }
-        }
-      }
+      pc_array.push_back(static_cast<PostureConstraint*>(constraint));
     }
     else if(constraint_category == RigidBodyConstraint::MultipleTimeLinearPostureConstraintCategory)
     {
@@ -496,6 +695,11 @@ void inverseKinBackend(RigidBodyManipulator* model_input, const int mode, const
       num_st_lpc++;
     }
   }
+  st_kc_dofs.resize(num_st_kc);
+  for(int i = 0;i<num_st_kc;i++)
+  {
+    st_kc_array[i]->dependentDofs(st_kc_dofs[i]);
+  }
   if(qsc_ptr == nullptr)
   {
     qscActiveFlag = false;
@@ -506,12 +710,115 @@ void inverseKinBackend(RigidBodyManipulator* model_input, const int mode, const
     qscActiveFlag = qsc_ptr->isActive(); 
     num_qsc_pts = qsc_ptr->getNumWeights();
   }
-  ikoptions.getQ(Q);
+  pointwise_solved = false;
+}
+
+/*
+ * Allocates the SNOPT workspace (unless the one we have is already of this
+ * size) and sets the options in it.  As with SNOPT's own snoptProblem, the
+ * initialized workspace can then be handed to any number of snopta calls.
+ */
+void InverseKinProblem::initSnopt(snopt::integer lenrw_input, snopt::integer leniw_input, snopt::integer lencw_input, const IKoptions &ikoptions)
+{
+  if(lenrw != lenrw_input || leniw != leniw_input || lencw != lencw_input)
+  {
+    std::free(rw); std::free(iw);
+    delete[] cw;
+    lenrw = lenrw_input;
+    leniw = leniw_input;
+    lencw = lencw_input;
+    rw = (snopt::doublereal*) std::calloc(lenrw,sizeof(snopt::doublereal));
+    iw = (snopt::integer*) std::calloc(leniw,sizeof(snopt::integer));
+    cw = new char[8*lencw];
+  }
   snopt::integer SNOPT_MajorIterationsLimit = static_cast<snopt::integer>(ikoptions.getMajorIterationsLimit());
   snopt::integer SNOPT_IterationsLimit = static_cast<snopt::integer>(ikoptions.getIterationsLimit());
   double SNOPT_MajorFeasibilityTolerance = ikoptions.getMajorFeasibilityTolerance();
   double SNOPT_MajorOptimalityTolerance = ikoptions.getMajorOptimalityTolerance();
   snopt::integer SNOPT_SuperbasicsLimit = static_cast<snopt::integer>(ikoptions.getSuperbasicsLimit());
+  snopt::integer iSumm  = -1;
+  snopt::integer iPrint = -1;
+  snopt::integer INFO_snopt;
+  SnoptLock snopt_lock;
+  snopt::sninit_(&iPrint,&iSumm,cw,&lencw,iw,&leniw,rw,&lenrw,8*500);
+  char strOpt1[200] = "Derivative option";
+  snopt::integer DerOpt = 1, strOpt_len = strlen(strOpt1);
+  snopt::snseti_(strOpt1,&DerOpt,&iPrint,&iSumm,&INFO_snopt,cw,&lencw,iw,&leniw,rw,&lenrw,strOpt_len,8*500);
+  char strOpt2[200] = "Major optimality tolerance";
+  strOpt_len = strlen(strOpt2);
+  snopt::snsetr_(strOpt2,&SNOPT_MajorOptimalityTolerance,&iPrint,&iSumm,&INFO_snopt,cw,&lencw,iw,&leniw,rw,&lenrw,strOpt_len,8*500);
+  char strOpt3[200] = "Major feasibility tolerance";
+  strOpt_len = strlen(strOpt3);
+  snopt::snsetr_(strOpt3,&SNOPT_MajorFeasibilityTolerance,&iPrint,&iSumm,&INFO_snopt,cw,&lencw,iw,&leniw,rw,&lenrw,strOpt_len,8*500);
+  char strOpt4[200] = "Superbasics limit";
+  strOpt_len = strlen(strOpt4);
+  snopt::snseti_(strOpt4,&SNOPT_SuperbasicsLimit,&iPrint,&iSumm,&INFO_snopt,cw,&lencw,iw,&leniw,rw,&lenrw,strOpt_len,8*500);
+  char strOpt5[200] = "Major iterations limit";
+  strOpt_len = strlen(strOpt5);
+  snopt::snseti_(strOpt5,&SNOPT_MajorIterationsLimit,&iPrint,&iSumm,&INFO_snopt,cw,&lencw,iw,&leniw,rw,&lenrw,strOpt_len,8*500);
+  char strOpt6[200] = "Iterations limit";
+  strOpt_len = strlen(strOpt6);
+  snopt::snseti_(strOpt6,&SNOPT_IterationsLimit,&iPrint,&iSumm,&INFO_snopt,cw,&lencw,iw,&leniw,rw,&lenrw,strOpt_len,8*500);
+}
+
+/* Whether a pointwise problem has the same variables, constraints and sparsity as the last one handed to SNOPT*/
+bool InverseKinProblem::samePointwisePattern(snopt::integer nx_i, snopt::integer nF_i, snopt::integer nG_i, const snopt::integer* iGfun, const snopt::integer* jGvar, snopt::integer lenA, const snopt::integer* iAfun, const snopt::integer* jAvar) const
+{
+  return pointwise_solved && pointwise_xstate.size() == nx_i && pointwise_Fstate.size() == nF_i
+    && pointwise_iGfun.size() == nG_i && equal(pointwise_iGfun.begin(),pointwise_iGfun.end(),iGfun) && equal(pointwise_jGvar.begin(),pointwise_jGvar.end(),jGvar)
+    && pointwise_iAfun.size() == lenA && equal(pointwise_iAfun.begin(),pointwise_iAfun.end(),iAfun) && equal(pointwise_jAvar.begin(),pointwise_jAvar.end(),jAvar);
+}
+
+template <typename DerivedA, typename DerivedB, typename DerivedC, typename DerivedD, typename DerivedE>
+void InverseKinProblem::solve(RigidBodyManipulator* model_input, const int mode, const int nT_input, const double* t_input, const MatrixBase<DerivedA> &q_seed, const MatrixBase<DerivedB> &q_nom_input, const int num_constraints, RigidBodyConstraint** const constraint_array, MatrixBase<DerivedC> &q_sol, MatrixBase<DerivedD> &qdot_sol, MatrixBase<DerivedE> &qddot_sol, int* INFO, vector<string> &infeasible_constraint, const IKoptions &ikoptions)
+{
+  setConstraints(model_input,num_constraints,constraint_array);
+  if(mode == 1)
+  {
+    initSnopt(10000000,500000,500,ikoptions);
+  }
+  else if(mode == 2)
+  {
+    initSnopt(20000000,2000000,5000,ikoptions);
+  }
+  solveKnots(mode,nT_input,t_input,q_seed,q_nom_input,q_sol,qdot_sol,qddot_sol,INFO,infeasible_constraint,ikoptions);
+}
+
+template <typename DerivedA, typename DerivedB, typename DerivedC, typename DerivedD, typename DerivedE>
+void InverseKinProblem::solveKnots(const int mode, const int nT_input, const double* t_input, const MatrixBase<DerivedA> &q_seed, const MatrixBase<DerivedB> &q_nom_input, MatrixBase<DerivedC> &q_sol, MatrixBase<DerivedD> &qdot_sol, MatrixBase<DerivedE> &qddot_sol, int* INFO, vector<string> &infeasible_constraint, const IKoptions &ikoptions)
+{
+  nT = nT_input;
+  t = const_cast<double*>(t_input);
+  q_nom = q_nom_input;
+  if(q_seed.rows() != nq || q_seed.cols() != nT || q_nom.rows() != nq || q_nom.cols() != nT)
+  {
+    cerr<<"Drake:inverseKinBackend: q_seed and q_nom must be of size nq x nT"<<endl;
+  }
+  MatrixXd joint_limit_min(nq,nT);
+  MatrixXd joint_limit_max(nq,nT);
+  for(int i = 0;i<nT;i++)
+  {
+    joint_limit_min.col(i) = model->joint_limit_min;
+    joint_limit_max.col(i) = model->joint_limit_max;
+  }
+  for(PostureConstraint* pc : pc_array)
+  {
+    VectorXd joint_min, joint_max;
+    for(int j = 0;j<nT;j++)
+    {
+      pc->bounds(&t[j],joint_min,joint_max);
+      for(int k = 0;k<nq;k++)
+      {
+        joint_limit_min(k,j) = (joint_limit_min(k,j)>joint_min[k]? joint_limit_min(k,j):joint_min[k]);
+        joint_limit_max(k,j) = (joint_limit_max(k,j)<joint_max[k]? joint_limit_max(k,j):joint_max[k]);
+        if(joint_limit_min(k,j)>joint_limit_max(k,j))
+        {
+          cerr<<"Drake:inverseKinBackend:BadInputs Some posture constraint has lower bound larger than the upper bound of other posture constraint for joint "<<k<< " at "<<j<<"'th time "<<endl;
+        }
+      }
+    }
+  }
+  ikoptions.getQ(Q);
   bool debug_mode = ikoptions.getDebug();
   bool sequentialSeedFlag = ikoptions.getSequentialSeedFlag();
   snopt::integer* INFO_snopt = nullptr;
@@ -573,22 +880,23 @@ void inverseKinBackend(RigidBodyManipulator* model_input, const int mode, const
         Cmin_array[i].tail(nc) = lb;
         Cmax_array[i].conservativeResize(Cmax_array[i].size()+nc);
         Cmax_array[i].tail(nc) = ub;
-        iCfun_array[i].conservativeResize(iCfun_array[i].size()+nc*nq);
-        jCvar_array[i].conservativeResize(jCvar_array[i].size()+nc*nq);
+        int ndofs = st_kc_dofs[j].size();
+        iCfun_array[i].conservativeResize(iCfun_array[i].size()+nc*ndofs);
+        jCvar_array[i].conservativeResize(jCvar_array[i].size()+nc*ndofs);
         VectorXi iCfun_append(nc);
         VectorXi jCvar_append(nc);
         for(int k = 0;k<nc;k++)
         {
           iCfun_append(k) = nc_array[i]+k+1; //use 1-index;
         }
-        for(int k = 0;k<nq;k++)
+        for(int k = 0;k<ndofs;k++)
         {
           iCfun_array[i].segment(nG_array[i]+k*nc,nc) = iCfun_append;
-          jCvar_append = VectorXi::Constant(nc,k+1); // use 1-index
+          jCvar_append = VectorXi::Constant(nc,st_kc_dofs[j][k]+1); // use 1-index
           jCvar_array[i].segment(nG_array[i]+k*nc,nc) = jCvar_append;
         }
         nc_array[i] = nc_array[i]+nc;
-        nG_array[i] = nG_array[i]+nq*nc;
+        nG_array[i] = nG_array[i]+ndofs*nc;
         if(debug_mode)
         {
           vector<string> constraint_name;
@@ -597,7 +905,7 @@ void inverseKinBackend(RigidBodyManipulator* model_input, const int mode, const
         }
       }
     }
-    st_lpc_nc = new int[num_st_lpc];
+    st_lpc_nc.resize(num_st_lpc);
     for(int j = 0;j<num_st_lpc;j++)
     {
       st_lpc_nc[j] = st_lpc_array[j]->getNumConstraint(&t[i]);
@@ -813,28 +1121,36 @@ void inverseKinBackend(RigidBodyManipulator* model_input, const int mode, const
       }
 
       snopt::integer minrw,miniw,mincw;
-      snopt::integer lenrw = 10000000, leniw = 500000, lencw = 500;
-      snopt::doublereal* rw;
-      rw = (snopt::doublereal*) std::calloc(lenrw,sizeof(snopt::doublereal));
-      //doublereal rw[lenrw];
-      snopt::integer* iw;
-      iw = (snopt::integer*) std::calloc(lenrw,sizeof(snopt::integer));
-      char cw[8*lencw];
+      // the user workspace, separate from SNOPT's own, only tells the
+      // callbacks which problem they are evaluating
+      char cu[8];
+      snopt::integer lencu = 1;
+      snopt::integer iu[1] = {problem_index};
+      snopt::integer leniu = 1;
+      snopt::doublereal ru[1];
+      snopt::integer lenru = 1;
 
-      snopt::integer Cold = 0; //, Basis = 1, Warm = 2;
-      snopt::doublereal *xmul = new snopt::doublereal[nx];
-      snopt::integer    *xstate = new snopt::integer[nx];
-      for(int j = 0;j<nx;j++)
+      // Warm start from the final basis of the previous knot (or of the
+      // previous call) when we start from its solution and the problem has
+      // the same layout
+      snopt::integer Cold = 0, Warm = 2; //, Basis = 1;
+      bool warm_start = samePointwisePattern(nx,nF,nG,iGfun,jGvar,lenA,iAfun,jAvar) && (i == 0 ? warm_start_first_knot : sequentialSeedFlag);
+      snopt::integer Start = warm_start ? Warm : Cold;
+      snopt::integer nS, nInf;
+      snopt::doublereal sInf;
+      if(warm_start)
       {
-        xstate[j] = 0;
+        nS = pointwise_nS;
+        num_warm_starts++;
       }
-      snopt::doublereal *F      = new snopt::doublereal[nF];
-      snopt::doublereal *Fmul   = new snopt::doublereal[nF];
-      snopt::integer    *Fstate = new snopt::integer[nF];
-      for(int j = 0;j<nF;j++)
+      else
       {
-        Fstate[j] = 0;
+        pointwise_xstate.assign(nx,0);
+        pointwise_Fstate.assign(nF,0);
+        pointwise_xmul.assign(nx,0.0);
+        pointwise_Fmul.assign(nF,0.0);
       }
+      snopt::doublereal *F      = new snopt::doublereal[nF];
       snopt::doublereal ObjAdd = 0.0;
 
       snopt::integer ObjRow = 1;
@@ -843,44 +1159,6 @@ void inverseKinBackend(RigidBodyManipulator* model_input, const int mode, const
       char* xnames = new char[nxname*8];
       char* Fnames = new char[nFname*8];
       char Prob[200];
-//      char printname[200];
-//      char specname[200];
-
-//      snopt::integer iSpecs = -1, spec_len;
-      snopt::integer iSumm  = -1;
-      snopt::integer iPrint = -1; //, prnt_len;
-
-      snopt::integer nS, nInf;
-      snopt::doublereal sInf;
-
-      /*sprintf(specname, "%s","ik.spc");
-      sprintf(printname, "%s","ik.out");
-      sprintf(Prob,"%s","ik");
-      prnt_len = strlen(printname);
-      spec_len = strlen(specname);
-      npname = strlen(Prob);
-      snopenappend_(&iPrint,printname, &INFO_snopt[i], prnt_len);*/
-
-      snopt::sninit_(&iPrint,&iSumm,cw,&lencw,iw,&leniw,rw,&lenrw,8*500);
-      //snopt::snfilewrapper_(specname,&iSpecs,&INFO_snopt[i],cw,&lencw,iw,&leniw,rw,&lenrw,spec_len,8*lencw);
-      char strOpt1[200] = "Derivative option";
-      snopt::integer DerOpt = 1, strOpt_len = strlen(strOpt1);
-      snopt::snseti_(strOpt1,&DerOpt,&iPrint,&iSumm,&INFO_snopt[i],cw,&lencw,iw,&leniw,rw,&lenrw,strOpt_len,8*500);
-      char strOpt2[200] = "Major optimality tolerance";
-      strOpt_len = strlen(strOpt2);
-      snopt::snsetr_(strOpt2,&SNOPT_MajorOptimalityTolerance,&iPrint,&iSumm,&INFO_snopt[i],cw,&lencw,iw,&leniw,rw,&lenrw,strOpt_len,8*500);
-      char strOpt3[200] = "Major feasibility tolerance";
-      strOpt_len = strlen(strOpt3);
-      snopt::snsetr_(strOpt3,&SNOPT_MajorFeasibilityTolerance,&iPrint,&iSumm,&INFO_snopt[i],cw,&lencw,iw,&leniw,rw,&lenrw,strOpt_len,8*500);
-      char strOpt4[200] = "Superbasics limit";
-      strOpt_len = strlen(strOpt4);
-      snopt::snseti_(strOpt4,&SNOPT_SuperbasicsLimit,&iPrint,&iSumm,&INFO_snopt[i],cw,&lencw,iw,&leniw,rw,&lenrw,strOpt_len,8*500);
-      char strOpt5[200] = "Major iterations limit";
-      strOpt_len = strlen(strOpt5);
-      snopt::snseti_(strOpt5,&SNOPT_MajorIterationsLimit,&iPrint,&iSumm,&INFO_snopt[i],cw,&lencw,iw,&leniw,rw,&lenrw,strOpt_len,8*500);
-      char strOpt6[200] = "Iterations limit";
-      strOpt_len = strlen(strOpt6);
-      snopt::snseti_(strOpt6,&SNOPT_IterationsLimit,&iPrint,&iSumm,&INFO_snopt[i],cw,&lencw,iw,&leniw,rw,&lenrw,strOpt_len,8*500);
      
 
       //debug only
@@ -949,19 +1227,22 @@ void inverseKinBackend(RigidBodyManipulator* model_input, const int mode, const
       
       mxArray* nF_ptr = mxCreateDoubleScalar((double) nF);
       mxSetCell(plhs[0],11,nF_ptr);*/
-      snopt::snopta_
-        ( &Cold, &nF, &nx, &nxname, &nFname,
-          &ObjAdd, &ObjRow, Prob, snoptIKfun,
-          iAfun, jAvar, &lenA, &lenA, A,
-          iGfun, jGvar, &nG, &nG,
-          xlow, xupp, xnames, Flow, Fupp, Fnames,
-          x, xstate, xmul, F, Fstate, Fmul,
-          &INFO_snopt[i], &mincw, &miniw, &minrw,
-          &nS, &nInf, &sInf,
-          cw, &lencw, iw, &leniw, rw, &lenrw,
-          cw, &lencw, iw, &leniw, rw, &lenrw,
-          npname, 8*nxname, 8*nFname,
-          8*500, 8*500);
+      {
+        SnoptLock snopt_lock;
+        snopt::snopta_
+          ( &Start, &nF, &nx, &nxname, &nFname,
+            &ObjAdd, &ObjRow, Prob, snoptIKfun,
+            iAfun, jAvar, &lenA, &lenA, A,
+            iGfun, jGvar, &nG, &nG,
+            xlow, xupp, xnames, Flow, Fupp, Fnames,
+            x, pointwise_xstate.data(), pointwise_xmul.data(), F, pointwise_Fstate.data(), pointwise_Fmul.data(),
+            &INFO_snopt[i], &mincw, &miniw, &minrw,
+            &nS, &nInf, &sInf,
+            cu, &lencu, iu, &leniu, ru, &lenru,
+            cw, &lencw, iw, &leniw, rw, &lenrw,
+            npname, 8*nxname, 8*nFname,
+            8*lencu, 8*500);
+      }
       //snclose_(&iPrint);
       //snclose_(&iSpecs);
       vector<string> Fname(Cname_array[i]);
@@ -1032,10 +1313,18 @@ void inverseKinBackend(RigidBodyManipulator* model_input, const int mode, const
           q_sol(j,i) = q_sol(j,i)<joint_limit_max(j,i)?q_sol(j,i):joint_limit_max(j,i);
         }
       }
+      pointwise_solved = INFO[i]<10;
+      if(pointwise_solved)
+      {
+        pointwise_nS = nS;
+        pointwise_iGfun.assign(iGfun,iGfun+nG);
+        pointwise_jGvar.assign(jGvar,jGvar+nG);
+        pointwise_iAfun.assign(iAfun,iAfun+lenA);
+        pointwise_jAvar.assign(jAvar,jAvar+lenA);
+      }
       
-      
-      delete[] xmul; delete[] xstate; delete[] xnames;
-      delete[] F; delete[] Fmul; delete[] Fstate; delete[] Fnames;
+      delete[] xnames;
+      delete[] F; delete[] Fnames;
       delete[] iGfun;  delete[] jGvar;
       if(lenA>0)
       {
@@ -1089,68 +1378,43 @@ void inverseKinBackend(RigidBodyManipulator* model_input, const int mode, const
       num_qfree = nT;
       num_qdotfree = 2;
     }
-    // This part can be rewritten using the sparse matrix if efficiency becomes a concern
-    MatrixXd velocity_mat1 = MatrixXd::Zero(nq*nT,nq*nT);
-    MatrixXd velocity_mat2 = MatrixXd::Zero(nq*nT,nq*nT);
-    velocity_mat1.block(0,0,nq,nq) = MatrixXd::Identity(nq,nq);
-    velocity_mat1.block(nq*(nT-1),nq*(nT-1),nq,nq) = MatrixXd::Identity(nq,nq);
+    // The interior knot velocities solve the tridiagonal system
+    // velocity_mat1*qdot = velocity_mat2*q, with qdot0 and qdotf on the
+    // boundary rows. All dofs share the same system.
+    MatrixXd velocity_mat1 = MatrixXd::Zero(nT,nT);
+    MatrixXd velocity_mat2 = MatrixXd::Zero(nT,nT);
+    velocity_mat1(0,0) = 1.0;
+    velocity_mat1(nT-1,nT-1) = 1.0;
     for(int j = 1;j<nT-1;j++)
     {
-      double val_tmp1 = dt[j-1];
-      double val_tmp2 = dt[j-1]*(2.0+2.0*dt_ratio[j-1]);
-      double val_tmp3 = dt[j-1]*dt_ratio[j-1];
-      double val_tmp4 = 3.0-3.0*dt_ratio[j-1]*dt_ratio[j-1];
-      double val_tmp5 = 3.0-val_tmp4;
-      for(int k = 0;k<nq;k++)
-      {
-        velocity_mat1(j*nq+k,(j-1)*nq+k) = val_tmp1;
-        velocity_mat1(j*nq+k,j*nq+k) = val_tmp2;
-        velocity_mat1(j*nq+k,(j+1)*nq+k) = val_tmp3;
-        velocity_mat2(j*nq+k,(j-1)*nq+k) = -3.0;
-        velocity_mat2(j*nq+k,j*nq+k) = val_tmp4;
-        velocity_mat2(j*nq+k,(j+1)*nq+k) = val_tmp5;
-      }
-    }
-    velocity_mat.resize(nq*(nT-2),nq*nT);
-    velocity_mat = velocity_mat1.inverse().block(nq,0,nq*(nT-2),nq*nT)*velocity_mat2;
-
-    MatrixXd velocity_mat1_middle_inv = (velocity_mat1.block(nq,nq,nq*(nT-2),nq*(nT-2))).inverse();
-    velocity_mat_qd0 = -velocity_mat1_middle_inv*velocity_mat1.block(nq,0,nq*(nT-2),nq);
-    velocity_mat_qdf = -velocity_mat1_middle_inv*velocity_mat1.block(nq,nq*(nT-1),nq*(nT-2),nq);
+      velocity_mat1(j,j-1) = dt[j-1];
+      velocity_mat1(j,j) = dt[j-1]*(2.0+2.0*dt_ratio[j-1]);
+      velocity_mat1(j,j+1) = dt[j-1]*dt_ratio[j-1];
+      velocity_mat2(j,j-1) = -3.0;
+      velocity_mat2(j,j) = 3.0-3.0*dt_ratio[j-1]*dt_ratio[j-1];
+      velocity_mat2(j,j+1) = 3.0*dt_ratio[j-1]*dt_ratio[j-1];
+    }
+    PartialPivLU<MatrixXd> velocity_mat1_middle_lu(velocity_mat1.block(1,1,nT-2,nT-2));
+    velocity_mat = velocity_mat1_middle_lu.solve(velocity_mat2.block(1,0,nT-2,nT));
+    velocity_mat_qd0 = -velocity_mat1_middle_lu.solve(velocity_mat1.block(1,0,nT-2,1));
+    velocity_mat_qdf = -velocity_mat1_middle_lu.solve(velocity_mat1.block(1,nT-1,nT-2,1));
 
-    MatrixXd accel_mat1 = MatrixXd::Zero(nq*nT,nq*nT);
-    MatrixXd accel_mat2 = MatrixXd::Zero(nq*nT,nq*nT);
+    MatrixXd accel_mat1 = MatrixXd::Zero(nT,nT);
+    MatrixXd accel_mat2 = MatrixXd::Zero(nT,nT);
     for(int j = 0;j<nT-1;j++)
     {
-      double val_tmp1 = -6.0/(dt[j]*dt[j]);
-      double val_tmp2 = -val_tmp1;
-      double val_tmp3 = -4.0/dt[j];
-      double val_tmp4 = 0.5*val_tmp3;
-      for(int k = 0;k<nq;k++)
-      {
-        accel_mat1(j*nq+k,j*nq+k) = val_tmp1;
-        accel_mat1(j*nq+k,(j+1)*nq+k) = val_tmp2;
-        accel_mat2(j*nq+k,j*nq+k) = val_tmp3;
-        accel_mat2(j*nq+k,(j+1)*nq+k) = val_tmp4;
-      }
-    }
-    for(int k = 0;k<nq;k++)
-    {
-      double val_tmp1 = 6.0/(dt[nT-2]*dt[nT-2]);
-      double val_tmp2 = -val_tmp1;
-      double val_tmp3 = 2.0/dt[nT-2];
-      double val_tmp4 = 4.0/dt[nT-2];
-      accel_mat1((nT-1)*nq+k,(nT-2)*nq+k) = val_tmp1;
-      accel_mat1((nT-1)*nq+k,(nT-1)*nq+k) = val_tmp2;
-      accel_mat2((nT-1)*nq+k,(nT-2)*nq+k) = val_tmp3;
-      accel_mat2((nT-1)*nq+k,(nT-1)*nq+k) = val_tmp4;
-    }
-    accel_mat.resize(nq*nT,nq*nT);
-    accel_mat = accel_mat1+accel_mat2.block(0,nq,nq*nT,nq*(nT-2))*velocity_mat;
-    accel_mat_qd0.resize(nq*nT,nq);
-    accel_mat_qd0 = accel_mat2.block(0,0,nq*nT,nq)+accel_mat2.block(0,nq,nq*nT,nq*(nT-2))*velocity_mat_qd0;
-    accel_mat_qdf.resize(nq*nT,nq);
-    accel_mat_qdf = accel_mat2.block(0,(nT-1)*nq,nT*nq,nq)+accel_mat2.block(0,nq,nq*nT,nq*(nT-2))*velocity_mat_qdf;
+      accel_mat1(j,j) = -6.0/(dt[j]*dt[j]);
+      accel_mat1(j,j+1) = 6.0/(dt[j]*dt[j]);
+      accel_mat2(j,j) = -4.0/dt[j];
+      accel_mat2(j,j+1) = -2.0/dt[j];
+    }
+    accel_mat1(nT-1,nT-2) = 6.0/(dt[nT-2]*dt[nT-2]);
+    accel_mat1(nT-1,nT-1) = -6.0/(dt[nT-2]*dt[nT-2]);
+    accel_mat2(nT-1,nT-2) = 2.0/dt[nT-2];
+    accel_mat2(nT-1,nT-1) = 4.0/dt[nT-2];
+    accel_mat = accel_mat1+accel_mat2.block(0,1,nT,nT-2)*velocity_mat;
+    accel_mat_qd0 = accel_mat2.col(0)+accel_mat2.block(0,1,nT,nT-2)*velocity_mat_qd0;
+    accel_mat_qdf = accel_mat2.col(nT-1)+accel_mat2.block(0,1,nT,nT-2)*velocity_mat_qdf;
 
     qfree_idx = new snopt::integer[nq*num_qfree];
     qdotf_idx = new snopt::integer[nq];
@@ -1302,57 +1566,52 @@ void inverseKinBackend(RigidBodyManipulator* model_input, const int mode, const
       t_samples[nT+num_inbetween_tSamples-1] = t[nT-1];
     }
     dqInbetweendqknot = new MatrixXd[nT-1];
-    dqInbetweendqd0 = new MatrixXd[nT-1];
-    dqInbetweendqdf = new MatrixXd[nT-1];
+    dqInbetweendqd0 = new VectorXd[nT-1];
+    dqInbetweendqdf = new VectorXd[nT-1];
 
+    // The knot velocity at knot m as a linear function of the knots, qdot0 and qdotf
+    MatrixXd qdotknotdqknot = MatrixXd::Zero(nT,nT);
+    VectorXd qdotknotdqd0 = VectorXd::Zero(nT);
+    VectorXd qdotknotdqdf = VectorXd::Zero(nT);
+    qdotknotdqknot.block(1,0,nT-2,nT) = velocity_mat;
+    qdotknotdqd0.segment(1,nT-2) = velocity_mat_qd0;
+    qdotknotdqdf.segment(1,nT-2) = velocity_mat_qdf;
+    qdotknotdqd0(0) = 1.0;
+    qdotknotdqdf(nT-1) = 1.0;
     for(int i = 0;i<nT-1;i++)
     {
       VectorXd dt_ratio_inbetween_i = t_inbetween[i]/dt[i];
       int nt_sample_inbetween_i = t_inbetween[i].size();
-      dqInbetweendqknot[i] = MatrixXd::Zero(nt_sample_inbetween_i*nq,nq*nT);
-      dqInbetweendqdf[i] = MatrixXd::Zero(nt_sample_inbetween_i*nq,nq);
-      dqInbetweendqdf[i] = MatrixXd::Zero(nt_sample_inbetween_i*nq,nq);
-      MatrixXd dq_idqdknot_i = MatrixXd::Zero(nt_sample_inbetween_i*nq,nq);
-      MatrixXd dq_idqdknot_ip1 = MatrixXd::Zero(nt_sample_inbetween_i*nq,nq);
+      dqInbetweendqknot[i].resize(nt_sample_inbetween_i,nT);
+      dqInbetweendqd0[i].resize(nt_sample_inbetween_i);
+      dqInbetweendqdf[i].resize(nt_sample_inbetween_i);
       for(int j = 0;j<nt_sample_inbetween_i;j++)
       {
         double val1 = 1.0-3.0*pow(dt_ratio_inbetween_i[j],2)+2.0*pow(dt_ratio_inbetween_i[j],3);
         double val2 = 3.0*pow(dt_ratio_inbetween_i[j],2)-2.0*pow(dt_ratio_inbetween_i[j],3);
         double val3 = (1.0-2.0*dt_ratio_inbetween_i[j]+pow(dt_ratio_inbetween_i[j],2))*t_inbetween[i](j);
         double val4 = (pow(dt_ratio_inbetween_i[j],2)-dt_ratio_inbetween_i[j])*t_inbetween[i](j);
-        for(int k = 0;k<nq;k++)
-        {
-          dqInbetweendqknot[i](j*nq+k,i*nq+k) = val1;
-          dqInbetweendqknot[i](j*nq+k,(i+1)*nq+k) = val2;
-          dq_idqdknot_i(j*nq+k,k) = val3;
-          dq_idqdknot_ip1(j*nq+k,k) = val4;
-        }
-      }
-      if(i>=1 && i<=nT-3)
-      {
-        dqInbetweendqknot[i] += dq_idqdknot_i*velocity_mat.block((i-1)*nq,0,nq,nq*nT)+dq_idqdknot_ip1*velocity_mat.block(i*nq,0,nq,nq*nT);
-        dqInbetweendqd0[i] = dq_idqdknot_i*velocity_mat_qd0.block((i-1)*nq,0,nq,nq)+dq_idqdknot_ip1*velocity_mat_qd0.block(i*nq,0,nq,nq);
-        dqInbetweendqdf[i] = dq_idqdknot_i*velocity_mat_qdf.block((i-1)*nq,0,nq,nq)+dq_idqdknot_ip1*velocity_mat_qdf.block(i*nq,0,nq,nq);
-      }
-      else if(i == 0 && i != nT-2)
-      {
-        dqInbetweendqknot[i] += dq_idqdknot_ip1*velocity_mat.block(i*nq,0,nq,nq*nT);
-        dqInbetweendqd0[i] = dq_idqdknot_i+dq_idqdknot_ip1*velocity_mat_qd0.block(i*nq,0,nq,nq);
-        dqInbetweendqdf[i] = dq_idqdknot_ip1*velocity_mat_qdf.block(i*nq,0,nq,nq);
-      }
-      else if(i == nT-2&& i != 0)
-      {
-        dqInbetweendqknot[i] += dq_idqdknot_i*velocity_mat.block((i-1)*nq,0,nq,nq*nT);
-        dqInbetweendqd0[i] = dq_idqdknot_i*velocity_mat_qd0.block((i-1)*nq,0,nq,nq);
-        dqInbetweendqdf[i] = dq_idqdknot_i*velocity_mat_qdf.block((i-1)*nq,0,nq,nq)+dq_idqdknot_ip1;
-      }
-      else if(i == 0 && i == nT-2)
-      {
-        dqInbetweendqd0[i] = dq_idqdknot_i;
-        dqInbetweendqdf[i] = dq_idqdknot_ip1;
+        dqInbetweendqknot[i].row(j) = val3*qdotknotdqknot.row(i)+val4*qdotknotdqknot.row(i+1);
+        dqInbetweendqknot[i](j,i) += val1;
+        dqInbetweendqknot[i](j,i+1) += val2;
+        dqInbetweendqd0[i](j) = val3*qdotknotdqd0(i)+val4*qdotknotdqd0(i+1);
+        dqInbetweendqdf[i](j) = val3*qdotknotdqdf(i)+val4*qdotknotdqdf(i+1);
       }
     }
     
+    st_kc_traj_cols.resize(num_st_kc);
+    for(int j = 0;j<num_st_kc;j++)
+    {
+      trajDofColumns(st_kc_dofs[j],st_kc_traj_cols[j]);
+    }
+    mt_kc_traj_cols.resize(num_mt_kc);
+    for(int j = 0;j<num_mt_kc;j++)
+    {
+      vector<int> mt_kc_dofs;
+      mt_kc_array[j]->dependentDofs(mt_kc_dofs);
+      trajDofColumns(mt_kc_dofs,mt_kc_traj_cols[j]);
+    }
+
     snopt::integer* nc_inbetween_array = new snopt::integer[num_inbetween_tSamples];
     snopt::integer* nG_inbetween_array = new snopt::integer[num_inbetween_tSamples];
     VectorXd* Cmin_inbetween_array = new VectorXd[num_inbetween_tSamples];
@@ -1379,55 +1638,24 @@ void inverseKinBackend(RigidBodyManipulator* model_input, const int mode, const
         Cmin_inbetween_array[i].tail(nc) = lb;
         Cmax_inbetween_array[i].conservativeResize(Cmax_inbetween_array[i].size()+nc);
         Cmax_inbetween_array[i].tail(nc) = ub;
-        iCfun_inbetween_array[i].conservativeResize(iCfun_inbetween_array[i].size()+nc*nq*(num_qfree+num_qdotfree));
-        jCvar_inbetween_array[i].conservativeResize(jCvar_inbetween_array[i].size()+nc*nq*(num_qfree+num_qdotfree));
-        VectorXi iCfun_append = VectorXi::Zero(nc*nq*(num_qfree+num_qdotfree));
-        VectorXi jCvar_append = VectorXi::Zero(nc*nq*(num_qfree+num_qdotfree));
-        for(int k = 0;k<nq*(num_qfree+num_qdotfree);k++)
+        const vector<int> &cols = st_kc_traj_cols[j];
+        int ng = nc*cols.size();
+        iCfun_inbetween_array[i].conservativeResize(iCfun_inbetween_array[i].size()+ng);
+        jCvar_inbetween_array[i].conservativeResize(jCvar_inbetween_array[i].size()+ng);
+        VectorXi iCfun_append(ng);
+        VectorXi jCvar_append(ng);
+        for(int k = 0;k<cols.size();k++)
         {
           for(int l = 0;l<nc;l++)
           {
-            iCfun_append(k*nc+l) = nc_inbetween_array[i]+l;            
-          }
-        }
-        iCfun_inbetween_array[i].tail(nc*nq*(num_qfree+num_qdotfree)) = iCfun_append;
-        for(int k = 0;k<nq*num_qfree;k++)
-        {
-          for(int l = 0;l<nc;l++)
-          {
-            jCvar_append(k*nc+l) = qfree_idx[k];
-          }
-        }
-        if(fixInitialState)
-        {
-          for(int k = nq*num_qfree;k<nq*num_qfree+nq;k++)
-          {
-            for(int l = 0;l<nc;l++)
-            {
-              jCvar_append(k*nc+l) = qdotf_idx[k-nq*num_qfree];
-            }
+            iCfun_append(k*nc+l) = nc_inbetween_array[i]+l;
+            jCvar_append(k*nc+l) = trajVarIdx(cols[k]);
           }
         }
-        else
-        {
-          for(int k = nq*num_qfree;k<nq*num_qfree+nq;k++)
-          {
-            for(int l = 0;l<nc;l++)
-            {
-              jCvar_append(k*nc+l) = qdot0_idx[k-nq*num_qfree];
-            }
-          }
-          for(int k = nq*num_qfree+nq;k<nq*num_qfree+2*nq;k++)
-          {
-            for(int l = 0;l<nc;l++)
-            {
-              jCvar_append(k*nc+l) = qdotf_idx[k-nq*num_qfree-nq];
-            }
-          }
-        }
-        jCvar_inbetween_array[i].tail(nc*nq*(num_qfree+num_qdotfree)) = jCvar_append;
+        iCfun_inbetween_array[i].tail(ng) = iCfun_append;
+        jCvar_inbetween_array[i].tail(ng) = jCvar_append;
         nc_inbetween_array[i] += nc;
-        nG_inbetween_array[i] += nc*nq*(num_qfree+num_qdotfree);
+        nG_inbetween_array[i] += ng;
         if(debug_mode)
         {
           vector<string> constraint_name;
@@ -1527,7 +1755,7 @@ void inverseKinBackend(RigidBodyManipulator* model_input, const int mode, const
     {
       mt_kc_nc[j] = mt_kc_array[j]->getNumConstraint(t_samples+qstart_idx,num_qfree+num_inbetween_tSamples);
       nF += mt_kc_nc[j];
-      nG += mt_kc_nc[j]*nq*(num_qfree+num_qdotfree);
+      nG += mt_kc_nc[j]*mt_kc_traj_cols[j].size();
     }
     for(int j = 0;j<num_mt_lpc;j++)
     {
@@ -1673,49 +1901,16 @@ void inverseKinBackend(RigidBodyManipulator* model_input, const int mode, const
           Fname[nf_cum+k] = mtkc_name[k];
         }
       }
-      for(int l = 0;l<nq*(num_qfree+num_qdotfree);l++)
+      for(int l = 0;l<mt_kc_traj_cols[j].size();l++)
       {
         for(int k = 0;k<mt_kc_nc[j];k++)
         {
           iGfun[nG_cum+l*mt_kc_nc[j]+k] = nf_cum+k+1;
-        }
-      }
-      for(int l = 0;l<nq*num_qfree;l++)
-      {
-        for(int k = 0;k<mt_kc_nc[j];k++)
-        {
-          jGvar[nG_cum+l*mt_kc_nc[j]+k] = qfree_idx[l]+1;
-        }
-      }
-      if(fixInitialState)
-      {
-        for(int l = nq*num_qfree;l<nq*num_qfree+nq;l++)
-        {
-          for(int k = 0;k<mt_kc_nc[j];k++)
-          {
-            jGvar[nG_cum+l*mt_kc_nc[j]+k] = qdotf_idx[l-nq*num_qfree]+1;
-          }
-        }
-      }
-      else
-      {
-        for(int l=nq*num_qfree;l<nq*num_qfree+nq;l++)
-        {
-          for(int k = 0;k<mt_kc_nc[j];k++)
-          {
-            jGvar[nG_cum+l*mt_kc_nc[j]+k] = qdot0_idx[l-nq*num_qfree]+1;
-          }
-        }
-        for(int l = nq*num_qfree+nq;l<nq*num_qfree+2*nq;l++)
-        {
-          for(int k = 0;k<mt_kc_nc[j];k++)
-          {
-            jGvar[nG_cum+l*mt_kc_nc[j]+k] = qdotf_idx[l-nq*num_qfree-nq]+1;
-          }
+          jGvar[nG_cum+l*mt_kc_nc[j]+k] = trajVarIdx(mt_kc_traj_cols[j][l])+1;
         }
       }
       nf_cum += mt_kc_nc[j];
-      nG_cum += mt_kc_nc[j]*nq*(num_qfree+num_qdotfree);
+      nG_cum += mt_kc_nc[j]*mt_kc_traj_cols[j].size();
     }
 
     // parse MultipleTimeLinearPostureConstraint for t
@@ -1787,12 +1982,14 @@ void inverseKinBackend(RigidBodyManipulator* model_input, const int mode, const
       }
     }
     snopt::integer minrw,miniw,mincw;
-    snopt::integer lenrw = 20000000, leniw = 2000000, lencw = 5000;
-    snopt::doublereal* rw;
-    rw = (snopt::doublereal*) std::calloc(lenrw,sizeof(snopt::doublereal));
-    snopt::integer* iw;
-    iw = (snopt::integer*) std::calloc(leniw,sizeof(snopt::integer));
-    char cw[8*lencw];
+    // the user workspace, separate from SNOPT's own, only tells the
+    // callbacks which problem they are evaluating
+    char cu[8];
+    snopt::integer lencu = 1;
+    snopt::integer iu[1] = {problem_index};
+    snopt::integer leniu = 1;
+    snopt::doublereal ru[1];
+    snopt::integer lenru = 1;
 
     snopt::integer Cold = 0; //, Basis = 1; //, Warm = 2;
     snopt::doublereal *xmul = new snopt::doublereal[nx];
@@ -1819,33 +2016,9 @@ void inverseKinBackend(RigidBodyManipulator* model_input, const int mode, const
     char* Fnames = new char[nFname*8];
     char Prob[200];
 
-//    snopt::integer iSpecs = -1, spec_len;
-    snopt::integer iSumm = -1;
-    snopt::integer iPrint = -1; //, prnt_len;
-
 
     snopt::integer nS, nInf;
     snopt::doublereal sInf;
-
-    snopt::sninit_(&iPrint,&iSumm,cw,&lencw,iw,&leniw,rw,&lenrw,8*500);
-    char strOpt1[200] = "Derivative option";
-    snopt::integer DerOpt = 1, strOpt_len = strlen(strOpt1);
-    snopt::snseti_(strOpt1,&DerOpt,&iPrint,&iSumm,INFO_snopt,cw,&lencw,iw,&leniw,rw,&lenrw,strOpt_len,8*500);
-    char strOpt2[200] = "Major optimality tolerance";
-    strOpt_len = strlen(strOpt2);
-    snopt::snsetr_(strOpt2,&SNOPT_MajorOptimalityTolerance,&iPrint,&iSumm,INFO_snopt,cw,&lencw,iw,&leniw,rw,&lenrw,strOpt_len,8*500);
-    char strOpt3[200] = "Major feasibility tolerance";
-    strOpt_len = strlen(strOpt3);
-    snopt::snsetr_(strOpt3,&SNOPT_MajorFeasibilityTolerance,&iPrint,&iSumm,INFO_snopt,cw,&lencw,iw,&leniw,rw,&lenrw,strOpt_len,8*500);
-    char strOpt4[200] = "Superbasics limit";
-    strOpt_len = strlen(strOpt4);
-    snopt::snseti_(strOpt4,&SNOPT_SuperbasicsLimit,&iPrint,&iSumm,INFO_snopt,cw,&lencw,iw,&leniw,rw,&lenrw,strOpt_len,8*500);
-    char strOpt5[200] = "Major iterations limit";
-    strOpt_len = strlen(strOpt5);
-    snopt::snseti_(strOpt5,&SNOPT_MajorIterationsLimit,&iPrint,&iSumm,INFO_snopt,cw,&lencw,iw,&leniw,rw,&lenrw,strOpt_len,8*500);
-    char strOpt6[200] = "Iterations limit";
-    strOpt_len = strlen(strOpt6);
-    snopt::snseti_(strOpt6,&SNOPT_IterationsLimit,&iPrint,&iSumm,INFO_snopt,cw,&lencw,iw,&leniw,rw,&lenrw,strOpt_len,8*500);
     //debug only
     /*MATFile *pmat;
     pmat = matOpen("inverseKinBackend_cpp.mat","w");
@@ -1924,22 +2097,22 @@ void inverseKinBackend(RigidBodyManipulator* model_input, const int mode, const
     matPutVariable(pmat,"jAvar",jAvar_ptr);
     matPutVariable(pmat,"A",A_ptr);
     printf("got iAfun jAvar A\n"); 
-    mxArray* velocity_mat_ptr = mxCreateDoubleMatrix(nq*(nT-2),nq*nT,mxREAL);
-    memcpy(mxGetPr(velocity_mat_ptr),velocity_mat.data(),sizeof(double)*nq*(nT-2)*nq*nT);
+    mxArray* velocity_mat_ptr = mxCreateDoubleMatrix(velocity_mat.rows(),velocity_mat.cols(),mxREAL);
+    memcpy(mxGetPr(velocity_mat_ptr),velocity_mat.data(),sizeof(double)*velocity_mat.size());
     matPutVariable(pmat,"velocity_mat",velocity_mat_ptr);
-    mxArray* velocity_mat_qd0_ptr = mxCreateDoubleMatrix(nq*(nT-2),nq,mxREAL);
+    mxArray* velocity_mat_qd0_ptr = mxCreateDoubleMatrix(velocity_mat_qd0.rows(),velocity_mat_qd0.cols(),mxREAL);
     memcpy(mxGetPr(velocity_mat_qd0_ptr),velocity_mat_qd0.data(),sizeof(double)*velocity_mat_qd0.size());
     matPutVariable(pmat,"velocity_mat_qd0",velocity_mat_qd0_ptr);
-    mxArray* velocity_mat_qdf_ptr = mxCreateDoubleMatrix(nq*(nT-2),nq,mxREAL);
+    mxArray* velocity_mat_qdf_ptr = mxCreateDoubleMatrix(velocity_mat_qdf.rows(),velocity_mat_qdf.cols(),mxREAL);
     memcpy(mxGetPr(velocity_mat_qdf_ptr),velocity_mat_qdf.data(),sizeof(double)*velocity_mat_qdf.size());
     matPutVariable(pmat,"velocity_mat_qdf",velocity_mat_qdf_ptr);
-    mxArray* accel_mat_ptr = mxCreateDoubleMatrix(nq*nT,nq*nT,mxREAL);
+    mxArray* accel_mat_ptr = mxCreateDoubleMatrix(accel_mat.rows(),accel_mat.cols(),mxREAL);
     memcpy(mxGetPr(accel_mat_ptr),accel_mat.data(),sizeof(double)*accel_mat.size());
     matPutVariable(pmat,"accel_mat",accel_mat_ptr);
-    mxArray* accel_mat_qd0_ptr = mxCreateDoubleMatrix(nq*nT,nq,mxREAL);
+    mxArray* accel_mat_qd0_ptr = mxCreateDoubleMatrix(accel_mat_qd0.rows(),accel_mat_qd0.cols(),mxREAL);
     memcpy(mxGetPr(accel_mat_qd0_ptr),accel_mat_qd0.data(),sizeof(double)*accel_mat_qd0.size());
     matPutVariable(pmat,"accel_mat_qd0",accel_mat_qd0_ptr);
-    mxArray* accel_mat_qdf_ptr = mxCreateDoubleMatrix(nq*nT,nq,mxREAL);
+    mxArray* accel_mat_qdf_ptr = mxCreateDoubleMatrix(accel_mat_qdf.rows(),accel_mat_qdf.cols(),mxREAL);
     memcpy(mxGetPr(accel_mat_qdf_ptr),accel_mat_qdf.data(),sizeof(double)*accel_mat_qdf.size());
     matPutVariable(pmat,"accel_mat_qdf",accel_mat_qdf_ptr);
     mxArray** dqInbetweendqknot_ptr = new mxArray*[nT-1];
@@ -1954,9 +2127,22 @@ void inverseKinBackend(RigidBodyManipulator* model_input, const int mode, const
       dqInbetweendqknot_ptr[i] = mxCreateDoubleMatrix(nq*t_inbetween[i].size(),nq*nT,mxREAL); 
       dqInbetweendqd0_ptr[i] = mxCreateDoubleMatrix(nq*t_inbetween[i].size(),nq,mxREAL); 
       dqInbetweendqdf_ptr[i] = mxCreateDoubleMatrix(nq*t_inbetween[i].size(),nq,mxREAL); 
-      memcpy(mxGetPr(dqInbetweendqknot_ptr[i]),dqInbetweendqknot[i].data(),sizeof(double)*dqInbetweendqknot[i].size());
-      memcpy(mxGetPr(dqInbetweendqd0_ptr[i]),dqInbetweendqd0[i].data(),sizeof(double)*dqInbetweendqd0[i].size());
-      memcpy(mxGetPr(dqInbetweendqdf_ptr[i]),dqInbetweendqdf[i].data(),sizeof(double)*dqInbetweendqdf[i].size());
+      // the full (nt_i*nq) x (nq*nT) maps of the matlab version
+      MatrixXd dqInbetweendqknot_full = MatrixXd::Zero(nq*t_inbetween[i].size(),nq*nT);
+      MatrixXd dqInbetweendqd0_full = MatrixXd::Zero(nq*t_inbetween[i].size(),nq);
+      MatrixXd dqInbetweendqdf_full = MatrixXd::Zero(nq*t_inbetween[i].size(),nq);
+      for(int j = 0;j<t_inbetween[i].size();j++)
+      {
+        for(int m = 0;m<nT;m++)
+        {
+          dqInbetweendqknot_full.block(j*nq,m*nq,nq,nq).diagonal().setConstant(dqInbetweendqknot[i](j,m));
+        }
+        dqInbetweendqd0_full.block(j*nq,0,nq,nq).diagonal().setConstant(dqInbetweendqd0[i](j));
+        dqInbetweendqdf_full.block(j*nq,0,nq,nq).diagonal().setConstant(dqInbetweendqdf[i](j));
+      }
+      memcpy(mxGetPr(dqInbetweendqknot_ptr[i]),dqInbetweendqknot_full.data(),sizeof(double)*dqInbetweendqknot_full.size());
+      memcpy(mxGetPr(dqInbetweendqd0_ptr[i]),dqInbetweendqd0_full.data(),sizeof(double)*dqInbetweendqd0_full.size());
+      memcpy(mxGetPr(dqInbetweendqdf_ptr[i]),dqInbetweendqdf_full.data(),sizeof(double)*dqInbetweendqdf_full.size());
       mxSetCell(dqInbetweendqknot_cell,i,dqInbetweendqknot_ptr[i]);
       mxSetCell(dqInbetweendqd0_cell,i,dqInbetweendqd0_ptr[i]);
       mxSetCell(dqInbetweendqdf_cell,i,dqInbetweendqdf_ptr[i]);
@@ -1996,53 +2182,25 @@ void inverseKinBackend(RigidBodyManipulator* model_input, const int mode, const
     // end of debugging
     */
 
-    snopt::snopta_
-      ( &Cold, &nF, &nx, &nxname, &nFname,
-        &ObjAdd, &ObjRow, Prob, snoptIKtrajfun,
-        iAfun, jAvar, &lenA, &lenA, A,
-        iGfun, jGvar, &nG, &nG,
-        xlow, xupp, xnames, Flow, Fupp, Fnames,
-        x, xstate, xmul, F, Fstate, Fmul,
-        INFO_snopt, &mincw, &miniw, &minrw,
-        &nS, &nInf, &sInf,
-        cw, &lencw, iw, &leniw, rw, &lenrw,
-        cw, &lencw, iw, &leniw, rw, &lenrw,
-        npname, 8*nxname, 8*nFname,
-        8*500, 8*500);
-    if(*INFO_snopt == 41)
-    {
-      nx_tmp = nx;
-      nG_tmp = nG;
-      nF_tmp = nF;
-      MatrixXd df_numerical(nF,nx);
-      VectorXd x_vec(nx_tmp);
-      memcpy(x_vec.data(),x,sizeof(double)*nx);
-      VectorXd c_vec(nF_tmp);
-      VectorXd G_vec(nG_tmp);
-      snoptIKtraj_userfun(x_vec,c_vec,G_vec);
-      MatrixXd df_userfun = MatrixXd::Zero(nF,nx);
-      for(int i = 0;i<nG;i++)
-      {
-        df_userfun(iGfun[i]-1,jGvar[i]-1) = G_vec(i);
-      }
-      gevalNumerical(&snoptIKtraj_fevalfun,x_vec,c_vec,df_numerical);
-      MatrixXd df_err = df_userfun-df_numerical;
-      df_err = df_err.cwiseAbs();
-      int max_err_row,max_err_col;
-      double max_err;
-      max_err = df_err.maxCoeff(&max_err_row,&max_err_col);
-      printf("The maximum gradient numerical error is %e, in row %d, col %d\nuser gradient is %e\n2nd order numerical gradient is %e\n",max_err,max_err_row+1,max_err_col+1,df_userfun(max_err_row,max_err_col),df_numerical(max_err_row,max_err_col));
-      MatrixXd df_numerical2;
-      gevalNumerical(&snoptIKtraj_fevalfun,x_vec,c_vec,df_numerical2,1);
-      printf("1st order numerical gradient is %e\n",df_numerical2(max_err_row,max_err_col));
-//      double err = 1e-10;
-      VectorXd x_vec_err(nx_tmp);
-      x_vec_err = VectorXd::Zero(nx_tmp);
-      x_vec_err(max_err_col) = 1e-10;
-      VectorXd G_vec1(nG_tmp);
-      VectorXd G_vec2(nG_tmp);
-      MatrixXd df_err2 = df_err.block(1,0,nF-1,nx);
-      printf("The maximum gradient numerical error, except in the cost function, is %e\n",df_err2.maxCoeff());
+    {
+      SnoptLock snopt_lock;
+      snopt::snopta_
+        ( &Cold, &nF, &nx, &nxname, &nFname,
+          &ObjAdd, &ObjRow, Prob, snoptIKtrajfun,
+          iAfun, jAvar, &lenA, &lenA, A,
+          iGfun, jGvar, &nG, &nG,
+          xlow, xupp, xnames, Flow, Fupp, Fnames,
+          x, xstate, xmul, F, Fstate, Fmul,
+          INFO_snopt, &mincw, &miniw, &minrw,
+          &nS, &nInf, &sInf,
+          cu, &lencu, iu, &leniu, ru, &lenru,
+          cw, &lencw, iw, &leniw, rw, &lenrw,
+          npname, 8*nxname, 8*nFname,
+          8*lencu, 8*500);
+    }
+    if(debug_mode && *INFO_snopt == 41)
+    {
+      checkIKtrajGradient(x,iGfun,jGvar);
     }
     VectorXd qdot0(nq);
     VectorXd qdotf(nq);
@@ -2082,15 +2240,8 @@ void inverseKinBackend(RigidBodyManipulator* model_input, const int mode, const
     }
     qdot_sol.block(0,0,nq,1) = qdot0;
     qdot_sol.block(0,nT-1,nq,1) = qdotf;
-    MatrixXd q_sol_tmp = q_sol;
-    q_sol_tmp.resize(nq*nT,1);
-    MatrixXd qdot_sol_tmp = velocity_mat*q_sol_tmp;
-    qdot_sol_tmp.resize(nq,nT-2);
-    qdot_sol.block(0,1,nq,nT-2) = qdot_sol_tmp;
-    MatrixXd qddot_sol_tmp(nq*nT,1);
-    qddot_sol_tmp= accel_mat*q_sol_tmp+accel_mat_qd0*qdot0+accel_mat_qdf*qdotf; 
-    qddot_sol_tmp.resize(nq,nT);
-    qddot_sol = qddot_sol_tmp;
+    qdot_sol.block(0,1,nq,nT-2) = q_sol*velocity_mat.transpose();
+    qddot_sol = q_sol*accel_mat.transpose()+qdot0*accel_mat_qd0.transpose()+qdotf*accel_mat_qdf.transpose();
 
     if(*INFO_snopt == 13 || *INFO_snopt == 31 || *INFO_snopt == 32)
     {
@@ -2145,7 +2296,6 @@ void inverseKinBackend(RigidBodyManipulator* model_input, const int mode, const
     }
     *INFO = static_cast<int>(*INFO_snopt);
 
-    delete rw;
     delete[] xmul; delete[] xstate; delete[] xnames; 
     delete[] F; delete[] Fmul; delete[] Fstate; delete[] Fnames;
     delete[] iGfun;  delete[] jGvar;
@@ -2175,15 +2325,179 @@ void inverseKinBackend(RigidBodyManipulator* model_input, const int mode, const
   delete[] iCfun_array; delete[] jCvar_array; 
   delete[] Cmin_array; delete[] Cmax_array; delete[] Cname_array;
   delete[] nc_array; delete[] nG_array; delete[] nA_array;
-  delete[] st_lpc_nc;
-  delete[] st_kc_array;
-  delete[] mt_kc_array;
-  delete[] st_lpc_array;
-  delete[] mt_lpc_array;
 }
+template <typename DerivedA, typename DerivedB, typename DerivedC, typename DerivedD, typename DerivedE>
+void inverseKinBackend(RigidBodyManipulator* model, const int mode, const int nT, const double* t, const MatrixBase<DerivedA> &q_seed, const MatrixBase<DerivedB> &q_nom, const int num_constraints, RigidBodyConstraint** const constraint_array, MatrixBase<DerivedC> &q_sol, MatrixBase<DerivedD> &qdot_sol, MatrixBase<DerivedE> &qddot_sol, int* INFO, vector<string> &infeasible_constraint, const IKoptions &ikoptions)
+{
+  InverseKinProblem problem;
+  problem.solve(model,mode,nT,t,q_seed,q_nom,num_constraints,constraint_array,q_sol,qdot_sol,qddot_sol,INFO,infeasible_constraint,ikoptions);
+}
+
 template void inverseKinBackend(RigidBodyManipulator* model, const int mode, const int nT, const double* t, const MatrixBase<Map<MatrixXd>> &q_seed, const MatrixBase<Map<MatrixXd>> &q_nom, const int num_constraints, RigidBodyConstraint** const constraint_array, MatrixBase<Map<MatrixXd>> &q_sol, MatrixBase<Map<MatrixXd>> &qdot_sol, MatrixBase<Map<MatrixXd>> &qddot_sol, int* INFO, vector<string> &infeasible_constraint, const IKoptions &ikoptions);
 template void inverseKinBackend(RigidBodyManipulator* model, const int mode, const int nT, const double* t, const MatrixBase<MatrixXd> &q_seed, const MatrixBase<MatrixXd> &q_nom, const int num_constraints, RigidBodyConstraint** const constraint_array, MatrixBase<MatrixXd> &q_sol, MatrixBase<MatrixXd> &qdot_sol, MatrixBase<MatrixXd> &qddot_sol, int* INFO, vector<string> &infeasible_constraint, const IKoptions &ikoptions);
 template void inverseKinBackend(RigidBodyManipulator* model, const int mode, const int nT, const double* t, const MatrixBase<Map<MatrixXd>> &q_seed, const MatrixBase<Map<MatrixXd>> &q_nom, const int num_constraints, RigidBodyConstraint** const constraint_array, MatrixBase<Map<MatrixXd>> &q_sol, MatrixBase<MatrixXd> &qdot_sol, MatrixBase<MatrixXd> &qddot_sol, int* INFO, vector<string> &infeasible_constraint, const IKoptions &ikoptions);
 template void inverseKinBackend(RigidBodyManipulator* model, const int mode, const int nT, const double* t, const MatrixBase<Map<VectorXd>> &q_seed, const MatrixBase<Map<VectorXd>> &q_nom, const int num_constraints, RigidBodyConstraint** const constraint_array, MatrixBase<Map<VectorXd>> &q_sol, MatrixBase<Map<VectorXd>> &qdot_sol, MatrixBase<Map<VectorXd>> &qddot_sol, int* INFO, vector<string> &infeasible_constraint, const IKoptions &ikoptions);
 template void inverseKinBackend(RigidBodyManipulator* model, const int mode, const int nT, const double* t, const MatrixBase<VectorXd> &q_seed, const MatrixBase<VectorXd> &q_nom, const int num_constraints, RigidBodyConstraint** const constraint_array, MatrixBase<VectorXd> &q_sol, MatrixBase<VectorXd> &qdot_sol, MatrixBase<VectorXd> &qddot_sol, int* INFO, vector<string> &infeasible_constraint, const IKoptions &ikoptions);
 template void inverseKinBackend(RigidBodyManipulator* model, const int mode, const int nT, const double* t, const MatrixBase<Map<VectorXd>> &q_seed, const MatrixBase<Map<VectorXd>> &q_nom, const int num_constraints, RigidBodyConstraint** const constraint_array, MatrixBase<Map<VectorXd>> &q_sol, MatrixBase<VectorXd> &qdot_sol, MatrixBase<VectorXd> &qddot_sol, int* INFO, vector<string> &infeasible_constraint, const IKoptions &ikoptions);
+
+class InverseKinPointwiseSession::Impl
+{
+  public:
+    Impl(const IKoptions &ikoptions) : ikoptions(ikoptions) {};
+
+    InverseKinProblem problem;
+    IKoptions ikoptions;
+};
+
+InverseKinPointwiseSession::InverseKinPointwiseSession(RigidBodyManipulator* model, const int num_constraints, RigidBodyConstraint** const constraint_array, const IKoptions &ikoptions)
+  : impl(new Impl(ikoptions))
+{
+  impl->problem.setConstraints(model,num_constraints,constraint_array);
+  impl->problem.initSnopt(10000000,500000,500,ikoptions);
+  impl->problem.warm_start_first_knot = true;
+}
+
+InverseKinPointwiseSession::~InverseKinPointwiseSession()
+{
+}
+
+template <typename DerivedA, typename DerivedB, typename DerivedC>
+void InverseKinPointwiseSession::solve(double t, const MatrixBase<DerivedA> &q_seed, const MatrixBase<DerivedB> &q_nom, MatrixBase<DerivedC> &q_sol, int &INFO, vector<string> &infeasible_constraint)
+{
+  VectorXd qdot_dummy, qddot_dummy;
+  impl->problem.solveKnots(1,1,&t,q_seed,q_nom,q_sol,qdot_dummy,qddot_dummy,&INFO,infeasible_constraint,impl->ikoptions);
+}
+
+template void InverseKinPointwiseSession::solve(double t, const MatrixBase<VectorXd> &q_seed, const MatrixBase<VectorXd> &q_nom, MatrixBase<VectorXd> &q_sol, int &INFO, vector<string> &infeasible_constraint);
+template void InverseKinPointwiseSession::solve(double t, const MatrixBase<Map<VectorXd>> &q_seed, const MatrixBase<Map<VectorXd>> &q_nom, MatrixBase<Map<VectorXd>> &q_sol, int &INFO, vector<string> &infeasible_constraint);
+
+int InverseKinPointwiseSession::numWarmStarts() const
+{
+  return impl->problem.num_warm_starts;
+}
+
+void inverseKinMultiStart(const vector<RigidBodyManipulator*> &models, const vector<RigidBodyConstraint**> &constraint_arrays, const int num_constraints, const MatrixXd &q_seed, const VectorXd &q_nom, const int num_random_seeds, VectorXd &q_sol, int &INFO, vector<string> &infeasible_constraint, vector<IKSeedStatistics> &seed_statistics, const IKoptions &ikoptions)
+{
+  // what the caller gets back if the arguments are bad: SNOPT's INFO for an invalid input
+  q_sol = q_nom;
+  INFO = 91;
+  infeasible_constraint.clear();
+  seed_statistics.clear();
+  if(models.empty() || models.size() != constraint_arrays.size())
+  {
+    cerr<<"Drake:inverseKinMultiStart: models and constraint_arrays must have the same nonzero length"<<endl;
+    return;
+  }
+  int nq = models[0]->num_dof;
+  if(q_nom.size() != nq || (q_seed.cols()>0 && q_seed.rows() != nq))
+  {
+    cerr<<"Drake:inverseKinMultiStart: q_seed must be nq x k and q_nom nq x 1"<<endl;
+    return;
+  }
+  if(num_random_seeds<0 || q_seed.cols()+num_random_seeds<1)
+  {
+    cerr<<"Drake:inverseKinMultiStart: needs at least one seed"<<endl;
+    return;
+  }
+  int num_user_seeds = q_seed.cols();
+  int num_seeds = num_user_seeds+num_random_seeds;
+  MatrixXd seeds(nq,num_seeds);
+  seeds.leftCols(num_user_seeds) = q_seed;
+  // a fixed generator seed, so that a call can be reproduced
+  mt19937 generator(0);
+  uniform_real_distribution<double> uniform(0.0,1.0);
+  for(int i = num_user_seeds;i<num_seeds;i++)
+  {
+    for(int k = 0;k<nq;k++)
+    {
+      double lb = models[0]->joint_limit_min(k);
+      double ub = models[0]->joint_limit_max(k);
+      seeds(k,i) = (std::isinf(lb) || std::isinf(ub))? q_nom(k) : lb+(ub-lb)*uniform(generator);
+    }
+  }
+
+  int num_threads = models.size();
+  vector<unique_ptr<InverseKinProblem>> problems(num_threads);
+  vector<vector<string>> seed_infeasible_constraint(num_seeds);
+  seed_statistics.resize(num_seeds);
+  atomic<bool> found(false);
+  auto solve_seed = [&](int thread_index,int i) {
+    IKSeedStatistics &stats = seed_statistics[i];
+    stats.q_seed = seeds.col(i);
+    stats.q_sol = stats.q_seed;
+    stats.INFO = -1;
+    stats.cancelled = found;
+    stats.solve_time = 0.0;
+    if(stats.cancelled)
+    {
+      return;
+    }
+    unique_ptr<InverseKinProblem> &problem = problems[thread_index];
+    if(!problem)
+    {
+      problem.reset(new InverseKinProblem());
+      problem->setConstraints(models[thread_index],num_constraints,constraint_arrays[thread_index]);
+      problem->initSnopt(10000000,500000,500,ikoptions);
+      problem->cancel = &found;
+    }
+    VectorXd qdot_dummy, qddot_dummy;
+    auto start = chrono::steady_clock::now();
+    problem->solveKnots(1,1,nullptr,stats.q_seed,q_nom,stats.q_sol,qdot_dummy,qddot_dummy,&stats.INFO,seed_infeasible_constraint[i],ikoptions);
+    stats.solve_time = chrono::duration<double>(chrono::steady_clock::now()-start).count();
+    if(stats.INFO<10)
+    {
+      found = true;
+    }
+    stats.cancelled = stats.INFO == 71;
+  };
+#ifdef SNOPT_REENTRANT
+  ThreadPool pool(num_threads);
+  pool.parallelFor(num_seeds,solve_seed);
+#else
+  // each solve holds SnoptLock from start to finish, kinematics included, so
+  // extra threads would only wait for it.  solve the seeds in order on this
+  // thread with models[0], and skip the rest once one succeeds
+  for(int i = 0;i<num_seeds;i++)
+  {
+    solve_seed(0,i);
+  }
+#endif
+
+  // the successful solution closest to q_nom.  if no seed succeeded, the one
+  // with the fewest infeasible constraints, and of those the lowest INFO
+  MatrixXd Q;
+  ikoptions.getQ(Q);
+  int best = -1;
+  double best_cost = numeric_limits<double>::infinity();
+  for(int i = 0;i<num_seeds;i++)
+  {
+    if(seed_statistics[i].INFO>=0 && seed_statistics[i].INFO<10)
+    {
+      VectorXd q_err = seed_statistics[i].q_sol-q_nom;
+      double cost = q_err.transpose()*Q*q_err;
+      if(cost<best_cost)
+      {
+        best = i;
+        best_cost = cost;
+      }
+    }
+  }
+  if(best<0)
+  {
+    for(int i = 0;i<num_seeds;i++)
+    {
+      if(seed_statistics[i].INFO<0)
+      {
+        continue;
+      }
+      if(best<0 || seed_infeasible_constraint[i].size()<seed_infeasible_constraint[best].size() ||
+         (seed_infeasible_constraint[i].size()==seed_infeasible_constraint[best].size() && seed_statistics[i].INFO<seed_statistics[best].INFO))
+      {
+        best = i;
+      }
+    }
+  }
+  q_sol = seed_statistics[best].q_sol;
+  INFO = seed_statistics[best].INFO;
+  infeasible_constraint = seed_infeasible_constraint[best];
+}
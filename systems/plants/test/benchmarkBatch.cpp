@@ -0,0 +1,88 @@
+/*
+ * Checks the batch (multi-configuration) methods against evaluating the
+ * configurations one at a time, and times them with one thread and with one
+ * thread per core.
+ */
+#include <iostream>
+#include <cstdio>
+#include <chrono>
+#include "chainModel.h"
+
+using namespace std;
+using namespace Eigen;
+
+double seconds(chrono::high_resolution_clock::time_point start)
+{
+  return chrono::duration_cast<chrono::nanoseconds>(chrono::high_resolution_clock::now()-start).count()/1e9;
+}
+
+int main()
+{
+  const int N = 200;  // e.g. the knot points of a trajectory
+  const double tol = 1e-10;
+
+  RigidBodyManipulator* model = createRevoluteChain(24);
+  int n = model->num_dof;
+  MatrixXd q = MatrixXd::Random(n,N), qd = MatrixXd::Random(n,N), qdd = MatrixXd::Random(n,N);
+  MatrixXd pts = MatrixXd::Zero(4,1);
+  pts << 1,0,0,1;
+  int body = model->num_bodies-1;
+
+  vector<MatrixXd> x, J, H, dtau;
+  MatrixXd com, C, tau, qdd_fd;
+  model->setNumThreads(4);  // exercise the thread pool even on a single-core machine
+  model->forwardKinBatch(body,pts,1,q,x,&J);
+  model->getCOMBatch(q,com);
+  model->HandCBatch(q,qd,H,C);
+  model->inverseDynamicsBatch(q,qd,qdd,tau,&dtau);
+  model->forwardDynamicsBatch(q,qd,tau,qdd_fd);
+
+  double err = 0.0;
+  MatrixXd xk, Jk(6,n), Hk(n,n), dtauk(n,2*n), comk;
+  VectorXd Ck(n), tauk(n);
+  for (int k=0; k<N; k++) {
+    VectorXd qk = q.col(k), qdk = qd.col(k), qddk = qdd.col(k);
+    model->doKinematics(qk.data());
+    model->forwardKin(body,pts,1,xk);
+    model->forwardJac(body,pts,1,Jk);
+    model->getCOM(comk);
+    model->HandC(qk.data(),qdk.data(),(MatrixXd*)NULL,Hk,Ck,(MatrixXd*)NULL,(MatrixXd*)NULL,(MatrixXd*)NULL);
+    model->inverseDynamics(qk.data(),qdk.data(),qddk,(MatrixXd*)NULL,tauk,&dtauk,(MatrixXd*)NULL);
+    err = max(err,(xk-x[k]).lpNorm<Infinity>());
+    err = max(err,(Jk-J[k]).lpNorm<Infinity>());
+    err = max(err,(comk-com.col(k)).lpNorm<Infinity>());
+    err = max(err,(Hk-H[k]).lpNorm<Infinity>());
+    err = max(err,(Ck-C.col(k)).lpNorm<Infinity>());
+    err = max(err,(tauk-tau.col(k)).lpNorm<Infinity>());
+    err = max(err,(dtauk-dtau[k]).lpNorm<Infinity>());
+    err = max(err,(qddk-qdd_fd.col(k)).lpNorm<Infinity>()/(1.0+qddk.lpNorm<Infinity>()));
+  }
+  if (err > tol) {
+    cerr << "batch results do not match the sequential ones (error " << err << ")" << endl;
+    return 1;
+  }
+
+  int num_threads[] = {1, 0};
+  for (int t=0; t<2; t++) {
+    model->setNumThreads(num_threads[t]);
+    model->forwardKinBatch(body,pts,1,q,x,&J);  // warm up the workspaces
+
+    auto start = chrono::high_resolution_clock::now();
+    model->forwardKinBatch(body,pts,1,q,x,&J);
+    double t_kin = seconds(start);
+
+    start = chrono::high_resolution_clock::now();
+    model->HandCBatch(q,qd,H,C);
+    double t_handc = seconds(start);
+
+    start = chrono::high_resolution_clock::now();
+    model->inverseDynamicsBatch(q,qd,qdd,tau,&dtau);
+    double t_id = seconds(start);
+
+    printf("%s: forwardKin+Jac %7.2f ms, HandC %7.2f ms, inverseDynamics with gradients %7.2f ms (%d configurations)\n",
+           num_threads[t]==1 ? "1 thread    " : "all threads ", t_kin*1e3, t_handc*1e3, t_id*1e3, N);
+  }
+
+  delete model;
+  return 0;
+}
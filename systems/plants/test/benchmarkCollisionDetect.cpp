@@ -0,0 +1,138 @@
+/*
+ * Times the all-pairs collisionDetect against the version that only reports
+ * the pairs closer than a threshold (and culls the rest in the broadphase),
+ * and checks that the two agree on the pairs within the threshold and within
+ * the median pair distance.  Then times doKinematics + allCollisions on a
+ * scene where every joint moves and on a mostly static one where only the
+ * last joint does, and prints how many collision elements were refreshed and
+ * skipped in each.
+ */
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include "URDFRigidBodyManipulator.h"
+
+using namespace std;
+
+double seconds(chrono::high_resolution_clock::time_point start)
+{
+  return chrono::duration_cast<chrono::nanoseconds>(chrono::high_resolution_clock::now()-start).count()/1e9;
+}
+
+// both visit the pairs in the same order, so the thresholded results are a subsequence
+bool matchesAllPairs(int k, double threshold, const VectorXd& phi, const MatrixXd& xA, const MatrixXd& xB,
+                     const vector<int>& bodyA_idx, const vector<int>& bodyB_idx,
+                     const VectorXd& phi_t, const MatrixXd& xA_t, const MatrixXd& xB_t,
+                     const vector<int>& bodyA_idx_t, const vector<int>& bodyB_idx_t)
+{
+  const double tol = 1e-10;
+  int j = 0;
+  for (int i=0; i<phi.size(); i++) {
+    if (phi(i) > threshold) continue;
+    if (j >= phi_t.size() || bodyA_idx[i] != bodyA_idx_t[j] || bodyB_idx[i] != bodyB_idx_t[j] ||
+        fabs(phi(i)-phi_t(j)) > tol || (xA.col(i)-xA_t.col(j)).lpNorm<Infinity>() > tol ||
+        (xB.col(i)-xB_t.col(j)).lpNorm<Infinity>() > tol) {
+      cerr << "configuration " << k << ": the pairs within " << threshold << " m do not match the all-pairs results" << endl;
+      return false;
+    }
+    j++;
+  }
+  if (j != phi_t.size()) {
+    cerr << "configuration " << k << ": " << phi_t.size()-j << " extra pairs beyond the threshold" << endl;
+    return false;
+  }
+  return true;
+}
+
+int main(int argc, char* argv[])
+{
+  const int N = 50;
+  const double threshold = 0.05;
+
+  const char* urdf = (argc>1) ? argv[1] : "examples/Atlas/urdf/atlas_convex_hull.urdf";
+  URDFRigidBodyManipulator* model = loadURDFfromFile(urdf);
+  if (!model) {
+    cerr << "ERROR: Failed to load model from " << urdf << endl;
+    return -1;
+  }
+
+  srand(0);
+  double t_all = 0.0, t_threshold = 0.0;
+  int num_all = 0, num_threshold = 0, num_median = 0;
+  for (int k=0; k<N; k++) {
+    VectorXd q = 0.3*VectorXd::Random(model->num_dof);
+    model->doKinematics(q.data(),false);
+
+    VectorXd phi, phi_t;
+    MatrixXd normal, xA, xB, normal_t, xA_t, xB_t;
+    vector<int> bodyA_idx, bodyB_idx, bodies_idx, bodyA_idx_t, bodyB_idx_t, bodies_idx_t;
+
+    auto start = chrono::high_resolution_clock::now();
+    model->collisionDetect(phi,normal,xA,xB,bodyA_idx,bodyB_idx,bodies_idx);
+    t_all += seconds(start);
+
+    start = chrono::high_resolution_clock::now();
+    model->collisionDetect(phi_t,normal_t,xA_t,xB_t,bodyA_idx_t,bodyB_idx_t,bodies_idx_t,threshold);
+    t_threshold += seconds(start);
+
+    if (!matchesAllPairs(k,threshold,phi,xA,xB,bodyA_idx,bodyB_idx,phi_t,xA_t,xB_t,bodyA_idx_t,bodyB_idx_t))
+      return 1;
+    num_all += phi.size();
+    num_threshold += phi_t.size();
+
+    // and at the median distance, so that about half of the pairs are compared
+    // even if nothing on the model comes within the fixed threshold
+    // (collisionDetect appends to the body index vectors)
+    if (phi.size() == 0) {
+      cerr << urdf << " has no pairs of bodies that can collide" << endl;
+      return 1;
+    }
+    vector<double> sorted_phi(phi.data(),phi.data()+phi.size());
+    nth_element(sorted_phi.begin(),sorted_phi.begin()+sorted_phi.size()/2,sorted_phi.end());
+    double median = sorted_phi[sorted_phi.size()/2];
+    bodyA_idx_t.clear();
+    bodyB_idx_t.clear();
+    model->collisionDetect(phi_t,normal_t,xA_t,xB_t,bodyA_idx_t,bodyB_idx_t,bodies_idx_t,median);
+    if (!matchesAllPairs(k,median,phi,xA,xB,bodyA_idx,bodyB_idx,phi_t,xA_t,xB_t,bodyA_idx_t,bodyB_idx_t))
+      return 1;
+    num_median += phi_t.size();
+  }
+
+  printf("%d configurations of %s\n", N, urdf);
+  printf("all pairs:         %6.1f pairs, %8.3f ms per call\n", (double)num_all/N, 1e3*t_all/N);
+  printf("within %.2f m:     %6.1f pairs, %8.3f ms per call\n", threshold, (double)num_threshold/N, 1e3*t_threshold/N);
+  printf("within the median: %6.1f pairs\n", (double)num_median/N);
+
+  VectorXd q0 = 0.3*VectorXd::Random(model->num_dof);
+  const char* scenes[] = {"every joint moves", "one joint moves"};
+  for (int scene=0; scene<2; scene++) {
+    long updated0, skipped0, updated1, skipped1;
+    int num_collisions = 0;
+    model->getCollisionElementUpdateCounts(updated0,skipped0);
+    auto start = chrono::high_resolution_clock::now();
+    for (int k=0; k<N; k++) {
+      VectorXd q = q0;
+      if (scene==0)
+        q += 0.01*k*VectorXd::Ones(model->num_dof);
+      else
+        q(model->num_dof-1) += 0.01*k;
+      model->doKinematics(q.data(),false);
+
+      vector<int> bodyA_idx, bodyB_idx;
+      MatrixXd ptsA, ptsB;
+      model->allCollisions(bodyA_idx,bodyB_idx,ptsA,ptsB);
+      num_collisions += bodyA_idx.size();
+    }
+    double t = seconds(start);
+    model->getCollisionElementUpdateCounts(updated1,skipped1);
+    printf("%-18s %6.1f elements refreshed, %6.1f skipped, %6.1f contacts, %8.3f ms per call\n", scenes[scene],
+           (double)(updated1-updated0)/N, (double)(skipped1-skipped0)/N, (double)num_collisions/N, 1e3*t/N);
+  }
+
+  delete model;
+  return 0;
+}
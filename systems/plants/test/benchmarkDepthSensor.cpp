@@ -0,0 +1,172 @@
+/*
+ * Checks RigidBodyDepthSensor against the analytic depth image of a box seen
+ * from above and the analytic ranges of a laser fan, checks that the tiled
+ * depth image matches casting the same rays in raster order, and reports the
+ * throughput in rays per second for a VGA depth camera looking at Atlas.
+ */
+#include <iostream>
+#include <cstdio>
+#include <cmath>
+#include <chrono>
+#include "URDFRigidBodyManipulator.h"
+#include "RigidBodyDepthSensor.h"
+
+using namespace std;
+
+double seconds(chrono::high_resolution_clock::time_point start)
+{
+  return chrono::duration_cast<chrono::nanoseconds>(chrono::high_resolution_clock::now()-start).count()/1e9;
+}
+
+// the unit direction of pixel (v,u) in the sensor frame
+Vector3d pixelDirection(const PinholeIntrinsics& K, int v, int u)
+{
+  Vector3d direction(1.0, -(u-K.cx)/K.fx, -(v-K.cy)/K.fy);
+  return direction.normalized();
+}
+
+int main(int argc, char* argv[])
+{
+  const double tol = 1e-6;
+  const double range = 10.0;
+
+  // the 2 x .5 x 1 brick, centered at the origin, with its top at z = .5
+  URDFRigidBodyManipulator* brick = loadURDFfromFile("systems/plants/test/FallingBrick.urdf");
+  if (!brick) {
+    cerr << "ERROR: Failed to load systems/plants/test/FallingBrick.urdf" << endl;
+    return -1;
+  }
+  VectorXd q = VectorXd::Zero(brick->num_dof);
+  brick->doKinematics(q.data());
+
+  // a camera in the world frame, 3 m above the brick and looking down (sensor
+  // x along world -z, sensor z along world x)
+  PinholeIntrinsics K = {64, 48, 40.0, 40.0, 31.5, 23.5};
+  Matrix4d T_camera = Matrix4d::Identity();
+  T_camera.topLeftCorner<3,3>() << 0, 0, 1,
+                                   0, 1, 0,
+                                  -1, 0, 0;
+  T_camera(2,3) = 3.0;
+  RigidBodyDepthSensor camera(brick,0,K,range,T_camera);
+  if (!camera.update()) {
+    cerr << "the depth camera raycast failed" << endl;
+    return 1;
+  }
+  MatrixXd depth;
+  camera.getDepthImage(depth);
+  int num_hits = 0;
+  for (int v=0; v<K.height; v++) {
+    for (int u=0; u<K.width; u++) {
+      // where the pixel's ray crosses the plane of the top of the brick
+      Vector3d direction = pixelDirection(K,v,u);
+      double x = 2.5*direction(2)/direction(0), y = 2.5*direction(1)/direction(0);
+      if (fabs(fabs(x)-1.0) < 1e-3 || fabs(fabs(y)-0.25) < 1e-3) continue;  // too close to an edge to call
+      bool hit = (fabs(x) < 1.0 && fabs(y) < 0.25);
+      num_hits += hit;
+      if (fabs(depth(v,u) - (hit ? 2.5 : range)) > tol) {
+        cerr << "depth camera pixel (" << v << "," << u << ") reads " << depth(v,u) << " instead of " << (hit ? 2.5 : range) << endl;
+        return 1;
+      }
+    }
+  }
+  Matrix3Xd points;
+  camera.getPointCloud(points);
+  if (num_hits == 0 || points.cols() < num_hits || (points.row(2).array() - 0.5).abs().maxCoeff() > tol) {
+    cerr << "the depth camera point cloud is not on the top of the brick" << endl;
+    return 1;
+  }
+
+  // a level laser fan 3 m out along x, looking back at the x = 1 face of the brick
+  DrakeCollision::RayFan fan(Vector3d(3,0,0), -0.5, 0.5, 101, range);
+  fan.orientation << -1, 0, 0,
+                      0,-1, 0,
+                      0, 0, 1;
+  RigidBodyDepthSensor lidar(brick,0,fan);
+  if (!lidar.update()) {
+    cerr << "the lidar raycast failed" << endl;
+    return 1;
+  }
+  MatrixXd scan;
+  lidar.getDepthImage(scan);
+  for (int j=0; j<fan.num_azimuth; j++) {
+    double azimuth = fan.min_azimuth + (fan.max_azimuth-fan.min_azimuth)*j/(fan.num_azimuth-1);
+    double y = 2.0*tan(azimuth);
+    if (fabs(fabs(y)-0.25) < 1e-3) continue;
+    double expected = (fabs(y) < 0.25) ? 2.0/cos(azimuth) : range;
+    if (fabs(scan(0,j) - expected) > tol) {
+      cerr << "lidar ray " << j << " reads " << scan(0,j) << " instead of " << expected << endl;
+      return 1;
+    }
+  }
+  delete brick;
+
+  const char* urdf = (argc>1) ? argv[1] : "examples/Atlas/urdf/atlas_convex_hull.urdf";
+  URDFRigidBodyManipulator* model = loadURDFfromFile(urdf);
+  if (!model) {
+    cerr << "ERROR: Failed to load model from " << urdf << endl;
+    return -1;
+  }
+  q = VectorXd::Zero(model->num_dof);
+  model->doKinematics(q.data());
+
+  // a VGA camera 3 m out along x, looking back at the robot
+  PinholeIntrinsics vga = {640, 480, 500.0, 500.0, 319.5, 239.5};
+  Matrix4d T_vga = Matrix4d::Identity();
+  T_vga.topLeftCorner<3,3>() << -1, 0, 0,
+                                 0,-1, 0,
+                                 0, 0, 1;
+  T_vga(0,3) = 3.0;
+  RigidBodyDepthSensor vga_camera(model,0,vga,range,T_vga);
+
+  // the same rays, cast in raster order
+  int N = vga.width*vga.height;
+  Matrix3Xd origins = T_vga.topRightCorner<3,1>().replicate(1,N), ray_endpoints(3,N);
+  for (int u=0; u<vga.width; u++)
+    for (int v=0; v<vga.height; v++)
+      ray_endpoints.col(v+u*vga.height) = T_vga.topRightCorner<3,1>() + range*T_vga.topLeftCorner<3,3>()*pixelDirection(vga,v,u);
+  VectorXd distances;
+
+  int num_threads[] = {1, 0};
+  const int num_frames = 5;
+  for (int t=0; t<2; t++) {
+    model->setNumThreads(num_threads[t]);
+
+    bool ok = true;
+    auto start = chrono::high_resolution_clock::now();
+    for (int k=0; k<num_frames; k++)
+      ok = vga_camera.update() && ok;
+    double t_tiled = seconds(start);
+    vga_camera.getDepthImage(depth);
+
+    start = chrono::high_resolution_clock::now();
+    for (int k=0; k<num_frames; k++)
+      ok = model->collisionRaycast(origins,ray_endpoints,distances,NULL,NULL) && ok;
+    double t_raster = seconds(start);
+    if (!ok) {
+      cerr << "the VGA raycast failed" << endl;
+      return 1;
+    }
+
+    // rays that miss everything would make the comparison and the timing meaningless
+    int num_vga_hits = (distances.array() >= 0.0).count();
+    if (num_vga_hits == 0) {
+      cerr << "none of the VGA rays hit " << urdf << endl;
+      return 1;
+    }
+
+    for (int i=0; i<N; i++) {
+      double raster_depth = (distances(i) < 0.0) ? range : distances(i)*pixelDirection(vga,i%vga.height,i/vga.height)(0);
+      if (fabs(depth(i) - raster_depth) > tol) {
+        cerr << "the tiled depth image differs from the raster order raycast at pixel " << i << endl;
+        return 1;
+      }
+    }
+
+    printf("%s threads: %dx%d depth image in %7.2f ms, %.2f million rays/s (raster order: %.2f million rays/s), %d rays hit\n",
+           num_threads[t] ? "one" : "all", vga.width, vga.height, t_tiled/num_frames*1e3,
+           num_frames*N/t_tiled/1e6, num_frames*N/t_raster/1e6, num_vga_hits);
+  }
+
+  delete model;
+  return 0;
+}
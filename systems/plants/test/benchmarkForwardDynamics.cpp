@@ -0,0 +1,104 @@
+/*
+ * Compares the articulated-body forwardDynamics against solving H*qdd = tau - C
+ * with HandC and an LDLT factorization, checking that both agree and timing
+ * each as the number of links grows.  Also checks the forwardDynamics
+ * gradients against finite differences on a short chain, and that a chain
+ * ending in massless links is reported instead of giving NaN.
+ */
+#include <iostream>
+#include <cstdio>
+#include <chrono>
+#include "chainModel.h"
+
+using namespace std;
+using namespace Eigen;
+
+int main()
+{
+  const int num_calls = 200;
+  const int num_links[] = {6, 12, 24, 48, 96};
+  const double tol = 1e-8;
+
+  for (int k=0; k<5; k++) {
+    RigidBodyManipulator* model = createRevoluteChain(num_links[k]);
+    int n = model->num_dof;
+    VectorXd q = VectorXd::Random(n), qd = VectorXd::Random(n), tau = VectorXd::Random(n);
+    MatrixXd H(n,n);
+    VectorXd C(n), qdd_aba(n), qdd_ldlt(n);
+    LDLT<MatrixXd> ldlt(n);
+
+    if (!model->forwardDynamics(q.data(),qd.data(),tau,(MatrixXd*)NULL,qdd_aba,(MatrixXd*)NULL,(MatrixXd*)NULL)) {
+      cerr << "forwardDynamics reported a singular mass matrix for " << n << " links" << endl;
+      return 1;
+    }
+    model->HandC(q.data(),qd.data(),(MatrixXd*)NULL,H,C,(MatrixXd*)NULL,(MatrixXd*)NULL,(MatrixXd*)NULL);
+    qdd_ldlt = ldlt.compute(H).solve(tau-C);
+    double err = (qdd_aba-qdd_ldlt).lpNorm<Infinity>()/(1.0+qdd_ldlt.lpNorm<Infinity>());
+    if (err > tol) {
+      cerr << "forwardDynamics and HandC+LDLT disagree for " << n << " links (relative error " << err << ")" << endl;
+      return 1;
+    }
+
+#ifdef EIGEN_RUNTIME_NO_MALLOC
+    internal::set_is_malloc_allowed(false);
+#endif
+    auto start = chrono::high_resolution_clock::now();
+    for (int i=0; i<num_calls; i++)
+      model->forwardDynamics(q.data(),qd.data(),tau,(MatrixXd*)NULL,qdd_aba,(MatrixXd*)NULL,(MatrixXd*)NULL);
+    auto stop = chrono::high_resolution_clock::now();
+#ifdef EIGEN_RUNTIME_NO_MALLOC
+    internal::set_is_malloc_allowed(true);
+#endif
+    double us_aba = chrono::duration_cast<chrono::nanoseconds>(stop-start).count()/1e3/num_calls;
+
+    start = chrono::high_resolution_clock::now();
+    for (int i=0; i<num_calls; i++) {
+      model->HandC(q.data(),qd.data(),(MatrixXd*)NULL,H,C,(MatrixXd*)NULL,(MatrixXd*)NULL,(MatrixXd*)NULL);
+      qdd_ldlt = ldlt.compute(H).solve(tau-C);
+    }
+    stop = chrono::high_resolution_clock::now();
+    double us_ldlt = chrono::duration_cast<chrono::nanoseconds>(stop-start).count()/1e3/num_calls;
+
+    printf("%2d links: forwardDynamics %8.2f us/call, HandC+LDLT %8.2f us/call\n", n, us_aba, us_ldlt);
+    delete model;
+  }
+
+  // gradients
+  RigidBodyManipulator* model = createRevoluteChain(5);
+  int n = model->num_dof;
+  model->damping.setConstant(0.1);
+  VectorXd x = VectorXd::Random(3*n), qdd(n), qdd_p(n), qdd_m(n);
+  MatrixXd dqdd(n,3*n), dqdd_numerical(n,3*n);
+  const double h = 1e-6;
+  for (int j=0; j<3*n; j++) {
+    VectorXd xp = x, xm = x;
+    xp(j) += h;  xm(j) -= h;
+    VectorXd taup = xp.tail(n), taum = xm.tail(n);
+    model->forwardDynamics(xp.data(),xp.data()+n,taup,(MatrixXd*)NULL,qdd_p,(MatrixXd*)NULL,(MatrixXd*)NULL);
+    model->forwardDynamics(xm.data(),xm.data()+n,taum,(MatrixXd*)NULL,qdd_m,(MatrixXd*)NULL,(MatrixXd*)NULL);
+    dqdd_numerical.col(j) = (qdd_p-qdd_m)/(2*h);
+  }
+  VectorXd tau = x.tail(n);
+  model->forwardDynamics(x.data(),x.data()+n,tau,(MatrixXd*)NULL,qdd,&dqdd,(MatrixXd*)NULL);
+  double err = (dqdd-dqdd_numerical).lpNorm<Infinity>()/(1.0+dqdd_numerical.lpNorm<Infinity>());
+  delete model;
+  if (err > 1e-6) {
+    cerr << "forwardDynamics gradients do not match finite differences (relative error " << err << ")" << endl;
+    return 1;
+  }
+
+  // the last two links are massless, so nothing resists the last joint
+  model = createRevoluteChain(5);
+  n = model->num_dof;
+  model->I[n-1].setZero();
+  model->I[n-2].setZero();
+  VectorXd q = VectorXd::Random(n), qd = VectorXd::Random(n);
+  tau = VectorXd::Random(n);
+  bool ok = model->forwardDynamics(q.data(),qd.data(),tau,(MatrixXd*)NULL,qdd,(MatrixXd*)NULL,(MatrixXd*)NULL);
+  delete model;
+  if (ok) {
+    cerr << "forwardDynamics did not report the singular mass matrix of a massless chain" << endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,51 @@
+/*
+ * Times HandC on serial chains of increasing length and checks that the call
+ * performs no heap allocations.  Build with -DEIGEN_RUNTIME_NO_MALLOC (and
+ * without NDEBUG) so that Eigen aborts on any malloc inside the timed loop.
+ */
+#include <iostream>
+#include <cstdio>
+#include <chrono>
+#include "chainModel.h"
+
+using namespace std;
+using namespace Eigen;
+
+int main()
+{
+  const int num_calls = 1000;
+  const int num_links[] = {6, 12, 24, 36};
+
+  for (int k=0; k<4; k++) {
+    RigidBodyManipulator* model = createRevoluteChain(num_links[k]);
+    int n = model->num_dof;
+    VectorXd q = VectorXd::Random(n), qd = VectorXd::Random(n);
+    MatrixXd H(n,n);
+    VectorXd C(n);
+
+    model->HandC(q.data(),qd.data(),(MatrixXd*)NULL,H,C,(MatrixXd*)NULL,(MatrixXd*)NULL,(MatrixXd*)NULL);
+
+#ifdef EIGEN_RUNTIME_NO_MALLOC
+    internal::set_is_malloc_allowed(false);
+#endif
+    auto start = chrono::high_resolution_clock::now();
+    for (int i=0; i<num_calls; i++) {
+      q(i%n) += 1e-3;
+      model->HandC(q.data(),qd.data(),(MatrixXd*)NULL,H,C,(MatrixXd*)NULL,(MatrixXd*)NULL,(MatrixXd*)NULL);
+    }
+    auto stop = chrono::high_resolution_clock::now();
+#ifdef EIGEN_RUNTIME_NO_MALLOC
+    internal::set_is_malloc_allowed(true);
+#endif
+
+    double us = chrono::duration_cast<chrono::nanoseconds>(stop-start).count()/1e3/num_calls;
+    printf("HandC, %2d links: %8.2f us/call", n, us);
+#ifdef EIGEN_RUNTIME_NO_MALLOC
+    printf(", no heap allocations");
+#endif
+    printf("\n");
+
+    delete model;
+  }
+  return 0;
+}
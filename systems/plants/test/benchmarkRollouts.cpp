@@ -0,0 +1,111 @@
+/*
+ * Runs a batch of noisy closed-loop rollouts of a chain with RolloutEngine,
+ * checks that the trajectories do not depend on the number of threads and
+ * that a noise-free rollout matches integrating the same dynamics one step at
+ * a time, and times the batch with one thread and with one thread per core.
+ */
+#include <iostream>
+#include <cstdio>
+#include <chrono>
+#include "chainModel.h"
+#include "RolloutEngine.h"
+
+using namespace std;
+using namespace Eigen;
+
+double seconds(chrono::high_resolution_clock::time_point start)
+{
+  return chrono::duration_cast<chrono::nanoseconds>(chrono::high_resolution_clock::now()-start).count()/1e9;
+}
+
+int main()
+{
+  const int num_rollouts = 64;
+  const double tol = 1e-10;
+
+  RigidBodyManipulator* model = createRevoluteChain(8);
+  int n = model->num_dof;
+
+  // PD control to the origin
+  RolloutEngine::Controller pd = [n](int rollout, double t, const VectorXd& x, VectorXd& u) {
+    u = -100.0*x.head(n) - 20.0*x.tail(n);
+  };
+
+  MatrixXd x0 = MatrixXd::Zero(2*n,num_rollouts);
+  x0.topRows(n) = 0.3*MatrixXd::Random(n,num_rollouts);
+  vector<unsigned int> seeds(num_rollouts);
+  for (int k=0; k<num_rollouts; k++) seeds[k] = k+1;
+
+  RolloutTrajectories traj, traj1;
+  RolloutEngine engine(*model,4);  // exercise the thread pool even on a single-core machine
+  engine.timestep = 1e-3;
+  engine.duration = 1.0;
+  engine.record_every = 10;
+  engine.input_noise_std = VectorXd::Constant(n,5.0);
+  engine.run(pd,x0,seeds,traj);
+
+  RolloutEngine engine1(*model,1);
+  engine1.timestep = engine.timestep;
+  engine1.duration = engine.duration;
+  engine1.record_every = engine.record_every;
+  engine1.input_noise_std = engine.input_noise_std;
+  engine1.run(pd,x0,seeds,traj1);
+
+  for (int k=0; k<num_rollouts; k++) {
+    if (traj.num_valid[k] != traj.num_samples) {
+      cerr << "rollout " << k << " diverged" << endl;
+      return 1;
+    }
+  }
+  if (traj.x != traj1.x || traj.u != traj1.u) {
+    cerr << "the rollouts depend on the number of threads" << endl;
+    return 1;
+  }
+
+  // one noise-free rollout against stepping the dynamics by hand
+  engine.input_noise_std.resize(0);
+  engine.run(pd,x0.leftCols(1),vector<unsigned int>(1,0),traj);
+  double h = engine.timestep;
+  VectorXd x = x0.col(0), u(n), k1, k2, k3, k4;
+  auto xdot = [&](const VectorXd& xk) {
+    VectorXd q = xk.head(n), qd = xk.tail(n), qdd(n), dx(2*n);
+    model->forwardDynamics(q.data(),qd.data(),u,(MatrixXd*)NULL,qdd,(MatrixXd*)NULL,(MatrixXd*)NULL);
+    dx << qd, qdd;
+    return dx;
+  };
+  double err = 0.0;
+  for (int s=0; s<traj.num_samples*engine.record_every; s++) {
+    if (s % engine.record_every == 0)
+      err = max(err,(traj.x.row(traj.row(0,s/engine.record_every)).transpose() - x).lpNorm<Infinity>());
+    pd(0,s*h,x,u);
+    k1 = xdot(x);
+    k2 = xdot(x + 0.5*h*k1);
+    k3 = xdot(x + 0.5*h*k2);
+    k4 = xdot(x + h*k3);
+    x += (h/6.0)*(k1 + 2.0*k2 + 2.0*k3 + k4);
+  }
+  if (err > tol) {
+    cerr << "the rollout does not match stepping the dynamics by hand (error " << err << ")" << endl;
+    return 1;
+  }
+
+  int num_threads[] = {1, 0};
+  engine.input_noise_std = VectorXd::Constant(n,5.0);
+  for (int t=0; t<2; t++) {
+    RolloutEngine timed(*model,num_threads[t]);
+    timed.timestep = engine.timestep;
+    timed.duration = engine.duration;
+    timed.record_every = engine.record_every;
+    timed.input_noise_std = engine.input_noise_std;
+
+    auto start = chrono::high_resolution_clock::now();
+    timed.run(pd,x0,seeds,traj);
+    double t_run = seconds(start);
+
+    printf("%2d threads: %d rollouts of %g s in %7.2f ms, %.1f simulated seconds per second\n",
+           timed.numThreads(), num_rollouts, timed.duration, t_run*1e3, num_rollouts*timed.duration/t_run);
+  }
+
+  delete model;
+  return 0;
+}
@@ -0,0 +1,66 @@
+#ifndef _CHAINMODEL_H_
+#define _CHAINMODEL_H_
+
+#include "RigidBodyManipulator.h"
+
+/*
+ * Builds an N-link serial chain of revolute joints (in the spirit of
+ * examples/PlanarNLink, but with the joint axes alternating by 90 degrees so
+ * that the chain is fully three-dimensional).  Both the kinematic tree and the
+ * featherstone structures are populated by hand, so that the tests do not
+ * depend on a URDF file or the floating base the parser adds.  The caller owns
+ * the returned model.
+ */
+inline RigidBodyManipulator* createRevoluteChain(int num_links, double link_length=1.0, double link_mass=1.0)
+{
+  RigidBodyManipulator* model = new RigidBodyManipulator(num_links,num_links,num_links+1);
+
+  model->bodies[0].linkname = "world";
+  model->bodies[0].parent = -1;
+  model->bodies[0].robotnum = 0;
+
+  Matrix3d Rx90;
+  Rx90 << 1,0,0, 0,0,-1, 0,1,0;
+
+  for (int i=0; i<num_links; i++) {
+    RigidBody& body = model->bodies[i+1];
+    body.linkname = "link" + std::to_string(i+1);
+    body.jointname = "joint" + std::to_string(i+1);
+    body.robotnum = 0;
+    body.parent = i;
+    body.dofnum = i;
+    body.floating = 0;
+    body.pitch = 0;
+    body.mass = link_mass;
+    body.com << link_length/2,0,0,1;
+
+    // joint frame relative to the parent link
+    Matrix3d R = (i%2) ? Rx90 : Matrix3d::Identity();
+    Vector3d p = (i>0) ? Vector3d(link_length,0,0) : Vector3d::Zero();
+    body.Ttree = Matrix4d::Identity();
+    body.Ttree.topLeftCorner<3,3>() = R;
+    body.Ttree.topRightCorner<3,1>() = p;
+
+    model->parent[i] = i-1;
+    model->dofnum[i] = i;
+    model->pitch[i] = 0;
+    model->damping[i] = 0.0;
+    model->coulomb_friction[i] = 0.0;
+    model->static_friction[i] = 0.0;
+    model->coulomb_window[i] = 1.0;
+    model->Xtree[i] = PluckerTransform(R.transpose(),p).toMatrix();
+
+    // slender rod about its center of mass, then shifted to the joint (mcI)
+    Vector3d c(link_length/2,0,0);
+    Matrix3d Ic = Vector3d(1e-3, link_mass*link_length*link_length/12, link_mass*link_length*link_length/12).asDiagonal();
+    Matrix3d cx = skew(c);
+    model->I[i] << Ic + link_mass*cx*cx.transpose(), link_mass*cx,
+                   link_mass*cx.transpose(), link_mass*Matrix3d::Identity();
+  }
+  model->a_grav << 0,0,0,0,0,-9.81;
+  model->compile();
+
+  return model;
+}
+
+#endif // _CHAINMODEL_H_
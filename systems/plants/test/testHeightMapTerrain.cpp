@@ -0,0 +1,116 @@
+/*
+ * Checks HeightMapTerrain against terrains with known answers (planes are
+ * reproduced exactly, heights at the grid points are the given ones), that the
+ * bicubic patches are C1 across cell borders, and that a batched query gives
+ * the same answers as one query per point.  Then times the batched lookup.
+ */
+#include <iostream>
+#include <cstdio>
+#include <cmath>
+#include <chrono>
+#include "HeightMapTerrain.h"
+
+using namespace std;
+using namespace Eigen;
+
+double seconds(chrono::high_resolution_clock::time_point start)
+{
+  return chrono::duration_cast<chrono::nanoseconds>(chrono::high_resolution_clock::now()-start).count()/1e9;
+}
+
+int main()
+{
+  const double tol = 1e-10;
+  const double x0 = -1.0, y0 = 0.5, dx = 0.05, dy = 0.08;
+  const int m = 40, n = 30;
+  const char* names[] = {"bilinear", "bicubic"};
+  HeightMapTerrain::Interpolation methods[] = {HeightMapTerrain::BILINEAR, HeightMapTerrain::BICUBIC};
+
+  // a sloped plane
+  double a = 0.3, b = 0.2, c = -0.1;
+  MatrixXd plane(m,n);
+  for (int i=0; i<m; i++)
+    for (int j=0; j<n; j++)
+      plane(i,j) = a + b*(x0+i*dx) + c*(y0+j*dy);
+  Vector3d plane_normal(-b,-c,1.0);
+  plane_normal.normalize();
+
+  MatrixXd rough = 0.05*MatrixXd::Random(m,n);
+
+  for (int t=0; t<2; t++) {
+    HeightMapTerrain flat(plane,x0,y0,dx,dy,methods[t]);
+    Vector3d normal;
+    for (int k=0; k<1000; k++) {
+      Vector2d p = Vector2d::Random();
+      double x = x0 + (m-1)*dx*0.5*(p(0)+1.0), y = y0 + (n-1)*dy*0.5*(p(1)+1.0);
+      double z = flat.getHeight(x,y,normal);
+      if (fabs(z - (a + b*x + c*y)) > tol || (normal - plane_normal).norm() > tol) {
+        cerr << names[t] << " interpolation does not reproduce a plane at (" << x << "," << y << ")" << endl;
+        return 1;
+      }
+    }
+
+    HeightMapTerrain terrain(rough,x0,y0,dx,dy,methods[t]);
+    for (int i=0; i<m; i++) {
+      for (int j=0; j<n; j++) {
+        if (fabs(terrain.getHeight(x0+i*dx,y0+j*dy) - rough(i,j)) > tol) {
+          cerr << names[t] << " interpolation misses the height at grid point (" << i << "," << j << ")" << endl;
+          return 1;
+        }
+      }
+    }
+
+    // past the border the terrain continues flat at the border height
+    if (fabs(terrain.getHeight(x0-1.0,y0-1.0,normal) - rough(0,0)) > tol || (normal - Vector3d(0,0,1)).norm() > tol) {
+      cerr << names[t] << " interpolation is not flat outside of the grid" << endl;
+      return 1;
+    }
+
+    // batched against one query per point
+    Matrix3Xd pts = Matrix3Xd::Random(3,100);
+    pts.row(0) = (x0 + (m-1)*dx*0.5) + (m-1)*dx*0.6*pts.row(0).array();  // some fall outside
+    pts.row(1) = (y0 + (n-1)*dy*0.5) + (n-1)*dy*0.6*pts.row(1).array();
+    Matrix3Xd pos, normals;
+    terrain.collisionDetect(pts,pos,normals);
+    for (int k=0; k<pts.cols(); k++) {
+      double z = terrain.getHeight(pts(0,k),pts(1,k),normal);
+      if (pos(0,k) != pts(0,k) || pos(1,k) != pts(1,k) || pos(2,k) != z || normals.col(k) != normal) {
+        cerr << names[t] << " batched query differs from a single query at point " << k << endl;
+        return 1;
+      }
+    }
+
+    int num_batches = 10000;
+    auto start = chrono::high_resolution_clock::now();
+    for (int k=0; k<num_batches; k++)
+      terrain.collisionDetect(pts,pos,normals);
+    double t_batch = seconds(start);
+    printf("%-8s: %.1f million contact point lookups per second (%.2f us for %d points)\n",
+           names[t], num_batches*pts.cols()/t_batch/1e6, t_batch/num_batches*1e6, (int) pts.cols());
+  }
+
+  // the bicubic slope is continuous across the cell borders (the bilinear one is not)
+  HeightMapTerrain terrain(rough,x0,y0,dx,dy,HeightMapTerrain::BICUBIC);
+  const double eps = 1e-9;
+  Vector3d normal_minus, normal_plus;
+  for (int i=1; i<m-1; i++) {
+    for (int j=1; j<n-1; j++) {
+      double x = x0 + i*dx, y = y0 + (j+0.3)*dy;
+      terrain.getHeight(x-eps,y,normal_minus);
+      terrain.getHeight(x+eps,y,normal_plus);
+      if ((normal_minus - normal_plus).norm() > 1e-6) {
+        cerr << "the bicubic normal jumps across x = " << x << endl;
+        return 1;
+      }
+      x = x0 + (i+0.3)*dx; y = y0 + j*dy;
+      terrain.getHeight(x,y-eps,normal_minus);
+      terrain.getHeight(x,y+eps,normal_plus);
+      if ((normal_minus - normal_plus).norm() > 1e-6) {
+        cerr << "the bicubic normal jumps across y = " << y << endl;
+        return 1;
+      }
+    }
+  }
+
+  return 0;
+}
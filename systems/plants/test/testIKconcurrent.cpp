@@ -0,0 +1,87 @@
+/*
+ * Solves the same inverseKin problem for several CoM heights, first one after
+ * the other and then all at once on separate threads (each with its own model),
+ * and checks that the concurrent solves give the same answers.  Unless drake
+ * is built with SNOPT_REENTRANT, each solve holds the SNOPT lock for its whole
+ * SNOPT call, kinematics included, so this checks that concurrent calls are
+ * safe, not that they overlap.
+ */
+#include "RigidBodyIK.h"
+#include "RigidBodyManipulator.h"
+#include "../constraint/RigidBodyConstraint.h"
+#include "URDFRigidBodyManipulator.h"
+#include "../IKoptions.h"
+#include <iostream>
+#include <cstdlib>
+#include <thread>
+#include <Eigen/Dense>
+
+using namespace std;
+using namespace Eigen;
+
+static void solveCoMHeight(URDFRigidBodyManipulator* model, double com_height, VectorXd &q_sol, int &info)
+{
+  Vector2d tspan;
+  tspan<<0,1;
+  VectorXd q0 = VectorXd::Zero(model->num_dof);
+  q0(3) = 0.8;
+  Vector3d com_lb = Vector3d::Zero();
+  Vector3d com_ub = Vector3d::Zero();
+  com_lb(2) = com_height;
+  com_ub(2) = com_height+0.05;
+  WorldCoMConstraint* com_kc = new WorldCoMConstraint(model,com_lb,com_ub,tspan);
+  RigidBodyConstraint* constraint_array[1] = {com_kc};
+  IKoptions ikoptions(model);
+  vector<string> infeasible_constraint;
+  q_sol.resize(model->num_dof);
+  inverseKin(model,q0,q0,1,constraint_array,q_sol,info,infeasible_constraint,ikoptions);
+  delete com_kc;
+}
+
+int main()
+{
+  const int num_problems = 4;
+  vector<URDFRigidBodyManipulator*> models(num_problems);
+  for(int i = 0;i<num_problems;i++)
+  {
+    models[i] = loadURDFfromFile("./examples/Atlas/urdf/atlas_minimal_contact.urdf");
+    if(!models[i])
+    {
+      cerr<<"ERROR: Failed to load model"<<endl;
+      return 1;
+    }
+  }
+
+  vector<VectorXd> q_seq(num_problems), q_par(num_problems);
+  vector<int> info_seq(num_problems), info_par(num_problems);
+  for(int i = 0;i<num_problems;i++)
+  {
+    solveCoMHeight(models[0],0.85+0.05*i,q_seq[i],info_seq[i]);
+  }
+
+  vector<thread> threads;
+  for(int i = 0;i<num_problems;i++)
+  {
+    threads.push_back(thread([&,i]() { solveCoMHeight(models[i],0.85+0.05*i,q_par[i],info_par[i]); }));
+  }
+  for(int i = 0;i<num_problems;i++)
+  {
+    threads[i].join();
+  }
+
+  int ret = 0;
+  for(int i = 0;i<num_problems;i++)
+  {
+    printf("problem %d: INFO = %d (sequential), %d (concurrent)\n",i,info_seq[i],info_par[i]);
+    if(info_seq[i] != 1 || info_par[i] != info_seq[i] || (q_par[i]-q_seq[i]).lpNorm<Infinity>() > 1e-8)
+    {
+      cerr<<"problem "<<i<<" does not match the sequential solve"<<endl;
+      ret = 1;
+    }
+  }
+  for(int i = 0;i<num_problems;i++)
+  {
+    delete models[i];
+  }
+  return ret;
+}
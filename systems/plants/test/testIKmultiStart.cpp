@@ -0,0 +1,147 @@
+/*
+ * Solves a CoM height problem with inverseKinMultiStart and checks the
+ * per-seed statistics and that the returned posture satisfies the constraint,
+ * then checks which seed is returned when the CoM height is out of reach.
+ * The seeds run on two threads only in a SNOPT_REENTRANT build; otherwise
+ * they run in order and nothing after the first success is solved.
+ */
+#include "RigidBodyIK.h"
+#include "RigidBodyManipulator.h"
+#include "../constraint/RigidBodyConstraint.h"
+#include "URDFRigidBodyManipulator.h"
+#include "../IKoptions.h"
+#include <iostream>
+#include <cstdlib>
+#include <Eigen/Dense>
+
+using namespace std;
+using namespace Eigen;
+
+int main()
+{
+  const int num_threads = 2;
+  const int num_random_seeds = 6;
+  vector<RigidBodyManipulator*> models(num_threads);
+  vector<WorldCoMConstraint*> com_kc(num_threads);
+  vector<RigidBodyConstraint**> constraint_arrays(num_threads);
+  Vector2d tspan;
+  tspan<<0,1;
+  Vector3d com_lb = Vector3d::Zero();
+  Vector3d com_ub = Vector3d::Zero();
+  com_lb(2) = 0.9;
+  com_ub(2) = 0.95;
+  for(int i = 0;i<num_threads;i++)
+  {
+    models[i] = loadURDFfromFile("./examples/Atlas/urdf/atlas_minimal_contact.urdf");
+    if(!models[i])
+    {
+      cerr<<"ERROR: Failed to load model"<<endl;
+      return 1;
+    }
+    com_kc[i] = new WorldCoMConstraint(models[i],com_lb,com_ub,tspan);
+    constraint_arrays[i] = new RigidBodyConstraint*[1];
+    constraint_arrays[i][0] = com_kc[i];
+  }
+  int nq = models[0]->num_dof;
+  MatrixXd q_seed = MatrixXd::Zero(nq,1);
+  q_seed(3) = 0.8;
+  VectorXd q_nom = q_seed.col(0);
+  IKoptions ikoptions(models[0]);
+
+  VectorXd q_sol(nq);
+  int info;
+  vector<string> infeasible_constraint;
+  vector<IKSeedStatistics> seed_statistics;
+  inverseKinMultiStart(models,constraint_arrays,1,q_seed,q_nom,num_random_seeds,q_sol,info,infeasible_constraint,seed_statistics,ikoptions);
+
+  int ret = 0;
+  printf("INFO = %d\n",info);
+  if(info >= 10)
+  {
+    cerr<<"no seed succeeded"<<endl;
+    ret = 1;
+  }
+  if(seed_statistics.size() != 1+num_random_seeds)
+  {
+    cerr<<"expected one statistics entry per seed"<<endl;
+    ret = 1;
+  }
+  for(int i = 0;i<seed_statistics.size();i++)
+  {
+    printf("seed %d: INFO = %d, cancelled = %d, %f s\n",i,seed_statistics[i].INFO,seed_statistics[i].cancelled,seed_statistics[i].solve_time);
+  }
+  if((seed_statistics[0].q_seed-q_seed.col(0)).lpNorm<Infinity>() != 0.0)
+  {
+    cerr<<"the user seed should be tried first"<<endl;
+    ret = 1;
+  }
+#ifndef SNOPT_REENTRANT
+  bool succeeded = false;
+  for(int i = 0;i<seed_statistics.size();i++)
+  {
+    if(succeeded && (seed_statistics[i].INFO != -1 || !seed_statistics[i].cancelled))
+    {
+      cerr<<"seed "<<i<<" was solved after an earlier seed had already succeeded"<<endl;
+      ret = 1;
+    }
+    succeeded = succeeded || (seed_statistics[i].INFO>=0 && seed_statistics[i].INFO<10);
+  }
+#endif
+  models[0]->doKinematics(q_sol.data());
+  Vector3d com;
+  models[0]->getCOM(com);
+  if(com(2) < com_lb(2)-1e-4 || com(2) > com_ub(2)+1e-4)
+  {
+    cerr<<"the CoM height of q_sol is "<<com(2)<<endl;
+    ret = 1;
+  }
+
+  // with the pelvis held at 0.8 m, a CoM 5 m up fails from every seed, and the
+  // result should come from one of the seeds rather than being seed 0 by default
+  vector<WorldCoMConstraint*> far_com_kc(num_threads);
+  vector<PostureConstraint*> pelvis_kc(num_threads);
+  vector<RigidBodyConstraint**> far_constraint_arrays(num_threads);
+  int pelvis_z_idx = 2;
+  VectorXd pelvis_z = 0.8*VectorXd::Ones(1);
+  for(int i = 0;i<num_threads;i++)
+  {
+    far_com_kc[i] = new WorldCoMConstraint(models[i],Vector3d(0,0,5.0),Vector3d(0,0,5.05),tspan);
+    pelvis_kc[i] = new PostureConstraint(models[i],tspan);
+    pelvis_kc[i]->setJointLimits(1,&pelvis_z_idx,pelvis_z,pelvis_z);
+    far_constraint_arrays[i] = new RigidBodyConstraint*[2];
+    far_constraint_arrays[i][0] = far_com_kc[i];
+    far_constraint_arrays[i][1] = pelvis_kc[i];
+  }
+  inverseKinMultiStart(models,far_constraint_arrays,2,q_seed,q_nom,num_random_seeds,q_sol,info,infeasible_constraint,seed_statistics,ikoptions);
+  int min_info = 100;
+  bool from_a_seed = false;
+  for(int i = 0;i<seed_statistics.size();i++)
+  {
+    min_info = min(min_info,seed_statistics[i].INFO);
+    from_a_seed = from_a_seed || (seed_statistics[i].INFO == info && seed_statistics[i].q_sol == q_sol);
+  }
+  if(info < 10 || min_info < 10 || !from_a_seed)
+  {
+    cerr<<"an unreachable CoM height should fail from every seed and return the result of one of them, INFO = "<<info<<endl;
+    ret = 1;
+  }
+
+  // without any seed there is nothing to solve
+  inverseKinMultiStart(models,constraint_arrays,1,MatrixXd(nq,0),q_nom,0,q_sol,info,infeasible_constraint,seed_statistics,ikoptions);
+  if(info != 91 || !seed_statistics.empty() || q_sol != q_nom)
+  {
+    cerr<<"a call without seeds should return INFO = 91 and q_nom, not INFO = "<<info<<endl;
+    ret = 1;
+  }
+
+  for(int i = 0;i<num_threads;i++)
+  {
+    delete com_kc[i];
+    delete[] constraint_arrays[i];
+    delete far_com_kc[i];
+    delete pelvis_kc[i];
+    delete[] far_constraint_arrays[i];
+    delete models[i];
+  }
+  return ret;
+}
@@ -0,0 +1,87 @@
+/*
+ * Tracks a sequence of CoM heights with an InverseKinPointwiseSession, seeding
+ * each solve with the previous solution, and checks the answers against
+ * separate inverseKinPointwise solves, and that every solve after the first
+ * warm starts.
+ */
+#include "RigidBodyIK.h"
+#include "RigidBodyManipulator.h"
+#include "../constraint/RigidBodyConstraint.h"
+#include "URDFRigidBodyManipulator.h"
+#include "../IKoptions.h"
+#include <iostream>
+#include <cstdlib>
+#include <Eigen/Dense>
+
+using namespace std;
+using namespace Eigen;
+
+int main()
+{
+  URDFRigidBodyManipulator* model = loadURDFfromFile("./examples/Atlas/urdf/atlas_minimal_contact.urdf");
+  if(!model)
+  {
+    cerr<<"ERROR: Failed to load model"<<endl;
+    return 1;
+  }
+  const int num_ticks = 10;
+  VectorXd q0 = VectorXd::Zero(model->num_dof);
+  q0(3) = 0.8;
+  // the CoM height rises by 1 cm per tick, with one constraint active at each tick
+  vector<WorldCoMConstraint*> com_kc(num_ticks);
+  vector<RigidBodyConstraint*> constraint_array(num_ticks);
+  for(int i = 0;i<num_ticks;i++)
+  {
+    Vector3d com_lb = Vector3d::Zero();
+    Vector3d com_ub = Vector3d::Zero();
+    com_lb(2) = 0.85+0.01*i;
+    com_ub(2) = com_lb(2)+0.005;
+    Vector2d tspan(i,i);
+    com_kc[i] = new WorldCoMConstraint(model,com_lb,com_ub,tspan);
+    constraint_array[i] = com_kc[i];
+  }
+  IKoptions ikoptions(model);
+
+  InverseKinPointwiseSession session(model,num_ticks,constraint_array.data(),ikoptions);
+  int ret = 0;
+  VectorXd q_seed = q0;
+  for(int i = 0;i<num_ticks;i++)
+  {
+    double t = i;
+    VectorXd q_session(model->num_dof);
+    int info_session;
+    vector<string> infeasible_constraint;
+    session.solve(t,q_seed,q0,q_session,info_session,infeasible_constraint);
+
+    MatrixXd q_seed_ik = q_seed, q_nom_ik = q0, q_ik(model->num_dof,1);
+    int info_ik;
+    inverseKinPointwise(model,1,&t,q_seed_ik,q_nom_ik,num_ticks,constraint_array.data(),q_ik,&info_ik,infeasible_constraint,ikoptions);
+
+    printf("tick %d: INFO = %d (session), %d (inverseKinPointwise), %d warm starts\n",i,info_session,info_ik,session.numWarmStarts());
+    if(info_session != 1 || info_ik != 1 || (q_session-q_ik.col(0)).lpNorm<Infinity>() > 1e-4)
+    {
+      cerr<<"tick "<<i<<" does not match inverseKinPointwise"<<endl;
+      ret = 1;
+    }
+    model->doKinematics(q_session.data());
+    Vector3d com;
+    model->getCOM(com);
+    if(com(2) < 0.85+0.01*i-1e-4 || com(2) > 0.855+0.01*i+1e-4)
+    {
+      cerr<<"tick "<<i<<": the CoM height is "<<com(2)<<endl;
+      ret = 1;
+    }
+    if(session.numWarmStarts() != i)
+    {
+      cerr<<"tick "<<i<<": expected every solve after the first to warm start"<<endl;
+      ret = 1;
+    }
+    q_seed = q_session;
+  }
+  for(WorldCoMConstraint* kc : com_kc)
+  {
+    delete kc;
+  }
+  delete model;
+  return ret;
+}
@@ -0,0 +1,75 @@
+/*
+ * Checks inverseDynamics against H*qdd + C from HandC (with external forces,
+ * damping and coulomb friction), checks its gradients against finite
+ * differences, and checks that the call without gradients does not allocate.
+ */
+#include <iostream>
+#include <cstdio>
+#include <chrono>
+#include "chainModel.h"
+
+using namespace std;
+using namespace Eigen;
+
+int main()
+{
+  RigidBodyManipulator* model = createRevoluteChain(8);
+  int n = model->num_dof;
+  model->damping.setConstant(0.1);
+  model->coulomb_friction.setConstant(0.2);
+  model->coulomb_window.setConstant(10.0);  // stay inside the (smooth) coulomb window for the finite differences
+
+  VectorXd x = VectorXd::Random(3*n), qdd = x.tail(n), tau(n), C(n);
+  MatrixXd f_ext = MatrixXd::Random(6,model->NB), H(n,n);
+
+  model->inverseDynamics(x.data(),x.data()+n,qdd,&f_ext,tau,(MatrixXd*)NULL,(MatrixXd*)NULL);
+  model->HandC(x.data(),x.data()+n,&f_ext,H,C,(MatrixXd*)NULL,(MatrixXd*)NULL,(MatrixXd*)NULL);
+  double err = (tau - H*qdd - C).lpNorm<Infinity>();
+  if (err > 1e-10) {
+    cerr << "inverseDynamics does not match H*qdd+C (error " << err << ")" << endl;
+    return 1;
+  }
+
+  MatrixXd dtau(n,2*n), dtau_numerical(n,2*n);
+  VectorXd tau_p(n), tau_m(n);
+  const double h = 1e-6;
+  for (int j=0; j<2*n; j++) {
+    VectorXd xp = x, xm = x;
+    xp(j) += h;  xm(j) -= h;
+    model->inverseDynamics(xp.data(),xp.data()+n,qdd,&f_ext,tau_p,(MatrixXd*)NULL,(MatrixXd*)NULL);
+    model->inverseDynamics(xm.data(),xm.data()+n,qdd,&f_ext,tau_m,(MatrixXd*)NULL,(MatrixXd*)NULL);
+    dtau_numerical.col(j) = (tau_p-tau_m)/(2*h);
+  }
+  model->inverseDynamics(x.data(),x.data()+n,qdd,&f_ext,tau,&dtau,(MatrixXd*)NULL);
+  err = (dtau-dtau_numerical).lpNorm<Infinity>()/(1.0+dtau_numerical.lpNorm<Infinity>());
+  if (err > 1e-6) {
+    cerr << "inverseDynamics gradients do not match finite differences (relative error " << err << ")" << endl;
+    return 1;
+  }
+
+  const int num_calls = 1000;
+#ifdef EIGEN_RUNTIME_NO_MALLOC
+  internal::set_is_malloc_allowed(false);
+#endif
+  auto start = chrono::high_resolution_clock::now();
+  for (int i=0; i<num_calls; i++)
+    model->inverseDynamics(x.data(),x.data()+n,qdd,&f_ext,tau,(MatrixXd*)NULL,(MatrixXd*)NULL);
+  auto stop = chrono::high_resolution_clock::now();
+#ifdef EIGEN_RUNTIME_NO_MALLOC
+  internal::set_is_malloc_allowed(true);
+#endif
+  double us_rnea = chrono::duration_cast<chrono::nanoseconds>(stop-start).count()/1e3/num_calls;
+
+  start = chrono::high_resolution_clock::now();
+  for (int i=0; i<num_calls; i++) {
+    model->HandC(x.data(),x.data()+n,&f_ext,H,C,(MatrixXd*)NULL,(MatrixXd*)NULL,(MatrixXd*)NULL);
+    tau = H*qdd + C;
+  }
+  stop = chrono::high_resolution_clock::now();
+  double us_handc = chrono::duration_cast<chrono::nanoseconds>(stop-start).count()/1e3/num_calls;
+
+  printf("%d links: inverseDynamics %6.2f us/call, HandC %6.2f us/call\n", n, us_rnea, us_handc);
+
+  delete model;
+  return 0;
+}
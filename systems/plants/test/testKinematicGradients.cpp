@@ -0,0 +1,159 @@
+/*
+ * Checks the kinematic gradients against central differences: forwardJac (for
+ * all three rotation types) and getCOMJac against forwardKin and getCOM,
+ * forwarddJac and getCOMdJac against forwardJac and getCOMJac, and
+ * forwardJacDot against forwardJac along qd.  Runs on a revolute chain and on
+ * the floating-base Atlas model, whose bodies each depend on a different
+ * subset of the dofs.
+ */
+#include <iostream>
+#include <cmath>
+#include "URDFRigidBodyManipulator.h"
+#include "chainModel.h"
+
+using namespace std;
+using namespace Eigen;
+
+static const double eps = 1e-6;
+static const double tol = 1e-5;
+
+static MatrixXd points()
+{
+  MatrixXd pts(4,2);
+  pts << 0.1,-0.2, 0.3,0.0, -0.1,0.2, 1,1;
+  return pts;
+}
+
+// forwardKin stacked into one column per point, as forwardJac orders its rows
+static VectorXd kin(RigidBodyManipulator* model, int body, int rotation_type, const VectorXd& q)
+{
+  VectorXd qk = q;
+  model->doKinematics(qk.data());
+  MatrixXd x;
+  model->forwardKin(body,points(),rotation_type,x);
+  return Map<VectorXd>(x.data(),x.size());
+}
+
+static MatrixXd jac(RigidBodyManipulator* model, int body, int rotation_type, const VectorXd& q)
+{
+  VectorXd qk = q;
+  model->doKinematics(qk.data());
+  MatrixXd J(3*points().cols(),model->num_dof);
+  model->forwardJac(body,points(),rotation_type,J);
+  return J;
+}
+
+static Vector3d com(RigidBodyManipulator* model, const VectorXd& q)
+{
+  VectorXd qk = q;
+  model->doKinematics(qk.data());
+  Vector3d c;
+  model->getCOM(c);
+  return c;
+}
+
+static MatrixXd comJac(RigidBodyManipulator* model, const VectorXd& q)
+{
+  VectorXd qk = q;
+  model->doKinematics(qk.data());
+  MatrixXd J(3,model->num_dof);
+  model->getCOMJac(J);
+  return J;
+}
+
+static bool compare(const char* name, const char* what, int body, const MatrixXd& A, const MatrixXd& B)
+{
+  if (A.rows() != B.rows() || A.cols() != B.cols()) {
+    cerr << name << ": " << what << " of body " << body << " is " << A.rows() << "x" << A.cols()
+         << " instead of " << B.rows() << "x" << B.cols() << endl;
+    return false;
+  }
+  double err = (A-B).lpNorm<Infinity>();
+  if (err > tol) {
+    cerr << name << ": " << what << " of body " << body << " differs from finite differences by " << err << endl;
+    return false;
+  }
+  return true;
+}
+
+static bool check(const char* name, RigidBodyManipulator* model)
+{
+  int n = model->num_dof;
+  MatrixXd pts = points();
+  int n_pts = pts.cols();
+  VectorXd q = 0.5*VectorXd::Random(n), qd = VectorXd::Random(n);
+
+  for (int body=1; body<model->num_bodies; body++) {
+    for (int rotation_type=0; rotation_type<3; rotation_type++) {
+      MatrixXd J = jac(model,body,rotation_type,q), J_fd(J.rows(),n);
+      for (int k=0; k<n; k++) {
+        VectorXd dq = VectorXd::Zero(n);
+        dq(k) = eps;
+        J_fd.col(k) = (kin(model,body,rotation_type,q+dq) - kin(model,body,rotation_type,q-dq))/(2*eps);
+      }
+      const char* what[] = {"forwardJac", "forwardJac (rpy)", "forwardJac (quaternion)"};
+      if (!compare(name,what[rotation_type],body,J,J_fd)) return false;
+    }
+
+    // dJ(:,i*n+j) is the derivative of J(:,i) with respect to q(j)
+    VectorXd qk = q;
+    model->doKinematics(qk.data(),true);
+    MatrixXd dJ(3*n_pts,n*n), dJ_fd(3*n_pts,n*n);
+    model->forwarddJac(body,pts,dJ);
+    for (int j=0; j<n; j++) {
+      VectorXd dq = VectorXd::Zero(n);
+      dq(j) = eps;
+      MatrixXd dJdqj = (jac(model,body,0,q+dq) - jac(model,body,0,q-dq))/(2*eps);
+      for (int i=0; i<n; i++)
+        dJ_fd.col(i*n+j) = dJdqj.col(i);
+    }
+    if (!compare(name,"forwarddJac",body,dJ,dJ_fd)) return false;
+
+    qk = q;
+    VectorXd qdk = qd;
+    model->doKinematics(qk.data(),false,qdk.data());
+    MatrixXd Jdot;
+    model->forwardJacDot(body,pts,0,Jdot);
+    MatrixXd Jdot_fd = (jac(model,body,0,q+eps*qd) - jac(model,body,0,q-eps*qd))/(2*eps);
+    if (!compare(name,"forwardJacDot",body,Jdot,Jdot_fd)) return false;
+  }
+
+  MatrixXd Jcom = comJac(model,q), Jcom_fd(3,n);
+  MatrixXd dJcom_fd(3,n*n);
+  for (int k=0; k<n; k++) {
+    VectorXd dq = VectorXd::Zero(n);
+    dq(k) = eps;
+    Jcom_fd.col(k) = (com(model,q+dq) - com(model,q-dq))/(2*eps);
+    MatrixXd dJdqk = (comJac(model,q+dq) - comJac(model,q-dq))/(2*eps);
+    for (int i=0; i<n; i++)
+      dJcom_fd.col(i*n+k) = dJdqk.col(i);
+  }
+  if (!compare(name,"getCOMJac",-1,Jcom,Jcom_fd)) return false;
+
+  VectorXd qk = q;
+  model->doKinematics(qk.data(),true);
+  MatrixXd dJcom(3,n*n);
+  model->getCOMdJac(dJcom);
+  if (!compare(name,"getCOMdJac",-1,dJcom,dJcom_fd)) return false;
+
+  cout << name << ": " << model->num_bodies-1 << " bodies, " << n << " dofs match finite differences" << endl;
+  return true;
+}
+
+int main()
+{
+  RigidBodyManipulator* chain = createRevoluteChain(8);
+  bool ok = check("revolute chain",chain);
+  delete chain;
+
+  const char* urdf = "examples/Atlas/urdf/atlas_minimal_contact.urdf";
+  URDFRigidBodyManipulator* atlas = loadURDFfromFile(urdf);
+  if (!atlas) {
+    cerr << "ERROR: Failed to load model from " << urdf << endl;
+    return 1;
+  }
+  ok = check("floating-base Atlas",atlas) && ok;
+  delete atlas;
+
+  return ok ? 0 : 1;
+}
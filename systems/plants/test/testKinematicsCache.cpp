@@ -0,0 +1,109 @@
+/*
+ * Evaluates one manipulator from several threads at once, each with its own
+ * KinematicsCache, and checks the results against evaluating the same
+ * configurations one at a time through the default cache.
+ */
+#include <iostream>
+#include <thread>
+#include "chainModel.h"
+
+using namespace std;
+using namespace Eigen;
+
+int main()
+{
+  const int N = 100;
+  const int num_threads = 4;
+  const double tol = 1e-12;
+
+  RigidBodyManipulator* model = createRevoluteChain(12);
+  int n = model->num_dof;
+  int body = model->num_bodies-1;
+  MatrixXd q = MatrixXd::Random(n,N), qd = MatrixXd::Random(n,N);
+  MatrixXd pts(4,2);
+  pts << 1,0, 0,1, 0,0, 1,1;
+
+  vector<MatrixXd> x(N), J(N), Jdot(N), H(N);
+  MatrixXd com(3,N), C(n,N);
+  for (int k=0; k<N; k++) {
+    VectorXd qk = q.col(k), qdk = qd.col(k), Ck(n);
+    MatrixXd comk;
+    J[k].resize(6*pts.cols(),n);
+    H[k].resize(n,n);
+    model->doKinematics(qk.data(),false,qdk.data());
+    model->forwardKin(body,pts,1,x[k]);
+    model->forwardJac(body,pts,1,J[k]);
+    model->forwardJacDot(body,pts,0,Jdot[k]);
+    model->getCOM(comk);
+    com.col(k) = comk;
+    model->HandC(qk.data(),qdk.data(),(MatrixXd*)NULL,H[k],Ck,(MatrixXd*)NULL,(MatrixXd*)NULL,(MatrixXd*)NULL);
+    C.col(k) = Ck;
+  }
+  VectorXd q_default = model->default_cache.q;
+
+  // every thread sweeps all of the configurations, so that the threads really do overlap
+  vector<double> err(num_threads,0.0);
+  vector<thread> threads;
+  for (int t=0; t<num_threads; t++) {
+    threads.push_back(thread([&,t]() {
+      KinematicsCache cache(*model);
+      MatrixXd xk, Jk(6*pts.cols(),n), Jdotk, comk, Hk(n,n);
+      VectorXd Ck(n);
+      for (int i=0; i<N; i++) {
+        int k = (i + t*N/num_threads) % N;
+        VectorXd qk = q.col(k), qdk = qd.col(k);
+        model->doKinematics(cache,qk.data(),false,qdk.data());
+        model->forwardKin(cache,body,pts,1,xk);
+        model->forwardJac(cache,body,pts,1,Jk);
+        model->forwardJacDot(cache,body,pts,0,Jdotk);
+        model->getCOM(cache,comk);
+        model->HandC(cache,qk.data(),qdk.data(),(MatrixXd*)NULL,Hk,Ck,(MatrixXd*)NULL,(MatrixXd*)NULL,(MatrixXd*)NULL);
+        err[t] = max(err[t],(xk-x[k]).lpNorm<Infinity>());
+        err[t] = max(err[t],(Jk-J[k]).lpNorm<Infinity>());
+        err[t] = max(err[t],(Jdotk-Jdot[k]).lpNorm<Infinity>());
+        err[t] = max(err[t],(comk-com.col(k)).lpNorm<Infinity>());
+        err[t] = max(err[t],(Hk-H[k]).lpNorm<Infinity>());
+        err[t] = max(err[t],(Ck-C.col(k)).lpNorm<Infinity>());
+      }
+    }));
+  }
+  for (int t=0; t<num_threads; t++)
+    threads[t].join();
+
+  for (int t=0; t<num_threads; t++) {
+    if (err[t] > tol) {
+      cerr << "thread " << t << " does not match the sequential results (error " << err[t] << ")" << endl;
+      return 1;
+    }
+  }
+  if (model->default_cache.q != q_default) {
+    cerr << "evaluating with a separate cache modified the default cache" << endl;
+    return 1;
+  }
+
+  // repeated queries at one state are served from the cache, and a new state empties it
+  {
+    KinematicsCache cache(*model);
+    VectorXd q0 = q.col(0), q1 = q.col(1);
+    MatrixXd J0(6*pts.cols(),n), J1(6*pts.cols(),n), Jcom0, Jcom1;
+    model->doKinematics(cache,q0.data());
+    model->forwardJacCached(cache,body,pts,1,J0);
+    model->forwardJacCached(cache,body,pts,1,J1);
+    model->getCOMJacCached(cache,Jcom0);
+    model->getCOMJacCached(cache,Jcom1);
+    if (cache.num_query_hits != 2 || cache.num_query_misses != 2 || (J0-J[0]).lpNorm<Infinity>() > tol || J1 != J0 || Jcom1 != Jcom0) {
+      cerr << "repeated queries at one state were not served from the cache" << endl;
+      return 1;
+    }
+    model->doKinematics(cache,q1.data());
+    model->forwardJacCached(cache,body,pts,1,J1);
+    if (cache.num_query_misses != 3 || (J1-J[1]).lpNorm<Infinity>() > tol) {
+      cerr << "a new state did not invalidate the cached queries" << endl;
+      return 1;
+    }
+  }
+
+  cout << num_threads << " threads x " << N << " configurations match the sequential results" << endl;
+  delete model;
+  return 0;
+}
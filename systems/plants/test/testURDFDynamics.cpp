@@ -0,0 +1,151 @@
+/*
+ * Checks the featherstone structure that the URDF parser sets up: the HandC
+ * mass matrix against one assembled link by link from the URDF inertias and
+ * the kinematic jacobians, the gravity terms against the COM jacobian, and the
+ * velocity terms against finite differences of the mass matrix.
+ */
+#include <iostream>
+#include <cmath>
+#include "URDFRigidBodyManipulator.h"
+#include "urdf_interface/model.h"
+
+using namespace std;
+
+// world frame angular velocity jacobian of a body, by central differences of its rotation
+static MatrixXd angularJacobian(RigidBodyManipulator* model, int body, VectorXd q)
+{
+  const double eps = 1e-6;
+  int n = model->num_dof;
+  MatrixXd pts(4,4);
+  pts << 0,1,0,0, 0,0,1,0, 0,0,0,1, 1,1,1,1;
+  MatrixXd x(3,4);
+  Matrix3d R, Rp, Rm;
+
+  model->doKinematics(q.data());
+  model->forwardKin(body,pts,0,x);
+  R = x.rightCols(3).colwise() - x.col(0);
+
+  MatrixXd Jw(3,n);
+  for (int k=0; k<n; k++) {
+    q(k) += eps;
+    model->doKinematics(q.data());
+    model->forwardKin(body,pts,0,x);
+    Rp = x.rightCols(3).colwise() - x.col(0);
+    q(k) -= 2*eps;
+    model->doKinematics(q.data());
+    model->forwardKin(body,pts,0,x);
+    Rm = x.rightCols(3).colwise() - x.col(0);
+    q(k) += eps;
+    Matrix3d wx = (Rp-Rm)/(2*eps)*R.transpose();
+    Jw.col(k) << wx(2,1), wx(0,2), wx(1,0);
+  }
+  return Jw;
+}
+
+static void massMatrix(RigidBodyManipulator* model, double* q, MatrixXd& H)
+{
+  int n = model->num_dof;
+  VectorXd qd = VectorXd::Zero(n), C(n);
+  model->HandC(q,qd.data(),(MatrixXd*)NULL,H,C,(MatrixXd*)NULL,(MatrixXd*)NULL,(MatrixXd*)NULL);
+}
+
+static bool check(const char* urdf)
+{
+  const double tol = 1e-5;
+
+  URDFRigidBodyManipulator* model = loadURDFfromFile(urdf);
+  if (!model) {
+    cerr << "ERROR: Failed to load model from " << urdf << endl;
+    return false;
+  }
+  int n = model->num_dof;
+  bool success = true;
+
+  for (int trial=0; trial<5; trial++) {
+    VectorXd q = VectorXd::Random(n), qd = VectorXd::Random(n), C(n), C0(n);
+    MatrixXd H(n,n);
+    model->HandC(q.data(),qd.data(),(MatrixXd*)NULL,H,C,(MatrixXd*)NULL,(MatrixXd*)NULL,(MatrixXd*)NULL);
+
+    // H = sum_i m_i*Jv_i'*Jv_i + Jw_i'*R_i*Ic_i*R_i'*Jw_i
+    MatrixXd H_links = MatrixXd::Zero(n,n), Jv(3,n), x(3,4);
+    double mass = 0.0;
+    for (int i=1; i<model->num_bodies; i++) {
+      RigidBody& b = model->bodies[i];
+      boost::shared_ptr<urdf::Link> link = model->urdf_model[b.robotnum]->links_.at(b.linkname);
+      if (!link->inertial) continue;
+      const urdf::Inertial& inertial = *link->inertial;
+      Matrix3d Ic, Rc;
+      Ic << inertial.ixx, inertial.ixy, inertial.ixz,
+            inertial.ixy, inertial.iyy, inertial.iyz,
+            inertial.ixz, inertial.iyz, inertial.izz;
+      double qx,qy,qz,qw;
+      inertial.origin.rotation.getQuaternion(qx,qy,qz,qw);
+      Rc = Quaterniond(qw,qx,qy,qz).toRotationMatrix();
+
+      MatrixXd Jw = angularJacobian(model,i,q);
+      model->doKinematics(q.data());
+      model->forwardJac(i,b.com,0,Jv);
+      MatrixXd pts(4,4);
+      pts << 0,1,0,0, 0,0,1,0, 0,0,0,1, 1,1,1,1;
+      model->forwardKin(i,pts,0,x);
+      Matrix3d R = x.rightCols(3).colwise() - x.col(0);
+      Matrix3d Iw = R*Rc*Ic*Rc.transpose()*R.transpose();
+
+      H_links += b.mass*Jv.transpose()*Jv + Jw.transpose()*Iw*Jw;
+      mass += b.mass;
+    }
+    double err = (H-H_links).lpNorm<Infinity>();
+    if (err > tol*(1+H.lpNorm<Infinity>())) {
+      cerr << urdf << ": HandC mass matrix is off by " << err << endl;
+      success = false;
+    }
+
+    // the gravity terms are m*g*Jcom_z'
+    VectorXd zero = VectorXd::Zero(n);
+    MatrixXd H0(n,n), Jcom(3,n);
+    model->HandC(q.data(),zero.data(),(MatrixXd*)NULL,H0,C0,(MatrixXd*)NULL,(MatrixXd*)NULL,(MatrixXd*)NULL);
+    model->doKinematics(q.data());
+    model->getCOMJac(Jcom);
+    err = (C0 - 9.81*mass*Jcom.row(2).transpose()).lpNorm<Infinity>();
+    if (err > tol*(1+C0.lpNorm<Infinity>())) {
+      cerr << urdf << ": HandC gravity terms are off by " << err << endl;
+      success = false;
+    }
+
+    // (without joint damping or friction) the velocity terms are Hdot*qd - d/dq(qd'*H*qd/2)
+    const double eps = 1e-6;
+    MatrixXd Hp(n,n), Hm(n,n);
+    VectorXd qp = q + eps*qd, qm = q - eps*qd, dT(n);
+    massMatrix(model,qp.data(),Hp);
+    massMatrix(model,qm.data(),Hm);
+    VectorXd Hdot_qd = (Hp-Hm)/(2*eps)*qd;
+    for (int k=0; k<n; k++) {
+      qp = q; qp(k) += eps;
+      qm = q; qm(k) -= eps;
+      massMatrix(model,qp.data(),Hp);
+      massMatrix(model,qm.data(),Hm);
+      dT(k) = qd.dot((Hp-Hm)*qd)/(4*eps);
+    }
+    VectorXd friction = VectorXd::Zero(n);
+    for (int i=0; i<model->NB; i++)
+      friction(model->dofnum[i]) = model->damping[i]*qd(model->dofnum[i]) + (qd(model->dofnum[i])>0 ? 1 : -1)*model->coulomb_friction[i];
+    err = (C - C0 - friction - (Hdot_qd - dT)).lpNorm<Infinity>();
+    if (err > 1e-4*(1+C.lpNorm<Infinity>())) {
+      cerr << urdf << ": HandC velocity terms are off by " << err << endl;
+      success = false;
+    }
+  }
+
+  delete model;
+  return success;
+}
+
+int main()
+{
+  bool success = check("examples/Atlas/urdf/atlas_minimal_contact.urdf");
+  success = check("systems/plants/test/FallingBrick.urdf") && success;
+  success = check("systems/plants/test/MassSpringDamper.urdf") && success;
+  success = check("systems/plants/test/SpringPendulum.urdf") && success;
+  if (success) cout << "HandC agrees with the URDF inertias" << endl;
+  return success ? 0 : 1;
+}